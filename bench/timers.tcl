@@ -0,0 +1,72 @@
+# timers.tcl --
+#
+# Micro-benchmark for timer handlers:  keeps a large number of "after"
+# timers pending while timers are created, cancelled and fired.  With
+# Tcl 7.4 this measures the timer heap of tkEvent.c, with later Tcl
+# versions the timer queue of Tcl itself.  Run it by "make bench" or
+#
+#	cwsh -headless 80x24 bench/timers.tcl ?count? ?rounds?
+#
+# where count is the number of pending timers (default 10000) and rounds
+# the number of timers cancelled and fired (default 1000).  The results
+# are printed as microseconds per operation.  Random delays are taken
+# from a fixed seed, so runs can be compared.
+#
+# See the file "license.terms" for information on usage and redistribution
+# of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+
+set count 10000
+set rounds 1000
+if {[llength $argv] > 0} {
+    set count [lindex $argv 0]
+}
+if {[llength $argv] > 1} {
+    set rounds [lindex $argv 1]
+}
+
+set seed 4711
+proc random n {
+    global seed
+    set seed [expr ($seed * 16807) % 2147483647]
+    return [expr $seed % $n]
+}
+
+proc report {what usecs} {
+    puts [format "%-32s %10.2f us" $what [lindex $usecs 0]]
+}
+
+# Timers far in the future, so that none fires while measuring.
+
+proc later {} {
+    return [after [expr 600000 + [random 600000]] {incr fired}]
+}
+
+set fired 0
+set i 0
+report "create $count timers" [time {
+    set ids($i) [later]
+    incr i
+} $count]
+
+report "cancel and create $rounds" [time {
+    set i [random $count]
+    after cancel $ids($i)
+    set ids($i) [later]
+} $rounds]
+
+report "fire $rounds" [time {
+    after 0 {incr fired}
+    update
+} $rounds]
+
+set i 0
+report "cancel $count timers" [time {
+    after cancel $ids($i)
+    incr i
+} $count]
+
+if {$fired != $rounds} {
+    puts "error: $fired of $rounds timers fired"
+    exit 1
+}
+exit
@@ -116,12 +116,21 @@ typedef struct {
     struct CkWindow *winPtr;    
 } CkWindowEvent;
 
+typedef struct {
+    long type;
+    struct CkWindow *winPtr;
+    char *data;			/* Pasted characters, NUL terminated.
+				 * Owned by whoever generated the event. */
+    int length;			/* Number of bytes in data. */
+} CkPasteEvent;
+
 typedef union {
     long type;
     CkAnyEvent any;
     CkKeyEvent key;
     CkMouseEvent mouse;
     CkWindowEvent win;
+    CkPasteEvent paste;
 } CkEvent;
 
 /*
@@ -137,6 +146,7 @@ typedef union {
 #define CK_EV_DESTROY    0x00000080
 #define CK_EV_FOCUSIN    0x00000100
 #define CK_EV_FOCUSOUT   0x00000200
+#define CK_EV_PASTE      0x00000400
 #define CK_EV_BARCODE    0x10000000
 #define CK_EV_ALL        0xffffffff
 
@@ -265,6 +275,66 @@ typedef struct CkEventHandler {
 					 * end of list). */
 } CkEventHandler;
  
+/*
+ * Counters kept for each main window and reported by the "curses
+ * stats" command and Ck_GetStats.  Events are counted by the number
+ * of the bit of their type (CK_EV_KEYPRESS is 0, etc.).  Times are
+ * in microseconds and only measured while timing is enabled by
+ * "curses stats timing".  The CK_STATS_TIMERS, CK_STATS_IDLE and
+ * CK_STATS_WAIT phases, as well as the queue lengths, are only known
+ * when ck runs its own event loop (Tcl 7.4);  they are process wide.
+ */
+
+#define CK_STATS_EVENT_TYPES	32
+
+#define CK_STATS_INPUT		0
+#define CK_STATS_EVENTS		1
+#define CK_STATS_BINDINGS	2
+#define CK_STATS_REFRESH	3
+#define CK_STATS_TIMERS		4
+#define CK_STATS_IDLE		5
+#define CK_STATS_WAIT		6
+#define CK_STATS_PHASES		7
+
+/*
+ * Kinds of calls measured by the profiler in ckProfile.c, see
+ * CkProfileRecord.
+ */
+
+#define CK_PROFILE_BIND		0
+#define CK_PROFILE_DISPLAY	1
+#define CK_PROFILE_GEOMETRY	2
+
+typedef struct Ck_Stats {
+    int refreshRequests;	/* Calls to Ck_EventuallyRefresh. */
+    int refreshes;		/* Screen updates actually done;  the
+				 * other requests were coalesced. */
+    int refreshFullCount;	/* Number of screen updates which had to
+				 * refresh all windows. */
+    int refreshWinsTouched;	/* Number of windows touched and refreshed
+				 * by incremental screen updates. */
+    int refreshWinsSkipped;	/* Number of windows skipped since they
+				 * neither were damaged nor overlapped a
+				 * damaged window. */
+    int refreshLinesScrolled;	/* Number of window lines moved by
+				 * Ck_ScrollWindow instead of being
+				 * redrawn. */
+    int refreshLines;		/* Screen lines handed to doupdate. */
+    int pairLookups;		/* Number of color pair lookups. */
+    int pairAllocs;		/* Number of color pairs initialized. */
+    int pairEvictions;		/* Number of color pairs recycled which
+				 * weren't in use by any window. */
+    int pairForced;		/* Number of color pairs recycled although
+				 * still in use, since all pairs were. */
+    int events[CK_STATS_EVENT_TYPES];
+				/* Events dispatched, by type. */
+    int bindScripts;		/* Binding scripts evaluated. */
+    int idleHandlers;		/* Idle handlers pending, or -1. */
+    int timerHandlers;		/* Timer handlers pending, or -1. */
+    double phaseTime[CK_STATS_PHASES];
+				/* Time spent in each phase. */
+} Ck_Stats;
+
 /*
  * Ck keeps the following data structure for the main
  * window (created by a call to Ck_CreateMainWindow). It stores
@@ -275,6 +345,12 @@ typedef struct CkEventHandler {
 typedef struct CkMainInfo {
     struct CkWindow *winPtr;	/* Pointer to main window. */
     Tcl_Interp *interp;		/* Interpreter associated with application. */
+    struct CkMainInfo *nextPtr;	/* Next in list of all main windows of
+				 * this process, one per terminal. */
+    SCREEN *screen;		/* Curses screen of the terminal. NULL
+				 * if not known (e.g. PDCurses). */
+    FILE *termIn, *termOut;	/* Input/output streams of the terminal. */
+    int termFd;			/* File descriptor for terminal input. */
     Tcl_HashTable nameTable;	/* Hash table mapping path names to CkWindow
 				 * structs for all windows related to this
 				 * main window.  Managed by ckWindow.c. */
@@ -297,8 +373,29 @@ typedef struct CkMainInfo {
 				 * see comment in ckWindow.c. */
     double lastRefresh;		/* Delay computation for updates. */
     Tk_TimerToken refreshTimer;	/* Timer for delayed updates. */
+    struct CkDamage *damagePtr;	/* Per screen line damaged column spans,
+				 * used by DoRefresh in ckWindow.c to
+				 * decide which windows must be touched. */
+    Ck_Stats stats;		/* Counters for "curses stats",
+				 * "curses refreshstats" and
+				 * "curses pairstats". */
     ClientData mouseData;       /* Value used by mouse handling code. */
     ClientData barcodeData;	/* Value used by bar code handling code. */
+    ClientData pasteData;	/* Value used by bracketed paste and
+				 * typeahead handling code. */
+    ClientData inputQueue;	/* Events read from the terminal but not
+				 * yet dispatched.  Managed by ckEvent.c. */
+    ClientData profileData;	/* Times of bindings and idle callbacks
+				 * for "curses profile".  Managed by
+				 * ckProfile.c. */
+    ClientData headlessData;	/* Input pipe and size of a headless
+				 * terminal, NULL for real terminals.
+				 * Managed by ckHeadless.c. */
+    ClientData pairData;	/* Value used by color pair allocation code. */
+    int inputErrors;		/* Number of consecutive failed reads
+				 * from the terminal. */
+    int buttonPressed;		/* Mouse button currently held down, for
+				 * xterm mouse reports. */
     int flags;			/* See definitions below. */
 #if CK_USE_UTF
     Tcl_Encoding isoEncoding;
@@ -312,6 +409,9 @@ typedef struct CkMainInfo {
 #define CK_REFRESH_TIMER   16
 #define CK_HAS_BARCODE     32
 #define CK_NOCLR_ON_EXIT   64
+#define CK_REFRESH_ALL    128
+#define CK_NEWTERM        256
+#define CK_HEADLESS       512
 
 /*
  * Ck keeps one of the following structures for each window.
@@ -408,6 +508,15 @@ typedef struct CkWindow {
     int attr;			/* Video attributes. */
     int flags;			/* Various flag values, see below. */
 
+    /*
+     * Information used by ckWindow.c for incremental screen updates.
+     */
+
+    int damageX1, damageY1;	/* Top-left corner of damaged region in
+				 * window coordinates; only valid if the
+				 * CK_DAMAGED flag is set. */
+    int damageX2, damageY2;	/* Bottom-right corner (exclusive) of
+				 * damaged region. */
 
 } CkWindow;
 
@@ -427,6 +536,9 @@ typedef struct CkWindow {
  *				can be omitted.
  * CK_ALREADY_DEAD:		1 means the window is in the process of
  *				being destroyed already.
+ * CK_DAMAGED:			1 means the window has been drawn into
+ *				since the last screen update; the damaged
+ *				region is recorded in damageX1 etc.
  */
 
 #define CK_MAPPED		1
@@ -436,6 +548,7 @@ typedef struct CkWindow {
 #define CK_RECURSIVE_DESTROY	16
 #define CK_ALREADY_DEAD		32
 #define CK_DONTRESTRICTSIZE     64
+#define CK_DAMAGED		128
 
 /*
  * Window stacking literals
@@ -612,6 +725,7 @@ typedef struct Ck_ConfigSpec {
 extern Ck_Uid ckNormalUid;
 extern Ck_Uid ckActiveUid;
 extern Ck_Uid ckDisabledUid;
+extern int ckStatsTiming;
 
 /*
  * Internal procedures.
@@ -630,6 +744,11 @@ EXTERN int	CkBarcodeCmd _ANSI_ARGS_((ClientData clientData,
 		    Tcl_Interp *interp, int argc, char **argv));
 EXTERN void	CkBindEventProc _ANSI_ARGS_((CkWindow *winPtr,
 		    CkEvent *eventPtr));
+EXTERN int	CkBindingExists _ANSI_ARGS_((Ck_BindingTable bindingTable,
+		    int eventType, int detail, int numObjects,
+		    ClientData *objectPtr));
+EXTERN void	CkDamageWindow _ANSI_ARGS_((CkWindow *winPtr, int x, int y,
+		    int width, int height));
 EXTERN int	CkCopyAndGlobalEval _ANSI_ARGS_((Tcl_Interp *interp,
 		    char *string));
 EXTERN void	CkDisplayChars _ANSI_ARGS_((CkMainInfo *mainPtr,
@@ -637,6 +756,12 @@ EXTERN void	CkDisplayChars _ANSI_ARGS_((CkMainInfo *mainPtr,
 		    int numChars, int x, int y, int tabOrigin, int flags));
 EXTERN void	CkEventDeadWindow _ANSI_ARGS_((CkWindow *winPtr));
 EXTERN void	CkFreeBindingTags _ANSI_ARGS_((CkWindow *winPtr));
+EXTERN void	CkFreeBarcode _ANSI_ARGS_((CkMainInfo *mainPtr));
+EXTERN void	CkFreeHeadless _ANSI_ARGS_((ClientData headlessData));
+EXTERN void	CkFreePairs _ANSI_ARGS_((CkMainInfo *mainPtr));
+EXTERN void	CkFreeInputQueue _ANSI_ARGS_((CkMainInfo *mainPtr));
+EXTERN void	CkFreePaste _ANSI_ARGS_((CkMainInfo *mainPtr));
+EXTERN void	CkFreeProfile _ANSI_ARGS_((CkMainInfo *mainPtr));
 EXTERN char *	CkGetBarcodeData _ANSI_ARGS_((CkMainInfo *mainPtr));
 
 #if (TCL_MAJOR_VERSION == 7) && (TCL_MINOR_VERSION <= 4)
@@ -646,15 +771,33 @@ EXTERN int	CkHandleInput _ANSI_ARGS_((ClientData clientData, int mask,
 EXTERN void	CkHandleInput _ANSI_ARGS_((ClientData clientData, int mask));
 #endif
 
+EXTERN int	CkHeadlessCmd _ANSI_ARGS_((ClientData clientData,
+		    Tcl_Interp *interp, int argc, char **argv));
+EXTERN ClientData CkHeadlessOpen _ANSI_ARGS_((Tcl_Interp *interp,
+		    char *size, FILE **inFilePtr, FILE **outFilePtr));
+EXTERN void	CkHeadlessSetup _ANSI_ARGS_((CkMainInfo *mainPtr));
 EXTERN int	CkInitFrame _ANSI_ARGS_((Tcl_Interp *interp, CkWindow *winPtr,
 		    int argc, char **argv));
 EXTERN char *	CkKeysymToString _ANSI_ARGS_((KeySym keySym, int printControl));
+EXTERN int	CkHasBinding _ANSI_ARGS_((CkWindow *winPtr, int eventType,
+		    int detail));
+EXTERN CkMainInfo *CkLookupMainInfo _ANSI_ARGS_((CkMainInfo *mainPtr));
 EXTERN int	CkMeasureChars _ANSI_ARGS_((CkMainInfo *mainPtr,
 		    char *source, int maxChars,
 		    int startX, int maxX, int tabOrigin, int flags,
 		    int *nextPtr, int *nextCPtr));
 EXTERN void     CkOptionClassChanged _ANSI_ARGS_((CkWindow *winPtr));
 EXTERN void     CkOptionDeadWindow _ANSI_ARGS_((CkWindow *winPtr));
+EXTERN int	CkPasteCmd _ANSI_ARGS_((ClientData clientData,
+		    Tcl_Interp *interp, int argc, char **argv));
+EXTERN int	CkProfileCmd _ANSI_ARGS_((ClientData clientData,
+		    Tcl_Interp *interp, int argc, char **argv));
+EXTERN void	CkProfileRecord _ANSI_ARGS_((CkMainInfo *mainPtr, int kind,
+		    char *name1, char *name2, double t0));
+EXTERN double	CkProfileStart _ANSI_ARGS_((CkMainInfo *mainPtr));
+EXTERN void	CkProfileWindow _ANSI_ARGS_((CkWindow *winPtr, double t0));
+EXTERN void	CkSetTerm _ANSI_ARGS_((CkMainInfo *mainPtr));
+EXTERN double	CkStatsClock _ANSI_ARGS_((void));
 EXTERN KeySym	CkStringToKeysym _ANSI_ARGS_((char *name));
 EXTERN int	CkTermHasKey _ANSI_ARGS_((Tcl_Interp *interp, char *name));
 EXTERN void	CkUnderlineChars _ANSI_ARGS_((CkMainInfo *mainPtr,
@@ -759,12 +902,16 @@ EXTERN void	Ck_GetRootGeometry _ANSI_ARGS_((CkWindow *winPtr, int *xPtr,
 		    int *yPtr, int *widthPtr, int *heightPtr));
 EXTERN int      Ck_GetScrollInfo _ANSI_ARGS_((Tcl_Interp *interp,
 		    int argc, char **argv, double *dblPtr, int *intPtr));
+EXTERN void	Ck_GetStats _ANSI_ARGS_((CkWindow *winPtr,
+		    Ck_Stats *statsPtr));
 EXTERN Ck_Uid	Ck_GetUid _ANSI_ARGS_((char *string));
 EXTERN CkWindow *Ck_GetWindowXY _ANSI_ARGS_((CkMainInfo *mainPtr, int *xPtr,
 		    int *yPtr, int mode));
 EXTERN void	Ck_HandleEvent _ANSI_ARGS_((CkMainInfo *mainPtr,
 		    CkEvent *eventPtr));
 EXTERN int	Ck_Init _ANSI_ARGS_((Tcl_Interp *interp));
+EXTERN int	Ck_InitTerminal _ANSI_ARGS_((Tcl_Interp *interp,
+		    char *device, char *termType));
 EXTERN void	Ck_Main _ANSI_ARGS_((int argc, char **argv,
 		    int (*appInitProc)()));
 EXTERN void	Ck_MainLoop _ANSI_ARGS_((void));
@@ -788,10 +935,13 @@ EXTERN CkWindow *Ck_NameToWindow _ANSI_ARGS_((Tcl_Interp *interp,
 EXTERN void	Ck_Preserve _ANSI_ARGS_((ClientData clientData));
 EXTERN void	Ck_Release _ANSI_ARGS_((ClientData clientData));
 #endif
+EXTERN void	Ck_ResetStats _ANSI_ARGS_((CkWindow *winPtr));
 EXTERN void	Ck_ResizeWindow _ANSI_ARGS_((CkWindow *winPtr, int width,
 		    int height));
 EXTERN int	Ck_RestackWindow _ANSI_ARGS_((CkWindow *winPtr, int aboveBelow,
 		    CkWindow *otherPtr));
+EXTERN int	Ck_ScrollWindow _ANSI_ARGS_((CkWindow *winPtr, int top,
+		    int bottom, int count));
 EXTERN void	Ck_SetClass _ANSI_ARGS_((CkWindow *winPtr, char *className));
 EXTERN int	Ck_SetEncoding _ANSI_ARGS_((Tcl_Interp *interp, char *name));
 EXTERN void	Ck_SetFocus _ANSI_ARGS_((CkWindow *winPtr));
@@ -828,6 +978,7 @@ EXTERN void	Tk_DoWhenIdle _ANSI_ARGS_((Tk_IdleProc *proc,
 EXTERN void	Tk_DoWhenIdle2 _ANSI_ARGS_((Tk_IdleProc *proc,
 		    ClientData clientData));
 EXTERN void	Tk_Sleep _ANSI_ARGS_((int ms));
+EXTERN void	TkEventStats _ANSI_ARGS_((Ck_Stats *statsPtr, int reset));
 
 #endif
 
@@ -40,6 +40,25 @@
  */
 
 #define EVENT_BUFFER_SIZE 30
+
+/*
+ * Space needed to format the value of a numeric %-sequence:
+ */
+
+#define NUM_SIZE 40
+
+/*
+ * With Tcl 8.1 and later, binding commands are run from Tcl objects
+ * kept with their pattern sequences, so that they are parsed and
+ * compiled once instead of for every event.
+ */
+
+#if (TCL_MAJOR_VERSION > 8) || \
+    ((TCL_MAJOR_VERSION == 8) && (TCL_MINOR_VERSION >= 1))
+#define CK_BIND_OBJS 1
+#else
+#define CK_BIND_OBJS 0
+#endif
 typedef struct BindingTable {
     CkEvent eventRing[EVENT_BUFFER_SIZE];/* Circular queue of recent events
 					 * (higher indices are for more recent
@@ -57,6 +76,11 @@ typedef struct BindingTable {
 					 * of patterns associated with that
 					 * object.  Keys are ClientData,
 					 * values are (PatSeq *). */
+    Tcl_HashTable cacheTable;		/* Bindings resolved by Ck_BindEvent
+					 * for a window's objects.  Keys are
+					 * CacheKey structs, values are
+					 * (BindCache *).  Flushed whenever
+					 * pattern sequences change. */
     Tcl_Interp *interp;			/* Interpreter in which commands are
 					 * executed. */
 } BindingTable;
@@ -78,6 +102,36 @@ typedef struct PatternTableKey {
 				 * additional.*/
 } PatternTableKey;
 
+/*
+ * Most events are bound by single-event pattern sequences, which match
+ * regardless of the events before.  Ck_BindEvent thus caches for a
+ * window, event type and detail the binding found for each object of
+ * the window.  Objects with multi-event sequences for the event must
+ * still be matched against the ring of recent events every time.
+ */
+
+typedef struct CacheKey {
+    CkWindow *winPtr;		/* Window where event occurred. */
+    int type;			/* Type of event. */
+    int detail;			/* Keycode or button, 0 if none. */
+} CacheKey;
+
+typedef struct CachedMatch {
+    ClientData object;		/* Object for which binding was looked
+				 * up, to detect changed binding tags. */
+    struct PatSeq *matchPtr;	/* Single-event sequence bound for the
+				 * event, NULL if none. */
+    int useRing;		/* Non-zero means a multi-event sequence
+				 * may match, so MatchPatterns must be
+				 * called for this object. */
+} CachedMatch;
+
+typedef struct BindCache {
+    int numObjects;		/* Number of entries in match. */
+    CachedMatch match[1];	/* One per object, in order.  Actually
+				 * numObjects entries are allocated. */
+} BindCache;
+
 /*
  * The following structure defines a pattern, which is matched
  * against events as part of the process of converting events
@@ -123,6 +177,20 @@ typedef struct PatSeq {
 				 * sequences for the same object
 				 * (NULL for end of list).  Needed to
 				 * implement Tk_DeleteAllBindings. */
+#if CK_BIND_OBJS
+    int objc;			/* If command is a single command made of
+				 * plain words, the number of words;  0
+				 * if not, -1 if not yet examined. */
+    Tcl_Obj **objv;		/* The objc words of command.  A NULL entry
+				 * stands for a word consisting of a
+				 * single %-sequence. */
+    char *percents;		/* For each word, the character following
+				 * "%" if objv has NULL for it. */
+    Tcl_Obj *scriptObj;		/* If objc is 0, the most recent expansion
+				 * of command; reused (with its bytecode)
+				 * as long as the expansion doesn't change.
+				 * NULL if none. */
+#endif
     Pattern pats[1];		/* Array of "numPats" patterns.  Only
 				 * one element is declared here but
 				 * in actuality enough space will be
@@ -174,10 +242,18 @@ static EventInfo eventArray[] = {
     {"ButtonPress",	CK_EV_MOUSE_DOWN,	CK_EV_MOUSE_DOWN},
     {"ButtonRelease",	CK_EV_MOUSE_UP,		CK_EV_MOUSE_UP},
     {"BarCode",		CK_EV_BARCODE,		CK_EV_BARCODE},
+    {"Paste",		CK_EV_PASTE,		CK_EV_PASTE},
     {(char *) NULL,	0,			0}
 };
 static Tcl_HashTable eventTable;
 
+/*
+ * Nesting level of Ck_BindEvent;  the time spent in bindings is
+ * only taken at the outermost level.
+ */
+
+static int bindDepth = 0;
+
 /*
  * Prototypes for local procedures defined in this file:
  */
@@ -188,7 +264,24 @@ static void		ExpandPercents _ANSI_ARGS_((CkWindow *winPtr,
 static PatSeq *		FindSequence _ANSI_ARGS_((Tcl_Interp *interp,
 			    BindingTable *bindPtr, ClientData object,
 			    char *eventString, int create));
+static void		FlushCache _ANSI_ARGS_((BindingTable *bindPtr));
+static void		GetPatternString _ANSI_ARGS_((PatSeq *psPtr,
+			    Tcl_DString *dsPtr));
 static char *		GetField _ANSI_ARGS_((char *p, char *copy, int size));
+static char *		GetPercentValue _ANSI_ARGS_((CkWindow *winPtr,
+			    int c, CkEvent *eventPtr, KeySym keySym,
+			    char *numStorage));
+#if CK_BIND_OBJS
+static void		FreeCommandObjs _ANSI_ARGS_((PatSeq *psPtr));
+static Tcl_Obj *	GetCommandObj _ANSI_ARGS_((CkWindow *winPtr,
+			    PatSeq *psPtr, CkEvent *eventPtr,
+			    KeySym keySym, int *compilePtr));
+static void		SplitCommand _ANSI_ARGS_((PatSeq *psPtr));
+#else
+#define FreeCommandObjs(psPtr)
+#endif
+static PatSeq *		MatchObject _ANSI_ARGS_((BindingTable *bindPtr,
+			    ClientData object, int detail, int *useRingPtr));
 static PatSeq *		MatchPatterns _ANSI_ARGS_((BindingTable *bindPtr,
 			    PatSeq *psPtr));
 
@@ -258,6 +351,7 @@ Ck_CreateBindingTable(interp)
     Tcl_InitHashTable(&bindPtr->patternTable,
 	    sizeof(PatternTableKey)/sizeof(int));
     Tcl_InitHashTable(&bindPtr->objectTable, TCL_ONE_WORD_KEYS);
+    Tcl_InitHashTable(&bindPtr->cacheTable, sizeof(CacheKey)/sizeof(int));
     bindPtr->interp = interp;
     return (Ck_BindingTable) bindPtr;
 }
@@ -300,6 +394,7 @@ Ck_DeleteBindingTable(bindingTable)
 	for (psPtr = (PatSeq *) Tcl_GetHashValue(hPtr);
 		psPtr != NULL; psPtr = nextPtr) {
 	    nextPtr = psPtr->nextSeqPtr;
+	    FreeCommandObjs(psPtr);
 	    ckfree((char *) psPtr->command);
 	    ckfree((char *) psPtr);
 	}
@@ -310,8 +405,10 @@ Ck_DeleteBindingTable(bindingTable)
      * binding table.
      */
 
+    FlushCache(bindPtr);
     Tcl_DeleteHashTable(&bindPtr->patternTable);
     Tcl_DeleteHashTable(&bindPtr->objectTable);
+    Tcl_DeleteHashTable(&bindPtr->cacheTable);
     ckfree((char *) bindPtr);
 }
 
@@ -356,6 +453,8 @@ Ck_CreateBinding(interp, bindingTable, object, eventString, command, append)
     psPtr = FindSequence(interp, bindPtr, object, eventString, 1);
     if (psPtr == NULL)
 	return TCL_ERROR;
+    FlushCache(bindPtr);
+    FreeCommandObjs(psPtr);
     if (append && (psPtr->command != NULL)) {
 	int length;
 	char *new;
@@ -453,6 +552,8 @@ Ck_DeleteBinding(interp, bindingTable, object, eventString)
 	    }
 	}
     }
+    FlushCache(bindPtr);
+    FreeCommandObjs(psPtr);
     ckfree((char *) psPtr->command);
     ckfree((char *) psPtr);
     return TCL_OK;
@@ -531,12 +632,8 @@ Ck_GetAllBindings(interp, bindingTable, object)
 {
     BindingTable *bindPtr = (BindingTable *) bindingTable;
     register PatSeq *psPtr;
-    register Pattern *patPtr;
     Tcl_HashEntry *hPtr;
     Tcl_DString ds;
-    char c, buffer[10];
-    int patsLeft;
-    register EventInfo *eiPtr;
 
     hPtr = Tcl_FindHashEntry(&bindPtr->objectTable, (char *) object);
     if (hPtr == NULL) {
@@ -546,97 +643,125 @@ Ck_GetAllBindings(interp, bindingTable, object)
     for (psPtr = (PatSeq *) Tcl_GetHashValue(hPtr); psPtr != NULL;
 	    psPtr = psPtr->nextObjPtr) {
 	Tcl_DStringTrunc(&ds, 0);
+	GetPatternString(psPtr, &ds);
+	Tcl_AppendElement(interp, Tcl_DStringValue(&ds));
+    }
+    Tcl_DStringFree(&ds);
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * GetPatternString --
+ *
+ *	Produce the event string of a binding, as given to the
+ *	"bind" command.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The event string is appended to *dsPtr.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+GetPatternString(psPtr, dsPtr)
+    PatSeq *psPtr;			/* Binding to describe. */
+    Tcl_DString *dsPtr;			/* Where to append its events. */
+{
+    register Pattern *patPtr;
+    char c, buffer[10];
+    int patsLeft;
+    register EventInfo *eiPtr;
+
+    /*
+     * Output information about each of the patterns in the
+     * sequence.  The order of the patterns in the sequence is
+     * backwards from the order in which they must be output.
+     */
+
+    for (patsLeft = psPtr->numPats,
+	    patPtr = &psPtr->pats[psPtr->numPats - 1];
+	    patsLeft > 0; patsLeft--, patPtr--) {
 
 	/*
-	 * For each binding, output information about each of the
-	 * patterns in its sequence.  The order of the patterns in
-	 * the sequence is backwards from the order in which they
-	 * must be output.
+	 * Check for button presses.
 	 */
 
-	for (patsLeft = psPtr->numPats,
-		patPtr = &psPtr->pats[psPtr->numPats - 1];
-		patsLeft > 0; patsLeft--, patPtr--) {
-
-	    /*
-	     * Check for button presses.
-	     */
+	if ((patPtr->eventType == CK_EV_MOUSE_DOWN)
+		&& (patPtr->detail != 0)) {
+	    sprintf(buffer, "<%d>", patPtr->detail);
+	    Tcl_DStringAppend(dsPtr, buffer, -1);
+	    continue;
+	}
 
-	    if ((patPtr->eventType == CK_EV_MOUSE_DOWN)
-		    && (patPtr->detail != 0)) {
-		sprintf(buffer, "<%d>", patPtr->detail);
-		Tcl_DStringAppend(&ds, buffer, -1);
-		continue;
-	    }
+	/*
+	 * Check for simple case of an ASCII character.
+	 */
 
-	    /*
-	     * Check for simple case of an ASCII character.
-	     */
+	if ((patPtr->eventType == CK_EV_KEYPRESS)
+		&& (patPtr->detail < 128)
+		&& isprint((unsigned char) patPtr->detail)
+		&& (patPtr->detail != '<')
+		&& (patPtr->detail != ' ')) {
+	    c = patPtr->detail;
+	    Tcl_DStringAppend(dsPtr, &c, 1);
+	    continue;
+	}
 
-	    if ((patPtr->eventType == CK_EV_KEYPRESS)
-		    && (patPtr->detail < 128)
-		    && isprint((unsigned char) patPtr->detail)
-		    && (patPtr->detail != '<')
-		    && (patPtr->detail != ' ')) {
-		c = patPtr->detail;
-		Tcl_DStringAppend(&ds, &c, 1);
-		continue;
-	    }
+	/*
+	 * It's a more general event specification.  First check
+	 * event type, then keysym or button detail.
+	 */
 
-	    /*
-	     * It's a more general event specification.  First check
-	     * event type, then keysym or button detail.
-	     */
+	Tcl_DStringAppend(dsPtr, "<", 1);
 
-	    Tcl_DStringAppend(&ds, "<", 1);
+	for (eiPtr = eventArray; eiPtr->name != NULL; eiPtr++) {
+	    if (eiPtr->type == patPtr->eventType) {
+		if (patPtr->eventType == CK_EV_KEYPRESS &&
+		    patPtr->detail == -1) {
+		    Tcl_DStringAppend(dsPtr, "Control", -1);
+		    goto endPat;
+		}
+		if (patPtr->eventType == CK_EV_KEYPRESS &&
+		    patPtr->detail > 0 && patPtr->detail < 0x20) {
+		    char *string;
 
-	    for (eiPtr = eventArray; eiPtr->name != NULL; eiPtr++) {
-		if (eiPtr->type == patPtr->eventType) {
-		    if (patPtr->eventType == CK_EV_KEYPRESS &&
-			patPtr->detail == -1) {
-			Tcl_DStringAppend(&ds, "Control", -1);
-			goto endPat;
-		    }
-		    if (patPtr->eventType == CK_EV_KEYPRESS &&
-		        patPtr->detail > 0 && patPtr->detail < 0x20) {
-			char *string;
-
-		        string = CkKeysymToString((KeySym) patPtr->detail, 0);
-		        if (string == NULL) {
-			    sprintf(buffer, "Control-%c",
-			        patPtr->detail + 0x40);
-			    string = buffer;
-			}
-			Tcl_DStringAppend(&ds, string, -1);
-			goto endPat;
-		    }
-		    Tcl_DStringAppend(&ds, eiPtr->name, -1);
-		    if (patPtr->detail != 0) {
-			Tcl_DStringAppend(&ds, "-", 1);
+		    string = CkKeysymToString((KeySym) patPtr->detail, 0);
+		    if (string == NULL) {
+			sprintf(buffer, "Control-%c",
+			    patPtr->detail + 0x40);
+			string = buffer;
 		    }
-		    break;
+		    Tcl_DStringAppend(dsPtr, string, -1);
+		    goto endPat;
+		}
+		Tcl_DStringAppend(dsPtr, eiPtr->name, -1);
+		if (patPtr->detail != 0) {
+		    Tcl_DStringAppend(dsPtr, "-", 1);
 		}
+		break;
 	    }
+	}
 
-	    if (patPtr->detail != 0) {
-		if (patPtr->eventType == CK_EV_KEYPRESS) {
-		    char *string;
+	if (patPtr->detail != 0) {
+	    if (patPtr->eventType == CK_EV_KEYPRESS) {
+		char *string;
 
-		    string = CkKeysymToString((KeySym) patPtr->detail, 0);
-		    if (string != NULL) {
-			Tcl_DStringAppend(&ds, string, -1);
-		    }
-		} else {
-		    sprintf(buffer, "%d", patPtr->detail);
-		    Tcl_DStringAppend(&ds, buffer, -1);
+		string = CkKeysymToString((KeySym) patPtr->detail, 0);
+		if (string != NULL) {
+		    Tcl_DStringAppend(dsPtr, string, -1);
 		}
+	    } else {
+		sprintf(buffer, "%d", patPtr->detail);
+		Tcl_DStringAppend(dsPtr, buffer, -1);
 	    }
-endPat:
-	    Tcl_DStringAppend(&ds, ">", 1);
 	}
-	Tcl_AppendElement(interp, Tcl_DStringValue(&ds));
+endPat:
+	Tcl_DStringAppend(dsPtr, ">", 1);
     }
-    Tcl_DStringFree(&ds);
 }
 
 /*
@@ -668,6 +793,12 @@ Ck_DeleteAllBindings(bindingTable, object)
     PatSeq *nextPtr;
     Tcl_HashEntry *hPtr;
 
+    /*
+     * This is called when a window is deleted, so flush the cache
+     * in any case:  it might refer to the window.
+     */
+
+    FlushCache(bindPtr);
     hPtr = Tcl_FindHashEntry(&bindPtr->objectTable, (char *) object);
     if (hPtr == NULL) {
 	return;
@@ -700,6 +831,7 @@ Ck_DeleteAllBindings(bindingTable, object)
 		}
 	    }
 	}
+	FreeCommandObjs(psPtr);
 	ckfree((char *) psPtr->command);
 	ckfree((char *) psPtr);
     }
@@ -742,12 +874,23 @@ Ck_BindEvent(bindingTable, eventPtr, winPtr, numObjects, objectPtr)
     CkMainInfo *mainPtr;
     CkEvent *ringPtr;
     PatSeq *matchPtr;
-    PatternTableKey key;
+    CacheKey key;
+    BindCache *cachePtr;
+    CachedMatch *cmPtr;
     Tcl_HashEntry *hPtr;
-    int detail, code;
+    int detail, code, new, n, numScripts = 0, profiling;
+    double t0 = 0.0, tp;
     Tcl_Interp *interp;
-    Tcl_DString scripts, savedResult;
+    Tcl_DString scripts, savedResult, profKeys;
+    char *keyPtr;
+#if CK_BIND_OBJS
+#define NUM_STATIC_OBJS 8
+    Tcl_Obj *staticObjs[NUM_STATIC_OBJS], **cmdObjs;
+    int staticCompile[NUM_STATIC_OBJS], *compile;
+    int i, numCmds = 0;
+#else
     char *p, *end;
+#endif
 
     /*
      * Add the new event to the ring of saved events for the
@@ -768,58 +911,89 @@ Ck_BindEvent(bindingTable, eventPtr, winPtr, numObjects, objectPtr)
 	detail = ringPtr->mouse.button;
     bindPtr->detailRing[bindPtr->curEvent] = detail;
 
+    /*
+     * Find the cached bindings for the objects, or look them up if
+     * the objects differ from those cached (the binding tags of the
+     * window were changed).
+     */
+
+    key.winPtr = winPtr;
+    key.type = ringPtr->type;
+    key.detail = detail;
+    hPtr = Tcl_CreateHashEntry(&bindPtr->cacheTable, (char *) &key, &new);
+    cachePtr = new ? NULL : (BindCache *) Tcl_GetHashValue(hPtr);
+    if (cachePtr != NULL && cachePtr->numObjects == numObjects) {
+	for (n = 0; n < numObjects; n++) {
+	    if (cachePtr->match[n].object != objectPtr[n])
+		break;
+	}
+	if (n < numObjects) {
+	    ckfree((char *) cachePtr);
+	    cachePtr = NULL;
+	}
+    } else if (cachePtr != NULL) {
+	ckfree((char *) cachePtr);
+	cachePtr = NULL;
+    }
+    if (cachePtr == NULL) {
+	cachePtr = (BindCache *) ckalloc(sizeof (BindCache) +
+		(numObjects - 1) * sizeof (CachedMatch));
+	cachePtr->numObjects = numObjects;
+	for (n = 0; n < numObjects; n++) {
+	    cmPtr = &cachePtr->match[n];
+	    cmPtr->object = objectPtr[n];
+	    cmPtr->useRing = 0;
+	    cmPtr->matchPtr = MatchObject(bindPtr, objectPtr[n], detail,
+		    &cmPtr->useRing);
+	}
+	Tcl_SetHashValue(hPtr, (ClientData) cachePtr);
+    }
+
     /*
      * Loop over all the objects, finding the binding script for each
      * one.  Append all of the binding scripts, with %-sequences expanded,
      * to "scripts", with null characters separating the scripts for
-     * each object.
+     * each object.  If the profiler is on, the binding tag and event
+     * string of each script go to "profKeys", since the script may
+     * delete its binding.
      */
 
     Tcl_DStringInit(&scripts);
-    for ( ; numObjects > 0; numObjects--, objectPtr++) {
-
-	/*
-	 * Match the new event against those recorded in the
-	 * pattern table, saving the longest matching pattern.
-	 * For events with details (key events) first
-	 * look for a binding for the specific key or button.
-	 * If none is found, then look for a binding for all
-         * control-keys (detail of -1, if the keycode is a control
-         * character), else look for a binding for all keys
-         * (detail of 0).
-	 */
-
-	matchPtr = NULL;
-	key.object = *objectPtr;
-	key.type = ringPtr->type;
-	key.detail = detail;
-	hPtr = Tcl_FindHashEntry(&bindPtr->patternTable, (char *) &key);
-	if (hPtr != NULL) {
-	    matchPtr = MatchPatterns(bindPtr,
-		    (PatSeq *) Tcl_GetHashValue(hPtr));
-	}
-	if (ringPtr->type == CK_EV_KEYPRESS && detail > 0 && detail < 0x20 &&
-            matchPtr == NULL) {
-	    key.detail = -1;
-	    hPtr = Tcl_FindHashEntry(&bindPtr->patternTable, (char *) &key);
-	    if (hPtr != NULL) {
-		matchPtr = MatchPatterns(bindPtr,
-			(PatSeq *) Tcl_GetHashValue(hPtr));
-	    }
-	}
-	if (detail != 0 && matchPtr == NULL) {
-	    key.detail = 0;
-	    hPtr = Tcl_FindHashEntry(&bindPtr->patternTable, (char *) &key);
-	    if (hPtr != NULL) {
-		matchPtr = MatchPatterns(bindPtr,
-			(PatSeq *) Tcl_GetHashValue(hPtr));
-	    }
+    Tcl_DStringInit(&profKeys);
+    profiling = CkProfileStart(winPtr->mainPtr) != 0.0;
+#if CK_BIND_OBJS
+    cmdObjs = staticObjs;
+    compile = staticCompile;
+    if (numObjects > NUM_STATIC_OBJS) {
+	cmdObjs = (Tcl_Obj **) ckalloc(numObjects * sizeof (Tcl_Obj *));
+	compile = (int *) ckalloc(numObjects * sizeof (int));
+    }
+#endif
+    for (n = 0; n < numObjects; n++) {
+	cmPtr = &cachePtr->match[n];
+	matchPtr = cmPtr->matchPtr;
+	if (cmPtr->useRing) {
+	    matchPtr = MatchObject(bindPtr, cmPtr->object, detail,
+		    (int *) NULL);
 	}
 
 	if (matchPtr != NULL) {
+	    if (profiling) {
+		Tcl_DStringAppend(&profKeys, (char *) cmPtr->object, -1);
+		Tcl_DStringAppend(&profKeys, "", 1);
+		GetPatternString(matchPtr, &profKeys);
+		Tcl_DStringAppend(&profKeys, "", 1);
+	    }
+#if CK_BIND_OBJS
+	    cmdObjs[numCmds] = GetCommandObj(winPtr, matchPtr, eventPtr,
+		    (KeySym) detail, &compile[numCmds]);
+	    Tcl_IncrRefCount(cmdObjs[numCmds]);
+	    numCmds++;
+#else
 	    ExpandPercents(winPtr, matchPtr->command, eventPtr,
 		    (KeySym) detail, &scripts);
 	    Tcl_DStringAppend(&scripts, "", 1);
+#endif
 	}
     }
 
@@ -847,11 +1021,66 @@ Ck_BindEvent(bindingTable, eventPtr, winPtr, numObjects, objectPtr)
     interp = bindPtr->interp;
     Tcl_DStringInit(&savedResult);
     Tcl_DStringGetResult(interp, &savedResult);
+    if (ckStatsTiming && bindDepth == 0)
+	t0 = CkStatsClock();
+    bindDepth++;
+    keyPtr = Tcl_DStringValue(&profKeys);
+#if CK_BIND_OBJS
+    for (i = 0; i < numCmds; i++) {
+	numScripts++;
+	tp = profiling ? CkProfileStart(mainPtr) : 0.0;
+	Tcl_AllowExceptions(interp);
+	if (compile[i]) {
+	    code = Tcl_EvalObjEx(interp, cmdObjs[i], TCL_EVAL_GLOBAL);
+	} else {
+	    code = Tcl_EvalEx(interp, Tcl_GetString(cmdObjs[i]), -1,
+		    TCL_EVAL_GLOBAL);
+	}
+	if (profiling && CkLookupMainInfo(mainPtr) == NULL) {
+	    profiling = 0;
+	} else if (profiling) {
+	    CkProfileRecord(mainPtr, CK_PROFILE_BIND, keyPtr,
+		keyPtr + strlen(keyPtr) + 1, tp);
+	    keyPtr += strlen(keyPtr) + 1;
+	    keyPtr += strlen(keyPtr) + 1;
+	}
+	if (code != TCL_OK) {
+	    if (code == TCL_CONTINUE) {
+		/*
+		 * Do nothing:  just go on to the next script.
+		 */
+	    } else if (code == TCL_BREAK) {
+		break;
+	    } else {
+		Tcl_AddErrorInfo(interp, "\n    (command bound to event)");
+		Tk_BackgroundError(interp);
+		break;
+	    }
+	}
+    }
+    for (i = 0; i < numCmds; i++) {
+	Tcl_DecrRefCount(cmdObjs[i]);
+    }
+    if (cmdObjs != staticObjs) {
+	ckfree((char *) cmdObjs);
+	ckfree((char *) compile);
+    }
+#else
     p = Tcl_DStringValue(&scripts);
     end = p + Tcl_DStringLength(&scripts);
     while (p != end) {
+	numScripts++;
+	tp = profiling ? CkProfileStart(mainPtr) : 0.0;
 	Tcl_AllowExceptions(interp);
 	code = Tcl_GlobalEval(interp, p);
+	if (profiling && CkLookupMainInfo(mainPtr) == NULL) {
+	    profiling = 0;
+	} else if (profiling) {
+	    CkProfileRecord(mainPtr, CK_PROFILE_BIND, keyPtr,
+		keyPtr + strlen(keyPtr) + 1, tp);
+	    keyPtr += strlen(keyPtr) + 1;
+	    keyPtr += strlen(keyPtr) + 1;
+	}
 	if (code != TCL_OK) {
 	    if (code == TCL_CONTINUE) {
 		/*
@@ -875,10 +1104,168 @@ Ck_BindEvent(bindingTable, eventPtr, winPtr, numObjects, objectPtr)
 	}
 	p++;
     }
+#endif
+    bindDepth--;
+    if (CkLookupMainInfo(mainPtr) != NULL) {
+	mainPtr->stats.bindScripts += numScripts;
+	if (bindDepth == 0 && t0 != 0.0) {
+	    mainPtr->stats.phaseTime[CK_STATS_BINDINGS] +=
+		CkStatsClock() - t0;
+	}
+    }
     Tcl_DStringResult(interp, &savedResult);
     Tcl_DStringFree(&scripts);
+    Tcl_DStringFree(&profKeys);
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * CkBindingExists --
+ *
+ *	Find out whether any of the given objects has a binding
+ *	for an event type with the given detail, e.g. Paste (detail
+ *	0) or a specific key.
+ *
+ * Results:
+ *	1 if there is such a binding, 0 otherwise.
+ *
+ * Side effects:
+ *	None.
+ *
+ *--------------------------------------------------------------
+ */
+
+int
+CkBindingExists(bindingTable, eventType, detail, numObjects, objectPtr)
+    Ck_BindingTable bindingTable;	/* Table in which to look for
+					 * bindings. */
+    int eventType;			/* Type of event. */
+    int detail;				/* Keycode or button, 0 if none. */
+    int numObjects;			/* Number of objects at *objectPtr. */
+    ClientData *objectPtr;		/* Array of one or more objects
+					 * to check for a binding. */
+{
+    BindingTable *bindPtr = (BindingTable *) bindingTable;
+    PatternTableKey key;
+
+    key.type = eventType;
+    key.detail = detail;
+    for ( ; numObjects > 0; numObjects--, objectPtr++) {
+	key.object = *objectPtr;
+	if (Tcl_FindHashEntry(&bindPtr->patternTable, (char *) &key) != NULL) {
+	    return 1;
+	}
+    }
+    return 0;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * MatchObject --
+ *
+ *	Find the binding of an object for the most recent event of
+ *	a binding table.  For events with details (key events) first
+ *	look for a binding for the specific key or button.  If none
+ *	is found, then look for a binding for all control-keys
+ *	(detail of -1, if the keycode is a control character), else
+ *	look for a binding for all keys (detail of 0).
+ *
+ * Results:
+ *	The longest matching pattern sequence, or NULL if none.  If
+ *	useRingPtr isn't NULL, only single-event sequences are looked
+ *	at:  if a multi-event sequence might match, *useRingPtr is set
+ *	to 1 and NULL is returned.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static PatSeq *
+MatchObject(bindPtr, object, detail, useRingPtr)
+    BindingTable *bindPtr;	/* Binding table with recent events. */
+    ClientData object;		/* Object whose bindings are matched. */
+    int detail;			/* Detail of most recent event. */
+    int *useRingPtr;		/* If not NULL, don't match multi-event
+				 * sequences but report them here. */
+{
+    PatternTableKey key;
+    Tcl_HashEntry *hPtr;
+    PatSeq *psPtr, *matchPtr = NULL;
+    int type = bindPtr->eventRing[bindPtr->curEvent].type;
+    int i, numKeys = 0, details[3];
+
+    details[numKeys++] = detail;
+    if (type == CK_EV_KEYPRESS && detail > 0 && detail < 0x20) {
+	details[numKeys++] = -1;
+    }
+    if (detail != 0) {
+	details[numKeys++] = 0;
+    }
+    key.object = object;
+    key.type = type;
+    for (i = 0; i < numKeys && matchPtr == NULL; i++) {
+	key.detail = details[i];
+	hPtr = Tcl_FindHashEntry(&bindPtr->patternTable, (char *) &key);
+	if (hPtr == NULL) {
+	    continue;
+	}
+	psPtr = (PatSeq *) Tcl_GetHashValue(hPtr);
+	if (useRingPtr == NULL) {
+	    matchPtr = MatchPatterns(bindPtr, psPtr);
+	    continue;
+	}
+
+	/*
+	 * There is at most one single-event sequence in the list, and
+	 * it matches since its pattern was used to look it up.
+	 */
+
+	for ( ; psPtr != NULL; psPtr = psPtr->nextSeqPtr) {
+	    if (psPtr->numPats > 1) {
+		*useRingPtr = 1;
+		return NULL;
+	    }
+	    matchPtr = psPtr;
+	}
+    }
+    return matchPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FlushCache --
+ *
+ *	Discard all bindings cached by Ck_BindEvent.  Must be called
+ *	whenever pattern sequences are created or deleted.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory is freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+FlushCache(bindPtr)
+    BindingTable *bindPtr;
+{
+    Tcl_HashEntry *hPtr;
+    Tcl_HashSearch search;
+
+    for (hPtr = Tcl_FirstHashEntry(&bindPtr->cacheTable, &search);
+	    hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
+	ckfree((char *) Tcl_GetHashValue(hPtr));
+	Tcl_DeleteHashEntry(hPtr);
+    }
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -1115,6 +1502,12 @@ closeAngle:
 	    + (numPats-1)*sizeof(Pattern)));
     psPtr->numPats = numPats;
     psPtr->command = NULL;
+#if CK_BIND_OBJS
+    psPtr->objc = -1;
+    psPtr->objv = NULL;
+    psPtr->percents = NULL;
+    psPtr->scriptObj = NULL;
+#endif
     psPtr->nextSeqPtr = (PatSeq *) Tcl_GetHashValue(hPtr);
     psPtr->hPtr = hPtr;
     Tcl_SetHashValue(hPtr, psPtr);
@@ -1305,6 +1698,153 @@ MatchPatterns(bindPtr, psPtr)
     return bestPtr;
 }
 
+/*
+ *--------------------------------------------------------------
+ *
+ * GetPercentValue --
+ *
+ *	Compute the replacement for a %-sequence in a binding
+ *	command.
+ *
+ * Results:
+ *	The value of the sequence "%c" for the given event, either a
+ *	static string or stored in numStorage (which must hold
+ *	NUM_SIZE+1 characters).
+ *
+ * Side effects:
+ *	None.
+ *
+ *--------------------------------------------------------------
+ */
+
+static char *
+GetPercentValue(winPtr, c, eventPtr, keySym, numStorage)
+    CkWindow *winPtr;		/* Window where event occurred. */
+    int c;			/* Character following the "%". */
+    register CkEvent *eventPtr;	/* Event containing information
+				 * to be used in % replacements. */
+    KeySym keySym;		/* KeySym: only relevant for
+				 * CK_EV_KEYPRESS events). */
+    char *numStorage;		/* Space for formatted values. */
+{
+    int number;
+    char *string;
+
+    number = 0;
+    string = "??";
+    switch (c) {
+	case 'k':
+	    number = eventPtr->key.keycode;
+	    goto doNumber;
+	case 'A':
+	    if (eventPtr->type == CK_EV_KEYPRESS) {
+		int numChars = 0;
+
+		if ((eventPtr->key.keycode & ~0xff) == 0 &&
+		    eventPtr->key.keycode != 0) {
+#if CK_USE_UTF
+		    char ch = eventPtr->key.keycode;
+		    int numc = 0;
+
+		    if (winPtr->mainPtr->isoEncoding) {
+			Tcl_ExternalToUtf(NULL,
+			    winPtr->mainPtr->isoEncoding,
+			    &ch, 1, 0, NULL,
+			    numStorage + numChars,
+			    NUM_SIZE + 1 - numChars,
+			    NULL, &numc, NULL);
+			numChars += numc;
+		    } else {
+			numStorage[numChars++] = eventPtr->key.keycode;
+		    }
+#else
+		    numStorage[numChars++] = eventPtr->key.keycode;
+#endif
+		}
+#if CK_USE_UTF
+		if (eventPtr->key.is_uch) {
+		    numChars = Tcl_UniCharToUtf(eventPtr->key.uch,
+						numStorage);
+		}
+#endif
+		numStorage[numChars] = '\0';
+		string = numStorage;
+	    } else if (eventPtr->type == CK_EV_BARCODE) {
+		string = CkGetBarcodeData(winPtr->mainPtr);
+		if (string == NULL) {
+		    numStorage[0] = '\0';
+		    string = numStorage;
+		}
+	    } else if (eventPtr->type == CK_EV_PASTE) {
+		string = eventPtr->paste.data;
+	    }
+	    goto doString;
+	case 'K':
+	    if (eventPtr->type == CK_EV_KEYPRESS) {
+		char *name;
+
+		name = CkKeysymToString(keySym, 1);
+		if (name != NULL) {
+		    string = name;
+		}
+	    }
+	    goto doString;
+	case 'N':
+	    number = (int) keySym;
+	    goto doNumber;
+	case 'W':
+	    if (Tcl_FindHashEntry(&winPtr->mainPtr->winTable,
+		(char *) eventPtr->any.winPtr) != NULL) {
+		string = eventPtr->any.winPtr->pathName;
+	    } else {
+		string = "??";
+	    }
+	    goto doString;
+	case 'x':
+	    if (eventPtr->type == CK_EV_MOUSE_UP ||
+		eventPtr->type == CK_EV_MOUSE_DOWN) {
+		number = eventPtr->mouse.x;
+	    }
+	    goto doNumber;
+	case 'y':
+	    if (eventPtr->type == CK_EV_MOUSE_UP ||
+		eventPtr->type == CK_EV_MOUSE_DOWN) {
+		number = eventPtr->mouse.y;
+	    }
+	    goto doNumber;
+	case 'b':
+	    if (eventPtr->type == CK_EV_MOUSE_UP ||
+		eventPtr->type == CK_EV_MOUSE_DOWN) {
+		number = eventPtr->mouse.button;
+	    }
+	    goto doNumber;
+	case 'X':
+	    if (eventPtr->type == CK_EV_MOUSE_UP ||
+		eventPtr->type == CK_EV_MOUSE_DOWN) {
+		number = eventPtr->mouse.rootx;
+	    }
+	    goto doNumber;
+	case 'Y':
+	    if (eventPtr->type == CK_EV_MOUSE_UP ||
+		eventPtr->type == CK_EV_MOUSE_DOWN) {
+		number = eventPtr->mouse.rooty;
+	    }
+	    goto doNumber;
+	default:
+	    numStorage[0] = c;
+	    numStorage[1] = '\0';
+	    string = numStorage;
+	    goto doString;
+    }
+
+    doNumber:
+    sprintf(numStorage, "%d", number);
+    return numStorage;
+
+    doString:
+    return string;
+}
+
 /*
  *--------------------------------------------------------------
  *
@@ -1339,8 +1879,6 @@ ExpandPercents(winPtr, before, eventPtr, keySym, dsPtr)
 {
     int spaceNeeded, cvtFlags;	/* Used to substitute string as proper Tcl
 				 * list element. */
-    int number;
-#define NUM_SIZE 40
     char *string, *string2;
     char numStorage[NUM_SIZE+1];
 
@@ -1365,116 +1903,8 @@ ExpandPercents(winPtr, before, eventPtr, keySym, dsPtr)
 	 * There's a percent sequence here.  Process it.
 	 */
 
-	number = 0;
-	string = "??";
-	switch (before[1]) {
-	    case 'k':
-		number = eventPtr->key.keycode;
-		goto doNumber;
-	    case 'A':
-		if (eventPtr->type == CK_EV_KEYPRESS) {
-		    int numChars = 0;
-
-		    if ((eventPtr->key.keycode & ~0xff) == 0 &&
-		        eventPtr->key.keycode != 0) {
-#if CK_USE_UTF
-			char c = eventPtr->key.keycode;
-			int numc = 0;
-
-			if (winPtr->mainPtr->isoEncoding) {
-			    Tcl_ExternalToUtf(NULL,
-				winPtr->mainPtr->isoEncoding,
-				&c, 1, 0, NULL,
-				numStorage + numChars,
-				sizeof (numStorage) - numChars,
-				NULL, &numc, NULL);
-			    numChars += numc;
-			} else {
-		    	    numStorage[numChars++] = eventPtr->key.keycode;
-			}
-#else
-		    	numStorage[numChars++] = eventPtr->key.keycode;
-#endif
-		    }
-#if CK_USE_UTF
-		    if (eventPtr->key.is_uch) {
-			numChars = Tcl_UniCharToUtf(eventPtr->key.uch,
-						    numStorage);
-		    }
-#endif
-		    numStorage[numChars] = '\0';
-		    string = numStorage;
-		} else if (eventPtr->type == CK_EV_BARCODE) {
-		    string = CkGetBarcodeData(winPtr->mainPtr);
-		    if (string == NULL) {
-			numStorage[0] = '\0';
-			string = numStorage;
-		    }
-		}
-		goto doString;
-	    case 'K':
-		if (eventPtr->type == CK_EV_KEYPRESS) {
-		    char *name;
-
-		    name = CkKeysymToString(keySym, 1);
-		    if (name != NULL) {
-			string = name;
-		    }
-		}
-		goto doString;
-	    case 'N':
-		number = (int) keySym;
-		goto doNumber;
-	    case 'W':
-		if (Tcl_FindHashEntry(&winPtr->mainPtr->winTable,
-		    (char *) eventPtr->any.winPtr) != NULL) {
-		    string = eventPtr->any.winPtr->pathName;
-		} else {
-		    string = "??";
-		}
-		goto doString;
-	    case 'x':
-		if (eventPtr->type == CK_EV_MOUSE_UP ||
-		    eventPtr->type == CK_EV_MOUSE_DOWN) {
-		    number = eventPtr->mouse.x;
-		}
-		goto doNumber;
-	    case 'y':
-		if (eventPtr->type == CK_EV_MOUSE_UP ||
-		    eventPtr->type == CK_EV_MOUSE_DOWN) {
-		    number = eventPtr->mouse.y;
-		}
-		goto doNumber;
-	    case 'b':
-		if (eventPtr->type == CK_EV_MOUSE_UP ||
-		    eventPtr->type == CK_EV_MOUSE_DOWN) {
-		    number = eventPtr->mouse.button;
-		}
-		goto doNumber;
-	    case 'X':
-		if (eventPtr->type == CK_EV_MOUSE_UP ||
-		    eventPtr->type == CK_EV_MOUSE_DOWN) {
-		    number = eventPtr->mouse.rootx;
-		}
-		goto doNumber;
-	    case 'Y':
-		if (eventPtr->type == CK_EV_MOUSE_UP ||
-		    eventPtr->type == CK_EV_MOUSE_DOWN) {
-		    number = eventPtr->mouse.rooty;
-		}
-		goto doNumber;
-	    default:
-		numStorage[0] = before[1];
-		numStorage[1] = '\0';
-		string = numStorage;
-		goto doString;
-	}
-
-	doNumber:
-	sprintf(numStorage, "%d", number);
-	string = numStorage;
-
-	doString:
+	string = GetPercentValue(winPtr, before[1], eventPtr, keySym,
+		numStorage);
 	spaceNeeded = Tcl_ScanElement(string, &cvtFlags);
         string2 = ckalloc(spaceNeeded + 1);
 	spaceNeeded = Tcl_ConvertElement(string, string2,
@@ -1485,6 +1915,200 @@ ExpandPercents(winPtr, before, eventPtr, keySym, dsPtr)
     }
 }
 
+#if CK_BIND_OBJS
+/*
+ *--------------------------------------------------------------
+ *
+ * SplitCommand --
+ *
+ *	Examine the command of a pattern sequence once, to find out
+ *	whether it is a single command whose words are either plain
+ *	text or a single %-sequence (e.g. "ckEntryInsert %W %A").
+ *	Such commands are run without substituting into and parsing
+ *	a script each time.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Fills in the objc, objv and percents fields of psPtr.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+SplitCommand(psPtr)
+    PatSeq *psPtr;		/* Pattern sequence with command. */
+{
+    Tcl_Parse parse;
+    Tcl_Token *tokenPtr;
+    char *script = psPtr->command;
+    int i, length = strlen(script);
+
+    psPtr->objc = 0;
+    if (Tcl_ParseCommand((Tcl_Interp *) NULL, script, length, 0,
+	    &parse) != TCL_OK) {
+	return;
+    }
+    for (i = (parse.commandStart - script) + parse.commandSize;
+	    i < length; i++) {
+	if (!isspace((unsigned char) script[i]) && (script[i] != ';')) {
+	    goto done;
+	}
+    }
+    if (parse.numWords <= 0) {
+	goto done;
+    }
+    for (i = 0, tokenPtr = parse.tokenPtr; i < parse.numWords;
+	    i++, tokenPtr += tokenPtr->numComponents + 1) {
+	if (tokenPtr->type != TCL_TOKEN_SIMPLE_WORD) {
+	    goto done;
+	}
+	if ((memchr(tokenPtr[1].start, '%', tokenPtr[1].size) != NULL)
+		&& ((tokenPtr[1].size != 2) || (tokenPtr[1].start[0] != '%')
+		|| (tokenPtr->start[0] == '{')
+		|| (tokenPtr->start[0] == '"'))) {
+	    goto done;
+	}
+    }
+
+    psPtr->objv = (Tcl_Obj **) ckalloc(parse.numWords * sizeof (Tcl_Obj *));
+    psPtr->percents = (char *) ckalloc(parse.numWords);
+    for (i = 0, tokenPtr = parse.tokenPtr; i < parse.numWords;
+	    i++, tokenPtr += tokenPtr->numComponents + 1) {
+	if (tokenPtr[1].start[0] == '%') {
+	    psPtr->objv[i] = NULL;
+	    psPtr->percents[i] = tokenPtr[1].start[1];
+	} else {
+	    psPtr->objv[i] = Tcl_NewStringObj(tokenPtr[1].start,
+		    tokenPtr[1].size);
+	    Tcl_IncrRefCount(psPtr->objv[i]);
+	    psPtr->percents[i] = 0;
+	}
+    }
+    psPtr->objc = parse.numWords;
+
+    done:
+    Tcl_FreeParse(&parse);
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * GetCommandObj --
+ *
+ *	Produce the command to run for a pattern sequence that
+ *	matched an event.
+ *
+ * Results:
+ *	A Tcl object holding the command with % constructs replaced
+ *	by information from the event.  For a single command of plain
+ *	words this is a pure list, which Tcl invokes without parsing;
+ *	otherwise it is the substituted script, which is kept and
+ *	reused with its bytecode as long as it doesn't change.  The
+ *	caller must take a reference to the object.  *compilePtr is
+ *	set to 0 if the object is better evaluated as a string:  a
+ *	script seen for the first time may never recur (e.g. with a
+ *	different %A for each key), so compiling it would be wasted.
+ *
+ * Side effects:
+ *	The command may be examined by SplitCommand.
+ *
+ *--------------------------------------------------------------
+ */
+
+static Tcl_Obj *
+GetCommandObj(winPtr, psPtr, eventPtr, keySym, compilePtr)
+    CkWindow *winPtr;		/* Window where event occurred. */
+    PatSeq *psPtr;		/* Pattern sequence that matched. */
+    CkEvent *eventPtr;		/* Event containing information
+				 * to be used in % replacements. */
+    KeySym keySym;		/* KeySym: only relevant for
+				 * CK_EV_KEYPRESS events). */
+    int *compilePtr;		/* Where to store whether to evaluate
+				 * the object as bytecode. */
+{
+    Tcl_Obj *listPtr, *wordPtr;
+    Tcl_DString ds;
+    char numStorage[NUM_SIZE+1];
+    int i;
+
+    *compilePtr = 1;
+    if (psPtr->objc < 0) {
+	SplitCommand(psPtr);
+    }
+    if (psPtr->objc > 0) {
+	listPtr = Tcl_NewListObj(0, (Tcl_Obj **) NULL);
+	for (i = 0; i < psPtr->objc; i++) {
+	    wordPtr = psPtr->objv[i];
+	    if (wordPtr == NULL) {
+		wordPtr = Tcl_NewStringObj(GetPercentValue(winPtr,
+			psPtr->percents[i], eventPtr, keySym, numStorage), -1);
+	    }
+	    Tcl_ListObjAppendElement((Tcl_Interp *) NULL, listPtr, wordPtr);
+	}
+	return listPtr;
+    }
+
+    Tcl_DStringInit(&ds);
+    ExpandPercents(winPtr, psPtr->command, eventPtr, keySym, &ds);
+    if ((psPtr->scriptObj == NULL)
+	    || (strcmp(Tcl_GetString(psPtr->scriptObj),
+		Tcl_DStringValue(&ds)) != 0)) {
+	if (psPtr->scriptObj != NULL) {
+	    Tcl_DecrRefCount(psPtr->scriptObj);
+	}
+	psPtr->scriptObj = Tcl_NewStringObj(Tcl_DStringValue(&ds),
+		Tcl_DStringLength(&ds));
+	Tcl_IncrRefCount(psPtr->scriptObj);
+	*compilePtr = 0;
+    }
+    Tcl_DStringFree(&ds);
+    return psPtr->scriptObj;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * FreeCommandObjs --
+ *
+ *	Release the Tcl objects derived from the command of a pattern
+ *	sequence, e.g. because the command changes.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Object references are dropped and memory is freed.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+FreeCommandObjs(psPtr)
+    PatSeq *psPtr;		/* Pattern sequence. */
+{
+    int i;
+
+    for (i = 0; i < psPtr->objc; i++) {
+	if (psPtr->objv[i] != NULL) {
+	    Tcl_DecrRefCount(psPtr->objv[i]);
+	}
+    }
+    if (psPtr->objv != NULL) {
+	ckfree((char *) psPtr->objv);
+	ckfree(psPtr->percents);
+    }
+    if (psPtr->scriptObj != NULL) {
+	Tcl_DecrRefCount(psPtr->scriptObj);
+    }
+    psPtr->objc = -1;
+    psPtr->objv = NULL;
+    psPtr->percents = NULL;
+    psPtr->scriptObj = NULL;
+}
+#endif /* CK_BIND_OBJS */
+
 /*
  *----------------------------------------------------------------------
  *
@@ -823,11 +823,13 @@ DisplayButton(clientData)
     Button *butPtr = (Button *) clientData;
     int x, y, fg, bg, attr, textWidth, charWidth;
     CkWindow *winPtr = butPtr->winPtr;
+    double t0;
 
     butPtr->flags &= ~REDRAW_PENDING;
     if ((butPtr->winPtr == NULL) || !(winPtr->flags & CK_MAPPED)) {
 	return;
     }
+    t0 = CkProfileStart(winPtr->mainPtr);
 
     if (butPtr->state == ckDisabledUid) {
         fg = butPtr->disabledFg;
@@ -921,6 +923,7 @@ DisplayButton(clientData)
     Ck_SetWindowAttr(winPtr, fg, bg, attr);
     wmove(winPtr->window, y, (butPtr->type >= TYPE_CHECK_BUTTON) ? 1 : x);
     Ck_EventuallyRefresh(winPtr);
+    CkProfileWindow(winPtr, t0);
 }
 
 /*
@@ -16,6 +16,42 @@
 #include "ckPort.h"
 #include "ck.h"
 
+/*
+ * Non-zero means the time spent in the phases of event processing
+ * is measured for "curses stats".
+ */
+
+int ckStatsTiming = 0;
+
+/*
+ * Names of event types for "curses stats", indexed by the number
+ * of the bit of the type.
+ */
+
+static char *statsEventNames[CK_STATS_EVENT_TYPES] = {
+    "KeyPress", "ButtonPress", "ButtonRelease", NULL,
+    "Unmap", "Map", "Expose", "Destroy",
+    "FocusIn", "FocusOut", "Paste", NULL,
+    NULL, NULL, NULL, NULL,
+    NULL, NULL, NULL, NULL,
+    NULL, NULL, NULL, NULL,
+    NULL, NULL, NULL, NULL,
+    "BarCode", NULL, NULL, NULL
+};
+
+/*
+ * Names of the phases of event processing for "curses stats".
+ */
+
+static char *statsPhaseNames[CK_STATS_PHASES] = {
+    "input", "events", "bindings", "refresh", "timers", "idle", "wait"
+};
+
+static int        GetBindObjects _ANSI_ARGS_((CkWindow *winPtr,
+		      ClientData *objects, ClientData **objPtrPtr));
+static int        StatsCmd _ANSI_ARGS_((Tcl_Interp *interp,
+		      CkWindow *winPtr, int argc, char **argv));
+static void       ReleaseInterp _ANSI_ARGS_((ClientData clientData));
 static char *     WaitVariableProc _ANSI_ARGS_((ClientData clientData,
 		      Tcl_Interp *interp, char *name1, char *name2,
                       int flags));
@@ -91,6 +127,7 @@ Ck_ExitCmd(clientData, interp, argc, argv)
     char **argv;		/* Argument strings. */
 {
     extern CkMainInfo *ckMainInfo;
+    CkMainInfo *mainPtr;
     int index = 1, noclear = 0, value = 0;
 
     if (argc > 3) {
@@ -107,14 +144,40 @@ Ck_ExitCmd(clientData, interp, argc, argv)
 	return TCL_ERROR;
     }
 
-    if (ckMainInfo != NULL) {
+    for (mainPtr = ckMainInfo; mainPtr != NULL; mainPtr = mainPtr->nextPtr) {
+	if (mainPtr->winPtr == (CkWindow *) clientData)
+	    break;
+    }
+    if (mainPtr != NULL) {
 	if (noclear) {
-	    ckMainInfo->flags |= CK_NOCLR_ON_EXIT;
+	    mainPtr->flags |= CK_NOCLR_ON_EXIT;
 	} else {
-	    ckMainInfo->flags &= ~CK_NOCLR_ON_EXIT;
+	    mainPtr->flags &= ~CK_NOCLR_ON_EXIT;
+	}
+
+	/*
+	 * Exiting from an interpreter which drives its own terminal
+	 * (see "curses newterm") only deletes that interpreter, which
+	 * closes the terminal. Since we may be called from a binding,
+	 * the real work is deferred until the event has been handled.
+	 */
+
+	if (mainPtr->flags & CK_NEWTERM) {
+	    Tcl_Preserve((ClientData) interp);
+	    Tcl_DeleteInterp(interp);
+	    Tk_DoWhenIdle(ReleaseInterp, (ClientData) interp);
+	    return TCL_OK;
 	}
 	Ck_DestroyWindow((CkWindow *) clientData);
     }
+
+    /*
+     * Restore all other terminals before the process goes away.
+     */
+
+    while (ckMainInfo != NULL) {
+	Ck_DestroyWindow(ckMainInfo->winPtr);
+    }
     endwin();	/* just in case */
 #if (TCL_MAJOR_VERSION >= 8)
     Tcl_Exit(value);
@@ -254,6 +317,7 @@ Ck_BellCmd(clientData, interp, argc, argv)
     int argc;			/* Number of arguments. */
     char **argv;		/* Argument strings. */
 {
+    CkSetTerm(((CkWindow *) clientData)->mainPtr);
     beep();
     doupdate();
     return TCL_OK;
@@ -291,6 +355,7 @@ Ck_UpdateCmd(clientData, interp, argc, argv)
 	flags = TK_DONT_WAIT;
     else if (argc == 2) {
 	if (strncmp(argv[1], "screen", strlen(argv[1])) == 0) {
+	    CkSetTerm(mainPtr->mainPtr);
             wrefresh(curscr);
 	    Ck_EventuallyRefresh(mainPtr);
 	    return TCL_OK;
@@ -360,6 +425,7 @@ Ck_CursesCmd(clientData, interp, argc, argv)
 	    argv[0], " option ?arg?\"", (char *) NULL);
 	return TCL_ERROR;
     }
+    CkSetTerm(mainPtr);
     c = argv[1][0];
     length = strlen(argv[1]);
     if ((c == 'b') && (strncmp(argv[1], "barcode", length) == 0)) {
@@ -406,7 +472,8 @@ Ck_CursesCmd(clientData, interp, argc, argv)
 		" ", argv[1], " charName ?value?\"", (char *) NULL);
 	    return TCL_ERROR;
         }
-    } else if ((c == 'h') && (strncmp(argv[1], "haskey", length) == 0)) {
+    } else if ((c == 'h') && (strncmp(argv[1], "haskey", length) == 0)
+	&& (length >= 2)) {
 	if (argc > 3) {
 	    Tcl_AppendResult(interp, "wrong # args: should be \"",
 		argv[0], " haskey ?keySym?\"", (char *) NULL);
@@ -415,7 +482,49 @@ Ck_CursesCmd(clientData, interp, argc, argv)
 	if (argc == 2)
 	    return CkAllKeyNames(interp);
 	return CkTermHasKey(interp, argv[2]);
-    } else if ((c == 'p') && (strncmp(argv[1], "purgeinput", length) == 0)) {
+    } else if ((c == 'h') && (strncmp(argv[1], "headless", length) == 0)
+	&& (length >= 2)) {
+	return CkHeadlessCmd(clientData, interp, argc, argv);
+    } else if ((c == 'n') && (strncmp(argv[1], "newterm", length) == 0)) {
+	Tcl_Interp *slave;
+	char *argv0;
+
+	if (argc != 4 && argc != 5) {
+	    Tcl_AppendResult(interp, "wrong # args: must be \"", argv[0],
+		" ", argv[1], " interpName device ?termType?\"",
+		(char *) NULL);
+	    return TCL_ERROR;
+	}
+	slave = Tcl_CreateSlave(interp, argv[2], 0);
+	if (slave == NULL) {
+	    if (*Tcl_GetStringResult(interp) == '\0') {
+		Tcl_AppendResult(interp, "couldn't create interpreter \"",
+		    argv[2], "\"", (char *) NULL);
+	    }
+	    return TCL_ERROR;
+	}
+	argv0 = Tcl_GetVar(interp, "argv0", TCL_GLOBAL_ONLY);
+	if (argv0 != NULL) {
+	    Tcl_SetVar(slave, "argv0", argv0, TCL_GLOBAL_ONLY);
+	}
+	if (Tcl_Init(slave) != TCL_OK ||
+	    Ck_InitTerminal(slave, argv[3], (argc > 4) ? argv[4] : NULL)
+	    != TCL_OK) {
+	    Tcl_AppendResult(interp, Tcl_GetStringResult(slave),
+		(char *) NULL);
+	    Tcl_DeleteInterp(slave);
+	    return TCL_ERROR;
+	}
+	Tcl_AppendResult(interp, argv[2], (char *) NULL);
+	return TCL_OK;
+    } else if ((c == 'p') && (strncmp(argv[1], "paste", length) == 0)
+	&& (length >= 3)) {
+	return CkPasteCmd(clientData, interp, argc, argv);
+    } else if ((c == 'p') && (strncmp(argv[1], "profile", length) == 0)
+	&& (length >= 2)) {
+	return CkProfileCmd(clientData, interp, argc, argv);
+    } else if ((c == 'p') && (strncmp(argv[1], "purgeinput", length) == 0)
+	&& (length >= 2)) {
 	if (argc != 2) {
 	    Tcl_AppendResult(interp, "wrong # args: should be \"",
 		argv[0], " purgeinput\"", (char *) NULL);
@@ -425,6 +534,26 @@ Ck_CursesCmd(clientData, interp, argc, argv)
 	    /* Empty loop body. */
 	}
 	return TCL_OK;
+    } else if ((c == 'p') && (strncmp(argv[1], "pairstats", length) == 0)
+	&& (length >= 2)) {
+	char buf[128];
+
+	if (argc == 3 && strcmp(argv[2], "reset") == 0) {
+	    mainPtr->stats.pairLookups = 0;
+	    mainPtr->stats.pairAllocs = 0;
+	    mainPtr->stats.pairEvictions = 0;
+	    mainPtr->stats.pairForced = 0;
+	    return TCL_OK;
+	} else if (argc != 2) {
+	    Tcl_AppendResult(interp, "wrong # args: must be \"", argv[0],
+		" ", argv[1], " ?reset?\"", (char *) NULL);
+	    return TCL_ERROR;
+	}
+	sprintf(buf, "lookups %d allocs %d evictions %d forced %d",
+	    mainPtr->stats.pairLookups, mainPtr->stats.pairAllocs,
+	    mainPtr->stats.pairEvictions, mainPtr->stats.pairForced);
+	Tcl_AppendResult(interp, buf, (char *) NULL);
+	return TCL_OK;
     } else if ((c == 'r') && (strncmp(argv[1], "refreshdelay", length) == 0)) {
 	if (argc == 2) {
 	    char buf[32];
@@ -444,6 +573,26 @@ Ck_CursesCmd(clientData, interp, argc, argv)
 		" ", argv[1], " ?milliseconds?\"", (char *) NULL);
 	    return TCL_ERROR;
 	}
+    } else if ((c == 'r') && (strncmp(argv[1], "refreshstats", length)
+	== 0)) {
+	char buf[128];
+
+	if (argc == 3 && strcmp(argv[2], "reset") == 0) {
+	    mainPtr->stats.refreshWinsTouched = 0;
+	    mainPtr->stats.refreshWinsSkipped = 0;
+	    mainPtr->stats.refreshFullCount = 0;
+	    mainPtr->stats.refreshLinesScrolled = 0;
+	    return TCL_OK;
+	} else if (argc != 2) {
+	    Tcl_AppendResult(interp, "wrong # args: must be \"", argv[0],
+		" ", argv[1], " ?reset?\"", (char *) NULL);
+	    return TCL_ERROR;
+	}
+	sprintf(buf, "touched %d skipped %d full %d scrolled %d",
+	    mainPtr->stats.refreshWinsTouched, mainPtr->stats.refreshWinsSkipped,
+	    mainPtr->stats.refreshFullCount, mainPtr->stats.refreshLinesScrolled);
+	Tcl_AppendResult(interp, buf, (char *) NULL);
+	return TCL_OK;
     } else if ((c == 'r') && (strncmp(argv[1], "reversekludge", length)
         == 0)) {
 	int onoff;
@@ -490,12 +639,25 @@ Ck_CursesCmd(clientData, interp, argc, argv)
         Tcl_SetResult(interp, "screen dump not supported by this curses", TCL_STATIC);
 	return TCL_ERROR;
 #endif
+    } else if ((c == 's') && (strncmp(argv[1], "stats", length) == 0)
+	&& (length >= 2)) {
+	return StatsCmd(interp, winPtr, argc, argv);
     } else if ((c == 's') && (strncmp(argv[1], "suspend", length) == 0)) {
 	if (argc != 2) {
 	    Tcl_AppendResult(interp, "wrong # args: must be \"", argv[0],
 		" ", argv[1], "\"", (char *) NULL);
 	    return TCL_ERROR;
 	}
+	if (mainPtr->flags & CK_NEWTERM) {
+	    Tcl_AppendResult(interp, "can't suspend a terminal opened ",
+		"by \"curses newterm\"", (char *) NULL);
+	    return TCL_ERROR;
+	}
+	if (mainPtr->flags & CK_HEADLESS) {
+	    Tcl_AppendResult(interp, "can't suspend a headless terminal",
+		(char *) NULL);
+	    return TCL_ERROR;
+	}
 #ifndef __WIN32__
 	curs_set(1);
 	endwin();
@@ -509,13 +671,203 @@ Ck_CursesCmd(clientData, interp, argc, argv)
     } else {
 	Tcl_AppendResult(interp, "bad option \"", argv[1],
 	    "\": must be barcode, baudrate, encoding, gchar, haskey, ",
-	    "purgeinput, refreshdelay, reversekludge, screendump or suspend",
+	    "headless, newterm, pairstats, paste, profile, purgeinput, ",
+	    "refreshdelay, refreshstats, reversekludge, screendump, stats ",
+	    "or suspend",
 	    (char *) NULL);
 	return TCL_ERROR;
     }
     return TCL_OK;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * StatsCmd --
+ *
+ *	This procedure is invoked to process the "curses stats"
+ *	command.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	The counters may be reset or timing may be turned on or off.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+StatsCmd(interp, winPtr, argc, argv)
+    Tcl_Interp *interp;		/* Current interpreter. */
+    CkWindow *winPtr;		/* Main window of interpreter. */
+    int argc;			/* Number of arguments. */
+    char **argv;		/* Argument strings. */
+{
+    Ck_Stats stats;
+    Tcl_DString list;
+    char buf[64];
+    int i, onoff;
+
+    if (argc == 3 && strcmp(argv[2], "reset") == 0) {
+	Ck_ResetStats(winPtr);
+	return TCL_OK;
+    } else if ((argc == 3 || argc == 4) && strcmp(argv[2], "timing") == 0) {
+	if (argc == 4) {
+	    if (Tcl_GetBoolean(interp, argv[3], &onoff) != TCL_OK)
+		return TCL_ERROR;
+	    ckStatsTiming = onoff;
+	}
+	Tcl_SetResult(interp, ckStatsTiming ? "1" : "0", TCL_STATIC);
+	return TCL_OK;
+    } else if (argc != 2) {
+	Tcl_AppendResult(interp, "wrong # args: must be \"", argv[0],
+	    " ", argv[1], " ?reset?\" or \"", argv[0], " ", argv[1],
+	    " timing ?boolean?\"", (char *) NULL);
+	return TCL_ERROR;
+    }
+
+    Ck_GetStats(winPtr, &stats);
+    Tcl_DStringInit(&list);
+    sprintf(buf, "refreshrequests %d refreshes %d coalesced %d",
+	stats.refreshRequests, stats.refreshes,
+	stats.refreshRequests - stats.refreshes);
+    Tcl_DStringAppend(&list, buf, -1);
+    sprintf(buf, " full %d touched %d skipped %d perrefresh %.1f",
+	stats.refreshFullCount, stats.refreshWinsTouched,
+	stats.refreshWinsSkipped, stats.refreshes > 0 ?
+	(double) stats.refreshWinsTouched / stats.refreshes : 0.0);
+    Tcl_DStringAppend(&list, buf, -1);
+    sprintf(buf, " scrolled %d lines %d", stats.refreshLinesScrolled,
+	stats.refreshLines);
+    Tcl_DStringAppend(&list, buf, -1);
+    Tcl_DStringAppendElement(&list, "pairs");
+    sprintf(buf, "lookups %d allocs %d evictions %d forced %d",
+	stats.pairLookups, stats.pairAllocs, stats.pairEvictions,
+	stats.pairForced);
+    Tcl_DStringAppendElement(&list, buf);
+    Tcl_DStringAppendElement(&list, "events");
+    Tcl_DStringStartSublist(&list);
+    for (i = 0; i < CK_STATS_EVENT_TYPES; i++) {
+	if (statsEventNames[i] != NULL) {
+	    Tcl_DStringAppendElement(&list, statsEventNames[i]);
+	    sprintf(buf, "%d", stats.events[i]);
+	    Tcl_DStringAppendElement(&list, buf);
+	}
+    }
+    Tcl_DStringEndSublist(&list);
+    sprintf(buf, " bindings %d", stats.bindScripts);
+    Tcl_DStringAppend(&list, buf, -1);
+    if (stats.idleHandlers >= 0) {
+	sprintf(buf, " idle %d timers %d", stats.idleHandlers,
+	    stats.timerHandlers);
+	Tcl_DStringAppend(&list, buf, -1);
+    }
+    Tcl_DStringAppendElement(&list, "time");
+    Tcl_DStringStartSublist(&list);
+    for (i = 0; i < CK_STATS_PHASES; i++) {
+	if (i >= CK_STATS_TIMERS && stats.idleHandlers < 0)
+	    break;
+	Tcl_DStringAppendElement(&list, statsPhaseNames[i]);
+	sprintf(buf, "%.0f", stats.phaseTime[i]);
+	Tcl_DStringAppendElement(&list, buf);
+    }
+    Tcl_DStringEndSublist(&list);
+    Tcl_DStringResult(interp, &list);
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Ck_GetStats --
+ *
+ *	Retrieve the counters of "curses stats" for the terminal
+ *	of a window.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The counters are stored in *statsPtr.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+Ck_GetStats(winPtr, statsPtr)
+    CkWindow *winPtr;		/* Any window of the terminal. */
+    Ck_Stats *statsPtr;		/* Where to store counters. */
+{
+    *statsPtr = winPtr->mainPtr->stats;
+#if (TCL_MAJOR_VERSION == 7) && (TCL_MINOR_VERSION <= 4)
+    TkEventStats(statsPtr, 0);
+#else
+    statsPtr->idleHandlers = statsPtr->timerHandlers = -1;
+#endif
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Ck_ResetStats --
+ *
+ *	Set the counters of "curses stats" for the terminal of a
+ *	window to zero.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	See above.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+Ck_ResetStats(winPtr)
+    CkWindow *winPtr;		/* Any window of the terminal. */
+{
+    memset((char *) &winPtr->mainPtr->stats, 0, sizeof (Ck_Stats));
+#if (TCL_MAJOR_VERSION == 7) && (TCL_MINOR_VERSION <= 4)
+    TkEventStats((Ck_Stats *) NULL, 1);
+#endif
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CkStatsClock --
+ *
+ *	Read the clock used to measure the phases of event
+ *	processing.
+ *
+ * Results:
+ *	The current time in microseconds.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+double
+CkStatsClock()
+{
+#if (TCL_MAJOR_VERSION == 7) && (TCL_MINOR_VERSION <= 4)
+    struct timeval tv;
+
+    gettimeofday(&tv, (struct timezone *) NULL);
+    return tv.tv_sec * 1000000.0 + tv.tv_usec;
+#else
+    Tcl_Time tv;
+    extern void TclpGetTime _ANSI_ARGS_((Tcl_Time *timePtr));
+
+    TclpGetTime(&tv);
+    return tv.sec * 1000000.0 + tv.usec;
+#endif
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -785,38 +1137,37 @@ Ck_BindCmd(clientData, interp, argc, argv)
 /*
  *----------------------------------------------------------------------
  *
- * CkBindEventProc --
+ * GetBindObjects --
  *
- *	This procedure is invoked by Ck_HandleEvent for each event;  it
- *	causes any appropriate bindings for that event to be invoked.
+ *	Compute the objects whose bindings apply to events in a
+ *	window, i.e. the window's binding tags.
  *
  * Results:
- *	None.
+ *	The number of objects.  They are stored at objects, if there
+ *	is room for them, else in malloc-ed memory.  *objPtrPtr is
+ *	set to the array used.
  *
  * Side effects:
- *	Depends on what bindings have been established with the "bind"
- *	command.
+ *	None.
  *
  *----------------------------------------------------------------------
  */
 
-void
-CkBindEventProc(winPtr, eventPtr)
+#define MAX_OBJS 20
+
+static int
+GetBindObjects(winPtr, objects, objPtrPtr)
     CkWindow *winPtr;			/* Pointer to info about window. */
-    CkEvent *eventPtr;			/* Information about event. */
+    ClientData *objects;		/* Space for MAX_OBJS objects. */
+    ClientData **objPtrPtr;		/* Store pointer to objects here. */
 {
-#define MAX_OBJS 20
-    ClientData objects[MAX_OBJS], *objPtr;
     static Ck_Uid allUid = NULL;
+    ClientData *objPtr;
     int i, count;
     char *p;
     Tcl_HashEntry *hPtr;
     CkWindow *topLevPtr;
 
-    if ((winPtr->mainPtr == NULL) || (winPtr->mainPtr->bindingTable == NULL)) {
-	return;
-    }
-
     objPtr = objects;
     if (winPtr->numTags != 0) {
 	/*
@@ -859,13 +1210,88 @@ CkBindEventProc(winPtr, eventPtr)
 	}
 	objPtr[count - 1] = (ClientData) allUid;
     }
+    *objPtrPtr = objPtr;
+    return count;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CkBindEventProc --
+ *
+ *	This procedure is invoked by Ck_HandleEvent for each event;  it
+ *	causes any appropriate bindings for that event to be invoked.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Depends on what bindings have been established with the "bind"
+ *	command.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+CkBindEventProc(winPtr, eventPtr)
+    CkWindow *winPtr;			/* Pointer to info about window. */
+    CkEvent *eventPtr;			/* Information about event. */
+{
+    ClientData objects[MAX_OBJS], *objPtr;
+    int count;
+
+    if ((winPtr->mainPtr == NULL) || (winPtr->mainPtr->bindingTable == NULL)) {
+	return;
+    }
+
+    count = GetBindObjects(winPtr, objects, &objPtr);
     Ck_BindEvent(winPtr->mainPtr->bindingTable, eventPtr, winPtr,
 	    count, objPtr);
     if (objPtr != objects) {
 	ckfree((char *) objPtr);
     }
 }
-
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CkHasBinding --
+ *
+ *	Find out whether an event type with the given detail (e.g.
+ *	Paste with detail 0, or a specific key) is bound for any of
+ *	the binding tags of a window.
+ *
+ * Results:
+ *	1 if so, 0 otherwise.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+CkHasBinding(winPtr, eventType, detail)
+    CkWindow *winPtr;			/* Pointer to info about window. */
+    int eventType;			/* Type of event. */
+    int detail;				/* Keycode or button, 0 if none. */
+{
+    ClientData objects[MAX_OBJS], *objPtr;
+    int count, result;
+
+    if ((winPtr->mainPtr == NULL) || (winPtr->mainPtr->bindingTable == NULL)) {
+	return 0;
+    }
+
+    count = GetBindObjects(winPtr, objects, &objPtr);
+    result = CkBindingExists(winPtr->mainPtr->bindingTable, eventType,
+	    detail, count, objPtr);
+    if (objPtr != objects) {
+	ckfree((char *) objPtr);
+    }
+    return result;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -1098,6 +1524,13 @@ Ck_TkwaitCmd(clientData, interp, argc, argv)
     return TCL_OK;
 }
 
+static void
+ReleaseInterp(clientData)
+    ClientData clientData;	/* Interpreter deleted by "exit". */
+{
+    Tcl_Release(clientData);
+}
+
 static char *
 WaitVariableProc(clientData, interp, name1, name2, flags)
     ClientData clientData;	/* Pointer to integer to set to 1. */
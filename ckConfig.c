@@ -26,6 +26,44 @@
 
 #define INIT		0x20
 
+/*
+ * Each table of configuration specs is compiled on first use into
+ * a SpecIndex for every combination of need and hate flags it is
+ * used with (the hate flags depend on whether the screen has colors).
+ * The index maps each option name and each of its unambiguous
+ * abbreviations to the spec it selects, with synonyms resolved, so
+ * that options are found by a single hash lookup.  It also keeps
+ * the parsed form of default values:  the first widget created
+ * converts the default string, later widgets copy the result.
+ */
+
+typedef struct ParsedDefault {
+    int size;			/* Number of bytes in value;  0 if the
+				 * default hasn't been converted yet, -1
+				 * if it must always go through DoConfig. */
+    union {
+	int intValue;
+	double doubleValue;
+	Ck_Justify justify;
+	Ck_Anchor anchor;
+	Ck_Uid uid;
+    } value;			/* Converted default value. */
+} ParsedDefault;
+
+typedef struct SpecIndex {
+    Ck_ConfigSpec *specs;	/* Table this index was built for. */
+    int needFlags, hateFlags;	/* Flags the index was built with. */
+    Tcl_HashTable nameTable;	/* Maps option names and abbreviations
+				 * to (Ck_ConfigSpec *). */
+    ParsedDefault *defaults;	/* One entry per spec of table. */
+    struct SpecIndex *nextPtr;	/* Next index for same table but other
+				 * flags, or NULL. */
+} SpecIndex;
+
+static Tcl_HashTable specIndexTable;	/* Maps spec tables to first
+					 * SpecIndex for them. */
+static int initialized = 0;		/* specIndexTable initialized. */
+
 /*
  * Forward declarations for procedures defined later in this file:
  */
@@ -34,8 +72,7 @@ static int		DoConfig _ANSI_ARGS_((Tcl_Interp *interp,
 			    CkWindow *winPtr, Ck_ConfigSpec *specPtr,
 			    Ck_Uid value, int valueIsUid, char *widgRec));
 static Ck_ConfigSpec *	FindConfigSpec _ANSI_ARGS_ ((Tcl_Interp *interp,
-			    Ck_ConfigSpec *specs, char *argvName,
-			    int needFlags, int hateFlags));
+			    SpecIndex *indexPtr, char *argvName));
 static char *		FormatConfigInfo _ANSI_ARGS_ ((Tcl_Interp *interp,
 			    CkWindow *winPtr, Ck_ConfigSpec *specPtr,
 			    char *widgRec));
@@ -43,7 +80,14 @@ static char *           FormatConfigValue _ANSI_ARGS_((Tcl_Interp *interp,
                             CkWindow *tkwin, Ck_ConfigSpec *specPtr,
                             char *widgRec, char *buffer,
                             Tcl_FreeProc **freeProcPtr));
-
+static SpecIndex *	GetSpecIndex _ANSI_ARGS_((Ck_ConfigSpec *specs,
+			    int needFlags, int hateFlags));
+static Ck_ConfigSpec *	MatchConfigSpec _ANSI_ARGS_((Ck_ConfigSpec *specs,
+			    char *argvName, int needFlags, int hateFlags,
+			    char **errorPtr));
+static void		SaveDefault _ANSI_ARGS_((Ck_ConfigSpec *specPtr,
+			    char *widgRec, ParsedDefault *defPtr));
+
 /*
  *--------------------------------------------------------------
  *
@@ -85,6 +129,8 @@ Ck_ConfigureWidget(interp, winPtr, specs, argc, argv, widgRec, flags)
 				 * or else they are not considered. */
     int hateFlags;		/* If a spec contains any bits here, it's
 				 * not considered. */
+    SpecIndex *indexPtr;
+    ParsedDefault *defPtr;
 
     needFlags = flags & ~(CK_CONFIG_USER_BIT - 1);
     if (!(winPtr->mainPtr->flags & CK_HAS_COLOR)) {
@@ -94,25 +140,14 @@ Ck_ConfigureWidget(interp, winPtr, specs, argc, argv, widgRec, flags)
     }
 
     /*
-     * Pass one:  scan through all the option specs, replacing strings
-     * with Ck_Uids (if this hasn't been done already) and clearing
+     * Pass one:  get the index of the option specs (this replaces
+     * strings with Ck_Uids if it hasn't been done already) and clear
      * the CK_CONFIG_OPTION_SPECIFIED flags.
      */
 
+    indexPtr = GetSpecIndex(specs, needFlags, hateFlags);
     for (specPtr = specs; specPtr->type != CK_CONFIG_END; specPtr++) {
-	if (!(specPtr->specFlags & INIT) && (specPtr->argvName != NULL)) {
-	    if (specPtr->dbName != NULL) {
-		specPtr->dbName = Ck_GetUid(specPtr->dbName);
-	    }
-	    if (specPtr->dbClass != NULL) {
-		specPtr->dbClass = Ck_GetUid(specPtr->dbClass);
-	    }
-	    if (specPtr->defValue != NULL) {
-		specPtr->defValue = Ck_GetUid(specPtr->defValue);
-	    }
-	}
-	specPtr->specFlags = (specPtr->specFlags & ~CK_CONFIG_OPTION_SPECIFIED)
-		| INIT;
+	specPtr->specFlags &= ~CK_CONFIG_OPTION_SPECIFIED;
     }
 
     /*
@@ -121,7 +156,7 @@ Ck_ConfigureWidget(interp, winPtr, specs, argc, argv, widgRec, flags)
      */
 
     for ( ; argc > 0; argc -= 2, argv += 2) {
-	specPtr = FindConfigSpec(interp, specs, *argv, needFlags, hateFlags);
+	specPtr = FindConfigSpec(interp, indexPtr, *argv);
 	if (specPtr == NULL) {
 	    return TCL_ERROR;
 	}
@@ -150,7 +185,8 @@ Ck_ConfigureWidget(interp, winPtr, specs, argc, argv, widgRec, flags)
      * Pass three:  scan through all of the specs again;  if no
      * command-line argument matched a spec, then check for info
      * in the option database.  If there was nothing in the
-     * database, then use the default.
+     * database, then use the default, copying its converted
+     * value when a previous widget already converted it.
      */
 
     if (!(flags & CK_CONFIG_ARGV_ONLY)) {
@@ -184,6 +220,12 @@ Ck_ConfigureWidget(interp, winPtr, specs, argc, argv, widgRec, flags)
 		value = specPtr->defValue;
 		if ((value != NULL) && !(specPtr->specFlags
 			& CK_CONFIG_DONT_SET_DEFAULT)) {
+		    defPtr = &indexPtr->defaults[specPtr - specs];
+		    if (defPtr->size > 0) {
+			memcpy(widgRec + specPtr->offset,
+			    (char *) &defPtr->value, defPtr->size);
+			continue;
+		    }
 		    if (DoConfig(interp, winPtr, specPtr, value, 1, widgRec) !=
 			    TCL_OK) {
 			char msg[200];
@@ -195,6 +237,9 @@ Ck_ConfigureWidget(interp, winPtr, specs, argc, argv, widgRec, flags)
 			Tcl_AddErrorInfo(interp, msg);
 			return TCL_ERROR;
 		    }
+		    if (defPtr->size == 0) {
+			SaveDefault(specPtr, widgRec, defPtr);
+		    }
 		}
 	    }
 	}
@@ -202,13 +247,134 @@ Ck_ConfigureWidget(interp, winPtr, specs, argc, argv, widgRec, flags)
     return TCL_OK;
 }
 
+/*
+ *--------------------------------------------------------------
+ *
+ * GetSpecIndex --
+ *
+ *	Return the index of a table of configuration specs for
+ *	the given flags, building it if this is the first time
+ *	the table is used with these flags.
+ *
+ * Results:
+ *	The return value is a pointer to the index.
+ *
+ * Side effects:
+ *	The first time a table is used, its strings are replaced
+ *	with Ck_Uids.  Memory for the index is allocated and kept
+ *	for the lifetime of the process.
+ *
+ *--------------------------------------------------------------
+ */
+
+static SpecIndex *
+GetSpecIndex(specs, needFlags, hateFlags)
+    Ck_ConfigSpec *specs;	/* Pointer to table of configuration
+				 * specifications for a widget. */
+    int needFlags;		/* Flags that must be present in
+				 * considered entries. */
+    int hateFlags;		/* Flags that must NOT be present in
+				 * considered entries. */
+{
+    Tcl_HashEntry *hPtr;
+    SpecIndex *indexPtr;
+    Ck_ConfigSpec *specPtr, *matchPtr;
+    Tcl_DString prefix;
+    char *errorMsg;
+    int new, length, numSpecs;
+
+    if (!initialized) {
+	Tcl_InitHashTable(&specIndexTable, TCL_ONE_WORD_KEYS);
+	initialized = 1;
+    }
+    hPtr = Tcl_CreateHashEntry(&specIndexTable, (char *) specs, &new);
+    if (!new) {
+	for (indexPtr = (SpecIndex *) Tcl_GetHashValue(hPtr);
+	    indexPtr != NULL; indexPtr = indexPtr->nextPtr) {
+	    if (indexPtr->needFlags == needFlags &&
+		indexPtr->hateFlags == hateFlags) {
+		return indexPtr;
+	    }
+	}
+    }
+
+    /*
+     * Replace strings with Ck_Uids (if this hasn't been done already),
+     * since synonyms are resolved by comparing database names.
+     */
+
+    for (specPtr = specs; specPtr->type != CK_CONFIG_END; specPtr++) {
+	if (!(specPtr->specFlags & INIT) && (specPtr->argvName != NULL)) {
+	    if (specPtr->dbName != NULL) {
+		specPtr->dbName = Ck_GetUid(specPtr->dbName);
+	    }
+	    if (specPtr->dbClass != NULL) {
+		specPtr->dbClass = Ck_GetUid(specPtr->dbClass);
+	    }
+	    if (specPtr->defValue != NULL) {
+		specPtr->defValue = Ck_GetUid(specPtr->defValue);
+	    }
+	}
+	specPtr->specFlags |= INIT;
+    }
+    numSpecs = specPtr - specs;
+
+    indexPtr = (SpecIndex *) ckalloc(sizeof (SpecIndex));
+    indexPtr->specs = specs;
+    indexPtr->needFlags = needFlags;
+    indexPtr->hateFlags = hateFlags;
+    Tcl_InitHashTable(&indexPtr->nameTable, TCL_STRING_KEYS);
+    indexPtr->defaults = (ParsedDefault *)
+	ckalloc(numSpecs * sizeof (ParsedDefault) + 1);
+    memset((char *) indexPtr->defaults, 0,
+	numSpecs * sizeof (ParsedDefault));
+    indexPtr->nextPtr = new ? NULL : (SpecIndex *) Tcl_GetHashValue(hPtr);
+    Tcl_SetHashValue(hPtr, (ClientData) indexPtr);
+
+    /*
+     * Enter every name and every abbreviation of it.  What an
+     * abbreviation selects is decided by MatchConfigSpec, so the
+     * index gives exactly the results of a search of the table;
+     * abbreviations which are ambiguous are left out.
+     */
+
+    Tcl_DStringInit(&prefix);
+    for (specPtr = specs; specPtr->type != CK_CONFIG_END; specPtr++) {
+	if (specPtr->argvName == NULL) {
+	    continue;
+	}
+	if (((specPtr->specFlags & needFlags) != needFlags)
+		|| (specPtr->specFlags & hateFlags)) {
+	    continue;
+	}
+	for (length = strlen(specPtr->argvName); length > 1; length--) {
+	    Tcl_DStringSetLength(&prefix, 0);
+	    Tcl_DStringAppend(&prefix, specPtr->argvName, length);
+	    hPtr = Tcl_CreateHashEntry(&indexPtr->nameTable,
+		Tcl_DStringValue(&prefix), &new);
+	    if (!new) {
+		continue;
+	    }
+	    matchPtr = MatchConfigSpec(specs, Tcl_DStringValue(&prefix),
+		needFlags, hateFlags, &errorMsg);
+	    if (matchPtr == NULL) {
+		Tcl_DeleteHashEntry(hPtr);
+	    } else {
+		Tcl_SetHashValue(hPtr, (ClientData) matchPtr);
+	    }
+	}
+    }
+    Tcl_DStringFree(&prefix);
+    return indexPtr;
+}
+
 /*
  *--------------------------------------------------------------
  *
  * FindConfigSpec --
  *
- *	Search through a table of configuration specs, looking for
- *	one that matches a given argvName.
+ *	Look up the configuration spec that matches a given
+ *	argvName in the index of a table of specs.
  *
  * Results:
  *	The return value is a pointer to the matching entry, or NULL
@@ -222,8 +388,56 @@ Ck_ConfigureWidget(interp, winPtr, specs, argc, argv, widgRec, flags)
  */
 
 static Ck_ConfigSpec *
-FindConfigSpec(interp, specs, argvName, needFlags, hateFlags)
+FindConfigSpec(interp, indexPtr, argvName)
     Tcl_Interp *interp;		/* Used for reporting errors. */
+    SpecIndex *indexPtr;	/* Index of table of configuration
+				 * specifications for a widget. */
+    char *argvName;		/* Name (suitable for use in a "config"
+				 * command) identifying particular option. */
+{
+    Tcl_HashEntry *hPtr;
+    Ck_ConfigSpec *specPtr;
+    char *errorMsg;
+
+    hPtr = Tcl_FindHashEntry(&indexPtr->nameTable, argvName);
+    if (hPtr != NULL) {
+	return (Ck_ConfigSpec *) Tcl_GetHashValue(hPtr);
+    }
+
+    /*
+     * Not in the index, so it's an error;  search the table to
+     * find out which one.
+     */
+
+    specPtr = MatchConfigSpec(indexPtr->specs, argvName,
+	indexPtr->needFlags, indexPtr->hateFlags, &errorMsg);
+    if (specPtr == NULL) {
+	Tcl_AppendResult(interp, errorMsg, argvName, "\"", (char *) NULL);
+    }
+    return specPtr;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * MatchConfigSpec --
+ *
+ *	Search through a table of configuration specs, looking for
+ *	one that matches a given argvName.
+ *
+ * Results:
+ *	The return value is a pointer to the matching entry, or NULL
+ *	if nothing matched.  In that case *errorPtr is set to the
+ *	start of an error message, to be followed by argvName.
+ *
+ * Side effects:
+ *	None.
+ *
+ *--------------------------------------------------------------
+ */
+
+static Ck_ConfigSpec *
+MatchConfigSpec(specs, argvName, needFlags, hateFlags, errorPtr)
     Ck_ConfigSpec *specs;	/* Pointer to table of configuration
 				 * specifications for a widget. */
     char *argvName;		/* Name (suitable for use in a "config"
@@ -232,6 +446,7 @@ FindConfigSpec(interp, specs, argvName, needFlags, hateFlags)
 				 * entry. */
     int hateFlags;		/* Flags that must NOT be present in
 				 * matching entry. */
+    char **errorPtr;		/* Error message is returned here. */
 {
     Ck_ConfigSpec *specPtr;
     char c;			/* First character of current argument. */
@@ -258,16 +473,14 @@ FindConfigSpec(interp, specs, argvName, needFlags, hateFlags)
 	    goto gotMatch;
 	}
 	if (matchPtr != NULL) {
-	    Tcl_AppendResult(interp, "ambiguous option \"", argvName,
-		    "\"", (char *) NULL);
+	    *errorPtr = "ambiguous option \"";
 	    return (Ck_ConfigSpec *) NULL;
 	}
 	matchPtr = specPtr;
     }
 
     if (matchPtr == NULL) {
-	Tcl_AppendResult(interp, "unknown option \"", argvName,
-		"\"", (char *) NULL);
+	*errorPtr = "unknown option \"";
 	return (Ck_ConfigSpec *) NULL;
     }
 
@@ -281,9 +494,7 @@ FindConfigSpec(interp, specs, argvName, needFlags, hateFlags)
     if (specPtr->type == CK_CONFIG_SYNONYM) {
 	for (specPtr = specs; ; specPtr++) {
 	    if (specPtr->type == CK_CONFIG_END) {
-		Tcl_AppendResult(interp,
-			"couldn't find synonym for option \"",
-			argvName, "\"", (char *) NULL);
+		*errorPtr = "couldn't find synonym for option \"";
 		return (Ck_ConfigSpec *) NULL;
 	    }
 	    if ((specPtr->dbName == matchPtr->dbName)
@@ -296,7 +507,68 @@ FindConfigSpec(interp, specs, argvName, needFlags, hateFlags)
     }
     return specPtr;
 }
-
+
+/*
+ *--------------------------------------------------------------
+ *
+ * SaveDefault --
+ *
+ *	Remember the converted default value of a spec after
+ *	DoConfig has stored it in a widget record, so that it can
+ *	be copied into the records of further widgets.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	*defPtr is filled in.  Values which own resources (strings,
+ *	borders), depend on the widget (windows, custom options), or
+ *	set a group of fields are marked to always use DoConfig.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+SaveDefault(specPtr, widgRec, defPtr)
+    Ck_ConfigSpec *specPtr;	/* Spec whose default was applied. */
+    char *widgRec;		/* Record holding converted default. */
+    ParsedDefault *defPtr;	/* Where to save it. */
+{
+    int size;
+
+    switch (specPtr->type) {
+	case CK_CONFIG_BOOLEAN:
+	case CK_CONFIG_INT:
+	case CK_CONFIG_COLOR:
+	case CK_CONFIG_COORD:
+	case CK_CONFIG_ATTR:
+	    size = sizeof (int);
+	    break;
+	case CK_CONFIG_DOUBLE:
+	    size = sizeof (double);
+	    break;
+	case CK_CONFIG_UID:
+	    size = sizeof (Ck_Uid);
+	    break;
+	case CK_CONFIG_JUSTIFY:
+	    size = sizeof (Ck_Justify);
+	    break;
+	case CK_CONFIG_ANCHOR:
+	    size = sizeof (Ck_Anchor);
+	    break;
+	default:
+	    size = -1;
+	    break;
+    }
+    if ((specPtr[1].argvName == NULL) && (specPtr[1].type != CK_CONFIG_END)) {
+	size = -1;
+    }
+    if (size > 0) {
+	memcpy((char *) &defPtr->value, widgRec + specPtr->offset, size);
+    }
+    defPtr->size = size;
+}
+
 /*
  *--------------------------------------------------------------
  *
@@ -525,8 +797,8 @@ Ck_ConfigureInfo(interp, winPtr, specs, widgRec, argvName, flags)
 
     Tcl_SetResult(interp, (char *) NULL, TCL_STATIC);
     if (argvName != NULL) {
-	specPtr = FindConfigSpec(interp, specs, argvName, needFlags,
-		hateFlags);
+	specPtr = FindConfigSpec(interp,
+		GetSpecIndex(specs, needFlags, hateFlags), argvName);
 	if (specPtr == NULL) {
 	    return TCL_ERROR;
 	}
@@ -601,7 +873,8 @@ Ck_ConfigureValue(interp, winPtr, specs, widgRec, argvName, flags)
         hateFlags = CK_CONFIG_MONO_ONLY;
     else
         hateFlags = CK_CONFIG_COLOR_ONLY;
-    specPtr = FindConfigSpec(interp, specs, argvName, needFlags, hateFlags);
+    specPtr = FindConfigSpec(interp,
+            GetSpecIndex(specs, needFlags, hateFlags), argvName);
     if (specPtr == NULL) {
         return TCL_ERROR;
     }
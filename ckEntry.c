@@ -800,10 +800,12 @@ DisplayEntry(clientData)
     CkWindow *winPtr = entryPtr->winPtr;
     int y, startX, leftIndex, selectFirst, selectLast, insertPos, dummy;
     char *displayString;
+    double t0;
 
     entryPtr->flags &= ~REDRAW_PENDING;
     if ((entryPtr->winPtr == NULL) || !(winPtr->flags & CK_MAPPED))
 	return;
+    t0 = CkProfileStart(winPtr->mainPtr);
 
     /*
      * Update the scrollbar if that's needed.
@@ -893,6 +895,7 @@ DisplayEntry(clientData)
     }
 
     Ck_EventuallyRefresh(winPtr);
+    CkProfileWindow(winPtr, t0);
 }
 
 /*
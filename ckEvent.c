@@ -20,10 +20,35 @@
 #include "gpm.h"
 #endif
 
+/*
+ * Events decoded from terminal input are collected in a queue per
+ * main window, and dispatched back to back once the input available
+ * has been read.  CkHandleInput reads at most INPUT_BATCH codes and
+ * stops when INPUT_QUEUE_SIZE events are waiting, so that other event
+ * sources and redisplay aren't starved by a flood of input.  The queue
+ * grows beyond INPUT_QUEUE_SIZE if a single code yields many events.
+ */
+
+#define INPUT_QUEUE_SIZE	128
+#define INPUT_BATCH		1024
+
+typedef struct InputQueue {
+    int first;			/* Index of oldest event in ring. */
+    int count;			/* Number of events in ring. */
+    int size;			/* Number of slots in ring. */
+    int dispatchPending;	/* A QEvt to dispatch the queue has been
+				 * put on Tcl's event queue. */
+    CkEvent *events;		/* Ring of events. */
+} InputQueue;
+
+static void	DispatchInput _ANSI_ARGS_((CkMainInfo *mainPtr));
+static int	dispatchDepth = 0;	/* Nesting level of DispatchInput,
+					 * events time is only taken at
+					 * the outermost level. */
+
 #if (TCL_MAJOR_VERSION >= 8)
 typedef struct {
     Tcl_Event header;		/* Standard event header. */
-    CkEvent event;		/* Ck event data. */
     CkMainInfo *mainPtr;	/* Pointer to Ck main info. */
 } CkQEvt;
 
@@ -118,6 +143,69 @@ typedef struct barcodeData {
  */
 
 static void BarcodeTimeout _ANSI_ARGS_((ClientData clientData));
+
+/*
+ * For bracketed paste and typeahead handling an instance of the
+ * following structure is linked to mainInfo.  In bracketed paste mode
+ * xterm compatible terminals surround pasted text with the marks below;
+ * the characters in between are collected into the buffer and delivered
+ * as a single Paste event.  Typeahead handling collects runs of printable
+ * characters already waiting in the input after a printable key, and
+ * delivers runs of at least the given number of characters as Paste
+ * events, too.  A run ends before any key bound specifically (e.g.
+ * <Key-q>) for the focus window, which is delivered as a Key event.
+ * Paste events for windows without Paste bindings are turned back into
+ * Key events by Ck_HandleEvent.
+ */
+
+#define PASTE_START	"\033[200~"
+#define PASTE_END	"\033[201~"
+#define PASTE_MARK_LEN	6
+
+/*
+ * A bracketed paste longer than PASTE_MAX_LENGTH bytes is delivered in
+ * several Paste events.  If no input arrives for PASTE_TIMEOUT ms while
+ * waiting for the end mark, the text collected is delivered and the
+ * paste is considered finished.
+ */
+
+#define PASTE_MAX_LENGTH	65536
+#define PASTE_TIMEOUT		1000
+
+typedef struct PasteData {
+    int bracketed;		/* Bracketed paste mode is on. */
+    int typeahead;		/* Minimum number of characters for
+				 * a Paste event from typeahead, 0 if
+				 * typeahead isn't collected. */
+    int inPaste;		/* Start mark of bracketed paste has
+				 * been read, end mark not yet. */
+    Tk_TimerToken timer;	/* Timeout for end mark, NULL if none. */
+    Tcl_DString buffer;		/* Here the pasted characters are
+				 * assembled. */
+} PasteData;
+
+static void	DeliverPaste _ANSI_ARGS_((CkMainInfo *mainPtr,
+		    char *bytes, int length, int bracketed));
+#if CK_USE_UTF
+static int	GetUtfChar _ANSI_ARGS_((int code, char *buffer,
+		    Tcl_UniChar *uchPtr));
+#endif
+static int	KeyIsBound _ANSI_ARGS_((CkMainInfo *mainPtr, int code));
+static void	KeysFromBytes _ANSI_ARGS_((CkMainInfo *mainPtr,
+		    CkWindow *winPtr, char *bytes, int length, int queue));
+static int	PasteInput _ANSI_ARGS_((CkMainInfo *mainPtr, int code));
+static void	PasteTimeout _ANSI_ARGS_((ClientData clientData));
+static void	PasteToKeys _ANSI_ARGS_((CkMainInfo *mainPtr,
+		    CkEvent *eventPtr));
+static void	QueueEvent _ANSI_ARGS_((CkMainInfo *mainPtr,
+		    CkEvent *eventPtr));
+#if (TCL_MAJOR_VERSION == 7) && (TCL_MINOR_VERSION <= 4)
+static int	ReadInput _ANSI_ARGS_((CkMainInfo *mainPtr));
+#else
+static void	ReadInput _ANSI_ARGS_((CkMainInfo *mainPtr));
+#endif
+static int	Typeahead _ANSI_ARGS_((CkMainInfo *mainPtr,
+		    CkEvent *eventPtr, char *bytes, int length));
 
 /*
  *--------------------------------------------------------------
@@ -360,6 +448,26 @@ Ck_HandleEvent(mainPtr, eventPtr)
     GenericHandler *genPrevPtr;
     CkWindow *winPtr;
     InProgress ip;
+    int i;
+
+    if (eventPtr->type == CK_EV_PASTE &&
+	(Tcl_FindHashEntry(&mainPtr->winTable, (char *) eventPtr->any.winPtr)
+	== NULL || !CkHasBinding(eventPtr->any.winPtr, CK_EV_PASTE, 0))) {
+	/*
+	 * Nobody is prepared for a Paste event: deliver the characters
+	 * as Key events instead.
+	 */
+
+	PasteToKeys(mainPtr, eventPtr);
+	return;
+    }
+
+    for (i = 0; i < CK_STATS_EVENT_TYPES; i++) {
+	if (eventPtr->type & (1 << i)) {
+	    mainPtr->stats.events[i]++;
+	    break;
+	}
+    }
 
     /* 
      * Invoke all the generic event handlers (those that are
@@ -515,11 +623,9 @@ CkHandleInput(clientData, mask, flags)
                                  * contains bits such as TK_DONT_WAIT,
                                  * TK_X_EVENTS, Tk_FILE_EVENTS, etc. */
 {
-    CkEvent event;
     CkMainInfo *mainPtr = (CkMainInfo *) clientData;
-    int code;
-    static int buttonpressed = 0;
-    static int errCount = 0;
+    double t0, eventsTime;
+    int result;
 
     if (!(flags & TK_FILE_EVENTS))
 	return 0;
@@ -527,15 +633,59 @@ CkHandleInput(clientData, mask, flags)
     if (!(mask & TK_READABLE))
 	return TK_READABLE;
 
+    if (!ckStatsTiming)
+	return ReadInput(mainPtr);
+    t0 = CkStatsClock();
+    eventsTime = mainPtr->stats.phaseTime[CK_STATS_EVENTS];
+    result = ReadInput(mainPtr);
+    if (CkLookupMainInfo(mainPtr) != NULL) {
+	mainPtr->stats.phaseTime[CK_STATS_INPUT] += CkStatsClock() - t0 -
+	    (mainPtr->stats.phaseTime[CK_STATS_EVENTS] - eventsTime);
+    }
+    return result;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * ReadInput --
+ *
+ *	Read the pending keyboard input of a main window into its
+ *	input queue and dispatch it.
+ *
+ * Results:
+ *	TK_FILE_HANDLED.
+ *
+ * Side effects:
+ *	The handling of the events could cause additional
+ *	side effects.
+ *
+ *--------------------------------------------------------------
+ */
+
+static int
+ReadInput(mainPtr)
+    CkMainInfo *mainPtr;	/* Main window to read input for. */
+{
+    CkEvent event;
+    int code, numCodes = 0;
+
+    CkSetTerm(mainPtr);
     code = getch();
+nextCode:
     if (code == ERR) {
-	if (++errCount > 100) {
+	if (++mainPtr->inputErrors > 100) {
 	    Tcl_Eval(mainPtr->interp, "exit 99");
+	    if (mainPtr->flags & CK_NEWTERM)
+		return TK_FILE_HANDLED;	/* only that terminal is gone */
 	    exit(99);			/* just in case */
 	}
 	return TK_READABLE;
     }
-    errCount = 0;
+    mainPtr->inputErrors = 0;
+
+    if (mainPtr->pasteData != NULL && PasteInput(mainPtr, code))
+	goto nextInput;
 
     /*
      * Barcode reader handling.
@@ -567,7 +717,19 @@ CkHandleInput(clientData, mask, flags)
 		event.key.type = CK_EV_BARCODE;
 		event.key.winPtr = mainPtr->focusPtr;
 		event.key.keycode = 0;
+
+		/*
+		 * The packet is in the barcode buffer, so the event
+		 * can't be queued:  deliver it right after the events
+		 * read before it.
+		 */
+
+		DispatchInput(mainPtr);
+		if (CkLookupMainInfo(mainPtr) == NULL)
+		    return TK_FILE_HANDLED;
 		Ck_HandleEvent(mainPtr, &event);
+		if (CkLookupMainInfo(mainPtr) == NULL)
+		    return TK_FILE_HANDLED;
 		/*
 		 * Careful, event handler could turn barcode off.
 		 * Only reset buffer index if BarCode event delivered
@@ -578,14 +740,14 @@ CkHandleInput(clientData, mask, flags)
 		    bd->delivered = 0;
 		    bd->index = -1;
 		}
-		return TK_FILE_HANDLED;
+		goto nextInput;
 	    } else {
 		/* Leave space for one NUL byte. */
 		if (bd->index < sizeof (bd->buffer) - 1)
 		    bd->buffer[bd->index] = code;
 		bd->index++;
 	    }
-	    return TK_READABLE;
+	    goto nextInput;
 	}
     }
 
@@ -603,7 +765,7 @@ CkHandleInput(clientData, mask, flags)
 	}
 
 	if (getmouse(&mEvent) == ERR)
-	    return TK_FILE_HANDLED;
+	    goto nextInput;
 
 	for (i = 1; i <= 3; i++) {
 	    if (BUTTON_PRESS(mEvent.bstate, i)) {
@@ -617,8 +779,7 @@ mouseEventNC:
 		event.mouse.y = mEvent.y;
 		event.mouse.winPtr = Ck_GetWindowXY(mainPtr, &event.mouse.x,
 		    &event.mouse.y, 1);
-		Ck_HandleEvent(mainPtr, &event);
-		return TK_FILE_HANDLED;
+		goto mkEvent;
 	    }
 	}
     }
@@ -641,8 +802,7 @@ mouseEvt:
 		event.mouse.y = Mouse_status.y;
 		event.mouse.winPtr = Ck_GetWindowXY(mainPtr, &event.mouse.x,
 		    &event.mouse.y, 1);
-		Ck_HandleEvent(mainPtr, &event);
-		return TK_FILE_HANDLED;
+		goto mkEvent;
 	    }
 	}
     }
@@ -669,7 +829,7 @@ mouseEvt:
 		goto getM;
 	    ungetch(code2);
 	} else
-	    errCount++;
+	    mainPtr->inputErrors++;
 	goto keyEvent;
 getM:
 	code2 = getch();
@@ -678,42 +838,41 @@ getM:
 		goto getMouse;
 	    ungetch(code2);
 	} else
-	    errCount++;
+	    mainPtr->inputErrors++;
 	goto keyEvent;
 getMouse:
 	code2 = getch();
 	if (code2 == ERR) {
-	    errCount++;
-	    return TK_READABLE;
+	    mainPtr->inputErrors++;
+	    goto done;
 	}
 	event.mouse.button = ((code2 - 0x20) & 0x03) + 1;
 	code2 = getch();
 	if (code2 == ERR) {
-	    errCount++;
-	    return TK_READABLE;
+	    mainPtr->inputErrors++;
+	    goto done;
 	}
 	event.mouse.x = event.mouse.rootx = code2 - 0x20 - 1;
 	code2 = getch();
 	if (code2 == ERR) {
-	    errCount++;
-	    return TK_READABLE;
+	    mainPtr->inputErrors++;
+	    goto done;
 	}
 	event.mouse.y = event.mouse.rooty = code2 - 0x20 - 1;
 	if (event.mouse.button > 3) {
-	    event.mouse.button = buttonpressed;
-	    buttonpressed = 0;
+	    event.mouse.button = mainPtr->buttonPressed;
+	    mainPtr->buttonPressed = 0;
 	    event.mouse.type = CK_EV_MOUSE_UP;
 	    goto mouseEvent;
-	} else if (buttonpressed == 0) {
-	    buttonpressed = event.mouse.button;
+	} else if (mainPtr->buttonPressed == 0) {
+	    mainPtr->buttonPressed = event.mouse.button;
 	    event.mouse.type = CK_EV_MOUSE_DOWN;
 mouseEvent:
 	    event.mouse.winPtr = Ck_GetWindowXY(mainPtr, &event.mouse.x,
 	        &event.mouse.y, 1);
-	    Ck_HandleEvent(mainPtr, &event);
-	    return TK_FILE_HANDLED;
+	    goto mkEvent;
 	}
-	return TK_READABLE;
+	goto nextInput;
     }
 #endif
 
@@ -723,7 +882,34 @@ keyEvent:
     event.key.keycode = code;
     if (event.key.keycode < 0)
 	event.key.keycode &= 0xff;
-    Ck_HandleEvent(mainPtr, &event);
+    if (mainPtr->pasteData != NULL &&
+	((PasteData *) mainPtr->pasteData)->typeahead > 0 &&
+	((code >= 0x20 && code < 0x7f) || (code >= 0xa0 && code < 0x100)) &&
+	!KeyIsBound(mainPtr, code)) {
+	char c = code;
+
+	code = Typeahead(mainPtr, &event, &c, 1);
+	if (code == ERR)
+	    goto done;
+	goto nextCode;
+    }
+
+mkEvent:
+    QueueEvent(mainPtr, &event);
+
+    /*
+     * Go on with the next input, unless enough has been read.
+     */
+
+nextInput:
+    if (++numCodes < INPUT_BATCH && (mainPtr->inputQueue == NULL ||
+	((InputQueue *) mainPtr->inputQueue)->count < INPUT_QUEUE_SIZE)) {
+	code = getch();
+	if (code != ERR)
+	    goto nextCode;
+    }
+done:
+    DispatchInput(mainPtr);
     return TK_FILE_HANDLED;
 }
 #else
@@ -734,25 +920,67 @@ CkHandleInput(clientData, mask)
                                  * TK_WRITABLE, and TK_EXCEPTION, indicating
                                  * current state of file. */
 {
-    CkEvent event;
-    CkQEvt *qev;
     CkMainInfo *mainPtr = (CkMainInfo *) clientData;
-    int code;
-    static int buttonpressed = 0;
-    static int errCount = 0;
+    double t0, eventsTime;
+
+    if (!(mask & TCL_READABLE))
+	return;
+
+    if (!ckStatsTiming) {
+	ReadInput(mainPtr);
+	return;
+    }
+    t0 = CkStatsClock();
+    eventsTime = mainPtr->stats.phaseTime[CK_STATS_EVENTS];
+    ReadInput(mainPtr);
+    if (CkLookupMainInfo(mainPtr) != NULL) {
+	mainPtr->stats.phaseTime[CK_STATS_INPUT] += CkStatsClock() - t0 -
+	    (mainPtr->stats.phaseTime[CK_STATS_EVENTS] - eventsTime);
+    }
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * ReadInput --
+ *
+ *	Read the pending keyboard input of a main window into its
+ *	input queue.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	A Tcl event is queued to dispatch the input.  Barcode
+ *	packets are dispatched right away, which could cause
+ *	additional side effects.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+ReadInput(mainPtr)
+    CkMainInfo *mainPtr;	/* Main window to read input for. */
+{
+    CkEvent event;
+    int code, numCodes = 0;
 #if CK_USE_UTF
-    int ucp = 0;
+    int ucp;
     char ucbuf[16];
     Tcl_UniChar uch = 0;
 #endif
 
-    if (!(mask & TCL_READABLE))
-	return;
-
+    CkSetTerm(mainPtr);
     code = getch();
+nextCode:
+#if CK_USE_UTF
+    ucp = 0;
+#endif
     if (code == ERR) {
-	if (++errCount > 100) {
+	if (++mainPtr->inputErrors > 100) {
 	    Tcl_Eval(mainPtr->interp, "exit 99");
+	    if (mainPtr->flags & CK_NEWTERM)
+		return;			/* only that terminal is gone */
 #if (TCL_MAJOR_VERSION >= 8)
 	    Tcl_Exit(99);			/* just in case */
 #else
@@ -761,35 +989,14 @@ CkHandleInput(clientData, mask)
 	}
 	return;
     }
-    errCount = 0;
+    mainPtr->inputErrors = 0;
+
+    if (mainPtr->pasteData != NULL && PasteInput(mainPtr, code))
+	goto nextInput;
+
 #if CK_USE_UTF
     if (mainPtr->isoEncoding == NULL && code >= 0xc0 && code < 0x100) {
-	int need = 2;
-
-	if (code >= 0xfc)
-	    need = 6;
-	else if (code >= 0xf8)
-	    need = 5;
-	else if (code >= 0xf0)
-	    need = 4;
-	else if (code >= 0xe0)
-	    need = 3;
-	nodelay(curscr, FALSE);
-	while (need-- > 0 && code >= 0x80 && code < 0x100) {
-	    ucbuf[ucp++] = code;
-	    code = getch();
-	    if (code == ERR)
-		break;
-	    if (code < 0x80 || code >= 0xc0) {
-		ungetch(code);
-		break;
-	    }
-	}
-	nodelay(curscr, TRUE);
-	if (code >= 0x100 && code != ERR)
-	    ungetch(code);
-	ucbuf[ucp] = '\0';
-	Tcl_UtfToUniChar(ucbuf, &uch);
+	ucp = GetUtfChar(code, ucbuf, &uch);
 	code = 0;
     }
 #endif
@@ -824,7 +1031,19 @@ CkHandleInput(clientData, mask)
 		event.key.type = CK_EV_BARCODE;
 		event.key.winPtr = mainPtr->focusPtr;
 		event.key.keycode = 0;
+
+		/*
+		 * The packet is in the barcode buffer, so the event
+		 * can't be queued:  deliver it right after the events
+		 * read before it.
+		 */
+
+		DispatchInput(mainPtr);
+		if (CkLookupMainInfo(mainPtr) == NULL)
+		    return;
 		Ck_HandleEvent(mainPtr, &event);
+		if (CkLookupMainInfo(mainPtr) == NULL)
+		    return;
 		/*
 		 * Careful, event handler could turn barcode off.
 		 * Only reset buffer index if BarCode event delivered
@@ -835,7 +1054,7 @@ CkHandleInput(clientData, mask)
 		    bd->delivered = 0;
 		    bd->index = -1;
 		}
-		return;
+		goto nextInput;
 	    } else {
 		/* Leave space for one NUL byte. */
 		if (bd->index < sizeof (bd->buffer) - 1) {
@@ -867,7 +1086,7 @@ CkHandleInput(clientData, mask)
 		}
 		bd->index++;
 	    }
-	    return;
+	    goto nextInput;
 	}
     }
 
@@ -885,7 +1104,7 @@ CkHandleInput(clientData, mask)
 	}
 
         if (getmouse(&mEvent) == ERR)
-	    return;
+	    goto nextInput;
 
 	for (i = 1; i <= 3; i++) {
 	    if (BUTTON_PRESS(mEvent.bstate, i)) {
@@ -951,7 +1170,7 @@ mouseEvt:
 		goto getM;
 	    ungetch(code2);
 	} else
-	    errCount++;
+	    mainPtr->inputErrors++;
 	goto keyEvent;
 getM:
 	code2 = getch();
@@ -960,41 +1179,41 @@ getM:
 		goto getMouse;
 	    ungetch(code2);
 	} else
-	    errCount++;
+	    mainPtr->inputErrors++;
 	goto keyEvent;
 getMouse:
 	code2 = getch();
 	if (code2 == ERR) {
-	    errCount++;
+	    mainPtr->inputErrors++;
 	    return;
 	}
 	event.mouse.button = ((code2 - 0x20) & 0x03) + 1;
 	code2 = getch();
 	if (code2 == ERR) {
-	    errCount++;
+	    mainPtr->inputErrors++;
 	    return;
 	}
 	event.mouse.x = event.mouse.rootx = code2 - 0x20 - 1;
 	code2 = getch();
 	if (code2 == ERR) {
-	    errCount++;
+	    mainPtr->inputErrors++;
 	    return;
 	}
 	event.mouse.y = event.mouse.rooty = code2 - 0x20 - 1;
 	if (event.mouse.button > 3) {
-	    event.mouse.button = buttonpressed;
-	    buttonpressed = 0;
+	    event.mouse.button = mainPtr->buttonPressed;
+	    mainPtr->buttonPressed = 0;
 	    event.mouse.type = CK_EV_MOUSE_UP;
 	    goto mouseEvent;
-	} else if (buttonpressed == 0) {
-	    buttonpressed = event.mouse.button;
+	} else if (mainPtr->buttonPressed == 0) {
+	    mainPtr->buttonPressed = event.mouse.button;
 	    event.mouse.type = CK_EV_MOUSE_DOWN;
 mouseEvent:
 	    event.mouse.winPtr = Ck_GetWindowXY(mainPtr, &event.mouse.x,
 	        &event.mouse.y, 1);
 	    goto mkEvent;
 	}
-	return;
+	goto nextInput;
     }
 #endif
 
@@ -1017,12 +1236,46 @@ keyEvent:
 	event.key.is_uch = 1;
 #endif
 
+    /*
+     * Collect typeahead following a printable character.
+     */
+
+    if (mainPtr->pasteData != NULL &&
+	((PasteData *) mainPtr->pasteData)->typeahead > 0 &&
+	!KeyIsBound(mainPtr, event.key.keycode)) {
+	char c = code;
+
+#if CK_USE_UTF
+	if (ucp > 0)
+	    code = Typeahead(mainPtr, &event, ucbuf, ucp);
+	else if ((code >= 0x20 && code < 0x7f) ||
+	    (mainPtr->isoEncoding != NULL && code >= 0xa0 && code < 0x100))
+	    code = Typeahead(mainPtr, &event, &c, 1);
+#else
+	if ((code >= 0x20 && code < 0x7f) || (code >= 0xa0 && code < 0x100))
+	    code = Typeahead(mainPtr, &event, &c, 1);
+#endif
+	else
+	    goto mkEvent;
+	if (code == ERR)
+	    return;
+	goto nextCode;
+    }
+
 mkEvent:
-    qev = (CkQEvt *) ckalloc(sizeof (CkQEvt));
-    qev->header.proc = Ck_HandleQEvent;
-    qev->event = event;
-    qev->mainPtr = mainPtr;
-    Tcl_QueueEvent(&qev->header, TCL_QUEUE_TAIL);
+    QueueEvent(mainPtr, &event);
+
+    /*
+     * Go on with the next input, unless enough has been read.
+     */
+
+nextInput:
+    if (++numCodes < INPUT_BATCH && (mainPtr->inputQueue == NULL ||
+	((InputQueue *) mainPtr->inputQueue)->count < INPUT_QUEUE_SIZE)) {
+	code = getch();
+	if (code != ERR)
+	    goto nextCode;
+    }
 }
 
 static int
@@ -1035,7 +1288,16 @@ Ck_HandleQEvent(evPtr, flags)
     if (!(flags & TCL_WINDOW_EVENTS)) {
 	return 0;
     }
-    Ck_HandleEvent(qev->mainPtr, &qev->event);
+
+    /*
+     * The terminal may have been closed meanwhile.
+     */
+
+    if (CkLookupMainInfo(qev->mainPtr) != NULL &&
+	qev->mainPtr->inputQueue != NULL) {
+	((InputQueue *) qev->mainPtr->inputQueue)->dispatchPending = 0;
+	DispatchInput(qev->mainPtr);
+    }
     return 1;
 }
 #endif /* TCL_MAJOR_VERSION == 7 && TCL_MINOR_VERSION <= 4 */
@@ -1124,7 +1386,6 @@ CkHandleGPMInput(clientData, mask)
 {
     Gpm_Event gpmEvent;
     CkEvent event;
-    CkQEvt *qev;
     CkMainInfo *mainPtr = (CkMainInfo *) clientData;
     int ret, type;
 
@@ -1161,11 +1422,7 @@ CkHandleGPMInput(clientData, mask)
 	event.mouse.y = event.mouse.rooty = gpmEvent.y - 1;
 	event.mouse.winPtr = Ck_GetWindowXY(mainPtr, &event.mouse.x,
 	    &event.mouse.y, 1);
-	qev = (CkQEvt *) ckalloc(sizeof (CkQEvt));
-	qev->header.proc = Ck_HandleQEvent;
-	qev->event = event;
-	qev->mainPtr = mainPtr;
-	Tcl_QueueEvent(&qev->header, TCL_QUEUE_TAIL);
+	QueueEvent(mainPtr, &event);
     }
 }
 #endif /* TCL_MAJOR_VERSION == 7 && TCL_MINOR_VERSION <= 4 */
@@ -1246,6 +1503,30 @@ CkGetBarcodeData(mainPtr)
     return bd->buffer;
 }
 
+/*
+ *--------------------------------------------------------------
+ *
+ * CkFreeBarcode --
+ *
+ *	Turn off barcode reader handling and release its data.
+ *
+ *--------------------------------------------------------------
+ */
+
+void
+CkFreeBarcode(mainPtr)
+    CkMainInfo *mainPtr;
+{
+    BarcodeData *bd = (BarcodeData *) mainPtr->barcodeData;
+
+    if (mainPtr->flags & CK_HAS_BARCODE) {
+	Tk_DeleteTimerHandler(bd->timer);
+	mainPtr->flags &= ~CK_HAS_BARCODE;
+	mainPtr->barcodeData = NULL;
+	ckfree((char *) bd);
+    }
+}
+
 /*
  *--------------------------------------------------------------
  *
@@ -1284,12 +1565,7 @@ CkBarcodeCmd(clientData, interp, argc, argv)
     } else if (argc == 3) {
 	if (strcmp(argv[2], "off") != 0)
 	    goto badArgs;
-	if (mainPtr->flags & CK_HAS_BARCODE) {
-	    Tk_DeleteTimerHandler(bd->timer);
-	    mainPtr->flags &= ~CK_HAS_BARCODE;
-	    mainPtr->barcodeData = NULL;
-	    ckfree((char *) bd);
-	}
+	CkFreeBarcode(mainPtr);
 	return TCL_OK;
     } else if (argc == 4 || argc == 5) {
 	int start, end, pkttime;
@@ -1321,3 +1597,690 @@ badArgs:
     }
     return TCL_ERROR;
 }
+
+/*
+ *--------------------------------------------------------------
+ *
+ * QueueEvent --
+ *
+ *	Add an event read from the terminal to the input queue of
+ *	a main window.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The queue is created or enlarged as necessary.  With Tcl 8
+ *	a Tcl event is queued which dispatches the input queue,
+ *	else CkHandleInput dispatches it when done reading.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+QueueEvent(mainPtr, eventPtr)
+    CkMainInfo *mainPtr;
+    CkEvent *eventPtr;
+{
+    InputQueue *iq = (InputQueue *) mainPtr->inputQueue;
+
+    if (iq == NULL) {
+	iq = (InputQueue *) ckalloc(sizeof (InputQueue));
+	iq->first = iq->count = 0;
+	iq->size = INPUT_QUEUE_SIZE;
+	iq->dispatchPending = 0;
+	iq->events = (CkEvent *) ckalloc(iq->size * sizeof (CkEvent));
+	mainPtr->inputQueue = (ClientData) iq;
+    } else if (iq->count >= iq->size) {
+	CkEvent *events;
+	int n = iq->size - iq->first;
+
+	events = (CkEvent *) ckalloc(2 * iq->size * sizeof (CkEvent));
+	memcpy(events, iq->events + iq->first, n * sizeof (CkEvent));
+	memcpy(events + n, iq->events, iq->first * sizeof (CkEvent));
+	ckfree((char *) iq->events);
+	iq->events = events;
+	iq->first = 0;
+	iq->size *= 2;
+    }
+    iq->events[(iq->first + iq->count) % iq->size] = *eventPtr;
+    iq->count++;
+#if (TCL_MAJOR_VERSION >= 8)
+    if (!iq->dispatchPending) {
+	CkQEvt *qev;
+
+	qev = (CkQEvt *) ckalloc(sizeof (CkQEvt));
+	qev->header.proc = Ck_HandleQEvent;
+	qev->mainPtr = mainPtr;
+	Tcl_QueueEvent(&qev->header, TCL_QUEUE_TAIL);
+	iq->dispatchPending = 1;
+    }
+#endif
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * DispatchInput --
+ *
+ *	Handle the events in the input queue of a main window, in
+ *	the order they were read.  Key and Paste events go to the
+ *	window having the focus when they are handled, since an
+ *	earlier event may have moved the focus.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Whatever the event handlers and bindings do.  These may
+ *	enter the event loop and dispatch later events, or close
+ *	the terminal.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+DispatchInput(mainPtr)
+    CkMainInfo *mainPtr;
+{
+    InputQueue *iq;
+    CkEvent event;
+    double t0 = 0.0;
+
+    if (ckStatsTiming && dispatchDepth == 0)
+	t0 = CkStatsClock();
+    dispatchDepth++;
+    while (CkLookupMainInfo(mainPtr) != NULL &&
+	(iq = (InputQueue *) mainPtr->inputQueue) != NULL && iq->count > 0) {
+	event = iq->events[iq->first];
+	iq->first = (iq->first + 1) % iq->size;
+	iq->count--;
+	if (event.type & (CK_EV_KEYPRESS | CK_EV_PASTE))
+	    event.any.winPtr = mainPtr->focusPtr;
+	CkSetTerm(mainPtr);
+	Ck_HandleEvent(mainPtr, &event);
+	if (event.type == CK_EV_PASTE)
+	    ckfree(event.paste.data);
+    }
+    if (--dispatchDepth == 0 && t0 != 0.0 &&
+	CkLookupMainInfo(mainPtr) != NULL) {
+	mainPtr->stats.phaseTime[CK_STATS_EVENTS] += CkStatsClock() - t0;
+    }
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * CkFreeInputQueue --
+ *
+ *	Release the input queue of a main window, dropping events
+ *	not handled yet.
+ *
+ *--------------------------------------------------------------
+ */
+
+void
+CkFreeInputQueue(mainPtr)
+    CkMainInfo *mainPtr;
+{
+    InputQueue *iq = (InputQueue *) mainPtr->inputQueue;
+
+    if (iq != NULL) {
+	for ( ; iq->count > 0; iq->count--) {
+	    if (iq->events[iq->first].type == CK_EV_PASTE)
+		ckfree(iq->events[iq->first].paste.data);
+	    iq->first = (iq->first + 1) % iq->size;
+	}
+	mainPtr->inputQueue = NULL;
+	ckfree((char *) iq->events);
+	ckfree((char *) iq);
+    }
+}
+
+#if CK_USE_UTF
+/*
+ *--------------------------------------------------------------
+ *
+ * GetUtfChar --
+ *
+ *	Read the rest of an UTF-8 sequence from the terminal.
+ *
+ * Results:
+ *	The bytes of the sequence starting with code are stored in
+ *	buffer (NUL terminated) and their number is returned.  The
+ *	character is stored at *uchPtr.
+ *
+ *--------------------------------------------------------------
+ */
+
+static int
+GetUtfChar(code, buffer, uchPtr)
+    int code;			/* First byte of sequence. */
+    char *buffer;		/* Room for at least 8 bytes. */
+    Tcl_UniChar *uchPtr;
+{
+    int need = 2, ucp = 0;
+
+    if (code >= 0xfc)
+	need = 6;
+    else if (code >= 0xf8)
+	need = 5;
+    else if (code >= 0xf0)
+	need = 4;
+    else if (code >= 0xe0)
+	need = 3;
+    nodelay(curscr, FALSE);
+    while (need-- > 0 && code >= 0x80 && code < 0x100) {
+	buffer[ucp++] = code;
+	code = getch();
+	if (code == ERR)
+	    break;
+	if (code < 0x80 || code >= 0xc0) {
+	    ungetch(code);
+	    break;
+	}
+    }
+    nodelay(curscr, TRUE);
+    if (code >= 0x100 && code != ERR)
+	ungetch(code);
+    buffer[ucp] = '\0';
+    Tcl_UtfToUniChar(buffer, uchPtr);
+    return ucp;
+}
+#endif
+
+/*
+ *--------------------------------------------------------------
+ *
+ * PasteInput --
+ *
+ *	Check for and collect bracketed paste input.
+ *
+ * Results:
+ *	1 if code was consumed as part of pasted text, 0 if it
+ *	must be processed as normal input.
+ *
+ * Side effects:
+ *	All input available is read while in a bracketed paste,
+ *	and a Paste event is delivered when the end mark is seen
+ *	or PASTE_MAX_LENGTH bytes have been collected.
+ *
+ *--------------------------------------------------------------
+ */
+
+static int
+PasteInput(mainPtr, code)
+    CkMainInfo *mainPtr;
+    int code;			/* Code just read from terminal. */
+{
+    PasteData *pd = (PasteData *) mainPtr->pasteData;
+    int i, length, codes[PASTE_MARK_LEN];
+    char c, *start, *end;
+
+    if (!pd->inPaste) {
+	if (!pd->bracketed || code != PASTE_START[0])
+	    return 0;
+	for (i = 1; i < PASTE_MARK_LEN; i++) {
+	    codes[i] = getch();
+	    if (codes[i] != PASTE_START[i]) {
+		/*
+		 * Not a start mark, push back what was read.
+		 */
+
+		if (codes[i] != ERR)
+		    ungetch(codes[i]);
+		while (--i > 0)
+		    ungetch(codes[i]);
+		return 0;
+	    }
+	}
+	pd->inPaste = 1;
+	Tcl_DStringSetLength(&pd->buffer, 0);
+	code = getch();
+    }
+    for ( ; code != ERR; code = getch()) {
+	if (code >= 0x100)
+	    continue;		/* Function key, can't be pasted. */
+	c = code;
+	Tcl_DStringAppend(&pd->buffer, &c, 1);
+	length = Tcl_DStringLength(&pd->buffer);
+	end = Tcl_DStringValue(&pd->buffer) + length;
+	if (c == PASTE_END[PASTE_MARK_LEN - 1] && length >= PASTE_MARK_LEN &&
+	    memcmp(end - PASTE_MARK_LEN, PASTE_END, PASTE_MARK_LEN) == 0) {
+	    pd->inPaste = 0;
+	    DeliverPaste(mainPtr, Tcl_DStringValue(&pd->buffer),
+		length - PASTE_MARK_LEN, 1);
+	    break;
+	}
+	if (length >= PASTE_MAX_LENGTH) {
+	    /*
+	     * Deliver what was collected, but keep what might be the
+	     * beginning of the end mark or of a UTF-8 sequence.
+	     */
+
+	    start = Tcl_DStringValue(&pd->buffer);
+	    end -= PASTE_MARK_LEN - 1;
+	    while (end > start && (*end & 0xc0) == 0x80)
+		end--;
+	    DeliverPaste(mainPtr, start, end - start, 1);
+	    length -= end - start;
+	    memmove(start, end, length);
+	    Tcl_DStringSetLength(&pd->buffer, length);
+	}
+    }
+    Tk_DeleteTimerHandler(pd->timer);
+    pd->timer = (Tk_TimerToken) NULL;
+    if (pd->inPaste)
+	pd->timer = Tk_CreateTimerHandler(PASTE_TIMEOUT, PasteTimeout,
+	    (ClientData) mainPtr);
+    return 1;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * PasteTimeout --
+ *
+ *	Handle timeout while waiting for the end mark of a
+ *	bracketed paste:  deliver the text collected so far.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+PasteTimeout(clientData)
+    ClientData clientData;
+{
+    CkMainInfo *mainPtr = (CkMainInfo *) clientData;
+    PasteData *pd = (PasteData *) mainPtr->pasteData;
+
+    if (pd != NULL && pd->inPaste) {
+	pd->timer = (Tk_TimerToken) NULL;
+	pd->inPaste = 0;
+	DeliverPaste(mainPtr, Tcl_DStringValue(&pd->buffer),
+	    Tcl_DStringLength(&pd->buffer), 1);
+	DispatchInput(mainPtr);
+    }
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * Typeahead --
+ *
+ *	Called for a printable key when typeahead is collected.
+ *	Reads the printable characters waiting in the input, up to
+ *	the first one with a key specific binding, and delivers them
+ *	along with the key as a Paste event, or as Key events if
+ *	there are too few of them.
+ *
+ * Results:
+ *	The code which ended the run of printable characters, or
+ *	ERR if no more input is available.
+ *
+ * Side effects:
+ *	Events are delivered.
+ *
+ *--------------------------------------------------------------
+ */
+
+static int
+Typeahead(mainPtr, eventPtr, bytes, length)
+    CkMainInfo *mainPtr;
+    CkEvent *eventPtr;		/* Key event of first character. */
+    char *bytes;		/* Input bytes of first character. */
+    int length;			/* Number of bytes. */
+{
+    PasteData *pd = (PasteData *) mainPtr->pasteData;
+    Tcl_DString *dsPtr = &pd->buffer;
+    int code, count;
+    char c;
+#if CK_USE_UTF
+    char ucbuf[16];
+    Tcl_UniChar uch;
+#endif
+
+    Tcl_DStringSetLength(dsPtr, 0);
+    Tcl_DStringAppend(dsPtr, bytes, length);
+    for (count = 1; (code = getch()) != ERR; count++) {
+	c = code;
+	if (KeyIsBound(mainPtr, code)) {
+	    break;
+	} else if (code >= 0x20 && code < 0x7f) {
+	    Tcl_DStringAppend(dsPtr, &c, 1);
+#if CK_USE_UTF
+	} else if (mainPtr->isoEncoding == NULL) {
+	    if (code < 0xc0 || code >= 0x100)
+		break;
+	    Tcl_DStringAppend(dsPtr, ucbuf, GetUtfChar(code, ucbuf, &uch));
+	} else if (code >= 0xa0 && code < 0x100) {
+	    Tcl_DStringAppend(dsPtr, &c, 1);
+#else
+	} else if (code >= 0xa0 && code < 0x100) {
+	    Tcl_DStringAppend(dsPtr, &c, 1);
+#endif
+	} else {
+	    break;
+	}
+    }
+    if (count >= pd->typeahead) {
+	DeliverPaste(mainPtr, Tcl_DStringValue(dsPtr),
+	    Tcl_DStringLength(dsPtr), 0);
+    } else {
+	KeysFromBytes(mainPtr, eventPtr->key.winPtr, Tcl_DStringValue(dsPtr),
+	    Tcl_DStringLength(dsPtr), 1);
+    }
+    return code;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * KeyIsBound --
+ *
+ *	Find out whether the focus window has a binding for the
+ *	specific key read as code (not only for all keys).  Such
+ *	keys must not become part of a Paste event.
+ *
+ * Results:
+ *	1 if the key is bound, 0 otherwise.
+ *
+ * Side effects:
+ *	None.
+ *
+ *--------------------------------------------------------------
+ */
+
+static int
+KeyIsBound(mainPtr, code)
+    CkMainInfo *mainPtr;
+    int code;			/* Code read from terminal. */
+{
+    if (code <= 0 || code >= 0x100 || mainPtr->focusPtr == NULL)
+	return 0;
+#if CK_USE_UTF
+    if (mainPtr->isoEncoding == NULL && code >= 0x80)
+	return 0;		/* Part of UTF-8 sequence, keycode 0. */
+#endif
+    return CkHasBinding(mainPtr->focusPtr, CK_EV_KEYPRESS, code);
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * DeliverPaste --
+ *
+ *	Deliver a Paste event for the focus window.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The input bytes are converted to UTF-8 if necessary.  For
+ *	bracketed pastes carriage returns, which terminals send for
+ *	line ends, are turned into newlines.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+DeliverPaste(mainPtr, bytes, length, bracketed)
+    CkMainInfo *mainPtr;
+    char *bytes;		/* Input bytes. */
+    int length;			/* Number of bytes. */
+    int bracketed;		/* Bytes are from a bracketed paste. */
+{
+    CkEvent event;
+    Tcl_DString ds;
+    char *p, *q, *end;
+
+    if (length <= 0)
+	return;
+    Tcl_DStringInit(&ds);
+#if CK_USE_UTF
+    if (mainPtr->isoEncoding != NULL)
+	Tcl_ExternalToUtfDString(mainPtr->isoEncoding, bytes, length, &ds);
+    else
+#endif
+	Tcl_DStringAppend(&ds, bytes, length);
+    if (bracketed) {
+	p = q = Tcl_DStringValue(&ds);
+	end = p + Tcl_DStringLength(&ds);
+	while (p < end) {
+	    if (*p == '\r') {
+		*q++ = '\n';
+		if (++p < end && *p == '\n')
+		    p++;
+	    } else
+		*q++ = *p++;
+	}
+	Tcl_DStringSetLength(&ds, q - Tcl_DStringValue(&ds));
+    }
+    event.paste.type = CK_EV_PASTE;
+    event.paste.winPtr = mainPtr->focusPtr;
+    event.paste.length = Tcl_DStringLength(&ds);
+    event.paste.data = ckalloc(event.paste.length + 1);
+    memcpy(event.paste.data, Tcl_DStringValue(&ds), event.paste.length + 1);
+    Tcl_DStringFree(&ds);
+    QueueEvent(mainPtr, &event);
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * PasteToKeys --
+ *
+ *	Handle the characters of a Paste event as Key events.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Key events are handled.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+PasteToKeys(mainPtr, eventPtr)
+    CkMainInfo *mainPtr;
+    CkEvent *eventPtr;		/* Paste event. */
+{
+    Tcl_DString ds;
+    char *p, *end;
+
+    Tcl_DStringInit(&ds);
+#if CK_USE_UTF
+    if (mainPtr->isoEncoding != NULL)
+	Tcl_UtfToExternalDString(mainPtr->isoEncoding, eventPtr->paste.data,
+	    eventPtr->paste.length, &ds);
+    else
+#endif
+	Tcl_DStringAppend(&ds, eventPtr->paste.data, eventPtr->paste.length);
+    end = Tcl_DStringValue(&ds) + Tcl_DStringLength(&ds);
+    for (p = Tcl_DStringValue(&ds); p < end; p++) {
+	if (*p == '\n')
+	    *p = '\r';		/* The Return key. */
+    }
+    KeysFromBytes(mainPtr, eventPtr->paste.winPtr, Tcl_DStringValue(&ds),
+	Tcl_DStringLength(&ds), 0);
+    Tcl_DStringFree(&ds);
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * KeysFromBytes --
+ *
+ *	Turn input bytes into Key events for a window, the same
+ *	as CkHandleInput would have done.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The events are queued or handled right away.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+KeysFromBytes(mainPtr, winPtr, bytes, length, queue)
+    CkMainInfo *mainPtr;
+    CkWindow *winPtr;		/* Window for events. */
+    char *bytes;		/* Input bytes, NUL terminated. */
+    int length;			/* Number of bytes. */
+    int queue;			/* Non-zero means queue the events,
+				 * else handle them now. */
+{
+    CkEvent event;
+    char *end = bytes + length;
+    int code;
+
+    while (bytes < end) {
+	if (!queue && CkLookupMainInfo(mainPtr) == NULL)
+	    break;
+	code = *bytes & 0xff;
+	event.key.type = CK_EV_KEYPRESS;
+	event.key.winPtr = winPtr;
+#if CK_USE_UTF
+	if (mainPtr->isoEncoding == NULL && code >= 0xc0) {
+	    bytes += Tcl_UtfToUniChar(bytes, &event.key.uch);
+	    event.key.keycode = 0;
+	    event.key.is_uch = 1;
+	} else {
+	    bytes++;
+	    event.key.keycode = code;
+	    event.key.uch = code;
+	    event.key.is_uch = mainPtr->isoEncoding == NULL && code >= 0x20;
+	}
+#else
+	bytes++;
+	event.key.keycode = code;
+#endif
+	if (queue)
+	    QueueEvent(mainPtr, &event);
+	else
+	    Ck_HandleEvent(mainPtr, &event);
+    }
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * CkFreePaste --
+ *
+ *	Turn off bracketed paste and typeahead handling and release
+ *	its data.
+ *
+ *--------------------------------------------------------------
+ */
+
+void
+CkFreePaste(mainPtr)
+    CkMainInfo *mainPtr;
+{
+    PasteData *pd = (PasteData *) mainPtr->pasteData;
+
+    if (pd != NULL) {
+#ifndef __WIN32__
+	if (pd->bracketed) {
+	    fflush(mainPtr->termOut);
+	    fputs("\033[?2004l", mainPtr->termOut);
+	    fflush(mainPtr->termOut);
+	}
+#endif
+	Tk_DeleteTimerHandler(pd->timer);
+	Tcl_DStringFree(&pd->buffer);
+	mainPtr->pasteData = NULL;
+	ckfree((char *) pd);
+    }
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * CkPasteCmd --
+ *
+ *	Minor command handler to deal with bracketed paste and
+ *	typeahead.  Called by "curses" Tcl command.
+ *
+ * Results:
+ *	TCL_OK or TCL_ERROR.
+ *
+ *--------------------------------------------------------------
+ */
+
+int
+CkPasteCmd(clientData, interp, argc, argv)
+    ClientData clientData;      /* Main window associated with
+			         * interpreter. */
+    Tcl_Interp *interp;         /* Current interpreter. */
+    int argc;                   /* Number of arguments. */
+    char **argv;                /* Argument strings. */
+{
+    CkMainInfo *mainPtr = ((CkWindow *) (clientData))->mainPtr;
+    PasteData *pd = (PasteData *) mainPtr->pasteData;
+    int i, length, bracketed, typeahead;
+    char c, buffer[64];
+
+    bracketed = pd == NULL ? 0 : pd->bracketed;
+    typeahead = pd == NULL ? 0 : pd->typeahead;
+    if (argc == 2) {
+	sprintf(buffer, "-bracketed %d -typeahead %d", bracketed, typeahead);
+	Tcl_AppendResult(interp, buffer, (char *) NULL);
+	return TCL_OK;
+    }
+    if (argc % 2) {
+	goto badArgs;
+    }
+    for (i = 2; i < argc; i += 2) {
+	c = argv[i][1];
+	length = strlen(argv[i]);
+	if (c == 'b' && length >= 2 &&
+	    strncmp(argv[i], "-bracketed", length) == 0) {
+	    if (Tcl_GetBoolean(interp, argv[i + 1], &bracketed) != TCL_OK)
+		return TCL_ERROR;
+	} else if (c == 't' && length >= 2 &&
+	    strncmp(argv[i], "-typeahead", length) == 0) {
+	    if (Tcl_GetInt(interp, argv[i + 1], &typeahead) != TCL_OK)
+		return TCL_ERROR;
+	    if (typeahead < 0) {
+		Tcl_AppendResult(interp, "bad typeahead \"", argv[i + 1],
+		    "\": must be a non-negative number", (char *) NULL);
+		return TCL_ERROR;
+	    }
+	} else {
+	    Tcl_AppendResult(interp, "bad option \"", argv[i],
+		"\": must be -bracketed or -typeahead", (char *) NULL);
+	    return TCL_ERROR;
+	}
+    }
+    if (!bracketed && typeahead == 0) {
+	CkFreePaste(mainPtr);
+	return TCL_OK;
+    }
+    if (pd == NULL) {
+	pd = (PasteData *) ckalloc(sizeof (PasteData));
+	pd->bracketed = 0;
+	pd->inPaste = 0;
+	pd->timer = (Tk_TimerToken) NULL;
+	Tcl_DStringInit(&pd->buffer);
+	mainPtr->pasteData = (ClientData) pd;
+    }
+#ifndef __WIN32__
+    if (bracketed != pd->bracketed) {
+	fflush(mainPtr->termOut);
+	fputs(bracketed ? "\033[?2004h" : "\033[?2004l", mainPtr->termOut);
+	fflush(mainPtr->termOut);
+    }
+#endif
+    pd->bracketed = bracketed;
+    pd->typeahead = typeahead;
+    return TCL_OK;
+
+badArgs:
+    Tcl_AppendResult(interp, "wrong # args: should be \"", argv[0],
+	" paste ?-bracketed boolean? ?-typeahead count?\"", (char *) NULL);
+    return TCL_ERROR;
+}
@@ -439,16 +439,19 @@ DisplayFrame(clientData)
 {
     Frame *framePtr = (Frame *) clientData;
     CkWindow *winPtr = framePtr->winPtr;
+    double t0;
 
     framePtr->flags &= ~REDRAW_PENDING;
     if ((framePtr->winPtr == NULL) || !(winPtr->flags & CK_MAPPED)) {
 	return;
     }
+    t0 = CkProfileStart(winPtr->mainPtr);
     Ck_ClearToBot(winPtr, 0, 0);
     if (framePtr->borderPtr != NULL)
 	Ck_DrawBorder(winPtr, framePtr->borderPtr, 0, 0,
 	    winPtr->width, winPtr->height);
     Ck_EventuallyRefresh(winPtr);
+    CkProfileWindow(winPtr, t0);
 }
 
 /*
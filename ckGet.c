@@ -16,11 +16,36 @@
 #include "ck.h"
 
 typedef struct {
-    short fg, bg;
+    short fg, bg;		/* Colors of the pair. */
+    unsigned long lastUse;	/* Value of useCount of table when the
+				 * pair was last looked up. */
+    Tcl_HashEntry *hPtr;	/* Entry in pairTable for the colors. */
 } CPair;
 
-static CPair *cPairs = NULL;
-static int numPairs, newPair;
+/*
+ * Color pairs allocated so far; one table per main window (terminal),
+ * kept in the pairData field of CkMainInfo.  Pairs are found by their
+ * colors through a hash table.  Once all pairs are initialized, the
+ * least recently used pair which doesn't appear in any window is
+ * recycled.
+ */
+
+typedef struct {
+    int maxPairs;		/* Number of usable pairs, including the
+				 * fixed pair 0. */
+    int numPairs;		/* Pairs 1 .. numPairs-1 are initialized. */
+    unsigned long useCount;	/* Incremented on each lookup. */
+    Tcl_HashTable pairTable;	/* Maps PAIR_KEY of colors to pair number. */
+    CPair pairs[1];		/* Actually maxPairs entries. */
+} CPairTable;
+
+#define PAIR_KEY(fg, bg) \
+	((char *) ((((long) (fg) & 0xffff) << 16) | ((long) (bg) & 0xffff)))
+
+static int		RecyclePair _ANSI_ARGS_((CkMainInfo *mainPtr,
+			    CPairTable *tablePtr));
+static void		MarkPairs _ANSI_ARGS_((CkWindow *winPtr,
+			    char *inUse, int maxPairs));
 
 /*
  * The hash table below is used to keep track of all the Ck_Uids created
@@ -254,18 +279,18 @@ Ck_NameOfAttr(attr)
 /*
  *------------------------------------------------------------------------
  *
- * Ck_GetColorPair --
+ * Ck_GetPair --
  *
  *	Given background/foreground curses colors, a color pair
  *	is allocated and returned.
  *
  * Results:
- *	TCL_OK if color found, curses color in *colorPtr.
- *	TCL_ERROR if color not found; interp->result contains an
- *	error message.
+ *	The curses attribute for the color pair.
  *
  * Side effects:
- *	None.
+ *	A new color pair may be initialized.  If all pairs are in use
+ *	already, the least recently used pair not appearing in any
+ *	window is changed to the new colors.
  *
  *------------------------------------------------------------------------
  */
@@ -275,29 +300,198 @@ Ck_GetPair(winPtr, fg, bg)
     CkWindow *winPtr;
     int fg, bg;
 {
-    int i;
+    int i, new;
+    CkMainInfo *mainPtr = winPtr->mainPtr;
+    CPairTable *tablePtr = (CPairTable *) mainPtr->pairData;
+    Tcl_HashEntry *hPtr;
 
-    if (!(winPtr->mainPtr->flags & CK_HAS_COLOR))
+    if (!(mainPtr->flags & CK_HAS_COLOR))
 	return COLOR_PAIR(0);
-    if (cPairs == NULL) {
-	cPairs = (CPair *) ckalloc(sizeof (CPair) * (COLOR_PAIRS + 2));
-	numPairs = 0;
-	newPair = 1;
+    if (tablePtr == NULL) {
+	int maxPairs = COLOR_PAIRS;
+
+	/*
+	 * Pair numbers must fit into the A_COLOR bits of an attribute.
+	 */
+
+	if (maxPairs > PAIR_NUMBER(A_COLOR) + 1)
+	    maxPairs = PAIR_NUMBER(A_COLOR) + 1;
+	tablePtr = (CPairTable *) ckalloc(sizeof (CPairTable) +
+	    sizeof (CPair) * maxPairs);
+	tablePtr->maxPairs = maxPairs;
+	tablePtr->numPairs = 1;
+	tablePtr->useCount = 0;
+	Tcl_InitHashTable(&tablePtr->pairTable, TCL_ONE_WORD_KEYS);
+	mainPtr->pairData = (ClientData) tablePtr;
     }
-    for (i = 1; i < numPairs; i++)
-	if (cPairs[i].fg == fg && cPairs[i].bg == bg)
-	    return COLOR_PAIR(i);
-    i = newPair;
-    cPairs[i].fg = fg;
-    cPairs[i].bg = bg;
-    init_pair((short) i, (short) fg, (short) bg);
-    if (++newPair >= COLOR_PAIRS)
-	newPair = 1;
+    mainPtr->stats.pairLookups++;
+    hPtr = Tcl_CreateHashEntry(&tablePtr->pairTable, PAIR_KEY(fg, bg), &new);
+    if (!new) {
+	i = (int) (long) Tcl_GetHashValue(hPtr);
+	tablePtr->pairs[i].lastUse = ++tablePtr->useCount;
+	return COLOR_PAIR(i);
+    }
+    if (tablePtr->numPairs < tablePtr->maxPairs)
+	i = tablePtr->numPairs++;
     else
-	numPairs = newPair;
+	i = RecyclePair(mainPtr, tablePtr);
+    if (i <= 0) {
+	Tcl_DeleteHashEntry(hPtr);
+	return COLOR_PAIR(0);
+    }
+    tablePtr->pairs[i].fg = fg;
+    tablePtr->pairs[i].bg = bg;
+    tablePtr->pairs[i].lastUse = ++tablePtr->useCount;
+    tablePtr->pairs[i].hPtr = hPtr;
+    Tcl_SetHashValue(hPtr, (ClientData) (long) i);
+    CkSetTerm(mainPtr);
+    init_pair((short) i, (short) fg, (short) bg);
+    mainPtr->stats.pairAllocs++;
     return COLOR_PAIR(i);
 }
-
+
+/*
+ *------------------------------------------------------------------------
+ *
+ * RecyclePair --
+ *
+ *	Called when all color pairs are initialized to pick one to be
+ *	reinitialized with other colors.  Curses gives no notice when
+ *	a cell is overwritten, so references to pairs are found by
+ *	scanning the contents of all windows of the terminal; this
+ *	only happens when the pair table is full.
+ *
+ * Results:
+ *	The number of the pair to reuse, or 0 if there is none.
+ *	The pair's colors are removed from the table.
+ *
+ * Side effects:
+ *	None.
+ *
+ *------------------------------------------------------------------------
+ */
+
+static int
+RecyclePair(mainPtr, tablePtr)
+    CkMainInfo *mainPtr;
+    CPairTable *tablePtr;
+{
+    int i, victim = 0, forced = 0;
+    char *inUse;
+
+    inUse = (char *) ckalloc(tablePtr->maxPairs);
+    memset(inUse, 0, tablePtr->maxPairs);
+    if (mainPtr->winPtr != NULL)
+	MarkPairs(mainPtr->winPtr, inUse, tablePtr->maxPairs);
+    for (i = 1; i < tablePtr->maxPairs; i++) {
+	if (inUse[i])
+	    continue;
+	if (victim == 0 ||
+	    tablePtr->pairs[i].lastUse < tablePtr->pairs[victim].lastUse)
+	    victim = i;
+    }
+    if (victim == 0) {
+	/*
+	 * Every pair shows up somewhere: recycle the least recently
+	 * looked up one, leaving some cells in the wrong colors until
+	 * they are redrawn.
+	 */
+
+	forced = 1;
+	for (i = 1; i < tablePtr->maxPairs; i++) {
+	    if (victim == 0 ||
+		tablePtr->pairs[i].lastUse < tablePtr->pairs[victim].lastUse)
+		victim = i;
+	}
+    }
+    ckfree(inUse);
+    if (victim > 0) {
+	Tcl_DeleteHashEntry(tablePtr->pairs[victim].hPtr);
+	if (forced)
+	    mainPtr->stats.pairForced++;
+	else
+	    mainPtr->stats.pairEvictions++;
+    }
+    return victim;
+}
+
+/*
+ *------------------------------------------------------------------------
+ *
+ * MarkPairs --
+ *
+ *	Flag the color pairs used by the cells and the current
+ *	attributes of a window and all of its descendants.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Entries of inUse are set to 1.
+ *
+ *------------------------------------------------------------------------
+ */
+
+static void
+MarkPairs(winPtr, inUse, maxPairs)
+    CkWindow *winPtr;
+    char *inUse;
+    int maxPairs;
+{
+    int x, y, width, height, curX, curY, pair;
+    CkWindow *childPtr;
+
+    if (winPtr->window != NULL) {
+	WINDOW *window = winPtr->window;
+
+	getyx(window, curY, curX);
+	getmaxyx(window, height, width);
+	for (y = 0; y < height; y++) {
+	    for (x = 0; x < width; x++) {
+		pair = PAIR_NUMBER(mvwinch(window, y, x) & A_COLOR);
+		if (pair < maxPairs)
+		    inUse[pair] = 1;
+	    }
+	}
+	wmove(window, curY, curX);
+	pair = PAIR_NUMBER(getattrs(window) & A_COLOR);
+	if (pair < maxPairs)
+	    inUse[pair] = 1;
+    }
+    for (childPtr = winPtr->childList; childPtr != NULL;
+	childPtr = childPtr->nextPtr)
+	MarkPairs(childPtr, inUse, maxPairs);
+}
+
+/*
+ *------------------------------------------------------------------------
+ *
+ * CkFreePairs --
+ *
+ *	Release the color pair table of a main window.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory is freed.
+ *
+ *------------------------------------------------------------------------
+ */
+
+void
+CkFreePairs(mainPtr)
+    CkMainInfo *mainPtr;
+{
+    CPairTable *tablePtr = (CPairTable *) mainPtr->pairData;
+
+    if (tablePtr != NULL) {
+	Tcl_DeleteHashTable(&tablePtr->pairTable);
+	ckfree((char *) tablePtr);
+	mainPtr->pairData = NULL;
+    }
+}
+
 /*
  *--------------------------------------------------------------
  *
@@ -1176,6 +1176,7 @@ ArrangeGrid(clientData)
     int intBWidth;	/* Width of internal border in parent window,
 			 * if any. */
     int iPadX, iPadY;
+    double t0;
 
     masterPtr->flags &= ~REQUESTED_RELAYOUT;
 
@@ -1201,6 +1202,7 @@ ArrangeGrid(clientData)
     masterPtr->abortPtr = &abort;
     abort = 0;
     Ck_Preserve((ClientData) masterPtr);
+    t0 = CkProfileStart(masterPtr->winPtr->mainPtr);
 
     /*
      * Pass #1: scan all the slaves to figure out the total amount
@@ -1366,6 +1368,10 @@ ArrangeGrid(clientData)
     }
 
     done:
+    if (!abort) {
+	CkProfileRecord(masterPtr->winPtr->mainPtr, CK_PROFILE_GEOMETRY,
+	    "grid", masterPtr->winPtr->pathName, t0);
+    }
     masterPtr->abortPtr = NULL;
     Ck_Release((ClientData) masterPtr);
 }
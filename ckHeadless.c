@@ -0,0 +1,539 @@
+/*
+ * ckHeadless.c --
+ *
+ *	This file implements headless terminals, which let Ck applications
+ *	run without a real terminal, e.g. for automated tests and
+ *	benchmarks.  Curses is told to write to the null device and to
+ *	read from a pipe, so widgets are displayed by the usual code into
+ *	curses' in-memory copy of the screen.  The "curses headless"
+ *	command feeds input into the pipe and reads the characters and
+ *	attributes of that screen back.
+ *
+ * Copyright (c) 1995 Christian Werner
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ */
+
+#include "ckPort.h"
+#include "ck.h"
+
+/*
+ * Size of a headless terminal if none is specified.
+ */
+
+#define DEF_HEADLESS_WIDTH	80
+#define DEF_HEADLESS_HEIGHT	24
+
+/*
+ * One of the following structures is hung off the main window
+ * of a headless terminal.
+ */
+
+typedef struct HeadlessData {
+    int inputFd;		/* Write end of the pipe from which curses
+				 * reads input. */
+    int width, height;		/* Size of the screen. */
+} HeadlessData;
+
+/*
+ * Line drawing characters of the alternate character set are
+ * read back as the following ASCII characters.
+ */
+
+static char acsChars[] = "lkmjtuvwnqx`afg~,+.-h0ioprsyz{|}";
+static char asciiChars[] = "+++++++++-|+:'#o<>v^###---_<>*!f";
+
+/*
+ * Prototypes for procedures defined in this file:
+ */
+
+static int	GetLineRange _ANSI_ARGS_((Tcl_Interp *interp,
+		    HeadlessData *headPtr, int argc, char **argv,
+		    int *firstPtr, int *lastPtr));
+static void	GetLineAttributes _ANSI_ARGS_((int y, int width,
+		    Tcl_DString *dsPtr));
+static void	GetLineText _ANSI_ARGS_((CkMainInfo *mainPtr, int y,
+		    int width, Tcl_DString *dsPtr));
+
+/*
+ *--------------------------------------------------------------
+ *
+ * CkHeadlessOpen --
+ *
+ *	Called instead of opening a terminal device when the
+ *	application is to run on a headless terminal.  The size
+ *	of the terminal is given as "widthxheight"; an empty
+ *	string means 80x24.
+ *
+ * Results:
+ *	A token for the headless terminal which is to be passed
+ *	to CkHeadlessSetup once curses is initialized and finally
+ *	to CkFreeHeadless.  *inFilePtr and *outFilePtr are set to
+ *	the streams for curses.  If an error occurs, NULL is
+ *	returned and an error message is left in interp->result.
+ *
+ * Side effects:
+ *	A pipe is created and the null device is opened.
+ *
+ *--------------------------------------------------------------
+ */
+
+ClientData
+CkHeadlessOpen(interp, size, inFilePtr, outFilePtr)
+    Tcl_Interp *interp;		/* Used for error reporting. */
+    char *size;			/* Size of the terminal. */
+    FILE **inFilePtr;		/* Returns stream curses reads from. */
+    FILE **outFilePtr;		/* Returns stream curses writes to. */
+{
+#ifdef __WIN32__
+    Tcl_AppendResult(interp, "can't open headless terminal: ",
+	"not supported on this platform", (char *) NULL);
+    return NULL;
+#else
+    HeadlessData *headPtr;
+    int width, height, fds[2];
+    char c;
+    FILE *inFile = NULL, *outFile;
+
+    width = DEF_HEADLESS_WIDTH;
+    height = DEF_HEADLESS_HEIGHT;
+    if (*size != '\0' &&
+	(sscanf(size, "%dx%d%c", &width, &height, &c) != 2 ||
+	 width <= 0 || height <= 0)) {
+	Tcl_AppendResult(interp, "bad headless terminal size \"", size,
+	    "\": must be widthxheight", (char *) NULL);
+	return NULL;
+    }
+    if (pipe(fds) < 0) {
+	Tcl_AppendResult(interp, "couldn't create pipe for headless ",
+	    "terminal: ", Tcl_PosixError(interp), (char *) NULL);
+	return NULL;
+    }
+    outFile = fopen("/dev/null", "w");
+    if (outFile != NULL) {
+	inFile = fdopen(fds[0], "r");
+    }
+    if (inFile == NULL) {
+	Tcl_AppendResult(interp, "couldn't open headless terminal: ",
+	    Tcl_PosixError(interp), (char *) NULL);
+	if (outFile != NULL) {
+	    fclose(outFile);
+	}
+	close(fds[0]);
+	close(fds[1]);
+	return NULL;
+    }
+
+    /*
+     * Nobody but this process is to use the pipe, and writing to
+     * it must never block, since the same process reads it.
+     */
+
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+    fcntl(fileno(outFile), F_SETFD, FD_CLOEXEC);
+
+    headPtr = (HeadlessData *) ckalloc(sizeof (HeadlessData));
+    headPtr->inputFd = fds[1];
+    headPtr->width = width;
+    headPtr->height = height;
+    *inFilePtr = inFile;
+    *outFilePtr = outFile;
+    return (ClientData) headPtr;
+#endif
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * CkHeadlessSetup --
+ *
+ *	Called when curses has been initialized for a headless
+ *	terminal, but before the size of the screen is used.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The curses screen is given the size of the headless terminal.
+ *	Without ncurses the size from the terminfo entry is kept.
+ *
+ *--------------------------------------------------------------
+ */
+
+void
+CkHeadlessSetup(mainPtr)
+    CkMainInfo *mainPtr;
+{
+    HeadlessData *headPtr = (HeadlessData *) mainPtr->headlessData;
+
+#ifdef NCURSES_VERSION
+    resizeterm(headPtr->height, headPtr->width);
+#endif
+    headPtr->width = COLS;
+    headPtr->height = LINES;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * CkFreeHeadless --
+ *
+ *	Release a token returned by CkHeadlessOpen.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The write end of the input pipe is closed and memory is freed.
+ *	The streams for curses must be closed by the caller.
+ *
+ *--------------------------------------------------------------
+ */
+
+void
+CkFreeHeadless(headlessData)
+    ClientData headlessData;
+{
+    HeadlessData *headPtr = (HeadlessData *) headlessData;
+
+    if (headPtr != NULL) {
+	close(headPtr->inputFd);
+	ckfree((char *) headPtr);
+    }
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * CkHeadlessCmd --
+ *
+ *	This procedure is invoked to process the "curses headless"
+ *	Tcl command.  See the user documentation for details on
+ *	what it does.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	See the user documentation.
+ *
+ *--------------------------------------------------------------
+ */
+
+int
+CkHeadlessCmd(clientData, interp, argc, argv)
+    ClientData clientData;	/* Main window. */
+    Tcl_Interp *interp;		/* Current interpreter. */
+    int argc;			/* Number of arguments. */
+    char **argv;		/* Argument strings. */
+{
+    CkMainInfo *mainPtr = ((CkWindow *) clientData)->mainPtr;
+    HeadlessData *headPtr = (HeadlessData *) mainPtr->headlessData;
+    Tcl_DString ds;
+    int c, length, y, x, curY, curX, first, last;
+    char buf[64];
+
+    if (argc == 2) {
+	Tcl_SetResult(interp, (headPtr != NULL) ? "1" : "0", TCL_STATIC);
+	return TCL_OK;
+    }
+    c = argv[2][0];
+    length = strlen(argv[2]);
+    if (headPtr == NULL) {
+	Tcl_AppendResult(interp, "can't use \"", argv[0], " ", argv[1],
+	    " ", argv[2], "\": terminal isn't headless", (char *) NULL);
+	return TCL_ERROR;
+    }
+    CkSetTerm(mainPtr);
+    if ((c == 'a') && (strncmp(argv[2], "attributes", length) == 0)) {
+	if (GetLineRange(interp, headPtr, argc, argv, &first, &last)
+	    != TCL_OK)
+	    return TCL_ERROR;
+	Tcl_DStringInit(&ds);
+	getyx(curscr, curY, curX);
+	for (y = first; y <= last; y++) {
+	    Tcl_DStringStartSublist(&ds);
+	    GetLineAttributes(y, headPtr->width, &ds);
+	    Tcl_DStringEndSublist(&ds);
+	}
+	wmove(curscr, curY, curX);
+	Tcl_DStringResult(interp, &ds);
+    } else if ((c == 'c') && (strncmp(argv[2], "cursor", length) == 0)) {
+	if (argc != 3) {
+	    Tcl_AppendResult(interp, "wrong # args: should be \"", argv[0],
+		" ", argv[1], " cursor\"", (char *) NULL);
+	    return TCL_ERROR;
+	}
+	getyx(curscr, y, x);
+	sprintf(buf, "%d %d", x, y);
+	Tcl_SetResult(interp, buf, TCL_VOLATILE);
+    } else if ((c == 'i') && (strncmp(argv[2], "input", length) == 0)) {
+	char *string;
+	int n, count;
+
+	if (argc != 4) {
+	    Tcl_AppendResult(interp, "wrong # args: should be \"", argv[0],
+		" ", argv[1], " input string\"", (char *) NULL);
+	    return TCL_ERROR;
+	}
+	Tcl_DStringInit(&ds);
+#if CK_USE_UTF
+	if (mainPtr->isoEncoding != NULL) {
+	    Tcl_UtfToExternalDString(mainPtr->isoEncoding, argv[3], -1, &ds);
+	} else
+#endif
+	Tcl_DStringAppend(&ds, argv[3], -1);
+	string = Tcl_DStringValue(&ds);
+	count = Tcl_DStringLength(&ds);
+	while (count > 0) {
+	    n = write(headPtr->inputFd, string, count);
+	    if (n <= 0) {
+		if (n < 0 && errno == EINTR)
+		    continue;
+		Tcl_DStringFree(&ds);
+		Tcl_AppendResult(interp, "couldn't write input: ",
+		    (n < 0 && errno != EAGAIN) ? Tcl_PosixError(interp) :
+		    "input buffer is full", (char *) NULL);
+		return TCL_ERROR;
+	    }
+	    string += n;
+	    count -= n;
+	}
+	Tcl_DStringFree(&ds);
+    } else if ((c == 's') && (strncmp(argv[2], "size", length) == 0)) {
+	if (argc != 3) {
+	    Tcl_AppendResult(interp, "wrong # args: should be \"", argv[0],
+		" ", argv[1], " size\"", (char *) NULL);
+	    return TCL_ERROR;
+	}
+	sprintf(buf, "%d %d", headPtr->width, headPtr->height);
+	Tcl_SetResult(interp, buf, TCL_VOLATILE);
+    } else if ((c == 't') && (strncmp(argv[2], "text", length) == 0)) {
+	if (GetLineRange(interp, headPtr, argc, argv, &first, &last)
+	    != TCL_OK)
+	    return TCL_ERROR;
+	Tcl_DStringInit(&ds);
+	getyx(curscr, curY, curX);
+	for (y = first; y <= last; y++) {
+	    GetLineText(mainPtr, y, headPtr->width, &ds);
+	}
+	wmove(curscr, curY, curX);
+	Tcl_DStringResult(interp, &ds);
+    } else {
+	Tcl_AppendResult(interp, "bad option \"", argv[2],
+	    "\": must be attributes, cursor, input, size or text",
+	    (char *) NULL);
+	return TCL_ERROR;
+    }
+    return TCL_OK;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * GetLineRange --
+ *
+ *	Parse the optional "?first? ?last?" line numbers of the
+ *	"curses headless text|attributes" commands.
+ *
+ * Results:
+ *	A standard Tcl result.  The range, clipped to the screen,
+ *	is returned in *firstPtr and *lastPtr; it is empty if
+ *	*firstPtr is greater than *lastPtr.
+ *
+ * Side effects:
+ *	None.
+ *
+ *--------------------------------------------------------------
+ */
+
+static int
+GetLineRange(interp, headPtr, argc, argv, firstPtr, lastPtr)
+    Tcl_Interp *interp;
+    HeadlessData *headPtr;
+    int argc;
+    char **argv;
+    int *firstPtr, *lastPtr;
+{
+    if (argc > 5) {
+	Tcl_AppendResult(interp, "wrong # args: should be \"", argv[0],
+	    " ", argv[1], " ", argv[2], " ?first? ?last?\"", (char *) NULL);
+	return TCL_ERROR;
+    }
+    *firstPtr = 0;
+    *lastPtr = headPtr->height - 1;
+    if (argc > 3) {
+	if (Tcl_GetInt(interp, argv[3], firstPtr) != TCL_OK)
+	    return TCL_ERROR;
+	*lastPtr = *firstPtr;
+	if (argc > 4 && Tcl_GetInt(interp, argv[4], lastPtr) != TCL_OK)
+	    return TCL_ERROR;
+    }
+    if (*firstPtr < 0)
+	*firstPtr = 0;
+    if (*lastPtr >= headPtr->height)
+	*lastPtr = headPtr->height - 1;
+    return TCL_OK;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * GetLineText --
+ *
+ *	Append the characters of a line of the screen, as last
+ *	updated by curses, as a list element to a dynamic string.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Trailing blanks are dropped.  Line drawing characters are
+ *	converted to ASCII, see asciiChars above.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+GetLineText(mainPtr, y, width, dsPtr)
+    CkMainInfo *mainPtr;
+    int y, width;
+    Tcl_DString *dsPtr;
+{
+    Tcl_DString line;
+    int x, ch, end = 0;
+    char *p;
+#ifdef USE_NCURSESW
+    cchar_t cch;
+    wchar_t wch[CCHARW_MAX + 1];
+    attr_t attrs;
+    short pair;
+    char buf[TCL_UTF_MAX];
+#else
+    chtype cch;
+    char buf[1];
+#endif
+
+    Tcl_DStringInit(&line);
+    for (x = 0; x < width; x++) {
+#ifdef USE_NCURSESW
+	mvwin_wch(curscr, y, x, &cch);
+	wch[0] = 0;
+	getcchar(&cch, wch, &attrs, &pair, NULL);
+	ch = wch[0];
+	if (attrs & WA_ALTCHARSET) {
+	    p = (ch < 0x80) ? strchr(acsChars, ch) : NULL;
+	    ch = (p != NULL && ch != 0) ? asciiChars[p - acsChars] : '?';
+	}
+	if (ch == 0) {
+	    continue;		/* right half of a wide character */
+	}
+	Tcl_DStringAppend(&line, buf, Tcl_UniCharToUtf(ch, buf));
+#else
+	cch = mvwinch(curscr, y, x);
+	ch = cch & A_CHARTEXT;
+	if (cch & A_ALTCHARSET) {
+	    p = (ch != 0) ? strchr(acsChars, ch) : NULL;
+	    ch = (p != NULL) ? asciiChars[p - acsChars] : '?';
+	}
+	buf[0] = ch;
+	Tcl_DStringAppend(&line, buf, 1);
+#endif
+	if (ch != ' ')
+	    end = Tcl_DStringLength(&line);
+    }
+    Tcl_DStringSetLength(&line, end);
+#if CK_USE_UTF && !defined(USE_NCURSESW)
+    if (mainPtr->isoEncoding != NULL) {
+	Tcl_DString utf;
+
+	Tcl_ExternalToUtfDString(mainPtr->isoEncoding,
+	    Tcl_DStringValue(&line), Tcl_DStringLength(&line), &utf);
+	Tcl_DStringAppendElement(dsPtr, Tcl_DStringValue(&utf));
+	Tcl_DStringFree(&utf);
+    } else
+#endif
+    Tcl_DStringAppendElement(dsPtr, Tcl_DStringValue(&line));
+    Tcl_DStringFree(&line);
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * GetLineAttributes --
+ *
+ *	Append the attributes of a line of the screen, as last
+ *	updated by curses, to a dynamic string.  Each run of
+ *	characters having the same attributes and colors becomes
+ *	a list element {column count attributes foreground background}.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+GetLineAttributes(y, width, dsPtr)
+    int y, width;
+    Tcl_DString *dsPtr;
+{
+    int x, start, attr = 0, lastAttr = 0, pair = 0, lastPair = 0;
+    short fg, bg;
+    char *name, buf[32];
+#ifdef USE_NCURSESW
+    cchar_t cch;
+    wchar_t wch[CCHARW_MAX + 1];
+    attr_t attrs;
+    short spair;
+#else
+    chtype cch;
+#endif
+
+    for (start = x = 0; x <= width; x++) {
+	if (x < width) {
+#ifdef USE_NCURSESW
+	    mvwin_wch(curscr, y, x, &cch);
+	    getcchar(&cch, wch, &attrs, &spair, NULL);
+	    attr = attrs & (A_ATTRIBUTES & ~(A_COLOR | A_ALTCHARSET));
+	    pair = spair;
+#else
+	    cch = mvwinch(curscr, y, x);
+	    attr = cch & (A_ATTRIBUTES & ~(A_COLOR | A_ALTCHARSET));
+	    pair = PAIR_NUMBER(cch & A_COLOR);
+#endif
+	    if (x == 0) {
+		lastAttr = attr;
+		lastPair = pair;
+		continue;
+	    }
+	    if (attr == lastAttr && pair == lastPair)
+		continue;
+	}
+	Tcl_DStringStartSublist(dsPtr);
+	sprintf(buf, "%d", start);
+	Tcl_DStringAppendElement(dsPtr, buf);
+	sprintf(buf, "%d", x - start);
+	Tcl_DStringAppendElement(dsPtr, buf);
+	name = Ck_NameOfAttr(lastAttr);
+	Tcl_DStringAppendElement(dsPtr, name);
+	ckfree(name);
+	if (pair_content(lastPair, &fg, &bg) == ERR) {
+	    fg = bg = -1;
+	}
+	name = Ck_NameOfColor(fg);
+	Tcl_DStringAppendElement(dsPtr, (name != NULL) ? name : "default");
+	name = Ck_NameOfColor(bg);
+	Tcl_DStringAppendElement(dsPtr, (name != NULL) ? name : "default");
+	Tcl_DStringEndSublist(dsPtr);
+	start = x;
+	lastAttr = attr;
+	lastPair = pair;
+    }
+}
@@ -29,8 +29,6 @@ typedef struct Element {
     				 * characters. */
     int selected;		/* 1 means this item is selected, 0 means
 				 * it isn't. */
-    struct Element *nextPtr;	/* Next in list of all elements of this
-				 * listbox, or NULL for last element. */
     char text[4];		/* Characters of this element, NULL-
 				 * terminated.  The actual space allocated
 				 * here will be as large as needed (> 4,
@@ -41,6 +39,47 @@ typedef struct Element {
 #define ElementSize(stringLength) \
 	(sizeof(Element) - 3 + stringLength)
 
+/*
+ * In virtual mode (non-empty -itemcommand option) the listbox doesn't
+ * hold its elements.  Instead, the text of an element is fetched on
+ * demand by invoking the item command, and kept in a bounded cache
+ * of records of the following type.  The cache is a hash table keyed
+ * by element index plus a doubly-linked list in least recently used
+ * order:
+ */
+
+typedef struct CachedItem {
+    int index;			/* Index of element in listbox. */
+    Tcl_HashEntry *hPtr;	/* Entry in itemCache of listbox. */
+    struct CachedItem *prevPtr;	/* Next more recently used item, or NULL
+				 * for the most recently used one. */
+    struct CachedItem *nextPtr;	/* Next less recently used item, or NULL
+				 * for the least recently used one. */
+    Element element;		/* Text of element;  its "selected" field
+				 * is unused.  Must be the last field of
+				 * the record. */
+} CachedItem;
+
+#define CachedItemSize(stringLength) \
+	(sizeof(CachedItem) - sizeof(Element) + ElementSize(stringLength))
+
+/*
+ * Minimum number of elements kept in the item cache of a virtual
+ * listbox.  The cache always holds at least two windowfuls.
+ */
+
+#define ITEM_CACHE_SIZE		256
+
+/*
+ * The selection of a virtual listbox is stored as a sorted array of
+ * disjoint, non-adjacent ranges of indices:
+ */
+
+typedef struct SelRange {
+    int first;			/* Index of first selected element. */
+    int last;			/* Index of last selected element. */
+} SelRange;
+
 /*
  * A data structure of the following type is kept for each listbox
  * widget managed by this file:
@@ -54,10 +93,30 @@ typedef struct {
     Tcl_Interp *interp;		/* Interpreter associated with listbox. */
     Tcl_Command widgetCmd;      /* Token for listbox's widget command. */
     int numElements;		/* Total number of elements in this listbox. */
-    Element *firstPtr;		/* First in list of elements (NULL if no
-				 * elements). */
-    Element *lastPtr;		/* Last in list of elements (NULL if no
-				 * elements). */
+    Element **elements;		/* Array of numElements pointers to the
+				 * elements in order, so that an element
+				 * can be found directly by its index
+				 * (NULL if no space allocated yet). */
+    int elementSpace;		/* Number of slots allocated for
+				 * elements. */
+
+    /*
+     * Information used in virtual mode only:
+     */
+
+    char *itemCmd;		/* Value of -itemcommand option:  command
+				 * prefix to fetch the text of an element.
+				 * NULL means the listbox holds its own
+				 * elements.  Malloc'ed. */
+    int itemCount;		/* Value of -itemcount option:  number of
+				 * elements in a virtual listbox. */
+    Tcl_HashTable itemCache;	/* Maps element indices to CachedItems. */
+    CachedItem *firstItemPtr;	/* Most recently used cached item. */
+    CachedItem *lastItemPtr;	/* Least recently used cached item. */
+    int numCached;		/* Number of entries in itemCache. */
+    SelRange *selRanges;	/* Selected ranges, sorted by index.  NULL
+				 * if no space allocated yet. */
+    int numRanges;		/* Number of ranges in selRanges. */
 
     /*
      * Information used when displaying widget:
@@ -76,6 +135,8 @@ typedef struct {
     int height;			/* Desired height of window, in lines. */
     int topIndex;		/* Index of top-most element visible in
 				 * window. */
+    int drawnTop;		/* Value of topIndex when the window was
+				 * last drawn, -1 if it never was. */
     int fullLines;		/* Number of lines that fit are completely
 				 * visible in window.  There may be one
 				 * additional line at the bottom that is
@@ -134,12 +195,19 @@ typedef struct {
  *				to be updated.
  * GOT_FOCUS:			Non-zero means this widget currently
  *				has the input focus.
+ * FETCHING_ITEM:		Non-zero means the item command of a
+ *				virtual listbox is being invoked.
+ * REDRAW_ALL:			Non-zero means more than the view has
+ *				changed since the last redisplay, so
+ *				that all lines must be drawn again.
  */
 
 #define REDRAW_PENDING		1
 #define UPDATE_V_SCROLLBAR	2
 #define UPDATE_H_SCROLLBAR	4
 #define GOT_FOCUS		8
+#define FETCHING_ITEM		16
+#define REDRAW_ALL		32
 
 /*
  * Information used for argv parsing:
@@ -182,6 +250,11 @@ static Ck_ConfigSpec configSpecs[] = {
 	DEF_LISTBOX_FG, Ck_Offset(Listbox, normalFg), 0},
     {CK_CONFIG_INT, "-height", "height", "Height",
 	DEF_LISTBOX_HEIGHT, Ck_Offset(Listbox, height), 0},
+    {CK_CONFIG_STRING, "-itemcommand", "itemCommand", "ItemCommand",
+	DEF_LISTBOX_ITEM_COMMAND, Ck_Offset(Listbox, itemCmd),
+	CK_CONFIG_NULL_OK},
+    {CK_CONFIG_INT, "-itemcount", "itemCount", "ItemCount",
+	DEF_LISTBOX_ITEM_COUNT, Ck_Offset(Listbox, itemCount), 0},
     {CK_CONFIG_ATTR, "-selectattributes", "selectAttributes",
         "SelectAttributes", DEF_LISTBOX_SELECT_ATTR_COLOR,
         Ck_Offset(Listbox, selAttr), CK_CONFIG_COLOR_ONLY},
@@ -232,6 +305,8 @@ static void		DeleteEls _ANSI_ARGS_((Listbox *listPtr, int first,
 			    int last));
 static void		DestroyListbox _ANSI_ARGS_((ClientData clientData));
 static void		DisplayListbox _ANSI_ARGS_((ClientData clientData));
+static Element *	FetchItem _ANSI_ARGS_((Listbox *listPtr, int index));
+static void		FlushItemCache _ANSI_ARGS_((Listbox *listPtr));
 static int		GetListboxIndex _ANSI_ARGS_((Tcl_Interp *interp,
 			    Listbox *listPtr, char *string, int numElsOK,
 			    int *indexPtr));
@@ -252,6 +327,10 @@ static int		ListboxWidgetCmd _ANSI_ARGS_((ClientData clientData,
 			    Tcl_Interp *interp, int argc, char **argv));
 static int		NearestListboxElement _ANSI_ARGS_((Listbox *listPtr,
 			    int y));
+static int		VirtualSelected _ANSI_ARGS_((Listbox *listPtr,
+			    int index));
+static void		VirtualSelect _ANSI_ARGS_((Listbox *listPtr,
+			    int first, int last, int select));
 
 /*
  *--------------------------------------------------------------
@@ -306,8 +385,16 @@ Ck_ListboxCmd(clientData, interp, argc, argv)
     listPtr->widgetCmd = Tcl_CreateCommand(interp, listPtr->winPtr->pathName,
         ListboxWidgetCmd, (ClientData) listPtr, ListboxCmdDeletedProc);
     listPtr->numElements = 0;
-    listPtr->firstPtr = NULL;
-    listPtr->lastPtr = NULL;
+    listPtr->elements = NULL;
+    listPtr->elementSpace = 0;
+    listPtr->itemCmd = NULL;
+    listPtr->itemCount = 0;
+    Tcl_InitHashTable(&listPtr->itemCache, TCL_ONE_WORD_KEYS);
+    listPtr->firstItemPtr = NULL;
+    listPtr->lastItemPtr = NULL;
+    listPtr->numCached = 0;
+    listPtr->selRanges = NULL;
+    listPtr->numRanges = 0;
     listPtr->normalBg = 0;
     listPtr->normalFg = 0;
     listPtr->normalAttr = 0;
@@ -320,6 +407,7 @@ Ck_ListboxCmd(clientData, interp, argc, argv)
     listPtr->width = 0;
     listPtr->height = 0;
     listPtr->topIndex = 0;
+    listPtr->drawnTop = -1;
     listPtr->fullLines = 1;
     listPtr->maxWidth = 0;
     listPtr->xOffset = 0;
@@ -430,7 +518,6 @@ ListboxWidgetCmd(clientData, interp, argc, argv)
 	    && (length >= 2)) {
 	int i, count;
 	char index[20];
-	Element *elPtr;
 
 	if (argc != 2) {
 	    Tcl_AppendResult(interp, "wrong # args: should be \"",
@@ -439,12 +526,25 @@ ListboxWidgetCmd(clientData, interp, argc, argv)
 	    goto error;
 	}
 	count = 0;
-	for (i = 0, elPtr = listPtr->firstPtr; elPtr != NULL;
-		i++, elPtr = elPtr->nextPtr) {
-	    if (elPtr->selected) {
-		sprintf(index, "%d", i);
-		Tcl_AppendElement(interp, index);
-		count++;
+	if (listPtr->itemCmd != NULL) {
+	    SelRange *rangePtr;
+
+	    for (rangePtr = listPtr->selRanges;
+		    rangePtr < listPtr->selRanges + listPtr->numRanges;
+		    rangePtr++) {
+		for (i = rangePtr->first; i <= rangePtr->last; i++) {
+		    sprintf(index, "%d", i);
+		    Tcl_AppendElement(interp, index);
+		    count++;
+		}
+	    }
+	} else {
+	    for (i = 0; i < listPtr->numElements; i++) {
+		if (listPtr->elements[i]->selected) {
+		    sprintf(index, "%d", i);
+		    Tcl_AppendElement(interp, index);
+		    count++;
+		}
 	    }
 	}
 	if (count != listPtr->numSelected) {
@@ -459,6 +559,9 @@ ListboxWidgetCmd(clientData, interp, argc, argv)
 		    (char *) NULL);
 	    goto error;
 	}
+	if (listPtr->itemCmd != NULL) {
+	    goto virtualError;
+	}
 	if (GetListboxIndex(interp, listPtr, argv[2], 0, &first) != TCL_OK) {
 	    goto error;
 	}
@@ -472,7 +575,6 @@ ListboxWidgetCmd(clientData, interp, argc, argv)
 	DeleteEls(listPtr, first, last);
     } else if ((c == 'g') && (strncmp(argv[1], "get", length) == 0)) {
 	int first, last, i;
-	Element *elPtr;
 
 	if ((argc != 3) && (argc != 4)) {
 	    Tcl_AppendResult(interp, "wrong # args: should be \"",
@@ -486,16 +588,39 @@ ListboxWidgetCmd(clientData, interp, argc, argv)
 		0, &last) != TCL_OK)) {
 	    goto error;
 	}
-	for (elPtr = listPtr->firstPtr, i = 0; i < first;
-		i++, elPtr = elPtr->nextPtr) {
-	    /* Empty loop body. */
-	}
-	if (elPtr != NULL) {
+	if ((first < listPtr->numElements) && (listPtr->itemCmd != NULL)) {
+	    Element *elPtr;
+	    Tcl_DString ds;
+
+	    /*
+	     * Each fetch evaluates the item command, which clobbers the
+	     * interpreter's result, so collect the elements aside.
+	     */
+
 	    if (argc == 3) {
-              Tcl_SetResult(interp, elPtr->text, TCL_VOLATILE);
+		last = first;
+	    }
+	    Tcl_DStringInit(&ds);
+	    for (i = first; i <= last; i++) {
+		elPtr = FetchItem(listPtr, i);
+		if (elPtr == NULL) {
+		    Tcl_DStringFree(&ds);
+		    goto error;
+		}
+		if (argc == 3) {
+		    Tcl_DStringAppend(&ds, elPtr->text, elPtr->textLength);
+		} else {
+		    Tcl_DStringAppendElement(&ds, elPtr->text);
+		}
+	    }
+	    Tcl_DStringResult(interp, &ds);
+	} else if (first < listPtr->numElements) {
+	    if (argc == 3) {
+              Tcl_SetResult(interp, listPtr->elements[first]->text,
+		  TCL_VOLATILE);
 	    } else {
-		for (  ; i <= last; i++, elPtr = elPtr->nextPtr) {
-		    Tcl_AppendElement(interp, elPtr->text);
+		for (i = first; i <= last; i++) {
+		    Tcl_AppendElement(interp, listPtr->elements[i]->text);
 		}
 	    }
 	}
@@ -525,6 +650,9 @@ ListboxWidgetCmd(clientData, interp, argc, argv)
 		    (char *) NULL);
 	    goto error;
 	}
+	if (listPtr->itemCmd != NULL) {
+	    goto virtualError;
+	}
 	if (GetListboxIndex(interp, listPtr, argv[2], 1, &index)
 		!= TCL_OK) {
 	    goto error;
@@ -606,19 +734,15 @@ ListboxWidgetCmd(clientData, interp, argc, argv)
 	} else if ((c == 'c') && (strncmp(argv[2], "clear", length) == 0)) {
 	    ListboxSelect(listPtr, first, last, 0);
 	} else if ((c == 'i') && (strncmp(argv[2], "includes", length) == 0)) {
-	    int i;
-	    Element *elPtr;
-
 	    if (argc != 4) {
 		Tcl_AppendResult(interp, "wrong # args: should be \"",
 			argv[0], " selection includes index\"", (char *) NULL);
 		goto error;
 	    }
-	    for (elPtr = listPtr->firstPtr, i = 0; i < first;
-		    i++, elPtr = elPtr->nextPtr) {
-		/* Empty loop body. */
-	    }
-	    if ((elPtr != NULL) && (elPtr->selected)) {
+	    if ((first < listPtr->numElements)
+		    && ((listPtr->itemCmd != NULL) ?
+			VirtualSelected(listPtr, first) :
+			listPtr->elements[first]->selected)) {
                 Tcl_SetResult(interp, "1", TCL_STATIC);
 	    } else {
                 Tcl_SetResult(interp, "0", TCL_STATIC);
@@ -737,6 +861,11 @@ ListboxWidgetCmd(clientData, interp, argc, argv)
     Ck_Release((ClientData) listPtr);
     return result;
 
+    virtualError:
+    Tcl_AppendResult(interp, "can't ", argv[1], " elements of virtual ",
+	    "listbox \"", argv[0], "\": use -itemcount instead",
+	    (char *) NULL);
+
     error:
     Ck_Release((ClientData) listPtr);
     return TCL_ERROR;
@@ -765,16 +894,25 @@ DestroyListbox(clientData)
     ClientData clientData;	/* Info about listbox widget. */
 {
     register Listbox *listPtr = (Listbox *) clientData;
-    register Element *elPtr, *nextPtr;
+    int i;
 
     /*
-     * Free up all of the list elements.
+     * Free up all of the list elements.  A virtual listbox has none;
+     * its numElements is the item count.
      */
 
-    for (elPtr = listPtr->firstPtr; elPtr != NULL; ) {
-	nextPtr = elPtr->nextPtr;
-	ckfree((char *) elPtr);
-	elPtr = nextPtr;
+    if (listPtr->itemCmd == NULL) {
+	for (i = 0; i < listPtr->numElements; i++) {
+	    ckfree((char *) listPtr->elements[i]);
+	}
+    }
+    if (listPtr->elements != NULL) {
+	ckfree((char *) listPtr->elements);
+    }
+    FlushItemCache(listPtr);
+    Tcl_DeleteHashTable(&listPtr->itemCache);
+    if (listPtr->selRanges != NULL) {
+	ckfree((char *) listPtr->selRanges);
     }
 
     Ck_FreeOptions(configSpecs, (char *) listPtr, 0);
@@ -849,11 +987,69 @@ ConfigureListbox(interp, listPtr, argc, argv, flags)
     char **argv;		/* Arguments. */
     int flags;			/* Flags to pass to Ck_ConfigureWidget. */
 {
+    Ck_ConfigSpec *specPtr;
+    int wasVirtual = (listPtr->itemCmd != NULL);
+    int oldCount = listPtr->numElements;
+    int itemsChanged = 0;
+
     if (Ck_ConfigureWidget(interp, listPtr->winPtr, configSpecs,
 	    argc, argv, (char *) listPtr, flags) != TCL_OK) {
 	return TCL_ERROR;
     }
 
+    /*
+     * Any change to -itemcommand or -itemcount discards what was fetched
+     * from the item command so far.  Entering virtual mode discards the
+     * listbox's own elements, leaving it clears the listbox.
+     */
+
+    for (specPtr = configSpecs; specPtr->type != CK_CONFIG_END; specPtr++) {
+	if ((specPtr->specFlags & CK_CONFIG_OPTION_SPECIFIED)
+		&& ((specPtr->offset == Ck_Offset(Listbox, itemCmd))
+		|| (specPtr->offset == Ck_Offset(Listbox, itemCount)))) {
+	    itemsChanged = 1;
+	}
+    }
+    if (listPtr->itemCount < 0) {
+	listPtr->itemCount = 0;
+    }
+    if (wasVirtual && (itemsChanged || (listPtr->itemCmd == NULL))) {
+	FlushItemCache(listPtr);
+	listPtr->maxWidth = 0;
+	listPtr->xOffset = 0;
+    }
+    if (listPtr->itemCmd != NULL) {
+	if (!wasVirtual) {
+	    DeleteEls(listPtr, 0, listPtr->numElements-1);
+	    oldCount = 0;
+	}
+	listPtr->numElements = listPtr->itemCount;
+	if (listPtr->numElements < oldCount) {
+	    VirtualSelect(listPtr, listPtr->numElements, oldCount-1, 0);
+	}
+    } else if (wasVirtual) {
+	listPtr->numRanges = 0;
+	listPtr->numSelected = 0;
+	listPtr->numElements = 0;
+    }
+    if (listPtr->numElements != oldCount) {
+	if (listPtr->selectAnchor >= listPtr->numElements) {
+	    listPtr->selectAnchor = 0;
+	}
+	if (listPtr->active >= listPtr->numElements) {
+	    listPtr->active = listPtr->numElements-1;
+	    if (listPtr->active < 0) {
+		listPtr->active = 0;
+	    }
+	}
+	if (listPtr->topIndex > listPtr->numElements - listPtr->fullLines) {
+	    listPtr->topIndex = listPtr->numElements - listPtr->fullLines;
+	    if (listPtr->topIndex < 0) {
+		listPtr->topIndex = 0;
+	    }
+	}
+    }
+
     /*
      * Register the desired geometry for the window and arrange for
      * the window to be redisplayed.
@@ -888,7 +1084,8 @@ DisplayListbox(clientData)
     Listbox *listPtr = (Listbox *) clientData;
     CkWindow *winPtr = listPtr->winPtr;
     Element *elPtr;
-    int i, limit, y, width, cursorY;
+    int i, first, limit, y, width, cursorY, selected, scroll;
+    double t0;
 
     listPtr->flags &= ~REDRAW_PENDING;
     if (listPtr->flags & UPDATE_V_SCROLLBAR) {
@@ -901,33 +1098,79 @@ DisplayListbox(clientData)
     if ((listPtr->winPtr == NULL) || !(winPtr->flags & CK_MAPPED)) {
 	return;
     }
+    t0 = CkProfileStart(winPtr->mainPtr);
 
+    /*
+     * If nothing but the view has changed since the last redisplay,
+     * move the lines still visible within the window and draw only
+     * those which came into view.  Otherwise draw everything.
+     */
+
+    first = listPtr->topIndex;
+    limit = listPtr->topIndex + listPtr->fullLines;
+    scroll = listPtr->topIndex - listPtr->drawnTop;
     Ck_SetWindowAttr(winPtr, listPtr->normalFg, listPtr->normalBg,
         listPtr->normalAttr);
-    Ck_ClearToBot(winPtr, 0, 0);
+    if (!(listPtr->flags & REDRAW_ALL) && (listPtr->drawnTop >= 0) &&
+	    Ck_ScrollWindow(winPtr, 0, listPtr->fullLines, scroll)) {
+	if (scroll > 0) {
+	    first = limit - scroll;
+	} else {
+	    limit = first - scroll;
+	}
+	for (y = first - listPtr->topIndex; y < limit - listPtr->topIndex;
+		y++) {
+	    Ck_ClearToEol(winPtr, 0, y);
+	}
+    } else {
+	Ck_ClearToBot(winPtr, 0, 0);
+    }
+    listPtr->flags &= ~REDRAW_ALL;
+    listPtr->drawnTop = listPtr->topIndex;
+    cursorY = 0;
+    if ((listPtr->flags & GOT_FOCUS) &&
+	    (listPtr->active >= listPtr->topIndex) &&
+	    (listPtr->active < listPtr->topIndex + listPtr->fullLines) &&
+	    (listPtr->active < listPtr->numElements)) {
+	cursorY = listPtr->active - listPtr->topIndex;
+    }
 
     /*
-     * Iterate through all of the elements of the listbox, displaying each
+     * Iterate through the elements to be drawn, displaying each
      * in turn.  Selected elements use a different fg/bg/attr.
      */
 
-    limit = listPtr->topIndex + listPtr->fullLines;
-    if (limit > listPtr->numElements) {
-	limit = listPtr->numElements;
-    }
+    Ck_Preserve((ClientData) listPtr);
     width = listPtr->xOffset + winPtr->width;
-    for (elPtr = listPtr->firstPtr, i = 0, y = cursorY = 0;
-            (elPtr != NULL) && (i < limit);
-	    elPtr = elPtr->nextPtr, i++) {
-	if (i < listPtr->topIndex) {
-	    continue;
+    for (i = first, y = first - listPtr->topIndex;
+	    (i < limit) && (i < listPtr->numElements); i++) {
+	if (listPtr->itemCmd != NULL) {
+
+	    /*
+	     * The item command may do anything, including destroying
+	     * the listbox.  On error, give up on the rest of the rows
+	     * rather than report the same error for each of them.
+	     */
+
+	    elPtr = FetchItem(listPtr, i);
+	    if (listPtr->winPtr == NULL) {
+		goto done;
+	    }
+	    if (elPtr == NULL) {
+		Tk_BackgroundError(listPtr->interp);
+		listPtr->flags |= REDRAW_ALL;
+		break;
+	    }
+	    selected = VirtualSelected(listPtr, i);
+	} else {
+	    elPtr = listPtr->elements[i];
+	    selected = elPtr->selected;
 	}
 	if (i == listPtr->active && (listPtr->flags & GOT_FOCUS)) {
-	    cursorY = y;
 	    Ck_SetWindowAttr(winPtr, listPtr->activeFg, listPtr->activeBg,
         	listPtr->activeAttr |
-        	(elPtr->selected ? listPtr->selAttr : 0));
-	} else if (elPtr->selected) {
+        	(selected ? listPtr->selAttr : 0));
+	} else if (selected) {
 	    Ck_SetWindowAttr(winPtr, listPtr->selFg, listPtr->selBg,
         	listPtr->selAttr);
         } else {
@@ -952,6 +1195,21 @@ DisplayListbox(clientData)
     }
     wmove(winPtr->window, cursorY, 0);
     Ck_EventuallyRefresh(winPtr);
+
+    /*
+     * Fetching items of a virtual listbox may have widened it.
+     */
+
+    if (listPtr->flags & UPDATE_H_SCROLLBAR) {
+	listPtr->flags &= ~UPDATE_H_SCROLLBAR;
+	ListboxUpdateHScrollbar(listPtr);
+    }
+
+    done:
+    if (listPtr->winPtr != NULL) {
+	CkProfileWindow(listPtr->winPtr, t0);
+    }
+    Ck_Release((ClientData) listPtr);
 }
 
 /*
@@ -1024,36 +1282,54 @@ InsertEls(listPtr, index, argc, argv)
     int argc;			/* Number of new elements to add. */
     char **argv;		/* New elements (one per entry). */
 {
-    register Element *prevPtr, *newPtr;
+    register Element *newPtr;
     int length, i, oldMaxWidth;
 
-    /*
-     * Find the element before which the new ones will be inserted.
-     */
-
     if (index <= 0) {
 	index = 0;
     }
     if (index > listPtr->numElements) {
 	index = listPtr->numElements;
     }
-    if (index == 0) {
-	prevPtr = NULL;
-    } else if (index == listPtr->numElements) {
-          prevPtr = listPtr->lastPtr;
-    } else {
-	for (prevPtr = listPtr->firstPtr, i = index - 1; i > 0; i--) {
-	    prevPtr = prevPtr->nextPtr;
+
+    /*
+     * Make room in the element array and open a gap for the new
+     * elements.
+     */
+
+    if (listPtr->numElements + argc > listPtr->elementSpace) {
+	int newSpace = 2 * listPtr->elementSpace;
+	Element **newElements;
+
+	if (newSpace < listPtr->numElements + argc) {
+	    newSpace = listPtr->numElements + argc;
+	}
+	if (newSpace < 16) {
+	    newSpace = 16;
 	}
+	newElements = (Element **)
+	    ckalloc((unsigned) (newSpace * sizeof (Element *)));
+	if (listPtr->elements != NULL) {
+	    memcpy((VOID *) newElements, (VOID *) listPtr->elements,
+		listPtr->numElements * sizeof (Element *));
+	    ckfree((char *) listPtr->elements);
+	}
+	listPtr->elements = newElements;
+	listPtr->elementSpace = newSpace;
+    }
+    if (index < listPtr->numElements) {
+	memmove((VOID *) (listPtr->elements + index + argc),
+	    (VOID *) (listPtr->elements + index),
+	    (listPtr->numElements - index) * sizeof (Element *));
     }
 
     /*
-     * For each new element, create a record, initialize it, and link
-     * it into the list of elements.
+     * For each new element, create a record, initialize it, and store
+     * it into the gap.
      */
 
     oldMaxWidth = listPtr->maxWidth;
-    for (i = argc ; i > 0; i--, argv++, prevPtr = newPtr) {
+    for (i = 0; i < argc; i++, argv++) {
 	length = strlen(*argv);
 	newPtr = (Element *) ckalloc(ElementSize(length));
 	newPtr->textLength = length;
@@ -1067,16 +1343,7 @@ InsertEls(listPtr, index, argc, argv)
 	    listPtr->maxWidth = newPtr->textWidth;
 	}
 	newPtr->selected = 0;
-	if (prevPtr == NULL) {
-	    newPtr->nextPtr = listPtr->firstPtr;
-	    listPtr->firstPtr = newPtr;
-	} else {
-	    newPtr->nextPtr = prevPtr->nextPtr;
-	    prevPtr->nextPtr = newPtr;
-	}
-    }
-    if ((prevPtr != NULL) && (prevPtr->nextPtr == NULL)) {
-	listPtr->lastPtr = prevPtr;
+	listPtr->elements[index + i] = newPtr;
     }
     listPtr->numElements += argc;
 
@@ -1130,7 +1397,7 @@ DeleteEls(listPtr, first, last)
     int first;			/* Index of first element to delete. */
     int last;			/* Index of last element to delete. */
 {
-    register Element *prevPtr, *elPtr;
+    register Element *elPtr;
     int count, i, widthChanged;
 
     /*
@@ -1150,36 +1417,13 @@ DeleteEls(listPtr, first, last)
     }
 
     /*
-     * Find the element just before the ones to delete.
-     */
-
-    if (first == 0) {
-	prevPtr = NULL;
-    } else {
-	for (i = first-1, prevPtr = listPtr->firstPtr; i > 0; i--) {
-	    prevPtr = prevPtr->nextPtr;
-	}
-    }
-
-    /*
-     * Delete the requested number of elements.
+     * Delete the requested number of elements and close the gap
+     * in the element array.
      */
 
     widthChanged = 0;
-    for (i = count; i > 0; i--) {
-	if (prevPtr == NULL) {
-	    elPtr = listPtr->firstPtr;
-	    listPtr->firstPtr = elPtr->nextPtr;
-	    if (listPtr->firstPtr == NULL) {
-		listPtr->lastPtr = NULL;
-	    }
-	} else {
-	    elPtr = prevPtr->nextPtr;
-	    prevPtr->nextPtr = elPtr->nextPtr;
-	    if (prevPtr->nextPtr == NULL) {
-		listPtr->lastPtr = prevPtr;
-	    }
-	}
+    for (i = first; i <= last; i++) {
+	elPtr = listPtr->elements[i];
 	if (elPtr->textWidth == listPtr->maxWidth) {
 	    widthChanged = 1;
 	}
@@ -1188,6 +1432,11 @@ DeleteEls(listPtr, first, last)
 	}
 	ckfree((char *) elPtr);
     }
+    if (last + 1 < listPtr->numElements) {
+	memmove((VOID *) (listPtr->elements + first),
+	    (VOID *) (listPtr->elements + last + 1),
+	    (listPtr->numElements - last - 1) * sizeof (Element *));
+    }
     listPtr->numElements -= count;
 
     /*
@@ -1228,9 +1477,9 @@ DeleteEls(listPtr, first, last)
     if (widthChanged) {
 	int maxWidth = 0;
 
-	for (elPtr = listPtr->firstPtr; elPtr != NULL; elPtr = elPtr->nextPtr)
-	    if (elPtr->textWidth > maxWidth)
-		maxWidth = elPtr->textWidth;
+	for (i = 0; i < listPtr->numElements; i++)
+	    if (listPtr->elements[i]->textWidth > maxWidth)
+		maxWidth = listPtr->elements[i]->textWidth;
 	if (maxWidth != listPtr->maxWidth) {
 	    listPtr->maxWidth = maxWidth;
 	    listPtr->flags |= UPDATE_H_SCROLLBAR;
@@ -1551,14 +1800,18 @@ ListboxSelect(listPtr, first, last, select)
     if (first >= listPtr->numElements) {
 	return;
     }
+    if (last >= listPtr->numElements) {
+	last = listPtr->numElements-1;
+    }
+    if (listPtr->itemCmd != NULL) {
+	VirtualSelect(listPtr, first, last, select);
+	return;
+    }
     oldCount = listPtr->numSelected;
     firstRedisplay = -1;
     increment = select ? 1 : -1;
-    for (i = 0, elPtr = listPtr->firstPtr; i < first;
-	    i++, elPtr = elPtr->nextPtr) {
-	/* Empty loop body. */
-    }
-    for ( ; i <= last; i++, elPtr = elPtr->nextPtr) {
+    for (i = first; i <= last; i++) {
+	elPtr = listPtr->elements[i];
 	if (elPtr->selected == select) {
 	    continue;
 	}
@@ -1574,6 +1827,314 @@ ListboxSelect(listPtr, first, last, select)
     }
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * VirtualSelected --
+ *
+ *	Find out whether an element of a virtual listbox is selected.
+ *
+ * Results:
+ *	1 if the element is in one of the selected ranges, 0 otherwise.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+VirtualSelected(listPtr, index)
+    register Listbox *listPtr;		/* Information about widget. */
+    int index;				/* Index of element. */
+{
+    int low, high, mid;
+
+    low = 0;
+    high = listPtr->numRanges - 1;
+    while (low <= high) {
+	mid = (low + high) / 2;
+	if (index < listPtr->selRanges[mid].first) {
+	    high = mid - 1;
+	} else if (index > listPtr->selRanges[mid].last) {
+	    low = mid + 1;
+	} else {
+	    return 1;
+	}
+    }
+    return 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * VirtualSelect --
+ *
+ *	Select or deselect a range of elements in a virtual listbox
+ *	by merging it into or cutting it out of the set of selected
+ *	ranges.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The selected ranges and the selection count are updated and
+ *	the listbox is redisplayed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+VirtualSelect(listPtr, first, last, select)
+    register Listbox *listPtr;		/* Information about widget. */
+    int first;				/* Index of first element to
+					 * select or deselect. */
+    int last;				/* Index of last element to
+					 * select or deselect;  must not
+					 * be less than first. */
+    int select;				/* 1 means select items, 0 means
+					 * deselect them. */
+{
+    SelRange *oldPtr, *newRanges;
+    int i, n, placed;
+
+    /*
+     * Build the new set in a fresh array:  at most one range is added,
+     * either the new one or the tail of a range split by a clear.
+     */
+
+    newRanges = (SelRange *)
+	ckalloc((unsigned) ((listPtr->numRanges + 1) * sizeof (SelRange)));
+    n = placed = 0;
+    for (i = 0; i < listPtr->numRanges; i++) {
+	oldPtr = &listPtr->selRanges[i];
+	if (select) {
+	    if (oldPtr->last < first - 1) {
+		newRanges[n++] = *oldPtr;
+	    } else if (oldPtr->first > last + 1) {
+		if (!placed) {
+		    newRanges[n].first = first;
+		    newRanges[n++].last = last;
+		    placed = 1;
+		}
+		newRanges[n++] = *oldPtr;
+	    } else {
+		if (oldPtr->first < first) {
+		    first = oldPtr->first;
+		}
+		if (oldPtr->last > last) {
+		    last = oldPtr->last;
+		}
+	    }
+	} else {
+	    if ((oldPtr->last < first) || (oldPtr->first > last)) {
+		newRanges[n++] = *oldPtr;
+		continue;
+	    }
+	    if (oldPtr->first < first) {
+		newRanges[n].first = oldPtr->first;
+		newRanges[n++].last = first - 1;
+	    }
+	    if (oldPtr->last > last) {
+		newRanges[n].first = last + 1;
+		newRanges[n++].last = oldPtr->last;
+	    }
+	}
+    }
+    if (select && !placed) {
+	newRanges[n].first = first;
+	newRanges[n++].last = last;
+    }
+    if (listPtr->selRanges != NULL) {
+	ckfree((char *) listPtr->selRanges);
+    }
+    listPtr->selRanges = newRanges;
+    listPtr->numRanges = n;
+    listPtr->numSelected = 0;
+    for (i = 0; i < n; i++) {
+	listPtr->numSelected += newRanges[i].last - newRanges[i].first + 1;
+    }
+    ListboxRedrawRange(listPtr, first, last);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FetchItem --
+ *
+ *	Return the element at a given index of a virtual listbox,
+ *	invoking the item command if the element isn't cached.
+ *
+ * Results:
+ *	A pointer to the element, which stays valid until the next
+ *	call to FetchItem or FlushItemCache.  If the item command
+ *	failed, NULL is returned and interp->result contains an
+ *	error message.
+ *
+ * Side effects:
+ *	The item command is invoked;  the element becomes the most
+ *	recently used one in the cache and the least recently used
+ *	ones may be discarded.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Element *
+FetchItem(listPtr, index)
+    register Listbox *listPtr;		/* Information about widget. */
+    int index;				/* Index of element to fetch. */
+{
+    Tcl_Interp *interp = listPtr->interp;
+    Tcl_HashEntry *hPtr;
+    CachedItem *itemPtr;
+    char *text, string[20];
+    int length, new, result, cacheSize;
+
+    hPtr = Tcl_FindHashEntry(&listPtr->itemCache, (char *) (long) index);
+    if (hPtr != NULL) {
+	itemPtr = (CachedItem *) Tcl_GetHashValue(hPtr);
+	if (itemPtr->prevPtr != NULL) {
+	    itemPtr->prevPtr->nextPtr = itemPtr->nextPtr;
+	    if (itemPtr->nextPtr != NULL) {
+		itemPtr->nextPtr->prevPtr = itemPtr->prevPtr;
+	    } else {
+		listPtr->lastItemPtr = itemPtr->prevPtr;
+	    }
+	    goto makeFirst;
+	}
+	return &itemPtr->element;
+    }
+
+    /*
+     * Not cached:  invoke the item command.  Don't allow it to fetch
+     * items itself, which would just recurse.
+     */
+
+    if (listPtr->flags & FETCHING_ITEM) {
+	Tcl_SetResult(interp, "listbox item command invoked recursively",
+		TCL_STATIC);
+	return NULL;
+    }
+    listPtr->flags |= FETCHING_ITEM;
+    sprintf(string, " %d", index);
+    result = Tcl_VarEval(interp, listPtr->itemCmd, string, (char *) NULL);
+    listPtr->flags &= ~FETCHING_ITEM;
+    if (result != TCL_OK) {
+	Tcl_AddErrorInfo(interp, "\n    (item command executed by listbox)");
+	return NULL;
+    }
+    if (listPtr->itemCmd == NULL) {
+	Tcl_SetResult(interp, "listbox is no longer virtual", TCL_STATIC);
+	return NULL;
+    }
+
+    text = Tcl_GetStringResult(interp);
+    length = strlen(text);
+    itemPtr = (CachedItem *) ckalloc(CachedItemSize(length));
+    itemPtr->index = index;
+    itemPtr->element.textLength = length;
+    strcpy(itemPtr->element.text, text);
+#if CK_USE_UTF
+    itemPtr->element.textWidth = Tcl_NumUtfChars(text, length);
+#else
+    itemPtr->element.textWidth = length;
+#endif
+    itemPtr->element.selected = 0;
+    Tcl_ResetResult(interp);
+    if (itemPtr->element.textWidth > listPtr->maxWidth) {
+	listPtr->maxWidth = itemPtr->element.textWidth;
+	listPtr->flags |= UPDATE_H_SCROLLBAR;
+    }
+    itemPtr->hPtr = Tcl_CreateHashEntry(&listPtr->itemCache,
+	    (char *) (long) index, &new);
+    if (!new) {
+	CachedItem *oldPtr = (CachedItem *) Tcl_GetHashValue(itemPtr->hPtr);
+
+	/*
+	 * The cache was filled for this index while the item command
+	 * ran (e.g. by "update");  the fresh text wins.
+	 */
+
+	if (oldPtr->prevPtr != NULL) {
+	    oldPtr->prevPtr->nextPtr = oldPtr->nextPtr;
+	} else {
+	    listPtr->firstItemPtr = oldPtr->nextPtr;
+	}
+	if (oldPtr->nextPtr != NULL) {
+	    oldPtr->nextPtr->prevPtr = oldPtr->prevPtr;
+	} else {
+	    listPtr->lastItemPtr = oldPtr->prevPtr;
+	}
+	ckfree((char *) oldPtr);
+	listPtr->numCached--;
+    }
+    Tcl_SetHashValue(itemPtr->hPtr, (ClientData) itemPtr);
+    listPtr->numCached++;
+    if (listPtr->lastItemPtr == NULL) {
+	listPtr->lastItemPtr = itemPtr;
+    }
+
+    makeFirst:
+    itemPtr->prevPtr = NULL;
+    itemPtr->nextPtr = listPtr->firstItemPtr;
+    if (listPtr->firstItemPtr != NULL) {
+	listPtr->firstItemPtr->prevPtr = itemPtr;
+    }
+    listPtr->firstItemPtr = itemPtr;
+
+    /*
+     * Trim the cache, dropping least recently used items first.
+     */
+
+    cacheSize = 2 * listPtr->fullLines;
+    if (cacheSize < ITEM_CACHE_SIZE) {
+	cacheSize = ITEM_CACHE_SIZE;
+    }
+    while (listPtr->numCached > cacheSize) {
+	CachedItem *lastPtr = listPtr->lastItemPtr;
+
+	listPtr->lastItemPtr = lastPtr->prevPtr;
+	listPtr->lastItemPtr->nextPtr = NULL;
+	Tcl_DeleteHashEntry(lastPtr->hPtr);
+	ckfree((char *) lastPtr);
+	listPtr->numCached--;
+    }
+    return &itemPtr->element;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FlushItemCache --
+ *
+ *	Discard all elements fetched by the item command of a virtual
+ *	listbox.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory is freed;  elements are fetched again when needed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+FlushItemCache(listPtr)
+    register Listbox *listPtr;		/* Information about widget. */
+{
+    CachedItem *itemPtr, *nextPtr;
+
+    for (itemPtr = listPtr->firstItemPtr; itemPtr != NULL;
+	    itemPtr = nextPtr) {
+	nextPtr = itemPtr->nextPtr;
+	Tcl_DeleteHashEntry(itemPtr->hPtr);
+	ckfree((char *) itemPtr);
+    }
+    listPtr->firstItemPtr = listPtr->lastItemPtr = NULL;
+    listPtr->numCached = 0;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -1601,6 +2162,7 @@ ListboxRedrawRange(listPtr, first, last)
 					 * be less than first;
 					 * these just bracket a range. */
 {
+    listPtr->flags |= REDRAW_ALL;
     if ((listPtr->winPtr == NULL) || !(listPtr->winPtr->flags & CK_MAPPED)
 	    || (listPtr->flags & REDRAW_PENDING)) {
 	return;
@@ -76,8 +76,21 @@ Ck_Main(argc, argv, appInitProc)
 
     interp = Tcl_CreateInterp();
 
+    /*
+     * A leading "-headless size" option runs the application on a
+     * headless terminal, see Ck_InitTerminal.  It is passed to
+     * Ck_Init in the environment.
+     */
+
+    if (argc > 2 && strcmp(argv[1], "-headless") == 0) {
+	Tcl_SetVar2(interp, "env", "CK_HEADLESS", argv[2], TCL_GLOBAL_ONLY);
+	argc -= 2;
+	argv += 2;
+	argv[0] = argv[-2];
+    }
+
 #ifndef __WIN32__
-    if (!isatty(0) || !isatty(1)) {
+    if (getenv("CK_HEADLESS") == NULL && (!isatty(0) || !isatty(1))) {
 #if (TCL_MAJOR_VERSION == 7) && (TCL_MINOR_VERSION <= 4)
 	fprintf(stderr, "standard input/output must be terminal\n");
 
@@ -1338,10 +1338,12 @@ DisplayMenu(clientData)
     int fg, nFg, aFg, dFg;
     int bg, nBg, aBg, dBg;
     int attr, nAt, aAt, dAt;
+    double t0;
 
     menuPtr->flags &= ~REDRAW_PENDING;
     if (menuPtr->winPtr == NULL || !(winPtr->flags & CK_MAPPED))
 	return;
+    t0 = CkProfileStart(winPtr->mainPtr);
 
     x = cursorX = menuPtr->borderPtr != NULL ? 1 : 0;
     y = cursorY = menuPtr->borderPtr != NULL ? 1 : 0;
@@ -1473,6 +1475,7 @@ DisplayMenu(clientData)
     }
     wmove(winPtr->window, cursorY, cursorX);
     Ck_EventuallyRefresh(winPtr);
+    CkProfileWindow(winPtr, t0);
 }
 
 /*
@@ -551,11 +551,13 @@ DisplayMenuButton(clientData)
     MenuButton *mbPtr = (MenuButton *) clientData;
     int x, y, fg, bg, attr, textWidth, charWidth;
     CkWindow *winPtr = mbPtr->winPtr;
+    double t0;
 
     mbPtr->flags &= ~REDRAW_PENDING;
     if ((mbPtr->winPtr == NULL) || !(winPtr->flags & CK_MAPPED)) {
 	return;
     }
+    t0 = CkProfileStart(winPtr->mainPtr);
 
     if (mbPtr->state == ckDisabledUid) {
         fg = mbPtr->disabledFg;
@@ -643,6 +645,7 @@ DisplayMenuButton(clientData)
     Ck_SetWindowAttr(winPtr, fg, bg, attr);
     wmove(winPtr->window, y, x);
     Ck_EventuallyRefresh(winPtr);
+    CkProfileWindow(winPtr, t0);
 }
 
 /*
@@ -588,11 +588,13 @@ DisplayMessage(clientData)
     register CkWindow *winPtr = msgPtr->winPtr;
     char *p;
     int x, y, lineLength, numChars, charsLeft, byteLength;
+    double t0;
 
     msgPtr->flags &= ~REDRAW_PENDING;
     if (msgPtr->winPtr == NULL || !(winPtr->flags & CK_MAPPED)) {
 	return;
     }
+    t0 = CkProfileStart(winPtr->mainPtr);
 
     Ck_SetWindowAttr(winPtr, msgPtr->fg, msgPtr->bg, msgPtr->attr);
     Ck_ClearToBot(winPtr, 0, 0);
@@ -672,6 +674,7 @@ DisplayMessage(clientData)
 	}
     }
     Ck_EventuallyRefresh(winPtr);
+    CkProfileWindow(winPtr, t0);
 }
 
 /*
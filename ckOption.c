@@ -191,6 +191,40 @@ static int serial = 0;
 
 static Element defaultMatch;
 
+/*
+ * Resolved options are cached per (parent window, class):  which
+ * options the database gives a window depends only on its ancestors
+ * and on its own name and class.  A window whose name doesn't occur
+ * as a node in any option (as is the case for almost all widgets)
+ * therefore gets the same values as its siblings of the same class,
+ * and can take them from the cache without loading the stacks.
+ * The cache is flushed whenever the database changes.
+ */
+
+typedef struct CachedValue {
+    Ck_Uid classUid;		/* Class of option, or NULL. */
+    Ck_Uid valueUid;		/* Value found in database, or NULL. */
+    struct CachedValue *nextPtr;
+				/* Next value for same option name but
+				 * other class, or NULL. */
+} CachedValue;
+
+typedef struct ClassCache {
+    Ck_Uid classUid;		/* Class of windows this is for. */
+    Tcl_HashTable valueTable;	/* Maps option names to lists of
+				 * CachedValue structures. */
+    struct ClassCache *nextPtr;	/* Next class with same parent. */
+} ClassCache;
+
+static Tcl_HashTable parentTable;
+				/* Maps parent windows to lists of
+				 * ClassCache structures. */
+static Tcl_HashTable nodeNameTable;
+				/* Keys are the Ck_Uids of all names (not
+				 * classes) which have been used as node
+				 * elements of options.  Windows with one
+				 * of these names bypass the cache. */
+
 /*
  * Forward declarations for procedures defined in this file:
  */
@@ -202,6 +236,9 @@ static ElArray *	ExtendArray _ANSI_ARGS_((ElArray *arrayPtr,
 			    Element *elPtr));
 static void		ExtendStacks _ANSI_ARGS_((ElArray *arrayPtr,
 			    int leaf));
+static void		FlushOptionCache _ANSI_ARGS_((void));
+static void		FreeClassCache _ANSI_ARGS_((ClassCache *classPtr));
+static ClassCache *	GetClassCache _ANSI_ARGS_((CkWindow *winPtr));
 static ElArray *	NewArray _ANSI_ARGS_((int numEls));
 static void		OptionInit _ANSI_ARGS_((CkMainInfo *mainPtr));
 static int		ParsePriority _ANSI_ARGS_((Tcl_Interp *interp,
@@ -251,7 +288,8 @@ Ck_AddOption(winPtr, name, value, priority)
     if (winPtr->mainPtr->optionRootPtr == NULL) {
 	OptionInit(winPtr->mainPtr);
     }
-    cachedWindow = NULL;	/* Invalidate the cache. */
+    cachedWindow = NULL;	/* Invalidate the caches. */
+    FlushOptionCache();
 
     /*
      * Compute the priority for the new element, including both the
@@ -317,6 +355,10 @@ Ck_AddOption(winPtr, name, value, priority)
 		    && (newEl.nameUid != winPtr->classUid)) {
 		return;
 	    }
+	    if (!(newEl.flags & CLASS)) {
+		Tcl_CreateHashEntry(&nodeNameTable, (char *) newEl.nameUid,
+			&count);
+	    }
 	    for (elPtr = (*arrayPtrPtr)->els, count = (*arrayPtrPtr)->numUsed;
 		    ; elPtr++, count--) {
 		if (count == 0) {
@@ -378,7 +420,8 @@ Ck_AddOption(winPtr, name, value, priority)
  * Side effects:
  *	The internal caches used to speed up option mapping
  *	may be modified, if this tkwin is different from the
- *	last tkwin used for option retrieval.
+ *	last tkwin used for option retrieval, or if the value
+ *	isn't yet cached for windows of this class and parent.
  *
  *--------------------------------------------------------------
  */
@@ -395,6 +438,33 @@ Ck_GetOption(winPtr, name, className)
     Ck_Uid nameId, classId;
     register Element *elPtr, *bestPtr;
     register int count;
+    Tcl_HashEntry *hPtr = NULL;
+    CachedValue *valuePtr;
+    int new;
+
+    /*
+     * First look in the cache for windows of this class and parent,
+     * unless the window's name is used in options.
+     */
+
+    if ((winPtr->parentPtr != NULL) && (winPtr->mainPtr->optionRootPtr != NULL)
+	    && (Tcl_FindHashEntry(&nodeNameTable, (char *) winPtr->nameUid)
+		== NULL)) {
+	hPtr = Tcl_CreateHashEntry(&GetClassCache(winPtr)->valueTable,
+		name, &new);
+	if (!new) {
+	    for (valuePtr = (CachedValue *) Tcl_GetHashValue(hPtr);
+		    valuePtr != NULL; valuePtr = valuePtr->nextPtr) {
+		if ((valuePtr->classUid == className)
+			|| ((valuePtr->classUid != NULL) && (className != NULL)
+			&& (strcmp(valuePtr->classUid, className) == 0))) {
+		    return valuePtr->valueUid;
+		}
+	    }
+	} else {
+	    Tcl_SetHashValue(hPtr, (ClientData) NULL);
+	}
+    }
 
     /*
      * Note:  no need to call OptionInit here:  it will be done by
@@ -423,6 +493,7 @@ Ck_GetOption(winPtr, name, className)
 	    bestPtr = elPtr;
 	}
     }
+    classId = NULL;
     if (className != NULL) {
 	classId = Ck_GetUid(className);
 	for (elPtr = stacks[EXACT_LEAF_CLASS]->els,
@@ -442,6 +513,13 @@ Ck_GetOption(winPtr, name, className)
 	    }
 	}
     }
+    if (hPtr != NULL) {
+	valuePtr = (CachedValue *) ckalloc(sizeof (CachedValue));
+	valuePtr->classUid = classId;
+	valuePtr->valueUid = bestPtr->child.valueUid;
+	valuePtr->nextPtr = (CachedValue *) Tcl_GetHashValue(hPtr);
+	Tcl_SetHashValue(hPtr, (ClientData) valuePtr);
+    }
     return bestPtr->child.valueUid;
 }
 
@@ -511,6 +589,7 @@ Ck_OptionCmd(clientData, interp, argc, argv)
 	if (mainPtr->optionRootPtr != NULL) {
 	    ClearOptionTree(mainPtr->optionRootPtr);
 	    mainPtr->optionRootPtr = NULL;
+	    FlushOptionCache();
 	}
 	cachedWindow = NULL;
 	return TCL_OK;
@@ -580,6 +659,26 @@ void
 CkOptionDeadWindow(winPtr)
     register CkWindow *winPtr;		/* Window to be cleaned up. */
 {
+    Tcl_HashEntry *hPtr;
+    ClassCache *classPtr, *nextPtr;
+
+    /*
+     * If options are cached for children of this window, then free
+     * them (the children are gone already).
+     */
+
+    if (numLevels != 0) {
+	hPtr = Tcl_FindHashEntry(&parentTable, (char *) winPtr);
+	if (hPtr != NULL) {
+	    for (classPtr = (ClassCache *) Tcl_GetHashValue(hPtr);
+		    classPtr != NULL; classPtr = nextPtr) {
+		nextPtr = classPtr->nextPtr;
+		FreeClassCache(classPtr);
+	    }
+	    Tcl_DeleteHashEntry(hPtr);
+	}
+    }
+
     /*
      * If this window is in the option stacks, then clear the stacks.
      */
@@ -603,6 +702,7 @@ CkOptionDeadWindow(winPtr)
 	    && (winPtr->mainPtr->optionRootPtr != NULL)) {
 	ClearOptionTree(winPtr->mainPtr->optionRootPtr);
 	winPtr->mainPtr->optionRootPtr = NULL;
+	FlushOptionCache();
     }
 }
 
@@ -614,7 +714,8 @@ CkOptionDeadWindow(winPtr)
  *	This procedure is invoked when a window's class changes.  If
  *	the window is on the option cache, this procedure flushes
  *	any information for the window, since the new class could change
- *	what is relevant.
+ *	what is relevant.  Likewise, cached values of descendants of
+ *	the window are flushed.
  *
  * Results:
  *	None.
@@ -632,6 +733,10 @@ CkOptionClassChanged(winPtr)
     int i, j, *basePtr;
     ElArray *arrayPtr;
 
+    if ((numLevels != 0) && ((winPtr->childList != NULL)
+	    || (Tcl_FindHashEntry(&parentTable, (char *) winPtr) != NULL))) {
+	FlushOptionCache();
+    }
     if (winPtr->optionLevel == -1) {
 	return;
     }
@@ -1307,6 +1412,9 @@ OptionInit(mainPtr)
 	defaultMatch.child.valueUid = NULL;
 	defaultMatch.priority = -1;
 	defaultMatch.flags = 0;
+
+	Tcl_InitHashTable(&parentTable, TCL_ONE_WORD_KEYS);
+	Tcl_InitHashTable(&nodeNameTable, TCL_ONE_WORD_KEYS);
     }
 
     /*
@@ -1352,3 +1460,116 @@ ClearOptionTree(arrayPtr)
     }
     ckfree((char *) arrayPtr);
 }
+
+/*
+ *--------------------------------------------------------------
+ *
+ * GetClassCache --
+ *
+ *	Find the cache of option values for windows with the same
+ *	parent and class as a given window, creating it if needed.
+ *
+ * Results:
+ *	The return value is a pointer to the cache.
+ *
+ * Side effects:
+ *	Memory may be allocated.
+ *
+ *--------------------------------------------------------------
+ */
+
+static ClassCache *
+GetClassCache(winPtr)
+    CkWindow *winPtr;		/* Window whose options are wanted. */
+{
+    Tcl_HashEntry *hPtr;
+    ClassCache *classPtr, *firstPtr;
+    int new;
+
+    hPtr = Tcl_CreateHashEntry(&parentTable, (char *) winPtr->parentPtr,
+	    &new);
+    firstPtr = new ? NULL : (ClassCache *) Tcl_GetHashValue(hPtr);
+    for (classPtr = firstPtr; classPtr != NULL; classPtr = classPtr->nextPtr) {
+	if (classPtr->classUid == winPtr->classUid) {
+	    return classPtr;
+	}
+    }
+    classPtr = (ClassCache *) ckalloc(sizeof (ClassCache));
+    classPtr->classUid = winPtr->classUid;
+    Tcl_InitHashTable(&classPtr->valueTable, TCL_STRING_KEYS);
+    classPtr->nextPtr = firstPtr;
+    Tcl_SetHashValue(hPtr, (ClientData) classPtr);
+    return classPtr;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * FreeClassCache --
+ *
+ *	Free a cache of option values and everything in it.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory is freed.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+FreeClassCache(classPtr)
+    ClassCache *classPtr;	/* Cache to free. */
+{
+    Tcl_HashEntry *hPtr;
+    Tcl_HashSearch search;
+    CachedValue *valuePtr, *nextPtr;
+
+    for (hPtr = Tcl_FirstHashEntry(&classPtr->valueTable, &search);
+	    hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
+	for (valuePtr = (CachedValue *) Tcl_GetHashValue(hPtr);
+		valuePtr != NULL; valuePtr = nextPtr) {
+	    nextPtr = valuePtr->nextPtr;
+	    ckfree((char *) valuePtr);
+	}
+    }
+    Tcl_DeleteHashTable(&classPtr->valueTable);
+    ckfree((char *) classPtr);
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * FlushOptionCache --
+ *
+ *	Discard all cached option values.  Called whenever the
+ *	option database changes.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory is freed.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+FlushOptionCache()
+{
+    Tcl_HashEntry *hPtr;
+    Tcl_HashSearch search;
+    ClassCache *classPtr, *nextPtr;
+
+    for (hPtr = Tcl_FirstHashEntry(&parentTable, &search);
+	    hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
+	for (classPtr = (ClassCache *) Tcl_GetHashValue(hPtr);
+		classPtr != NULL; classPtr = nextPtr) {
+	    nextPtr = classPtr->nextPtr;
+	    FreeClassCache(classPtr);
+	}
+    }
+    Tcl_DeleteHashTable(&parentTable);
+    Tcl_InitHashTable(&parentTable, TCL_ONE_WORD_KEYS);
+}
@@ -420,6 +420,7 @@ ArrangePacking(clientData)
 				 * repacking operation. */
     int borderX, borderY;
     int maxWidth, maxHeight, tmp;
+    double t0;
 
     masterPtr->flags &= ~REQUESTED_REPACK;
 
@@ -444,6 +445,7 @@ ArrangePacking(clientData)
     masterPtr->abortPtr = &abort;
     abort = 0;
     Ck_Preserve((ClientData) masterPtr);
+    t0 = CkProfileStart(masterPtr->winPtr->mainPtr);
 
     /*
      * Pass #1: scan all the slaves to figure out the total amount
@@ -669,6 +671,10 @@ ArrangePacking(clientData)
     }
 
 done:
+    if (!abort) {
+	CkProfileRecord(masterPtr->winPtr->mainPtr, CK_PROFILE_GEOMETRY,
+	    "pack", masterPtr->winPtr->pathName, t0);
+    }
     masterPtr->abortPtr = NULL;
     Ck_Release((ClientData) masterPtr);
 }
@@ -641,9 +641,26 @@ RecomputePlacement(clientData)
     CkWindow *ancestor, *realMaster;
     int x, y, width, height;
     int masterWidth, masterHeight, masterBW;
+    CkMainInfo *mainPtr = NULL;
+    Tcl_DString path;
+    double t0 = 0.0;
 
     masterPtr->flags &= ~PARENT_RECONFIG_PENDING;
 
+    /*
+     * Mapping slaves may invoke bindings which destroy the master,
+     * so the profiler gets a copy of its path name.
+     */
+
+    if (masterPtr->slavePtr != NULL) {
+	mainPtr = masterPtr->slavePtr->winPtr->mainPtr;
+	t0 = CkProfileStart(mainPtr);
+    }
+    Tcl_DStringInit(&path);
+    if (t0 != 0.0 && masterPtr->winPtr != NULL) {
+	Tcl_DStringAppend(&path, masterPtr->winPtr->pathName, -1);
+    }
+
     /*
      * Iterate over all the slaves for the master.  Each slave's
      * geometry can be computed independently of the other slaves.
@@ -793,6 +810,11 @@ RecomputePlacement(clientData)
 
 	Ck_MapWindow(slavePtr->winPtr);
     }
+    if (t0 != 0.0 && CkLookupMainInfo(mainPtr) != NULL) {
+	CkProfileRecord(mainPtr, CK_PROFILE_GEOMETRY, "place",
+	    Tcl_DStringValue(&path), t0);
+    }
+    Tcl_DStringFree(&path);
 }
 
 /*
@@ -0,0 +1,460 @@
+/*
+ * ckProfile.c --
+ *
+ *	This file implements an optional profiler which measures the
+ *	time taken by binding scripts, by the idle callbacks which
+ *	redisplay widgets and by those arranging the slaves of geometry
+ *	managers.  For each binding (tag and event pattern), widget
+ *	(class and path name) and master window the number of calls,
+ *	the total and the maximum time and a histogram of times are
+ *	kept.
+ *
+ * Copyright (c) 1995 Christian Werner
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ */
+
+#include "ckPort.h"
+#include "ck.h"
+
+/*
+ * Times are sorted into the following number of buckets:  bucket 0
+ * counts times below one microsecond, bucket i > 0 times from 2^(i-1)
+ * up to 2^i microseconds, and the last bucket all longer times.
+ */
+
+#define PROFILE_BUCKETS	20
+
+/*
+ * One of the following structures exists for each binding, widget
+ * or master window that has been profiled.
+ */
+
+typedef struct ProfileEntry {
+    int count;			/* Number of calls. */
+    double total;		/* Sum of times in microseconds. */
+    double max;			/* Longest time in microseconds. */
+    int buckets[PROFILE_BUCKETS];
+				/* Histogram of times, see above. */
+} ProfileEntry;
+
+/*
+ * The following structure is hung off the main window once the
+ * profiler has been used.
+ */
+
+typedef struct ProfileData {
+    int enabled;		/* Non-zero means times are taken. */
+    Tcl_HashTable entries;	/* Maps the list {kind name1 name2}
+				 * to a ProfileEntry. */
+} ProfileData;
+
+static char *kindNames[] = {
+    "bind", "display", "geometry"
+};
+
+/*
+ * Prototypes for procedures defined in this file:
+ */
+
+static int	CompareEntries _ANSI_ARGS_((CONST VOID *first,
+		    CONST VOID *second));
+static void	GetProfile _ANSI_ARGS_((ProfileData *profPtr,
+		    Tcl_DString *dsPtr, char *separator));
+static void	ResetProfile _ANSI_ARGS_((ProfileData *profPtr));
+
+/*
+ *--------------------------------------------------------------
+ *
+ * CkProfileStart --
+ *
+ *	Called before a binding script or an idle callback is run.
+ *
+ * Results:
+ *	The current time in microseconds if profiling is enabled for
+ *	the main window, otherwise 0.0, which is to be passed to
+ *	CkProfileRecord or CkProfileWindow when the call is done.
+ *
+ * Side effects:
+ *	None.
+ *
+ *--------------------------------------------------------------
+ */
+
+double
+CkProfileStart(mainPtr)
+    CkMainInfo *mainPtr;	/* Main window of the application. */
+{
+    ProfileData *profPtr = (ProfileData *) mainPtr->profileData;
+
+    if (profPtr == NULL || !profPtr->enabled) {
+	return 0.0;
+    }
+    return CkStatsClock();
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * CkProfileRecord --
+ *
+ *	Record the time taken by a binding script or idle callback
+ *	started at t0.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The entry for kind, name1 and name2 is updated.  Nothing
+ *	is done if t0 is 0.0, i.e. profiling was disabled when
+ *	the call started.
+ *
+ *--------------------------------------------------------------
+ */
+
+void
+CkProfileRecord(mainPtr, kind, name1, name2, t0)
+    CkMainInfo *mainPtr;	/* Main window of the application. */
+    int kind;			/* CK_PROFILE_BIND, CK_PROFILE_DISPLAY,
+				 * or CK_PROFILE_GEOMETRY. */
+    char *name1;		/* Binding tag, widget class, or name of
+				 * geometry manager. */
+    char *name2;		/* Event pattern, or path name of window. */
+    double t0;			/* Result of CkProfileStart. */
+{
+    ProfileData *profPtr = (ProfileData *) mainPtr->profileData;
+    ProfileEntry *entryPtr;
+    Tcl_HashEntry *hPtr;
+    Tcl_DString key;
+    double elapsed, limit;
+    int i, new;
+
+    if (t0 == 0.0 || profPtr == NULL) {
+	return;
+    }
+    elapsed = CkStatsClock() - t0;
+    if (elapsed < 0.0) {
+	elapsed = 0.0;
+    }
+
+    Tcl_DStringInit(&key);
+    Tcl_DStringAppendElement(&key, kindNames[kind]);
+    Tcl_DStringAppendElement(&key, name1 == NULL ? "" : name1);
+    Tcl_DStringAppendElement(&key, name2 == NULL ? "" : name2);
+    hPtr = Tcl_CreateHashEntry(&profPtr->entries, Tcl_DStringValue(&key),
+	&new);
+    Tcl_DStringFree(&key);
+    if (new) {
+	entryPtr = (ProfileEntry *) ckalloc(sizeof (ProfileEntry));
+	memset((char *) entryPtr, 0, sizeof (ProfileEntry));
+	Tcl_SetHashValue(hPtr, (ClientData) entryPtr);
+    } else {
+	entryPtr = (ProfileEntry *) Tcl_GetHashValue(hPtr);
+    }
+    entryPtr->count++;
+    entryPtr->total += elapsed;
+    if (elapsed > entryPtr->max) {
+	entryPtr->max = elapsed;
+    }
+    for (i = 0, limit = 1.0; i < PROFILE_BUCKETS - 1 && elapsed >= limit;
+	i++, limit *= 2.0) {
+	/* Empty loop body. */
+    }
+    entryPtr->buckets[i]++;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * CkProfileWindow --
+ *
+ *	Record the time taken by the idle callback which redisplays
+ *	a widget, keyed by the widget's class and path name.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	See CkProfileRecord.
+ *
+ *--------------------------------------------------------------
+ */
+
+void
+CkProfileWindow(winPtr, t0)
+    CkWindow *winPtr;		/* Window redisplayed. */
+    double t0;			/* Result of CkProfileStart. */
+{
+    if (t0 == 0.0) {
+	return;
+    }
+    CkProfileRecord(winPtr->mainPtr, CK_PROFILE_DISPLAY,
+	(char *) winPtr->classUid, winPtr->pathName, t0);
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * CkFreeProfile --
+ *
+ *	Release the profiling data of a main window.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory is freed.
+ *
+ *--------------------------------------------------------------
+ */
+
+void
+CkFreeProfile(mainPtr)
+    CkMainInfo *mainPtr;	/* Main window of the application. */
+{
+    ProfileData *profPtr = (ProfileData *) mainPtr->profileData;
+
+    if (profPtr != NULL) {
+	ResetProfile(profPtr);
+	Tcl_DeleteHashTable(&profPtr->entries);
+	ckfree((char *) profPtr);
+	mainPtr->profileData = NULL;
+    }
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * ResetProfile --
+ *
+ *	Forget all measurements.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	All entries are freed.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+ResetProfile(profPtr)
+    ProfileData *profPtr;
+{
+    Tcl_HashEntry *hPtr;
+    Tcl_HashSearch search;
+
+    for (hPtr = Tcl_FirstHashEntry(&profPtr->entries, &search);
+	hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
+	ckfree((char *) Tcl_GetHashValue(hPtr));
+    }
+    Tcl_DeleteHashTable(&profPtr->entries);
+    Tcl_InitHashTable(&profPtr->entries, TCL_STRING_KEYS);
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * CompareEntries --
+ *
+ *	Comparison procedure for qsort, sorts hash entries of
+ *	profile entries by decreasing total time.
+ *
+ *--------------------------------------------------------------
+ */
+
+static int
+CompareEntries(first, second)
+    CONST VOID *first, *second;
+{
+    ProfileEntry *e1, *e2;
+
+    e1 = (ProfileEntry *) Tcl_GetHashValue(*((Tcl_HashEntry **) first));
+    e2 = (ProfileEntry *) Tcl_GetHashValue(*((Tcl_HashEntry **) second));
+    if (e1->total > e2->total) {
+	return -1;
+    }
+    return (e1->total < e2->total) ? 1 : 0;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * GetProfile --
+ *
+ *	Format all entries, most expensive first.  Each entry
+ *	becomes a list {kind name1 name2 count n total t max m
+ *	histogram {b0 b1 ...}}, trailing empty buckets left out.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The entries are appended to *dsPtr as list elements if
+ *	separator is NULL, otherwise each followed by separator.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+GetProfile(profPtr, dsPtr, separator)
+    ProfileData *profPtr;
+    Tcl_DString *dsPtr;		/* Where to append the entries. */
+    char *separator;		/* String to put after each entry,
+				 * or NULL. */
+{
+    Tcl_HashEntry *hPtr, **hPtrs;
+    Tcl_HashSearch search;
+    ProfileEntry *entryPtr;
+    Tcl_DString entry;
+    char buf[128];
+    int i, k, n, numEntries;
+
+    numEntries = profPtr->entries.numEntries;
+    if (numEntries == 0) {
+	return;
+    }
+    hPtrs = (Tcl_HashEntry **) ckalloc(numEntries * sizeof (Tcl_HashEntry *));
+    for (i = 0, hPtr = Tcl_FirstHashEntry(&profPtr->entries, &search);
+	hPtr != NULL; i++, hPtr = Tcl_NextHashEntry(&search)) {
+	hPtrs[i] = hPtr;
+    }
+    qsort((VOID *) hPtrs, (size_t) numEntries, sizeof (Tcl_HashEntry *),
+	CompareEntries);
+
+    Tcl_DStringInit(&entry);
+    for (i = 0; i < numEntries; i++) {
+	entryPtr = (ProfileEntry *) Tcl_GetHashValue(hPtrs[i]);
+	Tcl_DStringSetLength(&entry, 0);
+	Tcl_DStringAppend(&entry,
+	    Tcl_GetHashKey(&profPtr->entries, hPtrs[i]), -1);
+	sprintf(buf, " count %d total %.0f max %.0f histogram {",
+	    entryPtr->count, entryPtr->total, entryPtr->max);
+	Tcl_DStringAppend(&entry, buf, -1);
+	for (n = PROFILE_BUCKETS; n > 0 && entryPtr->buckets[n - 1] == 0;
+	    n--) {
+	    /* Empty loop body. */
+	}
+	for (k = 0; k < n; k++) {
+	    sprintf(buf, k > 0 ? " %d" : "%d", entryPtr->buckets[k]);
+	    Tcl_DStringAppend(&entry, buf, -1);
+	}
+	Tcl_DStringAppend(&entry, "}", 1);
+	if (separator == NULL) {
+	    Tcl_DStringAppendElement(dsPtr, Tcl_DStringValue(&entry));
+	} else {
+	    Tcl_DStringAppend(dsPtr, Tcl_DStringValue(&entry), -1);
+	    Tcl_DStringAppend(dsPtr, separator, -1);
+	}
+    }
+    Tcl_DStringFree(&entry);
+    ckfree((char *) hPtrs);
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * CkProfileCmd --
+ *
+ *	This procedure is invoked to process the "curses profile"
+ *	Tcl command.  See the user documentation for details on
+ *	what it does.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	See the user documentation.
+ *
+ *--------------------------------------------------------------
+ */
+
+int
+CkProfileCmd(clientData, interp, argc, argv)
+    ClientData clientData;      /* Main window associated with
+			         * interpreter. */
+    Tcl_Interp *interp;         /* Current interpreter. */
+    int argc;                   /* Number of arguments. */
+    char **argv;                /* Argument strings. */
+{
+    CkMainInfo *mainPtr = ((CkWindow *) (clientData))->mainPtr;
+    ProfileData *profPtr = (ProfileData *) mainPtr->profileData;
+    Tcl_DString output;
+    int onoff, code = TCL_ERROR;
+    char *fileName, *outName;
+    Tcl_DString buffer;
+#if (TCL_MAJOR_VERSION == 7) && (TCL_MINOR_VERSION <= 4)
+    FILE *f;
+#else
+    Tcl_Channel f;
+#endif
+
+    if (profPtr == NULL) {
+	profPtr = (ProfileData *) ckalloc(sizeof (ProfileData));
+	profPtr->enabled = 0;
+	Tcl_InitHashTable(&profPtr->entries, TCL_STRING_KEYS);
+	mainPtr->profileData = (ClientData) profPtr;
+    }
+
+    if (argc == 2) {
+	Tcl_DStringInit(&output);
+	GetProfile(profPtr, &output, NULL);
+	Tcl_DStringResult(interp, &output);
+	return TCL_OK;
+    } else if (argc == 3 && strcmp(argv[2], "reset") == 0) {
+	ResetProfile(profPtr);
+	return TCL_OK;
+    } else if (argc == 3 && strcmp(argv[2], "dump") != 0) {
+	if (Tcl_GetBoolean(interp, argv[2], &onoff) != TCL_OK) {
+	    return TCL_ERROR;
+	}
+	profPtr->enabled = onoff;
+	return TCL_OK;
+    } else if (argc != 4 || strcmp(argv[2], "dump") != 0) {
+	Tcl_AppendResult(interp, "wrong # args: must be \"", argv[0],
+	    " ", argv[1], " ?boolean|reset?\" or \"", argv[0], " ", argv[1],
+	    " dump fileName\"", (char *) NULL);
+	return TCL_ERROR;
+    }
+
+    /*
+     * Write the entries to a file, one per line.
+     */
+
+    outName = argv[3];
+    Tcl_DStringInit(&output);
+    GetProfile(profPtr, &output, "\n");
+#if (TCL_MAJOR_VERSION == 7) && (TCL_MINOR_VERSION <= 4)
+    fileName = Tcl_TildeSubst(interp, outName, &buffer);
+    if (fileName == NULL)
+	goto done;
+    f = fopen(fileName, "w");
+    if (f == NULL) {
+	Tcl_AppendResult(interp, "error opening \"", fileName,
+	    "\": ", Tcl_PosixError(interp), (char *) NULL);
+	Tcl_DStringFree(&buffer);
+	goto done;
+    }
+    Tcl_DStringFree(&buffer);
+    fwrite(Tcl_DStringValue(&output), 1, Tcl_DStringLength(&output), f);
+    fclose(f);
+#else
+    fileName = Tcl_TranslateFileName(interp, outName, &buffer);
+    if (fileName == NULL)
+	goto done;
+    f = Tcl_OpenFileChannel(interp, fileName, "w", 0666);
+    Tcl_DStringFree(&buffer);
+    if (f == NULL)
+	goto done;
+    Tcl_Write(f, Tcl_DStringValue(&output), Tcl_DStringLength(&output));
+    if (Tcl_Close(interp, f) != TCL_OK)
+	goto done;
+#endif
+    code = TCL_OK;
+
+done:
+    Tcl_DStringFree(&output);
+    return code;
+}
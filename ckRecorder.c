@@ -12,6 +12,26 @@
 #include "ckPort.h"
 #include "ck.h"
 
+/*
+ * An event log file is parsed into an array of items of the following
+ * type before it is replayed.
+ */
+
+typedef struct {
+    int type;			/* REPLAY_DELAY, REPLAY_EVENT, or
+				 * REPLAY_SCRIPT, see below. */
+    int delay;			/* Milliseconds for REPLAY_DELAY. */
+    char *string;		/* Window path name for REPLAY_EVENT (NULL
+				 * for no window), script for
+				 * REPLAY_SCRIPT.  Malloc'ed. */
+    CkEvent event;		/* Event for REPLAY_EVENT. The window is
+				 * looked up when the event is delivered. */
+} ReplayItem;
+
+#define REPLAY_DELAY	0
+#define REPLAY_EVENT	1
+#define REPLAY_SCRIPT	2
+
 /*
  * There is one structure of the following type for the global data
  * of the recorder.
@@ -25,18 +45,68 @@ typedef struct {
 #if (TCL_MAJOR_VERSION == 7) && (TCL_MINOR_VERSION <= 4)
     struct timeval lastEvent;
     FILE *record;
-    FILE *replay;
 #else
     Tcl_Time lastEvent;
     Tcl_Channel record;
-    Tcl_Channel replay;
 #endif
+    ReplayItem *items;		/* Items being replayed, NULL if no
+				 * replay is in progress. */
+    int numItems;		/* Number of items. */
+    int nextItem;		/* Index of next item to replay. */
+    double speed;		/* Delays are divided by this; 0 means
+				 * ignore delays. */
+    char *command;		/* Script to invoke when replay is done,
+				 * or NULL.  Malloc'ed. */
+    int numEvents;		/* Number of events replayed so far. */
+    double startTime;		/* Time when replay started (ms). */
+    double redrawTime;		/* Time spent by event loop between
+				 * replayed events (ms). */
+    double lastMark;		/* Time when replay handler was left, or
+				 * 0 while a delay is in progress. */
     int withDelay;
+    int binary;			/* Non-zero means record file uses the
+				 * binary format described below. */
+    int bufferSize;		/* Size of output buffer of record file;
+				 * 0 means write each event right away. */
+    int flushInterval;		/* Milliseconds after which buffered events
+				 * are written at the latest. */
+    int flushTimerRunning;	/* Non-zero means flushTimer is set. */
+    Tk_TimerToken flushTimer;	/* Timer to write buffered events. */
+    Tcl_HashTable winIds;	/* Maps path names of windows to ids used
+				 * in binary record file. */
+    int nextWinId;		/* Id for next window in winIds. */
     CkEvent event;
 } Recorder;
 
 static Recorder *ckRecorder = NULL;
 
+/*
+ * Binary record files start with the line below.  The rest of the file
+ * consists of records, each made of a type byte followed by numbers
+ * in a variable length encoding (7 bits per byte, least significant
+ * first, high bit set on all but the last byte;  signed numbers are
+ * mapped to unsigned ones as 0, -1, 1, -2, ...) and strings (length
+ * followed by the characters):
+ *
+ * 'C' text		Comment line (without the leading "# ").
+ * 'W' id path		Window path for id used by later records.
+ *			Id 0 is the empty path and isn't defined.
+ * 'K' delay id keycode	Key press.
+ * 'B' delay id data	Bar code.
+ * 'V' delay id data	Pasted text.
+ * 'P' delay id button x y rootx rooty
+ *			Mouse button press (x etc. are signed).
+ * 'R' delay id button x y rootx rooty
+ *			Mouse button release.
+ *
+ * Delay is the number of milliseconds since the previous event if
+ * recording -withdelay, else 0.
+ */
+
+#define BINARY_MAGIC	"# CK-RECORDER-BINARY\n"
+#define BINARY_MAGIC_LEN	(sizeof (BINARY_MAGIC) - 1)
+#define DEFAULT_FLUSH_INTERVAL	1000
+
 /*
  *   Internal procedures.
  */
@@ -50,7 +120,43 @@ static int	DStringGets _ANSI_ARGS_((Tcl_Channel chan,
 		    Tcl_DString *dsPtr));
 #endif
 static void	DeliverEvent _ANSI_ARGS_((ClientData clientData));
+static void	FreeReplay _ANSI_ARGS_((ReplayItem *items, int numItems));
+static int	ConvertBinary _ANSI_ARGS_((Tcl_Interp *interp,
+		    char *inName, char *outName));
+static int	GetNumber _ANSI_ARGS_((unsigned char **pp,
+		    unsigned char *end, unsigned long *valuePtr));
+static int	PutNumber _ANSI_ARGS_((unsigned char *p,
+		    unsigned long value));
+static void	RecorderExitProc _ANSI_ARGS_((ClientData clientData));
+static void	RecorderFlush _ANSI_ARGS_((ClientData clientData));
+#if (TCL_MAJOR_VERSION == 7) && (TCL_MINOR_VERSION <= 4)
+static int	ReadReplay _ANSI_ARGS_((Tcl_Interp *interp, FILE *file,
+		    ReplayItem **itemsPtr, int *numItemsPtr));
+#else
+static int	ReadReplay _ANSI_ARGS_((Tcl_Interp *interp,
+		    Tcl_Channel file, ReplayItem **itemsPtr,
+		    int *numItemsPtr));
+#endif
 static void	RecorderReplay _ANSI_ARGS_((ClientData clientData));
+static void	RecorderStop _ANSI_ARGS_((Recorder *recPtr));
+static void	ReplayDone _ANSI_ARGS_((Recorder *recPtr));
+static void	ReplayMark _ANSI_ARGS_((Recorder *recPtr, int mark));
+static double	ReplayTime _ANSI_ARGS_((void));
+static void	StopReplay _ANSI_ARGS_((Recorder *recPtr));
+static char *	TextRecord _ANSI_ARGS_((int type, char *path, int *args,
+		    char *barCode));
+static void	WriteComment _ANSI_ARGS_((Recorder *recPtr, char *text));
+static void	WriteRecord _ANSI_ARGS_((Recorder *recPtr, char *bytes,
+		    int length));
+
+/*
+ * Macros to store signed numbers as unsigned ones and back:
+ */
+
+#define ZIGZAG(n)	(((n) < 0) ? \
+			    ((((unsigned long) -((n) + 1)) << 1) | 1) : \
+			    (((unsigned long) (n)) << 1))
+#define UNZIGZAG(u)	(((u) & 1) ? -(long) ((u) >> 1) - 1 : (long) ((u) >> 1))
 
 /*
  *----------------------------------------------------------------------
@@ -69,16 +175,16 @@ RecorderInput(clientData, eventPtr)
     CkEvent *eventPtr;
 {
     Recorder *recPtr = (Recorder *) clientData;
-    int hadEvent = 0, type = eventPtr->any.type;
+    int hadEvent = 0, type = eventPtr->any.type, delay = 0;
 #if (TCL_MAJOR_VERSION == 7) && (TCL_MINOR_VERSION <= 4)
     struct timeval now;
 #else
     Tcl_Time now;
     extern void TclpGetTime _ANSI_ARGS_((Tcl_Time *timePtr));
 #endif
-    char buffer[64];
-    char *keySym, *barCode, *result;
-    char *argv[16];
+    char *path, *barCode = NULL, *result;
+    int args[5];
+    CkWindow *winPtr;
 
     if (recPtr->record == NULL) {
 	Ck_DeleteGenericHandler(RecorderInput, clientData);
@@ -86,7 +192,8 @@ RecorderInput(clientData, eventPtr)
     }
 
     if (type != CK_EV_KEYPRESS && type != CK_EV_BARCODE &&
-    	type != CK_EV_MOUSE_UP && type != CK_EV_MOUSE_DOWN)
+    	type != CK_EV_MOUSE_UP && type != CK_EV_MOUSE_DOWN &&
+	type != CK_EV_PASTE)
     	return 0;
 
 #if (TCL_MAJOR_VERSION == 7) && (TCL_MINOR_VERSION <= 4)
@@ -98,111 +205,616 @@ RecorderInput(clientData, eventPtr)
 	diff = now.tv_sec * 1000 + now.tv_usec / 1000;
 	diff -= recPtr->lastEvent.tv_sec * 1000 +
 	    recPtr->lastEvent.tv_usec / 1000;
-	if (diff > 50) {
-	    if (diff > 3600000)
-		diff = 3600000;
-	    fprintf(recPtr->record, "<Delay> %d\n", (int) diff);
-	    hadEvent++;
-	}
+	if (diff > 3600000)
+	    diff = 3600000;
+	delay = (int) diff;
     }
 #else
     TclpGetTime(&now);
     if (recPtr->withDelay && recPtr->lastEvent.sec != 0 &&
 	recPtr->lastEvent.usec != 0) {
 	double diff;
-	char string[100];
 
 	diff = now.sec * 1000 + now.usec / 1000;
 	diff -= recPtr->lastEvent.sec * 1000 +
 	    recPtr->lastEvent.usec / 1000;
-	if (diff > 50) {
-	    if (diff > 3600000)
-		diff = 3600000;
-	    sprintf(string, "<Delay> %d\n", (int) diff);
-	    Tcl_Write(recPtr->record, string, strlen(string));
+	if (diff > 3600000)
+	    diff = 3600000;
+	delay = (int) diff;
+    }
+#endif
+
+    switch (type) {
+	case CK_EV_KEYPRESS:
+	    args[0] = eventPtr->key.keycode;
+	    break;
+	case CK_EV_BARCODE:
+	    barCode = CkGetBarcodeData(recPtr->mainPtr->mainPtr);
+	    if (barCode == NULL)
+		return 0;
+	    break;
+	case CK_EV_PASTE:
+	    barCode = eventPtr->paste.data;
+	    break;
+	case CK_EV_MOUSE_UP:
+	case CK_EV_MOUSE_DOWN:
+	    args[0] = eventPtr->mouse.button;
+	    args[1] = eventPtr->mouse.x;
+	    args[2] = eventPtr->mouse.y;
+	    args[3] = eventPtr->mouse.rootx;
+	    args[4] = eventPtr->mouse.rooty;
+	    break;
+    }
+    winPtr = eventPtr->any.winPtr;
+    path = winPtr == NULL ? "" : winPtr->pathName;
+
+    if (recPtr->binary) {
+	unsigned char buffer[128], *p = buffer;
+	Tcl_HashEntry *hPtr;
+	int i, id = 0, new, numArgs;
+
+	if (*path != '\0') {
+	    hPtr = Tcl_CreateHashEntry(&recPtr->winIds, path, &new);
+	    if (new) {
+		Tcl_DString ds;
+
+		Tcl_SetHashValue(hPtr, (ClientData) (long) recPtr->nextWinId);
+		Tcl_DStringInit(&ds);
+		*p = 'W';
+		p += 1 + PutNumber(p + 1, recPtr->nextWinId);
+		p += PutNumber(p, strlen(path));
+		Tcl_DStringAppend(&ds, (char *) buffer, p - buffer);
+		Tcl_DStringAppend(&ds, path, -1);
+		WriteRecord(recPtr, Tcl_DStringValue(&ds),
+		    Tcl_DStringLength(&ds));
+		Tcl_DStringFree(&ds);
+		p = buffer;
+		recPtr->nextWinId++;
+	    }
+	    id = (int) (long) Tcl_GetHashValue(hPtr);
+	}
+	*p++ = type == CK_EV_KEYPRESS ? 'K' : type == CK_EV_BARCODE ? 'B' :
+	    type == CK_EV_PASTE ? 'V' : type == CK_EV_MOUSE_DOWN ? 'P' : 'R';
+	p += PutNumber(p, delay);
+	p += PutNumber(p, id);
+	if (type == CK_EV_BARCODE || type == CK_EV_PASTE) {
+	    p += PutNumber(p, strlen(barCode));
+	    WriteRecord(recPtr, (char *) buffer, p - buffer);
+	    WriteRecord(recPtr, barCode, strlen(barCode));
+	} else {
+	    numArgs = type == CK_EV_KEYPRESS ? 1 : 5;
+	    p += PutNumber(p, args[0]);
+	    for (i = 1; i < numArgs; i++)
+		p += PutNumber(p, ZIGZAG(args[i]));
+	    WriteRecord(recPtr, (char *) buffer, p - buffer);
+	}
+	hadEvent++;
+    } else {
+	if (delay > 50) {
+	    char string[100];
+
+	    sprintf(string, "<Delay> %d\n", delay);
+	    WriteRecord(recPtr, string, strlen(string));
+	    hadEvent++;
+	}
+	result = TextRecord(type, path, args, barCode);
+	if (result != NULL) {
+	    WriteRecord(recPtr, result, strlen(result));
+	    WriteRecord(recPtr, "\n", 1);
+	    ckfree(result);
 	    hadEvent++;
 	}
     }
-#endif
 
+    if (hadEvent) {
+	if (recPtr->bufferSize == 0)
+	    RecorderFlush((ClientData) recPtr);
+	else if (!recPtr->flushTimerRunning) {
+	    recPtr->flushTimerRunning = 1;
+	    recPtr->flushTimer = Tk_CreateTimerHandler(recPtr->flushInterval,
+		RecorderFlush, (ClientData) recPtr);
+	}
+	recPtr->lastEvent = now;
+    }
+
+    return 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TextRecord --
+ *
+ *	Format an event as a line of a text record file.
+ *
+ * Results:
+ *	A malloc'ed string without trailing newline, or NULL if the
+ *	event can't be represented.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static char *
+TextRecord(type, path, args, barCode)
+    int type;			/* Event type. */
+    char *path;			/* Path name of window, may be empty. */
+    int *args;			/* Keycode for key events; button, x, y,
+				 * rootx, rooty for mouse events. */
+    char *barCode;		/* Data for bar code and paste events. */
+{
+    char buffer[5][16], *keySym, *argv[7];
+    int i;
+
+    argv[1] = path;
     switch (type) {
 	case CK_EV_KEYPRESS:
 	    argv[2] = NULL;
-	    keySym = CkKeysymToString(eventPtr->key.keycode, 1);
+	    keySym = CkKeysymToString(args[0], 1);
 	    if (strcmp(keySym, "NoSymbol") != 0)
 		argv[2] = keySym;
-	    else if (eventPtr->key.keycode > 0 &&
-		eventPtr->key.keycode < 256) {
+	    else if (args[0] > 0 && args[0] < 256) {
 		/* Unsafe, ie not portable */
-		sprintf(buffer, "0x%2x", eventPtr->key.keycode);
-		argv[2] = buffer;
+		sprintf(buffer[0], "0x%2x", args[0]);
+		argv[2] = buffer[0];
 	    }
-	    if (argv[2] != NULL) {
-		argv[0] = "<Key>";
-		argv[1] = eventPtr->key.winPtr == NULL ? "" :
-		    eventPtr->key.winPtr->pathName;
-		result = Tcl_Merge(3, argv);
-printPctSNL:
-#if (TCL_MAJOR_VERSION == 7) && (TCL_MINOR_VERSION <= 4)
-		fprintf(recPtr->record, "%s\n", result);
-#else
-		Tcl_Write(recPtr->record, result, strlen(result));
-		Tcl_Write(recPtr->record, "\n", 1);
-#endif
-		ckfree(result);
-		hadEvent++;
-	    }
-	    break;
+	    if (argv[2] == NULL)
+		return NULL;
+	    argv[0] = "<Key>";
+	    return Tcl_Merge(3, argv);
 
 	case CK_EV_BARCODE:
-	    barCode = CkGetBarcodeData(recPtr->mainPtr->mainPtr);
-	    if (barCode != NULL) {
-		argv[0] = "<BarCode>";
-		argv[1] = eventPtr->key.winPtr == NULL ? "" :
-		    eventPtr->key.winPtr->pathName;
-		argv[2] = barCode;
-		result = Tcl_Merge(3, argv);
-	        goto printPctSNL;
-	    }
-	    break;
+	    argv[0] = "<BarCode>";
+	    argv[2] = barCode;
+	    return Tcl_Merge(3, argv);
+
+	case CK_EV_PASTE: {
+	    char *result;
+	    int flags, length;
+
+	    /*
+	     * Pasted text may contain newlines, so it is quoted with
+	     * backslashes to keep the event on one line.
+	     */
+
+	    argv[0] = "<Paste>";
+	    argv[2] = Tcl_Merge(2, argv);
+	    length = strlen(argv[2]);
+	    result = ckalloc(length + 2 + Tcl_ScanElement(barCode, &flags));
+	    strcpy(result, argv[2]);
+	    ckfree(argv[2]);
+	    result[length++] = ' ';
+	    length += Tcl_ConvertElement(barCode, result + length,
+		flags | TCL_DONT_USE_BRACES);
+	    result[length] = '\0';
+	    return result;
+	}
 
 	case CK_EV_MOUSE_UP:
 	case CK_EV_MOUSE_DOWN:
-	    {
-	        char bbuf[16], xbuf[16], ybuf[16], rxbuf[16], rybuf[16];
-
-	        argv[0] = type == CK_EV_MOUSE_DOWN ?
-		    "<ButtonPress>" : "<ButtonRelease>";
-		argv[1] = eventPtr->mouse.winPtr == NULL ? "" :
-		    eventPtr->mouse.winPtr->pathName;
-		sprintf(bbuf, "%d", eventPtr->mouse.button);
-		argv[2] = bbuf;
-		sprintf(xbuf, "%d", eventPtr->mouse.x);
-		argv[3] = xbuf;
-		sprintf(ybuf, "%d", eventPtr->mouse.y);
-		argv[4] = ybuf;
-		sprintf(rxbuf, "%d", eventPtr->mouse.rootx);
-		argv[5] = rxbuf;
-		sprintf(rybuf, "%d", eventPtr->mouse.rooty);
-		argv[6] = rybuf;
-		result = Tcl_Merge(7, argv);
-	        goto printPctSNL;
+	    argv[0] = type == CK_EV_MOUSE_DOWN ?
+		"<ButtonPress>" : "<ButtonRelease>";
+	    for (i = 0; i < 5; i++) {
+		sprintf(buffer[i], "%d", args[i]);
+		argv[i + 2] = buffer[i];
 	    }
-	    break;
+	    return Tcl_Merge(7, argv);
     }
+    return NULL;
+}
 
-    if (hadEvent) {
+/*
+ *----------------------------------------------------------------------
+ *
+ * PutNumber, GetNumber --
+ *
+ *	Store or fetch an unsigned number in the variable length
+ *	encoding of binary record files.
+ *
+ * Results:
+ *	PutNumber returns the number of bytes stored at p (at most 10).
+ *	GetNumber returns 0 if the number is truncated, 1 otherwise;
+ *	the number is stored at *valuePtr and *pp is advanced.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+PutNumber(p, value)
+    unsigned char *p;
+    unsigned long value;
+{
+    int n = 0;
+
+    while (value >= 0x80) {
+	p[n++] = (value & 0x7f) | 0x80;
+	value >>= 7;
+    }
+    p[n++] = value;
+    return n;
+}
+
+static int
+GetNumber(pp, end, valuePtr)
+    unsigned char **pp;
+    unsigned char *end;
+    unsigned long *valuePtr;
+{
+    unsigned char *p = *pp;
+    unsigned long value = 0;
+    int shift = 0;
+
+    while (p < end) {
+	value |= (unsigned long) (*p & 0x7f) << shift;
+	if (!(*p++ & 0x80)) {
+	    *pp = p;
+	    *valuePtr = value;
+	    return 1;
+	}
+	shift += 7;
+    }
+    return 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * WriteRecord --
+ *
+ *	Write bytes to the record file.  They stay in the file's
+ *	buffer until RecorderFlush is called or the buffer is full.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+WriteRecord(recPtr, bytes, length)
+    Recorder *recPtr;
+    char *bytes;
+    int length;
+{
+#if (TCL_MAJOR_VERSION == 7) && (TCL_MINOR_VERSION <= 4)
+    fwrite(bytes, 1, length, recPtr->record);
+#else
+    Tcl_Write(recPtr->record, bytes, length);
+#endif
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RecorderFlush --
+ *
+ *	Write out buffered events of the record file.  Called after
+ *	each event when recording unbuffered, else by a timer.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+RecorderFlush(clientData)
+    ClientData clientData;
+{
+    Recorder *recPtr = (Recorder *) clientData;
+
+    recPtr->flushTimerRunning = 0;
+    if (recPtr->record != NULL) {
 #if (TCL_MAJOR_VERSION == 7) && (TCL_MINOR_VERSION <= 4)
 	fflush(recPtr->record);
 #else
 	Tcl_Flush(recPtr->record);
 #endif
-	recPtr->lastEvent = now;
     }
+}
 
-    return 0;
+/*
+ *----------------------------------------------------------------------
+ *
+ * RecorderExitProc --
+ *
+ *	Exit handler registered while recording buffered, so that
+ *	no events are lost when the application exits normally.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+RecorderExitProc(clientData)
+    ClientData clientData;
+{
+    Recorder *recPtr = (Recorder *) clientData;
+
+    if (recPtr->flushTimerRunning)
+	Tk_DeleteTimerHandler(recPtr->flushTimer);
+    RecorderFlush(clientData);
 }
-
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * WriteComment --
+ *
+ *	Write a comment line to the record file, as "# text" line
+ *	or 'C' record depending on the file format.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+WriteComment(recPtr, text)
+    Recorder *recPtr;
+    char *text;
+{
+    unsigned char buffer[16];
+    int length = strlen(text);
+
+    if (recPtr->binary) {
+	buffer[0] = 'C';
+	WriteRecord(recPtr, (char *) buffer,
+	    1 + PutNumber(buffer + 1, length));
+	WriteRecord(recPtr, text, length);
+    } else {
+	WriteRecord(recPtr, "# ", 2);
+	WriteRecord(recPtr, text, length);
+	WriteRecord(recPtr, "\n", 1);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RecorderStop --
+ *
+ *	Write out pending events and close the record file.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Recording is stopped.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+RecorderStop(recPtr)
+    Recorder *recPtr;
+{
+    if (recPtr->flushTimerRunning)
+	Tk_DeleteTimerHandler(recPtr->flushTimer);
+    recPtr->flushTimerRunning = 0;
+    if (recPtr->bufferSize > 0)
+	Tcl_DeleteExitHandler(RecorderExitProc, (ClientData) recPtr);
+#if (TCL_MAJOR_VERSION == 7) && (TCL_MINOR_VERSION <= 4)
+    fclose(recPtr->record);
+#else
+    Tcl_Close(NULL, recPtr->record);
+#endif
+    Ck_DeleteGenericHandler(RecorderInput, (ClientData) recPtr);
+    Tcl_DeleteHashTable(&recPtr->winIds);
+    recPtr->record = NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ConvertBinary --
+ *
+ *	Convert a binary record file to the text format which can
+ *	be replayed.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	The text file is written.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+ConvertBinary(interp, inName, outName)
+    Tcl_Interp *interp;
+    char *inName;		/* Name of binary record file. */
+    char *outName;		/* Name of text file to be written. */
+{
+    Tcl_DString input, output, buffer;
+    Tcl_HashTable paths;
+    Tcl_HashEntry *hPtr;
+    Tcl_HashSearch search;
+    unsigned char *p, *end;
+    unsigned long num[7];
+    char *fileName, *path, *string, *result, delay[32];
+    int i, n, new, type, numArgs, args[5], code = TCL_ERROR;
+#if (TCL_MAJOR_VERSION == 7) && (TCL_MINOR_VERSION <= 4)
+    FILE *f;
+#else
+    Tcl_Channel f;
+#endif
+    char block[4096];
+
+    Tcl_DStringInit(&input);
+    Tcl_DStringInit(&output);
+    Tcl_InitHashTable(&paths, TCL_ONE_WORD_KEYS);
+
+    /*
+     * Read the entire binary file.
+     */
+
+#if (TCL_MAJOR_VERSION == 7) && (TCL_MINOR_VERSION <= 4)
+    fileName = Tcl_TildeSubst(interp, inName, &buffer);
+    if (fileName == NULL)
+	goto done;
+    f = fopen(fileName, "rb");
+    if (f == NULL) {
+	Tcl_AppendResult(interp, "error opening \"", fileName,
+	    "\": ", Tcl_PosixError(interp), (char *) NULL);
+	Tcl_DStringFree(&buffer);
+	goto done;
+    }
+    Tcl_DStringFree(&buffer);
+    while ((n = fread(block, 1, sizeof (block), f)) > 0)
+	Tcl_DStringAppend(&input, block, n);
+    fclose(f);
+#else
+    fileName = Tcl_TranslateFileName(interp, inName, &buffer);
+    if (fileName == NULL)
+	goto done;
+    f = Tcl_OpenFileChannel(interp, fileName, "r", 0);
+    Tcl_DStringFree(&buffer);
+    if (f == NULL)
+	goto done;
+    Tcl_SetChannelOption(NULL, f, "-translation", "binary");
+    while ((n = Tcl_Read(f, block, sizeof (block))) > 0)
+	Tcl_DStringAppend(&input, block, n);
+    Tcl_Close(NULL, f);
+#endif
+    p = (unsigned char *) Tcl_DStringValue(&input);
+    end = p + Tcl_DStringLength(&input);
+    if (end - p < (int) BINARY_MAGIC_LEN ||
+	strncmp(BINARY_MAGIC, (char *) p, BINARY_MAGIC_LEN) != 0) {
+	Tcl_AppendResult(interp, "\"", inName,
+	    "\" is not a binary record file", (char *) NULL);
+	goto done;
+    }
+    p += BINARY_MAGIC_LEN;
+
+    /*
+     * Translate records.
+     */
+
+    Tcl_DStringAppend(&output, "# CK-RECORDER\n", -1);
+    while (p < end) {
+	type = *p++;
+	switch (type) {
+	    case 'C':
+		if (!GetNumber(&p, end, &num[0]) || num[0] > end - p)
+		    goto corrupt;
+		Tcl_DStringAppend(&output, "# ", 2);
+		Tcl_DStringAppend(&output, (char *) p, num[0]);
+		Tcl_DStringAppend(&output, "\n", 1);
+		p += num[0];
+		continue;
+	    case 'W':
+		if (!GetNumber(&p, end, &num[0]) ||
+		    !GetNumber(&p, end, &num[1]) || num[1] > end - p)
+		    goto corrupt;
+		hPtr = Tcl_CreateHashEntry(&paths, (char *) num[0], &new);
+		if (!new)
+		    ckfree((char *) Tcl_GetHashValue(hPtr));
+		string = (char *) ckalloc(num[1] + 1);
+		memcpy(string, p, num[1]);
+		string[num[1]] = '\0';
+		Tcl_SetHashValue(hPtr, (ClientData) string);
+		p += num[1];
+		continue;
+	    case 'K':
+		numArgs = 1;
+		type = CK_EV_KEYPRESS;
+		break;
+	    case 'B':
+		numArgs = 1;
+		type = CK_EV_BARCODE;
+		break;
+	    case 'V':
+		numArgs = 1;
+		type = CK_EV_PASTE;
+		break;
+	    case 'P':
+		numArgs = 5;
+		type = CK_EV_MOUSE_DOWN;
+		break;
+	    case 'R':
+		numArgs = 5;
+		type = CK_EV_MOUSE_UP;
+		break;
+	    default:
+		goto corrupt;
+	}
+	for (i = 0; i < numArgs + 2; i++) {
+	    if (!GetNumber(&p, end, &num[i]))
+		goto corrupt;
+	}
+	path = "";
+	if (num[1] != 0) {
+	    hPtr = Tcl_FindHashEntry(&paths, (char *) num[1]);
+	    if (hPtr == NULL)
+		goto corrupt;
+	    path = (char *) Tcl_GetHashValue(hPtr);
+	}
+	if (num[0] > 50) {
+	    sprintf(delay, "<Delay> %lu\n", num[0]);
+	    Tcl_DStringAppend(&output, delay, -1);
+	}
+	if (type == CK_EV_BARCODE || type == CK_EV_PASTE) {
+	    if (num[2] > end - p)
+		goto corrupt;
+	    string = (char *) ckalloc(num[2] + 1);
+	    memcpy(string, p, num[2]);
+	    string[num[2]] = '\0';
+	    p += num[2];
+	    result = TextRecord(type, path, args, string);
+	    ckfree(string);
+	} else {
+	    args[0] = (int) num[2];
+	    for (i = 1; i < numArgs; i++)
+		args[i] = (int) UNZIGZAG(num[i + 2]);
+	    result = TextRecord(type, path, args, NULL);
+	}
+	if (result != NULL) {
+	    Tcl_DStringAppend(&output, result, -1);
+	    Tcl_DStringAppend(&output, "\n", 1);
+	    ckfree(result);
+	}
+    }
+
+    /*
+     * Write the text file.
+     */
+
+#if (TCL_MAJOR_VERSION == 7) && (TCL_MINOR_VERSION <= 4)
+    fileName = Tcl_TildeSubst(interp, outName, &buffer);
+    if (fileName == NULL)
+	goto done;
+    f = fopen(fileName, "w");
+    if (f == NULL) {
+	Tcl_AppendResult(interp, "error opening \"", fileName,
+	    "\": ", Tcl_PosixError(interp), (char *) NULL);
+	Tcl_DStringFree(&buffer);
+	goto done;
+    }
+    Tcl_DStringFree(&buffer);
+    fwrite(Tcl_DStringValue(&output), 1, Tcl_DStringLength(&output), f);
+    fclose(f);
+#else
+    fileName = Tcl_TranslateFileName(interp, outName, &buffer);
+    if (fileName == NULL)
+	goto done;
+    f = Tcl_OpenFileChannel(interp, fileName, "w", 0666);
+    Tcl_DStringFree(&buffer);
+    if (f == NULL)
+	goto done;
+    Tcl_Write(f, Tcl_DStringValue(&output), Tcl_DStringLength(&output));
+    if (Tcl_Close(interp, f) != TCL_OK)
+	goto done;
+#endif
+    code = TCL_OK;
+    goto done;
+
+corrupt:
+    sprintf(block, "%d", (int) ((char *) p - Tcl_DStringValue(&input)));
+    Tcl_AppendResult(interp, "corrupt binary record file \"", inName,
+	"\" near offset ", block, (char *) NULL);
+
+done:
+    for (hPtr = Tcl_FirstHashEntry(&paths, &search); hPtr != NULL;
+	hPtr = Tcl_NextHashEntry(&search))
+	ckfree((char *) Tcl_GetHashValue(hPtr));
+    Tcl_DeleteHashTable(&paths);
+    Tcl_DStringFree(&input);
+    Tcl_DStringFree(&output);
+    return code;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -288,10 +900,13 @@ DeliverEvent(clientData)
 {
     Recorder *recPtr = (Recorder *) clientData;
 
+    ReplayMark(recPtr, 0);
+    recPtr->numEvents++;
     Tk_DoWhenIdle(RecorderReplay, (ClientData) recPtr);
     Ck_HandleEvent(recPtr->mainPtr->mainPtr, &recPtr->event);
+    ReplayMark(recPtr, 1);
 }
-
+
 /*
  *----------------------------------------------------------------------
  *
@@ -311,136 +926,374 @@ RecorderReplay(clientData)
     ClientData clientData;
 {
     Recorder *recPtr = (Recorder *) clientData;
-    Tcl_DString input;
-    char *p;
-    int getsResult, delayValue = 0, doidle = 1;
+    ReplayItem *itemPtr, *items;
+    int delay;
 
     recPtr->timerRunning = 0;
-    if (recPtr->replay == NULL)
+    if (recPtr->items == NULL)
 	return;
 
+    ReplayMark(recPtr, 0);
+    while (recPtr->nextItem < recPtr->numItems) {
+	itemPtr = &recPtr->items[recPtr->nextItem++];
+	switch (itemPtr->type) {
+	    case REPLAY_DELAY:
+		if (recPtr->speed <= 0.0)
+		    continue;
+		delay = (int) (itemPtr->delay / recPtr->speed);
+		if (delay <= 0)
+		    continue;
+		recPtr->timerRunning = 1;
+		recPtr->timer = Tk_CreateTimerHandler(delay, RecorderReplay,
+		    (ClientData) recPtr);
+		return;
+
+	    case REPLAY_EVENT:
+		recPtr->event = itemPtr->event;
+		if (itemPtr->string == NULL)
+		    recPtr->event.any.winPtr = NULL;
+		else if ((recPtr->event.any.winPtr =
+		    Ck_NameToWindow(recPtr->interp, itemPtr->string,
+		    recPtr->mainPtr)) == NULL)
+		    goto error;
+		Tk_DoWhenIdle(DeliverEvent, (ClientData) recPtr);
+		ReplayMark(recPtr, 1);
+		return;
+
+	    case REPLAY_SCRIPT:
+		items = recPtr->items;
+		if (Tcl_GlobalEval(recPtr->interp, itemPtr->string) != TCL_OK)
+		    goto error;
+		if (recPtr->items != items)
+		    return;		/* Replay stopped or restarted. */
+		break;
+	}
+    }
+    ReplayDone(recPtr);
+    return;
+
+error:
+    Tk_BackgroundError(recPtr->interp);
+    ReplayDone(recPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ReplayMark --
+ *
+ *	Called when the replay handlers are entered (mark == 0) or
+ *	left (mark != 0) for measuring the time the event loop spends
+ *	between replayed events, i.e. mostly for redisplay.
+ *
+ * Results:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+ReplayMark(recPtr, mark)
+    Recorder *recPtr;
+    int mark;
+{
+    double now = ReplayTime();
+
+    if (mark)
+	recPtr->lastMark = now;
+    else if (recPtr->lastMark > 0.0) {
+	recPtr->redrawTime += now - recPtr->lastMark;
+	recPtr->lastMark = 0.0;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ReplayTime --
+ *
+ *	Return the current time in milliseconds.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static double
+ReplayTime()
+{
+#if (TCL_MAJOR_VERSION == 7) && (TCL_MINOR_VERSION <= 4)
+    struct timeval now;
+
+    gettimeofday(&now, (struct timezone *) NULL);
+    return now.tv_sec * 1000.0 + now.tv_usec / 1000.0;
+#else
+    Tcl_Time now;
+    extern void TclpGetTime _ANSI_ARGS_((Tcl_Time *timePtr));
+
+    TclpGetTime(&now);
+    return now.sec * 1000.0 + now.usec / 1000.0;
+#endif
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ReadReplay --
+ *
+ *	Parse the remainder of an event log file into an array of
+ *	replay items, so that replaying needs no further parsing.
+ *
+ * Results:
+ *	A standard Tcl result.  On success, *itemsPtr and *numItemsPtr
+ *	are filled in with a malloc'ed array of items.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+ReadReplay(interp, file, itemsPtr, numItemsPtr)
+    Tcl_Interp *interp;
+#if (TCL_MAJOR_VERSION == 7) && (TCL_MINOR_VERSION <= 4)
+    FILE *file;
+#else
+    Tcl_Channel file;
+#endif
+    ReplayItem **itemsPtr;
+    int *numItemsPtr;
+{
+    Tcl_DString input;
+    ReplayItem item, *items;
+    int numItems = 0, maxItems = 64, lineNo = 1, code = TCL_OK;
+    int argc, deliver, keySym;
+    char **argv, *p, string[32];
+
+    items = (ReplayItem *) ckalloc(maxItems * sizeof (ReplayItem));
     Tcl_DStringInit(&input);
-    while ((getsResult = DStringGets(recPtr->replay, &input)) == TCL_OK) {
+    while (code == TCL_OK && DStringGets(file, &input) == TCL_OK) {
+	lineNo++;
 	p = Tcl_DStringValue(&input);
 	while (*p == ' ' || *p == '\t')
 	    ++p;
-	if (*p == '#') {
+	if (*p == '#' || *p == '\0') {
 	    Tcl_DStringTrunc(&input, 0);
 	    continue;
 	}
+	item.string = NULL;
+	deliver = 0;
 	if (*p == '<') {
-	    CkEvent event;
-	    int cmdError = TCL_OK, deliver = 0;
-	    int argc;
-	    char **argv;
-
-	    if (Tcl_SplitList(recPtr->interp, p, &argc, &argv) != TCL_OK) {
-		Tk_BackgroundError(recPtr->interp);
-		getsResult = TCL_ERROR;
-		break;
+	    if (Tcl_SplitList(interp, p, &argc, &argv) != TCL_OK) {
+		code = TCL_ERROR;
+		goto lineError;
 	    }
 	    if (strcmp(argv[0], "<Delay>") == 0) {
 		if (argc != 2) {
 badNumArgs:
-		    Tcl_AppendResult(recPtr->interp,
-			"wrong # args for ", argv[0], (char *) NULL);
-		    cmdError = TCL_ERROR;
-		} else
-		    cmdError = Tcl_GetInt(recPtr->interp, argv[1],
-			&delayValue);
+		    Tcl_AppendResult(interp, "wrong # args for ", argv[0],
+			(char *) NULL);
+		    code = TCL_ERROR;
+		} else {
+		    item.type = REPLAY_DELAY;
+		    code = Tcl_GetInt(interp, argv[1], &item.delay);
+		    deliver = item.delay > 0;
+		}
 	    } else if (strcmp(argv[0], "<Key>") == 0) {
-		int keySym;
-
 		if (argc != 3)
 		    goto badNumArgs;
-		event.any.type = CK_EV_KEYPRESS;
-		if (argv[1][0] == '\0')
-		    event.any.winPtr = NULL;
-		else if ((event.any.winPtr = Ck_NameToWindow(recPtr->interp,
-		    argv[1], recPtr->mainPtr)) == NULL)
-		    cmdError = TCL_ERROR;
-		else if (strncmp(argv[2], "Control-", 8) == 0 &&
+		item.type = REPLAY_EVENT;
+		item.event.any.type = CK_EV_KEYPRESS;
+		if (strncmp(argv[2], "Control-", 8) == 0 &&
 		    strlen(argv[2]) == 9) {
-		    event.key.keycode = argv[2][8] - 0x40;
-		    if (event.key.keycode > 0x20)
-			event.key.keycode -= 0x20;
+		    item.event.key.keycode = argv[2][8] - 0x40;
+		    if (item.event.key.keycode > 0x20)
+			item.event.key.keycode -= 0x20;
 		    deliver++;
 		} else if (strncmp(argv[2], "0x", 2) == 0 &&
 		    strlen(argv[2]) == 4) {
-		    sscanf(&argv[2][2], "%x", &event.key.keycode);
+		    sscanf(&argv[2][2], "%x", &item.event.key.keycode);
 		    deliver++;
 		} else if ((keySym = CkStringToKeysym(argv[2])) != NoSymbol) {
-		    event.key.keycode = keySym;
+		    item.event.key.keycode = keySym;
 		    deliver++;
 		}
 	    } else if (strcmp(argv[0], "<BarCode>") == 0) {
 		if (argc != 3)
 		    goto badNumArgs;
 
-	    } else if (strcmp(argv[0], "<ButtonPress>") == 0) {
-		if (argc != 7)
+	    } else if (strcmp(argv[0], "<Paste>") == 0) {
+		if (argc != 3)
 		    goto badNumArgs;
-		event.any.type = CK_EV_MOUSE_DOWN;
-doMouse:
-		if (argv[1][0] == '\0')
-		    event.any.winPtr = NULL;
-		else if ((event.any.winPtr = Ck_NameToWindow(recPtr->interp,
-		    argv[1], recPtr->mainPtr)) == NULL)
-		    cmdError = TCL_ERROR;
-		else {
-		    cmdError |= Tcl_GetInt(recPtr->interp, argv[2],
-		        &event.mouse.button);
-		    cmdError |= Tcl_GetInt(recPtr->interp, argv[3],
-		        &event.mouse.x);
-		    cmdError |= Tcl_GetInt(recPtr->interp, argv[4],
-		        &event.mouse.y);
-		    cmdError |= Tcl_GetInt(recPtr->interp, argv[5],
-		        &event.mouse.rootx);
-		    cmdError |= Tcl_GetInt(recPtr->interp, argv[6],
-		        &event.mouse.rooty);
-		    if (cmdError == TCL_OK)
-			deliver++;
-		}
-	    } else if (strcmp(argv[0], "<ButtonRelease>") == 0) {
+		item.type = REPLAY_EVENT;
+		item.event.any.type = CK_EV_PASTE;
+		item.event.paste.length = strlen(argv[2]);
+		item.event.paste.data = ckalloc(item.event.paste.length + 1);
+		strcpy(item.event.paste.data, argv[2]);
+		deliver++;
+
+	    } else if (strcmp(argv[0], "<ButtonPress>") == 0 ||
+		strcmp(argv[0], "<ButtonRelease>") == 0) {
 		if (argc != 7)
 		    goto badNumArgs;
-		event.any.type = CK_EV_MOUSE_UP;
-		goto doMouse;
+		item.type = REPLAY_EVENT;
+		item.event.any.type = argv[0][7] == 'P' ?
+		    CK_EV_MOUSE_DOWN : CK_EV_MOUSE_UP;
+		code |= Tcl_GetInt(interp, argv[2], &item.event.mouse.button);
+		code |= Tcl_GetInt(interp, argv[3], &item.event.mouse.x);
+		code |= Tcl_GetInt(interp, argv[4], &item.event.mouse.y);
+		code |= Tcl_GetInt(interp, argv[5], &item.event.mouse.rootx);
+		code |= Tcl_GetInt(interp, argv[6], &item.event.mouse.rooty);
+		deliver = code == TCL_OK;
 	    }
-	    ckfree((char *) argv);
-	    if (cmdError != TCL_OK) {
-		Tk_BackgroundError(recPtr->interp);
-		getsResult = cmdError;
-	    } else if (deliver) {
-		doidle = delayValue = 0;
-		recPtr->event = event;
-		Tk_DoWhenIdle(DeliverEvent, (ClientData) recPtr);
+	    if (deliver && item.type == REPLAY_EVENT && argv[1][0] != '\0') {
+		item.string = (char *) ckalloc(strlen(argv[1]) + 1);
+		strcpy(item.string, argv[1]);
 	    }
+	    ckfree((char *) argv);
+	} else {
+	    item.type = REPLAY_SCRIPT;
+	    item.string = (char *) ckalloc(strlen(p) + 1);
+	    strcpy(item.string, p);
+	    deliver = 1;
+	}
+	if (code != TCL_OK) {
+lineError:
+	    sprintf(string, "%d", lineNo);
+	    Tcl_AppendResult(interp, " in line ", string, (char *) NULL);
 	    break;
-	} else if (Tcl_GlobalEval(recPtr->interp, p) != TCL_OK) {
-	    Tk_BackgroundError(recPtr->interp);
-	    getsResult = TCL_ERROR;
-	    break;
+	}
+	if (deliver) {
+	    if (numItems >= maxItems) {
+		ReplayItem *newItems;
+
+		maxItems *= 2;
+		newItems = (ReplayItem *)
+		    ckalloc(maxItems * sizeof (ReplayItem));
+		memcpy(newItems, items, numItems * sizeof (ReplayItem));
+		ckfree((char *) items);
+		items = newItems;
+	    }
+	    items[numItems++] = item;
 	}
 	Tcl_DStringTrunc(&input, 0);
     }
-    if (getsResult != TCL_OK) {
-#if (TCL_MAJOR_VERSION == 7) && (TCL_MINOR_VERSION <= 4)
-	fclose(recPtr->replay);
-#else
-	Tcl_Close(NULL, recPtr->replay);
-#endif
-	recPtr->replay = NULL;
-    } else if (delayValue != 0) {
-	recPtr->timerRunning = 1;
-	recPtr->timer = Tk_CreateTimerHandler(delayValue, RecorderReplay,
-	    (ClientData) recPtr);
-    } else if (doidle != 0) {
-	Tk_DoWhenIdle(RecorderReplay, (ClientData) recPtr);
-    }
     Tcl_DStringFree(&input);
+    if (code != TCL_OK) {
+	FreeReplay(items, numItems);
+	return code;
+    }
+    *itemsPtr = items;
+    *numItemsPtr = numItems;
+    return TCL_OK;
 }
-
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FreeReplay --
+ *
+ *	Free an array of replay items.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+FreeReplay(items, numItems)
+    ReplayItem *items;
+    int numItems;
+{
+    int i;
+
+    if (items == NULL)
+	return;
+    for (i = 0; i < numItems; i++) {
+	if (items[i].string != NULL)
+	    ckfree(items[i].string);
+	if (items[i].type == REPLAY_EVENT &&
+	    items[i].event.any.type == CK_EV_PASTE)
+	    ckfree(items[i].event.paste.data);
+    }
+    ckfree((char *) items);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * StopReplay --
+ *
+ *	Stop replaying and release the replay items.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+StopReplay(recPtr)
+    Recorder *recPtr;
+{
+    if (recPtr->timerRunning)
+	Tk_DeleteTimerHandler(recPtr->timer);
+    recPtr->timerRunning = 0;
+    Tk_CancelIdleCall(RecorderReplay, (ClientData) recPtr);
+    Tk_CancelIdleCall(DeliverEvent, (ClientData) recPtr);
+    FreeReplay(recPtr->items, recPtr->numItems);
+    recPtr->items = NULL;
+    recPtr->numItems = recPtr->nextItem = 0;
+    if (recPtr->command != NULL)
+	ckfree(recPtr->command);
+    recPtr->command = NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ReplayDone --
+ *
+ *	Called when a replay is finished or aborted due to an error.
+ *	Invokes the -command script of the replay, if any, with a
+ *	report on the replay appended.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Whatever the command script does.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+ReplayDone(recPtr)
+    Recorder *recPtr;
+{
+    Tcl_DString cmd;
+    double elapsed;
+    char string[64];
+
+    elapsed = ReplayTime() - recPtr->startTime;
+    if (recPtr->command == NULL) {
+	StopReplay(recPtr);
+	return;
+    }
+    Tcl_DStringInit(&cmd);
+    Tcl_DStringAppend(&cmd, recPtr->command, -1);
+    Tcl_DStringStartSublist(&cmd);
+    Tcl_DStringAppendElement(&cmd, "events");
+    sprintf(string, "%d", recPtr->numEvents);
+    Tcl_DStringAppendElement(&cmd, string);
+    Tcl_DStringAppendElement(&cmd, "elapsed");
+    sprintf(string, "%.3f", elapsed);
+    Tcl_DStringAppendElement(&cmd, string);
+    Tcl_DStringAppendElement(&cmd, "rate");
+    sprintf(string, "%.1f", elapsed > 0.0 ?
+	recPtr->numEvents * 1000.0 / elapsed : 0.0);
+    Tcl_DStringAppendElement(&cmd, string);
+    Tcl_DStringAppendElement(&cmd, "redraw");
+    sprintf(string, "%.3f", recPtr->redrawTime);
+    Tcl_DStringAppendElement(&cmd, string);
+    Tcl_DStringEndSublist(&cmd);
+    StopReplay(recPtr);
+    if (Tcl_GlobalEval(recPtr->interp, Tcl_DStringValue(&cmd)) != TCL_OK)
+	Tk_BackgroundError(recPtr->interp);
+    Tcl_DStringFree(&cmd);
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -482,8 +1335,15 @@ Ck_RecorderCmd(clientData, interp, argc, argv)
 	recPtr->lastEvent.sec = recPtr->lastEvent.usec = 0;
 #endif
 	recPtr->record = NULL;
-	recPtr->replay = NULL;
+	recPtr->items = NULL;
+	recPtr->numItems = recPtr->nextItem = 0;
+	recPtr->command = NULL;
 	recPtr->withDelay = 0;
+	recPtr->binary = 0;
+	recPtr->bufferSize = 0;
+	recPtr->flushInterval = DEFAULT_FLUSH_INTERVAL;
+	recPtr->flushTimerRunning = 0;
+	recPtr->nextWinId = 1;
 	ckRecorder = recPtr;
     }
 
@@ -495,22 +1355,42 @@ Ck_RecorderCmd(clientData, interp, argc, argv)
     c = argv[1][0];
     length = strlen(argv[1]);
     if ((c == 'r') && (strncmp(argv[1], "replay", length) == 0)) {
-	char *fileName;
+	char *fileName, *command = NULL;
 	Tcl_DString buffer;
+	ReplayItem *items;
+	int i, numItems, code;
+	double speed = 1.0;
 #if (TCL_MAJOR_VERSION == 7) && (TCL_MINOR_VERSION <= 4)
 	FILE *newReplay;
 #else
 	Tcl_Channel newReplay;
 #endif
 
-	if (argc != 3) {
-	    Tcl_AppendResult(interp, "wrong # args: should be \"",
-		argv[0], " replay fileName\"", (char *) NULL);
+	for (i = 2; i < argc - 1; i++) {
+	    if (strcmp(argv[i], "-nodelay") == 0)
+		speed = 0.0;
+	    else if (strcmp(argv[i], "-speed") == 0 && i < argc - 2) {
+		if (Tcl_GetDouble(interp, argv[++i], &speed) != TCL_OK)
+		    return TCL_ERROR;
+		if (speed <= 0.0) {
+		    Tcl_AppendResult(interp, "bad speed \"", argv[i],
+			"\": must be positive", (char *) NULL);
+		    return TCL_ERROR;
+		}
+	    } else if (strcmp(argv[i], "-command") == 0 && i < argc - 2)
+		command = argv[++i];
+	    else
+		break;
+	}
+	if (argc < 3 || i != argc - 1) {
+	    Tcl_AppendResult(interp, "wrong # or bad args: should be \"",
+		argv[0], " replay ?-speed factor? ?-nodelay?",
+		" ?-command script? fileName\"", (char *) NULL);
 	    return TCL_ERROR;
 	}
 
 #if (TCL_MAJOR_VERSION == 7) && (TCL_MINOR_VERSION <= 4)
-	fileName = Tcl_TildeSubst(interp, argv[2], &buffer);
+	fileName = Tcl_TildeSubst(interp, argv[i], &buffer);
 	if (fileName == NULL) {
 replayError:
 	    Tcl_DStringFree(&buffer);
@@ -529,8 +1409,15 @@ replayError:
 	    Tcl_AppendResult(interp, "invalid file for replay", (char *) NULL);
 	    goto replayError;
 	}
+	if (strncmp(BINARY_MAGIC, Tcl_DStringValue(&buffer),
+	    BINARY_MAGIC_LEN - 1) == 0) {
+	    fclose(newReplay);
+	    Tcl_AppendResult(interp, "can't replay binary file, use \"",
+		argv[0], " convert\" first", (char *) NULL);
+	    goto replayError;
+	}
 #else
-	fileName = Tcl_TranslateFileName(interp, argv[2], &buffer);
+	fileName = Tcl_TranslateFileName(interp, argv[i], &buffer);
 	if (fileName == NULL) {
 replayError:
 	    Tcl_DStringFree(&buffer);
@@ -546,74 +1433,92 @@ replayError:
 	    Tcl_AppendResult(interp, "invalid file for replay", (char *) NULL);
 	    goto replayError;
 	}
+	if (strncmp(BINARY_MAGIC, Tcl_DStringValue(&buffer),
+	    BINARY_MAGIC_LEN - 1) == 0) {
+	    Tcl_Close(NULL, newReplay);
+	    Tcl_AppendResult(interp, "can't replay binary file, use \"",
+		argv[0], " convert\" first", (char *) NULL);
+	    goto replayError;
+	}
 #endif
-	if (recPtr->replay != NULL) {
-	    if (recPtr->timerRunning)
-		Tk_DeleteTimerHandler(recPtr->timer);
+	Tcl_DStringFree(&buffer);
+	code = ReadReplay(interp, newReplay, &items, &numItems);
 #if (TCL_MAJOR_VERSION == 7) && (TCL_MINOR_VERSION <= 4)
-	    fclose(recPtr->replay);
+	fclose(newReplay);
 #else
-	    Tcl_Close(NULL, recPtr->replay);
+	Tcl_Close(NULL, newReplay);
 #endif
-	    recPtr->timerRunning = 0;
+	if (code != TCL_OK)
+	    return code;
+	StopReplay(recPtr);
+	recPtr->items = items;
+	recPtr->numItems = numItems;
+	recPtr->nextItem = 0;
+	recPtr->speed = speed;
+	if (command != NULL) {
+	    recPtr->command = (char *) ckalloc(strlen(command) + 1);
+	    strcpy(recPtr->command, command);
 	}
-	recPtr->replay = newReplay;
+	recPtr->numEvents = 0;
+	recPtr->startTime = ReplayTime();
+	recPtr->redrawTime = recPtr->lastMark = 0.0;
 	recPtr->interp = interp;
 	Tk_DoWhenIdle(RecorderReplay, (ClientData) recPtr);
     } else if ((c == 's') && (strncmp(argv[1], "start", length) == 0) &&
 	(length > 1)) {
-	char *fileName;
-	int withDelay = 0, fileArg = 2;
+	char *fileName, *string;
+	int i, withDelay = 0, binary = 0, bufferSize = 0;
+	int flushInterval = DEFAULT_FLUSH_INTERVAL;
 	Tcl_DString buffer;
 #if (TCL_MAJOR_VERSION == 7) && (TCL_MINOR_VERSION <= 4)
 	FILE *newRecord;
 	time_t now;
 #else
 	Tcl_Channel newRecord;
-	char *string;
 #endif
 
-	if (argc < 3 || argc > 4) {
-badStartArgs:
+	for (i = 2; i < argc - 1; i++) {
+	    if (strcmp(argv[i], "-withdelay") == 0)
+		withDelay = 1;
+	    else if (strcmp(argv[i], "-binary") == 0)
+		binary = 1;
+	    else if (strcmp(argv[i], "-buffersize") == 0 && i < argc - 2) {
+		if (Tcl_GetInt(interp, argv[++i], &bufferSize) != TCL_OK)
+		    return TCL_ERROR;
+		if (bufferSize < 0)
+		    bufferSize = 0;
+	    } else if (strcmp(argv[i], "-flushinterval") == 0 &&
+		i < argc - 2) {
+		if (Tcl_GetInt(interp, argv[++i], &flushInterval) != TCL_OK)
+		    return TCL_ERROR;
+		if (flushInterval < 0)
+		    flushInterval = 0;
+	    } else
+		break;
+	}
+	if (argc < 3 || i != argc - 1) {
 	    Tcl_AppendResult(interp, "wrong # or bad args: should be \"",
-		argv[0], " start ?-withdelay? fileName\"", (char *) NULL);
+		argv[0], " start ?-withdelay? ?-binary? ?-buffersize bytes?",
+		" ?-flushinterval ms? fileName\"", (char *) NULL);
 	    return TCL_ERROR;
 	}
-	if (argc == 4) {
-	    if (strcmp(argv[2], "-withdelay") != 0)
-		goto badStartArgs;
-	    withDelay++;
-	    fileArg++;
-	}
 #if (TCL_MAJOR_VERSION == 7) && (TCL_MINOR_VERSION <= 4)
-	fileName = Tcl_TildeSubst(interp, argv[fileArg], &buffer);
+	fileName = Tcl_TildeSubst(interp, argv[i], &buffer);
 	if (fileName == NULL) {
 startError:
 	    Tcl_DStringFree(&buffer);
 	    return TCL_ERROR;
 	}
-	newRecord = fopen(fileName, "w");
+	newRecord = fopen(fileName, binary ? "wb" : "w");
 	if (newRecord == NULL) {
 	    Tcl_AppendResult(interp, "error opening \"", fileName,
 	        "\": ", Tcl_PosixError(interp), (char *) NULL);
 	    goto startError;
 	}
-	if (recPtr->record != NULL)
-	    fclose(recPtr->record);
-	else {
-	    recPtr->lastEvent.tv_sec = recPtr->lastEvent.tv_usec = 0;
-	    Ck_CreateGenericHandler(RecorderInput, recPtr);
-	}
-	recPtr->record = newRecord;
-	recPtr->withDelay = withDelay;
-	time(&now);
-	fprintf(recPtr->record, "# CK-RECORDER\n# %s", ctime(&now));
-	fprintf(recPtr->record, "# %s %s\n",
-	    Tcl_GetVar(interp, "argv0", TCL_GLOBAL_ONLY),
-	    Tcl_GetVar(interp, "argv", TCL_GLOBAL_ONLY));
-	Tcl_DStringFree(&buffer);
+	if (bufferSize > 0)
+	    setvbuf(newRecord, NULL, _IOFBF, bufferSize);
 #else
-	fileName = Tcl_TranslateFileName(interp, argv[fileArg], &buffer);
+	fileName = Tcl_TranslateFileName(interp, argv[i], &buffer);
 	if (fileName == NULL) {
 startError:
 	    Tcl_DStringFree(&buffer);
@@ -622,30 +1527,61 @@ startError:
 	newRecord = Tcl_OpenFileChannel(interp, fileName, "w", 0666);
 	if (newRecord == NULL)
 	    goto startError;
-	if (recPtr->record != NULL)
-	    Tcl_Close(NULL, recPtr->record);
-	else {
-	    recPtr->lastEvent.sec = recPtr->lastEvent.usec = 0;
-	    Ck_CreateGenericHandler(RecorderInput, (ClientData) recPtr);
+	if (binary)
+	    Tcl_SetChannelOption(NULL, newRecord, "-translation", "binary");
+	if (bufferSize > 0) {
+	    Tcl_SetChannelOption(NULL, newRecord, "-buffering", "full");
+	    Tcl_SetChannelBufferSize(newRecord, bufferSize);
 	}
+#endif
+	Tcl_DStringFree(&buffer);
+	if (recPtr->record != NULL)
+	    RecorderStop(recPtr);
+#if (TCL_MAJOR_VERSION == 7) && (TCL_MINOR_VERSION <= 4)
+	recPtr->lastEvent.tv_sec = recPtr->lastEvent.tv_usec = 0;
+#else
+	recPtr->lastEvent.sec = recPtr->lastEvent.usec = 0;
+#endif
+	Ck_CreateGenericHandler(RecorderInput, (ClientData) recPtr);
 	recPtr->record = newRecord;
 	recPtr->withDelay = withDelay;
-	string = "# CK-RECORDER\n# ";
-	Tcl_Write(recPtr->record, string, strlen(string));
+	recPtr->binary = binary;
+	recPtr->bufferSize = bufferSize;
+	recPtr->flushInterval = flushInterval;
+	recPtr->flushTimerRunning = 0;
+	Tcl_InitHashTable(&recPtr->winIds, TCL_STRING_KEYS);
+	recPtr->nextWinId = 1;
+	if (bufferSize > 0)
+	    Tcl_CreateExitHandler(RecorderExitProc, (ClientData) recPtr);
+
+	/*
+	 * Write header: magic line, time of day, and command line.
+	 */
+
+	if (binary)
+	    WriteRecord(recPtr, BINARY_MAGIC, BINARY_MAGIC_LEN);
+	else
+	    WriteRecord(recPtr, "# CK-RECORDER\n", 14);
+	Tcl_DStringInit(&buffer);
+#if (TCL_MAJOR_VERSION == 7) && (TCL_MINOR_VERSION <= 4)
+	time(&now);
+	string = ctime(&now);
+	Tcl_DStringAppend(&buffer, string, strlen(string) - 1);
+#else
 	Tcl_Eval(interp, "clock format [clock seconds]");
-        { char *result = Tcl_GetStringResult(interp);
-          Tcl_Write(recPtr->record, result, strlen(result));
-        }
+	Tcl_DStringAppend(&buffer, Tcl_GetStringResult(interp), -1);
 	Tcl_ResetResult(interp);
-	Tcl_Write(recPtr->record, "\n# ", 3);
+#endif
+	WriteComment(recPtr, Tcl_DStringValue(&buffer));
+	Tcl_DStringSetLength(&buffer, 0);
 	string = Tcl_GetVar(interp, "argv0", TCL_GLOBAL_ONLY);
-	Tcl_Write(recPtr->record, string, strlen(string));
-	Tcl_Write(recPtr->record, " ", 1);
+	Tcl_DStringAppend(&buffer, string == NULL ? "" : string, -1);
+	Tcl_DStringAppend(&buffer, " ", 1);
 	string = Tcl_GetVar(interp, "argv", TCL_GLOBAL_ONLY);
-	Tcl_Write(recPtr->record, string, strlen(string));
-	Tcl_Write(recPtr->record, "\n", 1);
+	Tcl_DStringAppend(&buffer, string == NULL ? "" : string, -1);
+	WriteComment(recPtr, Tcl_DStringValue(&buffer));
 	Tcl_DStringFree(&buffer);
-#endif
+	RecorderFlush((ClientData) recPtr);
     } else if ((c == 's') && (strncmp(argv[1], "stop", length) == 0) &&
 	(length > 1)) {
 	if (argc > 3) {
@@ -657,29 +1593,19 @@ badStopArgs:
 	if (argc == 3) {
 	    if (strcmp(argv[2], "replay") != 0)
 		goto badStopArgs;
-	    if (recPtr->replay != NULL) {
-		if (recPtr->timerRunning)
-		    Tk_DeleteTimerHandler(recPtr->timer);
-#if (TCL_MAJOR_VERSION == 7) && (TCL_MINOR_VERSION <= 4)
-		fclose(recPtr->replay);
-#else
-		Tcl_Close(NULL, recPtr->replay);
-#endif
-		recPtr->replay = NULL;
-		recPtr->timerRunning = 0;
-	    }
-	} else if (recPtr->record != NULL) {
-#if (TCL_MAJOR_VERSION == 7) && (TCL_MINOR_VERSION <= 4)
-	    fclose(recPtr->record);
-#else
-	    Tcl_Close(NULL, recPtr->record);
-#endif
-	    Ck_DeleteGenericHandler(RecorderInput, (ClientData) recPtr);
-	    recPtr->record = NULL;
+	    StopReplay(recPtr);
+	} else if (recPtr->record != NULL)
+	    RecorderStop(recPtr);
+    } else if ((c == 'c') && (strncmp(argv[1], "convert", length) == 0)) {
+	if (argc != 4) {
+	    Tcl_AppendResult(interp, "wrong # args: should be \"",
+		argv[0], " convert binaryFile textFile\"", (char *) NULL);
+	    return TCL_ERROR;
 	}
+	return ConvertBinary(interp, argv[2], argv[3]);
     } else {
 	Tcl_AppendResult(interp, "wrong # args: should be \"",
-		argv[0], " replay, start, or stop\"", (char *) NULL);
+		argv[0], " convert, replay, start, or stop\"", (char *) NULL);
 	return TCL_ERROR;
     }
     return TCL_OK;
@@ -633,10 +633,12 @@ DisplayScrollbar(clientData)
     register CkWindow *winPtr = scrollPtr->winPtr;
     int width, i;
     long gchar;
+    double t0;
 
     if ((scrollPtr->winPtr == NULL) || !(winPtr->flags & CK_MAPPED)) {
 	goto done;
     }
+    t0 = CkProfileStart(winPtr->mainPtr);
 
     width = (scrollPtr->vertical ? winPtr->height : winPtr->width);
 
@@ -699,6 +701,7 @@ DisplayScrollbar(clientData)
     waddch(winPtr->window, gchar);
 
     Ck_EventuallyRefresh(winPtr);
+    CkProfileWindow(winPtr, t0);
 
 done:
     scrollPtr->flags &= ~REDRAW_PENDING;
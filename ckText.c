@@ -40,6 +40,8 @@ static Ck_ConfigSpec configSpecs[] = {
 	DEF_TEXT_FG, Ck_Offset(CkText, fg), 0},
     {CK_CONFIG_COORD, "-height", "height", "Height",
 	DEF_TEXT_HEIGHT, Ck_Offset(CkText, height), 0},
+    {CK_CONFIG_INT, "-maxlines", "maxLines", "MaxLines",
+	DEF_TEXT_MAX_LINES, Ck_Offset(CkText, maxLines), 0},
     {CK_CONFIG_ATTR, "-selectattributes", "selectAttributes",
         "SelectAttributes", DEF_TEXT_SELECT_ATTR_COLOR,
         Ck_Offset(CkText, selAttr), CK_CONFIG_COLOR_ONLY},
@@ -96,6 +98,51 @@ Ck_Uid ckTextWordUid = NULL;
 
 int ckTextDebug = 0;
 
+/*
+ * Number of characters read and inserted at a time by the "load"
+ * widget command:
+ */
+
+#define LOAD_CHUNK 65536
+
+/*
+ * When a text with -maxlines grows beyond the limit, it is trimmed to
+ * 1/TRIM_FRACTION below the limit, so that the oldest lines get deleted
+ * in batches rather than one at a time.
+ */
+
+#define TRIM_FRACTION 16
+
+/*
+ * The structure below holds the state of a "search" widget command
+ * which is shared by the procedures doing the actual search.
+ */
+
+typedef struct TextSearch {
+    CkText *textPtr;		/* Text being searched. */
+    Tcl_Interp *interp;		/* Interpreter for results. */
+    int backwards;		/* Non-zero means search backwards. */
+    int all;			/* Non-zero means report all matches,
+				 * else only the first one. */
+    CkTextIndex *stopPtr;	/* Stop index, or NULL to search the
+				 * entire text. */
+    char *varName;		/* Name of -count variable, or NULL. */
+    int numMatches;		/* Number of matches reported so far. */
+    char *pattern;		/* Pattern for exact search. */
+    int patLength;		/* Number of bytes in pattern. */
+    int foldCase;		/* Non-zero means ignore case of ASCII
+				 * letters in exact search. */
+    int skip[256];		/* Boyer-Moore-Horspool shift for each
+				 * value of the last byte compared. */
+} TextSearch;
+
+/*
+ * Number of matches per line (or per pass of a multiline search) which
+ * can be kept without allocating memory:
+ */
+
+#define NUM_STATIC_FOUND 16
+
 /*
  * Forward declarations for procedures defined later in this file:
  */
@@ -106,11 +153,31 @@ static int		DeleteChars _ANSI_ARGS_((CkText *textPtr,
 			    char *index1String, char *index2String));
 static void		DestroyText _ANSI_ARGS_((ClientData clientData));
 static void		InsertChars _ANSI_ARGS_((CkText *textPtr,
-			    CkTextIndex *indexPtr, char *string));
+			    CkTextIndex *indexPtr, char *string, int length));
+static int		TrimLines _ANSI_ARGS_((CkText *textPtr));
 static void		TextCmdDeletedProc _ANSI_ARGS_((
 			    ClientData clientData));
 static void		TextEventProc _ANSI_ARGS_((ClientData clientData,
 			    CkEvent *eventPtr));
+static void		LoadChunk _ANSI_ARGS_((CkText *textPtr,
+			    CkTextIndex *indexPtr, char *string, int length));
+static int		TextLoadCmd _ANSI_ARGS_((CkText *textPtr,
+			    Tcl_Interp *interp, int argc, char **argv));
+static void		SearchInitExact _ANSI_ARGS_((TextSearch *searchPtr,
+			    char *pattern));
+static char *		SearchExact _ANSI_ARGS_((TextSearch *searchPtr,
+			    char *string, int length));
+#if CK_USE_UTF
+static int		SearchMultiline _ANSI_ARGS_((TextSearch *searchPtr,
+			    char *pattern, int exact, int noCase,
+			    int startingLine, int startingChar,
+			    int stopLine));
+static int		SearchTextOffset _ANSI_ARGS_((CkTextLine *linePtr,
+			    int charIndex));
+#endif
+static int		SearchReport _ANSI_ARGS_((TextSearch *searchPtr,
+			    CkTextLine *linePtr, char *string, int matchChar,
+			    int matchLength));
 static int		TextSearchCmd _ANSI_ARGS_((CkText *textPtr,
 			    Tcl_Interp *interp, int argc, char **argv));
 static int		TextWidgetCmd _ANSI_ARGS_((ClientData clientData,
@@ -195,6 +262,7 @@ Ck_TextCmd(clientData, interp, argc, argv)
     textPtr->height = 0;
     textPtr->prevWidth = new->width;
     textPtr->prevHeight = new->height;
+    textPtr->hlPtr = NULL;
     CkTextCreateDInfo(textPtr);
 #if CK_USE_UTF
     CkTextMakeByteIndex(textPtr->tree, 0, 0, &startIndex);
@@ -468,6 +536,8 @@ TextWidgetCmd(clientData, interp, argc, argv)
 	    }
 	    CkTextIndexForwChars(&index1, last-offset, &index1);
 	}
+    } else if ((c == 'h') && (strncmp(argv[1], "highlight", length) == 0)) {
+	result = CkTextHighlightCmd(textPtr, interp, argc, argv);
     } else if ((c == 'i') && (strncmp(argv[1], "index", length) == 0)
 	    && (length >= 3)) {
 	if (argc != 3) {
@@ -484,7 +554,7 @@ TextWidgetCmd(clientData, interp, argc, argv)
 	CkTextPrintIndex(&index1, Tcl_GetStringResult(interp));
     } else if ((c == 'i') && (strncmp(argv[1], "insert", length) == 0)
 	    && (length >= 3)) {
-	int i, j, numTags;
+	int i, j, numTags, atEnd;
 	char **tagNames;
 	CkTextTag **oldTagArrayPtr;
 
@@ -501,8 +571,9 @@ TextWidgetCmd(clientData, interp, argc, argv)
 	    goto done;
 	}
 	if (textPtr->state == ckTextNormalUid) {
+	    atEnd = CkTextAtEnd(textPtr);
 	    for (j = 3;  j < argc; j += 2) {
-		InsertChars(textPtr, &index1, argv[j]);
+		InsertChars(textPtr, &index1, argv[j], -1);
 		if (argc > (j+1)) {
 		    CkTextIndexForwChars(&index1, (int) strlen(argv[j]),
 			    &index2);
@@ -519,14 +590,29 @@ TextWidgetCmd(clientData, interp, argc, argv)
 			goto done;
 		    }
 		    for (i = 0; i < numTags; i++) {
-			CkBTreeTag(&index1, &index2,
-				CkTextCreateTag(textPtr, tagNames[i]), 1);
+			CkTextTag *tagPtr;
+
+			tagPtr = CkTextCreateTag(textPtr, tagNames[i]);
+			if (tagPtr->highlightRules > 0) {
+			    Tcl_AppendResult(interp, "tag \"", tagNames[i],
+				    "\" is used by highlighting rules",
+				    (char *) NULL);
+			    ckfree((char *) tagNames);
+			    result = TCL_ERROR;
+			    goto done;
+			}
+			CkBTreeTag(&index1, &index2, tagPtr, 1);
 		    }
 		    ckfree((char *) tagNames);
 		    index1 = index2;
 		}
 	    }
+	    if ((TrimLines(textPtr) >= 0) && atEnd) {
+		CkTextSeeEnd(textPtr);
+	    }
 	}
+    } else if ((c == 'l') && (strncmp(argv[1], "load", length) == 0)) {
+	result = TextLoadCmd(textPtr, interp, argc, argv);
     } else if ((c == 'm') && (strncmp(argv[1], "mark", length) == 0)) {
 	result = CkTextMarkCmd(textPtr, interp, argc, argv);
     } else if ((c == 's') && (strcmp(argv[1], "search") == 0)
@@ -548,8 +634,8 @@ TextWidgetCmd(clientData, interp, argc, argv)
     } else {
 	Tcl_AppendResult(interp, "bad option \"", argv[1],
 		"\":  must be bbox, cget, compare, configure, debug, delete, ",
-		"dlineinfo, get, index, insert, mark, scan, search, see, ",
-		"tag, window, xview, or yview",
+		"dlineinfo, get, highlight, index, insert, load, mark, scan, ",
+		"search, see, tag, window, xview, or yview",
 		(char *) NULL);
 	result = TCL_ERROR;
     }
@@ -595,6 +681,7 @@ DestroyText(clientData)
      */
 
     CkTextFreeDInfo(textPtr);
+    CkTextFreeHighlighter(textPtr);
     CkBTreeDestroy(textPtr->tree);
     for (hPtr = Tcl_FirstHashEntry(&textPtr->tagTable, &search);
 	    hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
@@ -654,6 +741,11 @@ ConfigureText(interp, textPtr, argc, argv, flags)
     char **argv;		/* Arguments. */
     int flags;			/* Flags to pass to Ck_ConfigureWidget. */
 {
+    /*
+     * The options of the widget are the defaults for all styles.
+     */
+
+    CkTextTagsChanged(textPtr);
     if (Ck_ConfigureWidget(interp, textPtr->winPtr, configSpecs,
 	    argc, argv, (char *) textPtr, flags) != TCL_OK) {
 	return TCL_ERROR;
@@ -751,6 +843,7 @@ ConfigureText(interp, textPtr, argc, argv, flags)
     Ck_GeometryRequest(textPtr->winPtr, textPtr->width, textPtr->height);
 
     CkTextRelayoutWindow(textPtr);
+    TrimLines(textPtr);
     return TCL_OK;
 }
 
@@ -870,12 +963,15 @@ TextCmdDeletedProc(clientData)
  */
 
 static void
-InsertChars(textPtr, indexPtr, string)
+InsertChars(textPtr, indexPtr, string, length)
     CkText *textPtr;		/* Overall information about text widget. */
     CkTextIndex *indexPtr;	/* Where to insert new characters.  May be
 				 * modified and/or invalidated. */
-    char *string;		/* Null-terminated string containing new
-				 * information to add to text. */
+    char *string;		/* String containing new information to add
+				 * to text. */
+    int length;			/* Number of bytes in string, or -1 if
+				 * string is null-terminated.  If >= 0,
+				 * string is loaded in bulk. */
 {
     int lineIndex;
 
@@ -894,12 +990,17 @@ InsertChars(textPtr, indexPtr, string)
     }
 
     /*
-     * Notify the display module that lines are about to change, then do
-     * the insertion.
+     * Notify the highlighter and the display module that lines are
+     * about to change, then do the insertion.
      */
 
+    CkTextHighlightChanged(textPtr, indexPtr, indexPtr);
     CkTextChanged(textPtr, indexPtr, indexPtr);
-    CkBTreeInsertChars(indexPtr, string);
+    if (length < 0) {
+	CkBTreeInsertChars(indexPtr, string);
+    } else {
+	CkBTreeLoadChars(indexPtr, string, length);
+    }
 
     /*
      * Invalidate any selection retrievals in progress.
@@ -908,6 +1009,291 @@ InsertChars(textPtr, indexPtr, string)
     textPtr->abortSelections = 1;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * TextLoadCmd --
+ *
+ *	This procedure is invoked to process the "load" widget command
+ *	for text widgets. See the user documentation for details on what
+ *	it does.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	The contents of a file or channel are inserted into the text.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+TextLoadCmd(textPtr, interp, argc, argv)
+    CkText *textPtr;		/* Information about text widget. */
+    Tcl_Interp *interp;		/* Current interpreter. */
+    int argc;			/* Number of arguments. */
+    char **argv;		/* Argument strings. */
+{
+    char *fileName = NULL, *chanName = NULL, *indexString = "end";
+    int i, n, lineIndex, atEnd, code = TCL_OK;
+    CkTextIndex index;
+#if (TCL_MAJOR_VERSION == 7) && (TCL_MINOR_VERSION <= 4)
+    FILE *f;
+    Tcl_DString buffer;
+    char *block;
+#else
+    Tcl_Channel chan;
+#if (TCL_MAJOR_VERSION > 8) || \
+    ((TCL_MAJOR_VERSION == 8) && (TCL_MINOR_VERSION >= 1))
+    Tcl_Obj *dataObj;
+#else
+    char *block;
+#endif
+#endif
+
+    for (i = 2; i < argc; i++) {
+	if (strcmp(argv[i], "-channel") == 0 && i < argc - 1) {
+	    chanName = argv[++i];
+	} else if (strcmp(argv[i], "-file") == 0 && i < argc - 1) {
+	    fileName = argv[++i];
+	} else if (i == argc - 1 && argv[i][0] != '-') {
+	    indexString = argv[i];
+	} else {
+	    break;
+	}
+    }
+    if (i < argc || (fileName == NULL) == (chanName == NULL)) {
+	Tcl_AppendResult(interp, "wrong # args: should be \"",
+		argv[0], " load -channel channelId|-file fileName ?index?\"",
+		(char *) NULL);
+	return TCL_ERROR;
+    }
+    if (CkTextGetIndex(interp, textPtr, indexString, &index) != TCL_OK) {
+	return TCL_ERROR;
+    }
+    if (textPtr->state != ckTextNormalUid) {
+	return TCL_OK;
+    }
+
+    /*
+     * Don't allow insertions on the last (dummy) line of the text.
+     */
+
+    lineIndex = CkBTreeLineIndex(index.linePtr);
+    if (lineIndex == CkBTreeNumLines(textPtr->tree)) {
+	lineIndex--;
+#if CK_USE_UTF
+	CkTextMakeByteIndex(textPtr->tree, lineIndex, 1000000, &index);
+#else
+	CkTextMakeIndex(textPtr->tree, lineIndex, 1000000, &index);
+#endif
+    }
+    atEnd = CkTextAtEnd(textPtr);
+
+    /*
+     * Read and insert the data in chunks of LOAD_CHUNK characters, so
+     * that the whole contents never need to be kept in memory twice.
+     */
+
+#if (TCL_MAJOR_VERSION == 7) && (TCL_MINOR_VERSION <= 4)
+    if (fileName != NULL) {
+	fileName = Tcl_TildeSubst(interp, fileName, &buffer);
+	if (fileName == NULL) {
+	    return TCL_ERROR;
+	}
+	f = fopen(fileName, "r");
+	if (f == NULL) {
+	    Tcl_AppendResult(interp, "couldn't open \"", fileName,
+		    "\": ", Tcl_PosixError(interp), (char *) NULL);
+	    Tcl_DStringFree(&buffer);
+	    return TCL_ERROR;
+	}
+	Tcl_DStringFree(&buffer);
+    } else if (Tcl_GetOpenFile(interp, chanName, 0, 1, &f) != TCL_OK) {
+	return TCL_ERROR;
+    }
+    block = (char *) ckalloc(LOAD_CHUNK);
+    while ((n = fread(block, 1, LOAD_CHUNK, f)) > 0) {
+	LoadChunk(textPtr, &index, block, n);
+    }
+    if (ferror(f)) {
+	code = TCL_ERROR;
+    }
+    ckfree(block);
+    if (fileName != NULL) {
+	fclose(f);
+    }
+#else
+    if (fileName != NULL) {
+	chan = Tcl_OpenFileChannel(interp, fileName, "r", 0);
+    } else {
+	chan = Tcl_GetChannel(interp, chanName, &i);
+	if (chan != NULL && !(i & TCL_READABLE)) {
+	    Tcl_AppendResult(interp, "channel \"", chanName,
+		    "\" wasn't opened for reading", (char *) NULL);
+	    return TCL_ERROR;
+	}
+    }
+    if (chan == NULL) {
+	return TCL_ERROR;
+    }
+#if (TCL_MAJOR_VERSION > 8) || \
+    ((TCL_MAJOR_VERSION == 8) && (TCL_MINOR_VERSION >= 1))
+    dataObj = Tcl_NewObj();
+    Tcl_IncrRefCount(dataObj);
+    while ((n = Tcl_ReadChars(chan, dataObj, LOAD_CHUNK, 0)) > 0) {
+	char *string = Tcl_GetStringFromObj(dataObj, &n);
+
+	LoadChunk(textPtr, &index, string, n);
+    }
+    Tcl_DecrRefCount(dataObj);
+#else
+    block = (char *) ckalloc(LOAD_CHUNK);
+    while ((n = Tcl_Read(chan, block, LOAD_CHUNK)) > 0) {
+	LoadChunk(textPtr, &index, block, n);
+    }
+    ckfree(block);
+#endif
+    if (n < 0) {
+	code = TCL_ERROR;
+    }
+#endif
+    if (code != TCL_OK) {
+	Tcl_AppendResult(interp, "error reading \"",
+		fileName != NULL ? fileName : chanName, "\": ",
+		Tcl_PosixError(interp), (char *) NULL);
+    }
+#if (TCL_MAJOR_VERSION != 7) || (TCL_MINOR_VERSION > 4)
+    if (fileName != NULL) {
+	Tcl_Close(NULL, chan);
+    }
+#endif
+    if ((textPtr->maxLines > 0) && atEnd) {
+	CkTextSeeEnd(textPtr);
+    }
+    return code;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * LoadChunk --
+ *
+ *	Insert one chunk of data for the "load" widget command and
+ *	advance the index past it.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The characters are added to the text before indexPtr, which
+ *	is updated to refer to the same position again.  The oldest
+ *	lines get deleted if the text has grown beyond -maxlines.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+LoadChunk(textPtr, indexPtr, string, length)
+    CkText *textPtr;		/* Information about text widget. */
+    CkTextIndex *indexPtr;	/* Where to insert the characters. */
+    char *string;		/* Characters to insert. */
+    int length;			/* Number of bytes in string. */
+{
+    int lineIndex, charIndex, n;
+    char *p, *end = string + length;
+
+    lineIndex = CkBTreeLineIndex(indexPtr->linePtr);
+    charIndex = indexPtr->charIndex + length;
+    for (p = string; (p = memchr(p, '\n', (size_t) (end - p))) != NULL; ) {
+	lineIndex++;
+	p++;
+	charIndex = end - p;
+    }
+    InsertChars(textPtr, indexPtr, string, length);
+    n = TrimLines(textPtr);
+    if (n > 0) {
+	lineIndex -= n;
+	if (lineIndex < 0) {
+	    lineIndex = charIndex = 0;
+	}
+    }
+#if CK_USE_UTF
+    CkTextMakeByteIndex(textPtr->tree, lineIndex, charIndex, indexPtr);
+#else
+    CkTextMakeIndex(textPtr->tree, lineIndex, charIndex, indexPtr);
+#endif
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TrimLines --
+ *
+ *	Enforce the -maxlines option after characters were added to
+ *	a text:  if it has too many lines, delete the oldest ones.
+ *
+ * Results:
+ *	The number of lines deleted, or -1 if the text has no limit.
+ *
+ * Side effects:
+ *	Lines may get deleted from the beginning of the text.  If the
+ *	top of the view was among them, the view starts at the new
+ *	first line.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+TrimLines(textPtr)
+    CkText *textPtr;		/* Overall information about text widget. */
+{
+    int numLines, count, resetView;
+    CkTextIndex index1, index2;
+
+    if (textPtr->maxLines <= 0) {
+	return -1;
+    }
+    numLines = CkBTreeNumLines(textPtr->tree);
+    if (numLines <= textPtr->maxLines) {
+	return 0;
+    }
+    count = numLines - textPtr->maxLines + textPtr->maxLines / TRIM_FRACTION;
+
+    /*
+     * Tell the highlighter and the display what's about to happen so
+     * they can discard obsolete information.  Unless the view shows some
+     * of the lines being deleted, it stays where it is.
+     */
+
+#if CK_USE_UTF
+    CkTextMakeByteIndex(textPtr->tree, 0, 0, &index1);
+    CkTextMakeByteIndex(textPtr->tree, count, 0, &index2);
+#else
+    CkTextMakeIndex(textPtr->tree, 0, 0, &index1);
+    CkTextMakeIndex(textPtr->tree, count, 0, &index2);
+#endif
+    CkTextHighlightChanged(textPtr, &index1, &index2);
+    CkTextChanged(textPtr, &index1, &index2);
+    resetView = CkTextIndexCmp(&textPtr->topIndex, &index2) < 0;
+    CkBTreeDeleteLines(textPtr->tree, count);
+    if (resetView) {
+#if CK_USE_UTF
+	CkTextMakeByteIndex(textPtr->tree, 0, 0, &index1);
+#else
+	CkTextMakeIndex(textPtr->tree, 0, 0, &index1);
+#endif
+	CkTextSetYView(textPtr, &index1, 0);
+    }
+
+    /*
+     * Invalidate any selection retrievals in progress.
+     */
+
+    textPtr->abortSelections = 1;
+    return count;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -1001,14 +1387,15 @@ DeleteChars(textPtr, index1String, index2String)
     }
 
     /*
-     * Tell the display what's about to happen so it can discard
-     * obsolete display information, then do the deletion.  Also,
+     * Tell the highlighter and the display what's about to happen so
+     * they can discard obsolete information, then do the deletion.  Also,
      * if the deletion involves the top line on the screen, then
      * we have to reset the view (the deletion will invalidate
      * textPtr->topIndex).  Compute what the new first character
      * will be, then do the deletion, then reset the view.
      */
 
+    CkTextHighlightChanged(textPtr, &index1, &index2);
     CkTextChanged(textPtr, &index1, &index2);
     resetView = line = charIndex = 0;
     if (CkTextIndexCmp(&index2, &textPtr->topIndex) >= 0) {
@@ -1091,19 +1478,20 @@ TextSearchCmd(textPtr, interp, argc, argv)
     int argc;			/* Number of arguments. */
     char **argv;		/* Argument strings. */
 {
-    int backwards, exact, c, i, argsLeft, noCase, leftToScan;
+    int backwards, exact, c, i, argsLeft, noCase, leftToScan, multiline;
     size_t length;
     int numLines, startingLine, startingChar, lineNum, firstChar, lastChar;
     int code, matchLength, matchChar, passes, stopLine, searchWholeText;
-    int patLength;
-    char *arg, *pattern, *varName, *p, *startOfLine;
-    char buffer[20];
+    int lineLength, lowerLine, numFound, maxFound;
+    int staticFound[2 * NUM_STATIC_FOUND], *found;
+    char *arg, *pattern, *p, *startOfLine;
     CkTextIndex index, stopIndex;
     Tcl_DString line, patDString;
     CkTextSegment *segPtr;
     CkTextLine *linePtr;
     Tcl_RegExp regexp = NULL;		/* Initialization needed only to
 					 * prevent compiler warning. */
+    TextSearch search;
 
     /*
      * Parse switches and other arguments.
@@ -1112,7 +1500,13 @@ TextSearchCmd(textPtr, interp, argc, argv)
     exact = 1;
     backwards = 0;
     noCase = 0;
-    varName = NULL;
+    multiline = 0;
+    search.textPtr = textPtr;
+    search.interp = interp;
+    search.all = 0;
+    search.varName = NULL;
+    search.stopPtr = NULL;
+    search.numMatches = 0;
     for (i = 2; i < argc; i++) {
 	arg = argv[i];
 	if (arg[0] != '-') {
@@ -1123,11 +1517,14 @@ TextSearchCmd(textPtr, interp, argc, argv)
 	    badSwitch:
 	    Tcl_AppendResult(interp, "bad switch \"", arg,
 		    "\": must be -forward, -backward, -exact, -regexp, ",
-		    "-nocase, -count, or --", (char *) NULL);
+		    "-nocase, -count, -all, -multiline, or --",
+		    (char *) NULL);
 	    return TCL_ERROR;
 	}
 	c = arg[1];
-	if ((c == 'b') && (strncmp(argv[i], "-backwards", length) == 0)) {
+	if ((c == 'a') && (strncmp(argv[i], "-all", length) == 0)) {
+	    search.all = 1;
+	} else if ((c == 'b') && (strncmp(argv[i], "-backwards", length) == 0)) {
 	    backwards = 1;
 	} else if ((c == 'c') && (strncmp(argv[i], "-count", length) == 0)) {
 	    if (i >= (argc-1)) {
@@ -1135,11 +1532,13 @@ TextSearchCmd(textPtr, interp, argc, argv)
 		return TCL_ERROR;
 	    }
 	    i++;
-	    varName = argv[i];
+	    search.varName = argv[i];
 	} else if ((c == 'e') && (strncmp(argv[i], "-exact", length) == 0)) {
 	    exact = 1;
 	} else if ((c == 'f') && (strncmp(argv[i], "-forwards", length) == 0)) {
 	    backwards = 0;
+	} else if ((c == 'm') && (strncmp(argv[i], "-multiline", length) == 0)) {
+	    multiline = 1;
 	} else if ((c == 'n') && (strncmp(argv[i], "-nocase", length) == 0)) {
 	    noCase = 1;
 	} else if ((c == 'r') && (strncmp(argv[i], "-regexp", length) == 0)) {
@@ -1158,6 +1557,14 @@ TextSearchCmd(textPtr, interp, argc, argv)
 		(char *) NULL);
 	return TCL_ERROR;
     }
+#if !CK_USE_UTF
+    if (multiline) {
+	Tcl_AppendResult(interp, "-multiline requires Tcl 8.1 or later",
+		(char *) NULL);
+	return TCL_ERROR;
+    }
+#endif
+    search.backwards = backwards;
     pattern = argv[i];
 
     /*
@@ -1180,7 +1587,8 @@ TextSearchCmd(textPtr, interp, argc, argv)
     }
 
     if (CkTextGetIndex(interp, textPtr, argv[i+1], &index) != TCL_OK) {
-	return TCL_ERROR;
+	code = TCL_ERROR;
+	goto freePattern;
     }
     numLines = CkBTreeNumLines(textPtr->tree);
     startingLine = CkBTreeLineIndex(index.linePtr);
@@ -1197,34 +1605,66 @@ TextSearchCmd(textPtr, interp, argc, argv)
     }
     if (argsLeft == 1) {
 	if (CkTextGetIndex(interp, textPtr, argv[i+2], &stopIndex) != TCL_OK) {
-	    return TCL_ERROR;
+	    code = TCL_ERROR;
+	    goto freePattern;
 	}
 	stopLine = CkBTreeLineIndex(stopIndex.linePtr);
 	if (!backwards && (stopLine == numLines)) {
 	    stopLine = numLines-1;
 	}
 	searchWholeText = 0;
+	search.stopPtr = &stopIndex;
     } else {
 	stopLine = 0;
 	searchWholeText = 1;
     }
 
+    /*
+     * Exact patterns are searched for with the Boyer-Moore-Horspool
+     * algorithm, which can also ignore case as long as the pattern
+     * is plain ASCII.  In that case, and if a line consists of a
+     * single segment, the line is searched in place.
+     */
+
+    lowerLine = noCase;
+    if (exact) {
+	search.foldCase = 0;
+	if (noCase) {
+	    for (p = pattern; *p != 0 && !(*p & 0x80); p++) {
+		/* Empty loop body. */
+	    }
+	    search.foldCase = (*p == 0);
+	    lowerLine = !search.foldCase;
+	}
+	SearchInitExact(&search, pattern);
+    }
+
+#if CK_USE_UTF
+    if (multiline) {
+	code = SearchMultiline(&search, pattern, exact, noCase,
+		startingLine, startingChar, stopLine);
+	goto freePattern;
+    }
+#endif
+
     /*
      * Scan through all of the lines of the text circularly, starting
      * at the given index.
      */
 
-    matchLength = patLength = 0;	/* Only needed to prevent compiler
-					 * warnings. */
-    if (exact) {
-	patLength = strlen(pattern);
-    } else {
+    if (!exact) {
 	regexp = Tcl_RegExpCompile(interp, pattern);
 	if (regexp == NULL) {
-	    return TCL_ERROR;
+	    code = TCL_ERROR;
+	    goto freePattern;
 	}
     }
+    matchLength = 0;			/* Only needed to prevent compiler
+					 * warnings. */
+    found = staticFound;
+    maxFound = NUM_STATIC_FOUND;
     lineNum = startingLine;
+    linePtr = CkBTreeFindLine(textPtr->tree, lineNum);
     code = TCL_OK;
     Tcl_DStringInit(&line);
     for (passes = 0; passes < 2; ) {
@@ -1242,43 +1682,49 @@ TextSearchCmd(textPtr, interp, argc, argv)
 	 * that "$" can be used to match the end of the line.
 	 */
 
-	linePtr = CkBTreeFindLine(textPtr->tree, lineNum);
-	for (segPtr = linePtr->segPtr; segPtr != NULL;
-		segPtr = segPtr->nextPtr) {
-	    if (segPtr->typePtr != &ckTextCharType) {
-		continue;
+	if (exact && !lowerLine && (linePtr->segPtr->nextPtr == NULL)) {
+	    startOfLine = linePtr->segPtr->body.chars;
+	    lineLength = linePtr->segPtr->size;
+	} else {
+	    for (segPtr = linePtr->segPtr; segPtr != NULL;
+		    segPtr = segPtr->nextPtr) {
+		if (segPtr->typePtr != &ckTextCharType) {
+		    continue;
+		}
+		Tcl_DStringAppend(&line, segPtr->body.chars, segPtr->size);
+	    }
+	    if (!exact) {
+		Tcl_DStringSetLength(&line, Tcl_DStringLength(&line)-1);
 	    }
-	    Tcl_DStringAppend(&line, segPtr->body.chars, segPtr->size);
-	}
-	if (!exact) {
-	    Tcl_DStringSetLength(&line, Tcl_DStringLength(&line)-1);
-	}
-	startOfLine = Tcl_DStringValue(&line);
 
-	/*
-	 * If we're ignoring case, convert the line to lower case.
-	 */
+	    /*
+	     * If we're ignoring case, convert the line to lower case.
+	     */
 
-	if (noCase) {
+	    if (lowerLine) {
 #if CK_USE_UTF
-	    Tcl_DStringSetLength(&line,
-		Tcl_UtfToLower(Tcl_DStringValue(&line)));
+		Tcl_DStringSetLength(&line,
+		    Tcl_UtfToLower(Tcl_DStringValue(&line)));
 #else
-	    for (p = Tcl_DStringValue(&line); *p != 0; p++) {
-		if (isupper((unsigned char) *p)) {
-		    *p = tolower((unsigned char) *p);
+		for (p = Tcl_DStringValue(&line); *p != 0; p++) {
+		    if (isupper((unsigned char) *p)) {
+			*p = tolower((unsigned char) *p);
+		    }
 		}
-	    }
 #endif
+	    }
+	    startOfLine = Tcl_DStringValue(&line);
+	    lineLength = Tcl_DStringLength(&line);
 	}
 
 	/*
 	 * Check for matches within the current line.  If so, and if we're
-	 * searching backwards, repeat the search to find the last match
-	 * in the line.
+	 * searching backwards or for all matches, repeat the search to
+	 * find the last or all matches in the line.
 	 */
 
 	matchChar = -1;
+	numFound = 0;
 	firstChar = 0;
 	lastChar = INT_MAX;
 	if (lineNum == startingLine) {
@@ -1310,7 +1756,7 @@ TextSearchCmd(textPtr, interp, argc, argv)
 		 */
 
 		firstChar = indexInDString;
-		if (firstChar >= Tcl_DStringLength(&line)) {
+		if (firstChar >= lineLength) {
 		    goto nextLine;
 		}
 	    } else {
@@ -1321,19 +1767,20 @@ TextSearchCmd(textPtr, interp, argc, argv)
 		lastChar = indexInDString;
 	    }
 	}
-	do {
+	while (firstChar <= lineLength) {
 	    int thisLength;
 #if CK_USE_UTF
 	    Tcl_UniChar ch;
 #endif
 
 	    if (exact) {
-		p = strstr(startOfLine + firstChar, pattern);
+		p = SearchExact(&search, startOfLine + firstChar,
+			lineLength - firstChar);
 		if (p == NULL) {
 		    break;
 		}
 		i = p - startOfLine;
-		thisLength = patLength;
+		thisLength = search.patLength;
 	    } else {
 		char *start, *end;
 		int match;
@@ -1361,77 +1808,52 @@ TextSearchCmd(textPtr, interp, argc, argv)
 #else
 	    firstChar = matchChar+1;
 #endif
-	} while (backwards);
+	    if (search.all) {
+		/*
+		 * Remember the match, and continue after it.
+		 */
+
+		if (numFound >= maxFound) {
+		    int *newFound;
+
+		    newFound = (int *) ckalloc(4 * maxFound * sizeof(int));
+		    memcpy(newFound, found, 2 * numFound * sizeof(int));
+		    if (found != staticFound) {
+			ckfree((char *) found);
+		    }
+		    found = newFound;
+		    maxFound *= 2;
+		}
+		found[2 * numFound] = matchChar;
+		found[2 * numFound + 1] = matchLength;
+		numFound++;
+		if (matchChar + matchLength > firstChar) {
+		    firstChar = matchChar + matchLength;
+		}
+	    } else if (!backwards) {
+		break;
+	    }
+	}
 
 	/*
-	 * If we found a match then we're done.  Make sure that
-	 * the match occurred before the stopping index, if one was
+	 * Report the match(es).  Stop if there's no need to go on or
+	 * if a match occurred beyond the stopping index, if one was
 	 * specified.
 	 */
 
-	if (matchChar >= 0) {
-#if CK_USE_UTF
-	    int numChars;
-
-	    numChars = Tcl_NumUtfChars(startOfLine + matchChar,
-		matchLength);
-#endif
-
-	    /*
-	     * The index information returned by the regular expression
-	     * parser only considers textual information:  it doesn't
-	     * account for embedded windows or any other non-textual info.
-	     * Scan through the line's segments again to adjust both
-	     * matchChar and matchCount.
-	     */
+	if (!search.all && (matchChar >= 0)) {
+	    code = SearchReport(&search, linePtr, startOfLine, matchChar,
+		    matchLength);
+	    goto done;
+	}
+	for (i = 0; i < numFound; i++) {
+	    int k = backwards ? numFound - 1 - i : i;
 
-	    for (segPtr = linePtr->segPtr, leftToScan = matchChar;
-		    leftToScan >= 0; segPtr = segPtr->nextPtr) {
-		if (segPtr->typePtr != &ckTextCharType) {
-		    matchChar += segPtr->size;
-		    continue;
-		}
-		leftToScan -= segPtr->size;
-	    }
-	    for (leftToScan += matchLength; leftToScan > 0;
-		    segPtr = segPtr->nextPtr) {
-		if (segPtr->typePtr != &ckTextCharType) {
-#if CK_USE_UTF
-		    numChars += segPtr->size;
-#else
-		    matchLength += segPtr->size;
-#endif
-		    continue;
-		}
-		leftToScan -= segPtr->size;
-	    }
-#if CK_USE_UTF
-	    CkTextMakeByteIndex(textPtr->tree, lineNum, matchChar, &index);
-#else
-	    CkTextMakeIndex(textPtr->tree, lineNum, matchChar, &index);
-#endif
-	    if (!searchWholeText) {
-		if (!backwards && (CkTextIndexCmp(&index, &stopIndex) >= 0)) {
-		    goto done;
-		}
-		if (backwards && (CkTextIndexCmp(&index, &stopIndex) < 0)) {
-		    goto done;
-		}
-	    }
-	    if (varName != NULL) {
-#if CK_USE_UTF
-		sprintf(buffer, "%d", numChars);
-#else
-		sprintf(buffer, "%d", matchLength);
-#endif
-		if (Tcl_SetVar(interp, varName, buffer, TCL_LEAVE_ERR_MSG)
-			== NULL) {
-		    code = TCL_ERROR;
-		    goto done;
-		}
+	    code = SearchReport(&search, linePtr, startOfLine, found[2 * k],
+		    found[2 * k + 1]);
+	    if (code != TCL_OK) {
+		goto done;
 	    }
-	    CkTextPrintIndex(&index, Tcl_GetStringResult(interp));
-	    goto done;
 	}
 
 	/*
@@ -1448,6 +1870,7 @@ TextSearchCmd(textPtr, interp, argc, argv)
 	    } else if (lineNum < 0) {
 		lineNum = numLines-1;
 	    }
+	    linePtr = CkBTreeFindLine(textPtr->tree, lineNum);
 	} else {
 	    lineNum++;
 	    if (!searchWholeText) {
@@ -1457,17 +1880,512 @@ TextSearchCmd(textPtr, interp, argc, argv)
 	    } else if (lineNum >= numLines) {
 		lineNum = 0;
 	    }
+	    if (lineNum == 0) {
+		linePtr = CkBTreeFindLine(textPtr->tree, lineNum);
+	    } else {
+		linePtr = CkBTreeNextLine(linePtr);
+	    }
 	}
 	Tcl_DStringSetLength(&line, 0);
     }
     done:
+    if (code == TCL_BREAK) {
+	code = TCL_OK;
+    }
     Tcl_DStringFree(&line);
+    if (found != staticFound) {
+	ckfree((char *) found);
+    }
+    freePattern:
     if (noCase) {
 	Tcl_DStringFree(&patDString);
     }
     return code;
 }
-
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SearchInitExact --
+ *
+ *	Prepare the skip table of the Boyer-Moore-Horspool algorithm
+ *	for an exact search.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The pattern fields of searchPtr are filled in.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+SearchInitExact(searchPtr, pattern)
+    TextSearch *searchPtr;	/* Search state;  foldCase must be set. */
+    char *pattern;		/* Pattern, in lower case if foldCase. */
+{
+    int i, n, c;
+
+    searchPtr->pattern = pattern;
+    n = searchPtr->patLength = strlen(pattern);
+    for (i = 0; i < 256; i++) {
+	searchPtr->skip[i] = n;
+    }
+    for (i = 0; i < n - 1; i++) {
+	c = (unsigned char) pattern[i];
+	searchPtr->skip[c] = n - 1 - i;
+	if (searchPtr->foldCase && (c >= 'a') && (c <= 'z')) {
+	    searchPtr->skip[c - 'a' + 'A'] = n - 1 - i;
+	}
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SearchExact --
+ *
+ *	Find the first occurrence of an exact pattern in a range of
+ *	characters, which needs not be null-terminated.
+ *
+ * Results:
+ *	Pointer to the first character of the match, or NULL.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+#define FOLD(c) ((((c) >= 'A') && ((c) <= 'Z')) ? (c) - 'A' + 'a' : (c))
+
+static char *
+SearchExact(searchPtr, string, length)
+    TextSearch *searchPtr;	/* Search state with pattern. */
+    char *string;		/* Characters to search. */
+    int length;			/* Number of bytes in string. */
+{
+    unsigned char *s = (unsigned char *) string;
+    unsigned char *pat = (unsigned char *) searchPtr->pattern;
+    int n = searchPtr->patLength, pos, i;
+
+    if (n > length) {
+	return NULL;
+    }
+    if (n == 0) {
+	return string;
+    }
+    if (!searchPtr->foldCase) {
+	if (n == 1) {
+	    return memchr(string, pat[0], (size_t) length);
+	}
+	for (pos = 0; pos <= length - n; pos += searchPtr->skip[s[pos+n-1]]) {
+	    if ((s[pos+n-1] == pat[n-1]) && (s[pos] == pat[0])
+		    && (memcmp(s + pos + 1, pat + 1, (size_t) (n - 2)) == 0)) {
+		return string + pos;
+	    }
+	}
+    } else {
+	for (pos = 0; pos <= length - n; pos += searchPtr->skip[s[pos+n-1]]) {
+	    for (i = n - 1; (i >= 0) && (FOLD(s[pos+i]) == pat[i]); i--) {
+		/* Empty loop body. */
+	    }
+	    if (i < 0) {
+		return string + pos;
+	    }
+	}
+    }
+    return NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SearchReport --
+ *
+ *	Report one match found by the "search" widget command.
+ *
+ * Results:
+ *	TCL_OK means the search should go on, TCL_BREAK means that
+ *	it's finished, either because the match was beyond the stop
+ *	index or because only one match is wanted.  TCL_ERROR means
+ *	the count variable couldn't be set.
+ *
+ * Side effects:
+ *	The index of the match is stored in or appended to the
+ *	interpreter's result, its length in the count variable.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+SearchReport(searchPtr, linePtr, string, matchChar, matchLength)
+    TextSearch *searchPtr;	/* Search state. */
+    CkTextLine *linePtr;	/* Line where the match starts. */
+    char *string;		/* Text extracted from that line. */
+    int matchChar;		/* Offset of match in string. */
+    int matchLength;		/* Length of match in bytes. */
+{
+    CkTextSegment *segPtr;
+    CkTextIndex index;
+    int leftToScan, flags;
+    char buffer[50];
+#if CK_USE_UTF
+    int numChars;
+
+    numChars = Tcl_NumUtfChars(string + matchChar, matchLength);
+#endif
+
+    /*
+     * The index information returned by the regular expression
+     * parser only considers textual information:  it doesn't
+     * account for embedded windows or any other non-textual info.
+     * Scan through the line's segments again to adjust both
+     * matchChar and matchCount.
+     */
+
+    for (segPtr = linePtr->segPtr, leftToScan = matchChar;
+	    (leftToScan >= 0) && (segPtr != NULL); segPtr = segPtr->nextPtr) {
+	if (segPtr->typePtr != &ckTextCharType) {
+	    matchChar += segPtr->size;
+	    continue;
+	}
+	leftToScan -= segPtr->size;
+    }
+    for (leftToScan += matchLength; (leftToScan > 0) && (segPtr != NULL);
+	    segPtr = segPtr->nextPtr) {
+	if (segPtr->typePtr != &ckTextCharType) {
+#if CK_USE_UTF
+	    numChars += segPtr->size;
+#else
+	    matchLength += segPtr->size;
+#endif
+	    continue;
+	}
+	leftToScan -= segPtr->size;
+    }
+    index.tree = searchPtr->textPtr->tree;
+    index.linePtr = linePtr;
+    index.charIndex = matchChar;
+    if (searchPtr->stopPtr != NULL) {
+	if (!searchPtr->backwards
+		&& (CkTextIndexCmp(&index, searchPtr->stopPtr) >= 0)) {
+	    return TCL_BREAK;
+	}
+	if (searchPtr->backwards
+		&& (CkTextIndexCmp(&index, searchPtr->stopPtr) < 0)) {
+	    return TCL_BREAK;
+	}
+    }
+    if (searchPtr->varName != NULL) {
+#if CK_USE_UTF
+	sprintf(buffer, "%d", numChars);
+#else
+	sprintf(buffer, "%d", matchLength);
+#endif
+	flags = TCL_LEAVE_ERR_MSG;
+	if (searchPtr->all && (searchPtr->numMatches > 0)) {
+	    flags |= TCL_LIST_ELEMENT | TCL_APPEND_VALUE;
+	}
+	if (Tcl_SetVar(searchPtr->interp, searchPtr->varName, buffer,
+		flags) == NULL) {
+	    return TCL_ERROR;
+	}
+    }
+    searchPtr->numMatches++;
+    CkTextPrintIndex(&index, buffer);
+    if (!searchPtr->all) {
+	Tcl_SetResult(searchPtr->interp, buffer, TCL_VOLATILE);
+	return TCL_BREAK;
+    }
+    Tcl_AppendElement(searchPtr->interp, buffer);
+    return TCL_OK;
+}
+
+#if CK_USE_UTF
+/*
+ *----------------------------------------------------------------------
+ *
+ * SearchMultiline --
+ *
+ *	Implements the "search" widget command with the -multiline
+ *	switch:  the text to be searched is collected into a single
+ *	string, so that matches may span lines.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	Matches are reported by SearchReport.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+SearchMultiline(searchPtr, pattern, exact, noCase, startingLine,
+	startingChar, stopLine)
+    TextSearch *searchPtr;	/* Search state. */
+    char *pattern;		/* Pattern, in lower case if noCase. */
+    int exact;			/* Non-zero means exact search. */
+    int noCase;			/* Non-zero means ignore case. */
+    int startingLine;		/* Line and character index where */
+    int startingChar;		/* the search starts. */
+    int stopLine;		/* Line of stop index. */
+{
+    CkText *textPtr = searchPtr->textPtr;
+    CkTextLine *linePtr;
+    CkTextSegment *segPtr;
+    Tcl_DString text;
+    Tcl_Obj *textObj = NULL, *patObj = NULL;
+    Tcl_RegExp regexp = NULL;
+    Tcl_RegExpInfo info;
+    int *lineStarts, numLines, firstLine, lastLine, lineNum, code = TCL_OK;
+    int startOff, stopOff, pass, lo, hi, pos, m, mEnd, step, i, k, flags;
+    int numFound = 0, maxFound = NUM_STATIC_FOUND;
+    int staticFound[2 * NUM_STATIC_FOUND], *found = staticFound;
+    int curByte = 0, curChar = 0;
+    char *string, *p;
+
+    /*
+     * Collect the lines between the start and stop index, or all
+     * lines, into one string, and remember where each line starts.
+     */
+
+    numLines = CkBTreeNumLines(textPtr->tree);
+    if (searchPtr->stopPtr == NULL) {
+	firstLine = 0;
+	lastLine = numLines - 1;
+    } else if (startingLine < stopLine) {
+	firstLine = startingLine;
+	lastLine = stopLine;
+    } else {
+	firstLine = stopLine;
+	lastLine = startingLine;
+    }
+    if (lastLine >= numLines) {
+	lastLine = numLines - 1;
+    }
+    lineStarts = (int *) ckalloc((lastLine - firstLine + 2) * sizeof(int));
+    Tcl_DStringInit(&text);
+    linePtr = CkBTreeFindLine(textPtr->tree, firstLine);
+    for (lineNum = firstLine; lineNum <= lastLine; lineNum++) {
+	lineStarts[lineNum - firstLine] = Tcl_DStringLength(&text);
+	for (segPtr = linePtr->segPtr; segPtr != NULL;
+		segPtr = segPtr->nextPtr) {
+	    if (segPtr->typePtr == &ckTextCharType) {
+		Tcl_DStringAppend(&text, segPtr->body.chars, segPtr->size);
+	    }
+	}
+	linePtr = CkBTreeNextLine(linePtr);
+    }
+    lineStarts[lastLine - firstLine + 1] = Tcl_DStringLength(&text);
+    string = Tcl_DStringValue(&text);
+
+    startOff = lineStarts[startingLine - firstLine] + SearchTextOffset(
+	    CkBTreeFindLine(textPtr->tree, startingLine), startingChar);
+    stopOff = 0;
+    if (searchPtr->stopPtr != NULL) {
+	lineNum = CkBTreeLineIndex(searchPtr->stopPtr->linePtr);
+	if (lineNum > lastLine) {
+	    stopOff = Tcl_DStringLength(&text);
+	} else {
+	    stopOff = lineStarts[lineNum - firstLine] + SearchTextOffset(
+		    searchPtr->stopPtr->linePtr,
+		    searchPtr->stopPtr->charIndex);
+	}
+    }
+
+    /*
+     * Exact patterns which can't be handled by SearchExact and regular
+     * expressions are matched by the regexp package.  "^" and "$"
+     * match at the beginning and end of each line.
+     */
+
+    if (!exact || (noCase && !searchPtr->foldCase)) {
+	flags = exact ? TCL_REG_QUOTE : (TCL_REG_ADVANCED | TCL_REG_NLANCH);
+	if (noCase) {
+	    flags |= TCL_REG_NOCASE;
+	}
+	patObj = Tcl_NewStringObj(pattern, -1);
+	Tcl_IncrRefCount(patObj);
+	regexp = Tcl_GetRegExpFromObj(searchPtr->interp, patObj, flags);
+	if (regexp == NULL) {
+	    code = TCL_ERROR;
+	    goto done;
+	}
+	textObj = Tcl_NewStringObj(string, Tcl_DStringLength(&text));
+	Tcl_IncrRefCount(textObj);
+    }
+
+    /*
+     * Search the range of start positions after (or before) the
+     * start index, then the rest of the text if there's no stop
+     * index.  Only the last match is kept when searching backwards
+     * for a single match.
+     */
+
+    for (pass = 0; pass < 2; pass++) {
+	if (pass == 0) {
+	    lo = searchPtr->backwards ?
+		    (searchPtr->stopPtr != NULL ? stopOff : 0) : startOff;
+	    hi = searchPtr->backwards ? startOff :
+		    (searchPtr->stopPtr != NULL ? stopOff :
+		    Tcl_DStringLength(&text));
+	} else {
+	    if (searchPtr->stopPtr != NULL) {
+		break;
+	    }
+	    lo = searchPtr->backwards ? startOff : 0;
+	    hi = searchPtr->backwards ? Tcl_DStringLength(&text) : startOff;
+	}
+	numFound = 0;
+	for (pos = lo; pos < hi; pos = mEnd) {
+	    if (regexp == NULL) {
+		p = SearchExact(searchPtr, string + pos,
+			Tcl_DStringLength(&text) - pos);
+		if (p == NULL) {
+		    break;
+		}
+		m = p - string;
+		mEnd = m + searchPtr->patLength;
+	    } else {
+		if (pos < curByte) {
+		    curByte = curChar = 0;
+		}
+		curChar += Tcl_NumUtfChars(string + curByte, pos - curByte);
+		curByte = pos;
+		flags = ((pos > 0) && (string[pos-1] != '\n')) ?
+			TCL_REG_NOTBOL : 0;
+		i = Tcl_RegExpExecObj(searchPtr->interp, regexp, textObj,
+			curChar, 1, flags);
+		if (i < 0) {
+		    code = TCL_ERROR;
+		    goto done;
+		}
+		if (i == 0) {
+		    break;
+		}
+		Tcl_RegExpGetInfo(regexp, &info);
+		m = Tcl_UtfAtIndex(string + pos, info.matches[0].start)
+			- string;
+		mEnd = Tcl_UtfAtIndex(string + m,
+			info.matches[0].end - info.matches[0].start) - string;
+	    }
+	    if (m >= hi) {
+		break;
+	    }
+	    if (!searchPtr->all) {
+		numFound = 0;
+	    } else if (numFound >= maxFound) {
+		int *newFound;
+
+		newFound = (int *) ckalloc(4 * maxFound * sizeof(int));
+		memcpy(newFound, found, 2 * numFound * sizeof(int));
+		if (found != staticFound) {
+		    ckfree((char *) found);
+		}
+		found = newFound;
+		maxFound *= 2;
+	    }
+	    found[2 * numFound] = m;
+	    found[2 * numFound + 1] = mEnd - m;
+	    numFound++;
+	    if (!searchPtr->all && !searchPtr->backwards) {
+		break;
+	    }
+
+	    /*
+	     * Continue after the match when collecting all matches, else
+	     * (searching backwards) one character after its start.
+	     */
+
+	    step = (m < Tcl_DStringLength(&text)) ?
+		    Tcl_UtfNext(string + m) - (string + m) : 1;
+	    if (!searchPtr->all || (mEnd < m + step)) {
+		mEnd = m + step;
+	    }
+	}
+
+	/*
+	 * Report the matches of this pass.
+	 */
+
+	for (i = 0; i < numFound; i++) {
+	    k = searchPtr->backwards ? numFound - 1 - i : i;
+	    m = found[2 * k];
+	    for (lo = 0, hi = lastLine - firstLine; lo < hi; ) {
+		lineNum = (lo + hi + 1) / 2;
+		if (lineStarts[lineNum] <= m) {
+		    lo = lineNum;
+		} else {
+		    hi = lineNum - 1;
+		}
+	    }
+	    code = SearchReport(searchPtr,
+		    CkBTreeFindLine(textPtr->tree, firstLine + lo),
+		    string + lineStarts[lo], m - lineStarts[lo],
+		    found[2 * k + 1]);
+	    if (code != TCL_OK) {
+		goto done;
+	    }
+	}
+    }
+
+    done:
+    if (code == TCL_BREAK) {
+	code = TCL_OK;
+    }
+    if (found != staticFound) {
+	ckfree((char *) found);
+    }
+    if (textObj != NULL) {
+	Tcl_DecrRefCount(textObj);
+    }
+    if (patObj != NULL) {
+	Tcl_DecrRefCount(patObj);
+    }
+    ckfree((char *) lineStarts);
+    Tcl_DStringFree(&text);
+    return code;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SearchTextOffset --
+ *
+ *	Convert a character index within a line into an offset in the
+ *	text extracted from the line's character segments.
+ *
+ * Results:
+ *	The offset.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+SearchTextOffset(linePtr, charIndex)
+    CkTextLine *linePtr;	/* Line. */
+    int charIndex;		/* Index within line. */
+{
+    CkTextSegment *segPtr;
+    int offset = charIndex, leftToScan;
+
+    for (segPtr = linePtr->segPtr, leftToScan = charIndex;
+	    (leftToScan > 0) && (segPtr != NULL); segPtr = segPtr->nextPtr) {
+	if (segPtr->typePtr != &ckTextCharType) {
+	    offset -= segPtr->size;
+	}
+	leftToScan -= segPtr->size;
+    }
+    return offset;
+}
+#endif
+
 /*
  *----------------------------------------------------------------------
  *
@@ -39,6 +39,11 @@ typedef struct CkTextLine {
 					 * means end of list. */
     struct CkTextSegment *segPtr;	/* First in ordered list of segments
 					 * that make up the line. */
+    int *charOffsets;			/* For long lines, table to convert
+					 * between character and byte offsets
+					 * (malloc-ed), see ckTextIndex.c.
+					 * NULL if not computed since the line
+					 * was last modified. */
 } CkTextLine;
 
 /*
@@ -284,6 +289,9 @@ typedef struct CkTextTag {
     int affectsDisplay;		/* Non-zero means that this tag affects the
 				 * way information is displayed on the screen
 				 * (so need to redisplay if tag changes). */
+    int highlightRules;		/* Number of syntax highlighting rules which
+				 * use this tag.  Such a tag may only be
+				 * changed by the highlighter. */
 } CkTextTag;
 
 #define TK_TAG_AFFECTS_DISPLAY	0x1
@@ -325,6 +333,17 @@ typedef struct CkTextSearch {
 					 * tags. */
 } CkTextSearch;
 
+/*
+ * The following structure describes a range of characters within a
+ * line that is to carry a tag;  see CkBTreeRetagLine.
+ */
+
+typedef struct CkTextTagSpan {
+    int start, end;			/* Offsets of first character and
+					 * character just after the range. */
+    CkTextTag *tagPtr;			/* Tag for the range. */
+} CkTextTagSpan;
+
 /*
  * The following data structure describes a single tab stop.
  */
@@ -399,9 +418,15 @@ typedef struct CkText {
 				 * in characters. */
     int prevWidth, prevHeight;	/* Last known dimensions of window;  used to
 				 * detect changes in size. */
+    int maxLines;		/* Maximum number of lines to keep;  the
+				 * oldest lines get deleted when more are
+				 * added.  <= 0 means no limit. */
     CkTextIndex topIndex;	/* Identifies first character in top display
 				 * line of window. */
     struct DInfo *dInfoPtr;	/* Information maintained by ckTextDisp.c. */
+    struct Highlighter *hlPtr;	/* Information maintained by
+				 * ckTextHighlight.c, or NULL if there are
+				 * no highlighting rules. */
 
     /*
      * Information related to selection.
@@ -586,6 +611,10 @@ extern CkTextBTree	CkBTreeCreate _ANSI_ARGS_((void));
 extern void		CkBTreeDestroy _ANSI_ARGS_((CkTextBTree tree));
 extern void		CkBTreeDeleteChars _ANSI_ARGS_((CkTextIndex *index1Ptr,
 			    CkTextIndex *index2Ptr));
+extern void		CkBTreeDeleteLines _ANSI_ARGS_((CkTextBTree tree,
+			    int count));
+extern int		CkBTreeFillTags _ANSI_ARGS_((CkTextIndex *indexPtr,
+			    CkTextTag **tagPtrs, int maxTags));
 extern CkTextLine *	CkBTreeFindLine _ANSI_ARGS_((CkTextBTree tree,
 			    int line));
 extern CkTextTag **	CkBTreeGetTags _ANSI_ARGS_((CkTextIndex *indexPtr,
@@ -593,11 +622,17 @@ extern CkTextTag **	CkBTreeGetTags _ANSI_ARGS_((CkTextIndex *indexPtr,
 extern void		CkBTreeInsertChars _ANSI_ARGS_((CkTextIndex *indexPtr,
 			    char *string));
 extern int		CkBTreeLineIndex _ANSI_ARGS_((CkTextLine *linePtr));
+extern void		CkBTreeLoadChars _ANSI_ARGS_((CkTextIndex *indexPtr,
+			    char *string, int length));
 extern void		CkBTreeLinkSegment _ANSI_ARGS_((CkTextSegment *segPtr,
 			    CkTextIndex *indexPtr));
 extern CkTextLine *	CkBTreeNextLine _ANSI_ARGS_((CkTextLine *linePtr));
 extern int		CkBTreeNextTag _ANSI_ARGS_((CkTextSearch *searchPtr));
 extern int		CkBTreeNumLines _ANSI_ARGS_((CkTextBTree tree));
+extern int		CkBTreeRetagLine _ANSI_ARGS_((CkTextBTree tree,
+			    CkTextLine *linePtr, int numTags,
+			    CkTextTag **tagPtrs, int numSpans,
+			    CkTextTagSpan *spanPtr));
 extern void		CkBTreeStartSearch _ANSI_ARGS_((CkTextIndex *index1Ptr,
 			    CkTextIndex *index2Ptr, CkTextTag *tagPtr,
 			    CkTextSearch *searchPtr));
@@ -606,6 +641,7 @@ extern void		CkBTreeTag _ANSI_ARGS_((CkTextIndex *index1Ptr,
 			    int add));
 extern void		CkBTreeUnlinkSegment _ANSI_ARGS_((CkTextBTree tree,
 			    CkTextSegment *segPtr, CkTextLine *linePtr));
+extern int		CkTextAtEnd _ANSI_ARGS_((CkText *textPtr));
 extern void		CkTextBindProc _ANSI_ARGS_((ClientData clientData,
 			    CkEvent *eventPtr));
 extern void		CkTextChanged _ANSI_ARGS_((CkText *textPtr,
@@ -623,12 +659,21 @@ extern int		CkTextDLineInfo _ANSI_ARGS_((CkText *textPtr,
 			    int *widthPtr, int *heightPtr, int *basePtr));
 extern CkTextTag *	CkTextCreateTag _ANSI_ARGS_((CkText *textPtr,
 			    char *tagName));
+extern void		CkTextFreeCharOffsets _ANSI_ARGS_((
+			    CkTextLine *linePtr));
 extern void		CkTextFreeDInfo _ANSI_ARGS_((CkText *textPtr));
+extern void		CkTextFreeHighlighter _ANSI_ARGS_((CkText *textPtr));
 extern void		CkTextFreeTag _ANSI_ARGS_((CkText *textPtr,
 			    CkTextTag *tagPtr));
 extern int		CkTextGetIndex _ANSI_ARGS_((Tcl_Interp *interp,
 			    CkText *textPtr, char *string,
 			    CkTextIndex *indexPtr));
+extern void		CkTextHighlightChanged _ANSI_ARGS_((CkText *textPtr,
+			    CkTextIndex *index1Ptr, CkTextIndex *index2Ptr));
+extern int		CkTextHighlightCmd _ANSI_ARGS_((CkText *textPtr,
+			    Tcl_Interp *interp, int argc, char **argv));
+extern void		CkTextHighlightView _ANSI_ARGS_((CkText *textPtr,
+			    int numLines));
 extern CkTextTabArray *	CkTextGetTabs _ANSI_ARGS_((Tcl_Interp *interp,
 			    CkWindow *winPtr, char *string));
 #if CK_USE_UTF
@@ -683,6 +728,7 @@ extern int		CkTextScanCmd _ANSI_ARGS_((CkText *textPtr,
 			    Tcl_Interp *interp, int argc, char **argv));
 extern int		CkTextSeeCmd _ANSI_ARGS_((CkText *textPtr,
 			    Tcl_Interp *interp, int argc, char **argv));
+extern void		CkTextSeeEnd _ANSI_ARGS_((CkText *textPtr));
 extern int		CkTextSegToOffset _ANSI_ARGS_((CkTextSegment *segPtr,
 			    CkTextLine *linePtr));
 extern CkTextSegment *	CkTextSetMark _ANSI_ARGS_((CkText *textPtr, char *name,
@@ -691,6 +737,7 @@ extern void		CkTextSetYView _ANSI_ARGS_((CkText *textPtr,
 			    CkTextIndex *indexPtr, int pickPlace));
 extern int		CkTextTagCmd _ANSI_ARGS_((CkText *textPtr,
 			    Tcl_Interp *interp, int argc, char **argv));
+extern void		CkTextTagsChanged _ANSI_ARGS_((CkText *textPtr));
 extern int		CkTextWindowCmd _ANSI_ARGS_((CkText *textPtr,
 			    Tcl_Interp *interp, int argc, char **argv));
 extern int		CkTextWindowIndex _ANSI_ARGS_((CkText *textPtr,
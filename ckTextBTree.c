@@ -75,9 +75,27 @@ typedef struct BTree {
 
 /*
  * The structure below is used to pass information between
- * CkBTreeGetTags and IncCount:
+ * CkBTreeDeleteLines and DeleteFirstLines:
  */
 
+typedef struct DeleteLinesInfo {
+    Tcl_HashTable toggles;		/* Maps a tag to its toggle-on segment
+					 * from the deleted lines whose
+					 * toggle-off hasn't been seen yet,
+					 * or NULL. */
+    CkTextSegment *keptPtr;		/* Segments that refused to die. */
+    CkTextSegment **lastPtrPtr;		/* Where to link the next one. */
+} DeleteLinesInfo;
+
+/*
+ * The structure below is used to pass information between
+ * CollectTags and IncCount.  The arrays start out in the caller's
+ * stack frame and are only malloc-ed when more than NUM_TAG_INFOS
+ * different tags are seen.
+ */
+
+#define NUM_TAG_INFOS 10
+
 typedef struct TagInfo {
     int numTags;			/* Number of tags for which there
 					 * is currently information in
@@ -85,9 +103,11 @@ typedef struct TagInfo {
     int arraySize;			/* Number of entries allocated for
 					 * tags and counts. */
     CkTextTag **tagPtrs;		/* Array of tags seen so far.
-					 * Malloc-ed. */
+					 * Malloc-ed if arraySize is larger
+					 * than NUM_TAG_INFOS. */
     int *counts;			/* Toggle count (so far) for each
-					 * entry in tags.  Malloc-ed. */
+					 * entry in tags.  Malloc-ed like
+					 * tagPtrs. */
 } TagInfo;
 
 /*
@@ -122,6 +142,10 @@ static CkTextSegment *	CharSplitProc _ANSI_ARGS_((CkTextSegment *segPtr,
 			    int index));
 static void		CheckNodeConsistency _ANSI_ARGS_((Node *nodePtr));
 static void		CleanupLine _ANSI_ARGS_((CkTextLine *linePtr));
+static void		CollectTags _ANSI_ARGS_((CkTextIndex *indexPtr,
+			    TagInfo *tagInfoPtr));
+static void		DeleteFirstLines _ANSI_ARGS_((Node *nodePtr,
+			    int count, DeleteLinesInfo *infoPtr));
 static void		DeleteSummaries _ANSI_ARGS_((Summary *tagPtr));
 static void		DestroyNode _ANSI_ARGS_((Node *nodePtr));
 static void		IncCount _ANSI_ARGS_((CkTextTag *tagPtr, int inc,
@@ -230,6 +254,7 @@ CkBTreeCreate()
 
     linePtr->parentPtr = rootPtr;
     linePtr->nextPtr = linePtr2;
+    linePtr->charOffsets = NULL;
     segPtr = (CkTextSegment *) ckalloc(CSEG_SIZE(1));
     linePtr->segPtr = segPtr;
     segPtr->typePtr = &ckTextCharType;
@@ -240,6 +265,7 @@ CkBTreeCreate()
 
     linePtr2->parentPtr = rootPtr;
     linePtr2->nextPtr = NULL;
+    linePtr2->charOffsets = NULL;
     segPtr = (CkTextSegment *) ckalloc(CSEG_SIZE(1));
     linePtr2->segPtr = segPtr;
     segPtr->typePtr = &ckTextCharType;
@@ -314,6 +340,7 @@ DestroyNode(nodePtr)
 		linePtr->segPtr = segPtr->nextPtr;
 		(*segPtr->typePtr->deleteProc)(segPtr, linePtr, 1);
 	    }
+	    CkTextFreeCharOffsets(linePtr);
 	    ckfree((char *) linePtr);
 	}
     } else {
@@ -408,6 +435,7 @@ CkBTreeInsertChars(indexPtr, string)
 
     prevPtr = SplitSeg(indexPtr);
     linePtr = indexPtr->linePtr;
+    CkTextFreeCharOffsets(linePtr);
     curPtr = prevPtr;
 
     /*
@@ -451,6 +479,7 @@ CkBTreeInsertChars(indexPtr, string)
 	newLinePtr = (CkTextLine *) ckalloc(sizeof(CkTextLine));
 	newLinePtr->parentPtr = linePtr->parentPtr;
 	newLinePtr->nextPtr = linePtr->nextPtr;
+	newLinePtr->charOffsets = NULL;
 	linePtr->nextPtr = newLinePtr;
 	newLinePtr->segPtr = segPtr->nextPtr;
 	segPtr->nextPtr = NULL;
@@ -491,6 +520,198 @@ CkBTreeInsertChars(indexPtr, string)
     }
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * CkBTreeLoadChars --
+ *
+ *	Insert a large amount of text into a B-tree.  Has the same
+ *	effect as CkBTreeInsertChars, but the new lines are distributed
+ *	over new bottom level nodes in a single pass, rather than being
+ *	added to the node of the insertion point and split off from
+ *	there by Rebalance.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Characters are added to the B-tree at the given position.
+ *	The internal structure of the B-tree changes.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+CkBTreeLoadChars(indexPtr, string, length)
+    CkTextIndex *indexPtr;		/* Indicates where to insert text.
+					 * When the procedure returns, this
+					 * index is no longer valid because
+					 * of changes to the segment
+					 * structure. */
+    char *string;			/* Bytes to insert (may contain
+					 * newlines, need not be null-
+					 * terminated). */
+    int length;				/* Number of bytes in string. */
+{
+    BTree *treePtr = (BTree *) indexPtr->tree;
+    Node *nodePtr, *parentPtr, *newPtr;
+    CkTextSegment *segPtr, *prevPtr, *tailPtr;
+    CkTextLine *linePtr, *lastPtr, *restPtr, *firstPtr;
+    char *end = string + length, *eol;
+    int chunkSize, changeToLineCount, numLines, numNodes, i, n;
+
+    eol = memchr(string, '\n', (size_t) length);
+    if (eol == NULL || eol == end - 1 ||
+	    memchr(eol + 1, '\n', (size_t) (end - eol - 1)) == NULL) {
+	/*
+	 * Not more than one newline: nothing to gain.
+	 */
+
+	Tcl_DString ds;
+
+	Tcl_DStringInit(&ds);
+	Tcl_DStringAppend(&ds, string, length);
+	CkBTreeInsertChars(indexPtr, Tcl_DStringValue(&ds));
+	Tcl_DStringFree(&ds);
+	return;
+    }
+
+    /*
+     * The first chunk of the string ends the line of the insertion
+     * point.  The segments after the insertion point are moved to
+     * the last new line.
+     */
+
+    prevPtr = SplitSeg(indexPtr);
+    linePtr = indexPtr->linePtr;
+    CkTextFreeCharOffsets(linePtr);
+    nodePtr = linePtr->parentPtr;
+    eol++;
+    chunkSize = eol - string;
+    segPtr = (CkTextSegment *) ckalloc(CSEG_SIZE(chunkSize));
+    segPtr->typePtr = &ckTextCharType;
+    segPtr->size = chunkSize;
+    memcpy(segPtr->body.chars, string, (size_t) chunkSize);
+    segPtr->body.chars[chunkSize] = 0;
+    if (prevPtr == NULL) {
+	tailPtr = linePtr->segPtr;
+	linePtr->segPtr = segPtr;
+    } else {
+	tailPtr = prevPtr->nextPtr;
+	prevPtr->nextPtr = segPtr;
+    }
+    segPtr->nextPtr = NULL;
+    string = eol;
+
+    /*
+     * Create the new lines and chain them after the insertion line.
+     */
+
+    restPtr = linePtr->nextPtr;
+    lastPtr = linePtr;
+    changeToLineCount = 0;
+    while (1) {
+	lastPtr->nextPtr = (CkTextLine *) ckalloc(sizeof(CkTextLine));
+	lastPtr = lastPtr->nextPtr;
+	lastPtr->parentPtr = nodePtr;
+	lastPtr->charOffsets = NULL;
+	changeToLineCount++;
+	eol = memchr(string, '\n', (size_t) (end - string));
+	if (eol == NULL) {
+	    break;
+	}
+	eol++;
+	chunkSize = eol - string;
+	segPtr = (CkTextSegment *) ckalloc(CSEG_SIZE(chunkSize));
+	segPtr->typePtr = &ckTextCharType;
+	segPtr->nextPtr = NULL;
+	segPtr->size = chunkSize;
+	memcpy(segPtr->body.chars, string, (size_t) chunkSize);
+	segPtr->body.chars[chunkSize] = 0;
+	lastPtr->segPtr = segPtr;
+	string = eol;
+    }
+    if (string < end) {
+	chunkSize = end - string;
+	segPtr = (CkTextSegment *) ckalloc(CSEG_SIZE(chunkSize));
+	segPtr->typePtr = &ckTextCharType;
+	segPtr->size = chunkSize;
+	memcpy(segPtr->body.chars, string, (size_t) chunkSize);
+	segPtr->body.chars[chunkSize] = 0;
+	segPtr->nextPtr = tailPtr;
+	lastPtr->segPtr = segPtr;
+    } else {
+	lastPtr->segPtr = tailPtr;
+    }
+    lastPtr->nextPtr = restPtr;
+    CleanupLine(linePtr);
+    CleanupLine(lastPtr);
+
+    /*
+     * Cut the node's (now long) list of lines into pieces of equal
+     * size, each between MIN_CHILDREN and MAX_CHILDREN lines long.
+     * If this takes more than one node, the node needs a parent.
+     */
+
+    numLines = nodePtr->numChildren + changeToLineCount;
+    numNodes = (numLines + MAX_CHILDREN - 1) / MAX_CHILDREN;
+    parentPtr = nodePtr->parentPtr;
+    if (parentPtr == NULL && numNodes > 1) {
+	parentPtr = (Node *) ckalloc(sizeof(Node));
+	parentPtr->parentPtr = NULL;
+	parentPtr->nextPtr = NULL;
+	parentPtr->summaryPtr = NULL;
+	parentPtr->level = 1;
+	parentPtr->children.nodePtr = nodePtr;
+	nodePtr->parentPtr = parentPtr;
+	treePtr->rootPtr = parentPtr;
+    }
+    firstPtr = nodePtr->children.linePtr;
+    for (i = 0; i < numNodes; i++) {
+	if (i == 0) {
+	    newPtr = nodePtr;
+	} else {
+	    newPtr = (Node *) ckalloc(sizeof(Node));
+	    newPtr->parentPtr = parentPtr;
+	    newPtr->nextPtr = nodePtr->nextPtr;
+	    nodePtr->nextPtr = newPtr;
+	    newPtr->summaryPtr = NULL;
+	    newPtr->level = 0;
+	    nodePtr = newPtr;
+	}
+	newPtr->children.linePtr = firstPtr;
+	for (n = (numLines + numNodes - i - 1) / (numNodes - i),
+		numLines -= n; n > 1; n--) {
+	    firstPtr = firstPtr->nextPtr;
+	}
+	lastPtr = firstPtr;
+	firstPtr = firstPtr->nextPtr;
+	lastPtr->nextPtr = NULL;
+	RecomputeNodeCounts(newPtr);
+    }
+
+    /*
+     * Update the counts in the ancestors, then let Rebalance take
+     * care of the upper levels of the tree, which have only about
+     * 1/MAX_CHILDREN as many entries.
+     */
+
+    if (parentPtr != NULL) {
+	RecomputeNodeCounts(parentPtr);
+	for (nodePtr = parentPtr->parentPtr; nodePtr != NULL;
+		nodePtr = nodePtr->parentPtr) {
+	    nodePtr->numLines += changeToLineCount;
+	}
+	if (parentPtr->numChildren > MAX_CHILDREN) {
+	    Rebalance(treePtr, parentPtr);
+	}
+    }
+
+    if (ckBTreeDebug) {
+	CkBTreeCheck(indexPtr->tree);
+    }
+}
+
 /*
  *--------------------------------------------------------------
  *
@@ -666,6 +887,7 @@ CkBTreeDeleteChars(index1Ptr, index2Ptr)
      * Delete all of the segments between prevPtr and lastPtr.
      */
 
+    CkTextFreeCharOffsets(index1Ptr->linePtr);
     curLinePtr = index1Ptr->linePtr;
     curNodePtr = curLinePtr->parentPtr;
     while (segPtr != lastPtr) {
@@ -690,6 +912,7 @@ CkBTreeDeleteChars(index1Ptr, index2Ptr)
 		    nodePtr->numLines--;
 		}
 		curNodePtr->numChildren--;
+		CkTextFreeCharOffsets(curLinePtr);
 		ckfree((char *) curLinePtr);
 	    }
 	    curLinePtr = nextLinePtr;
@@ -771,6 +994,7 @@ CkBTreeDeleteChars(index1Ptr, index2Ptr)
 	    }
 	    prevLinePtr->nextPtr = index2Ptr->linePtr->nextPtr;
 	}
+	CkTextFreeCharOffsets(index2Ptr->linePtr);
 	ckfree((char *) index2Ptr->linePtr);
 	Rebalance((BTree *) index2Ptr->tree, curNodePtr);
     }
@@ -791,6 +1015,198 @@ CkBTreeDeleteChars(index1Ptr, index2Ptr)
     }
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * CkBTreeDeleteLines --
+ *
+ *	Delete the first lines of a B-tree.  This is cheaper than
+ *	CkBTreeDeleteChars for the same range:  subtrees consisting
+ *	only of deleted lines are freed as a whole, toggles for the
+ *	same tag cancel each other out, and node counts are only
+ *	recomputed along the left edge of the tree.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Lines are deleted from the B-tree.  Marks in those lines move
+ *	to the beginning of the new first line, and tags that were on
+ *	at the end of the deleted range now start there.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+CkBTreeDeleteLines(tree, count)
+    CkTextBTree tree;			/* Tree to delete lines from. */
+    int count;				/* Number of lines to delete;  must
+					 * be less than the total number of
+					 * lines in the tree. */
+{
+    BTree *treePtr = (BTree *) tree;
+    DeleteLinesInfo info;
+    Node *nodePtr;
+    CkTextLine *linePtr;
+    CkTextSegment *segPtr, *prevPtr, *prev2Ptr;
+    Tcl_HashEntry *hPtr;
+    Tcl_HashSearch search;
+
+    if (count <= 0) {
+	return;
+    }
+    Tcl_InitHashTable(&info.toggles, TCL_ONE_WORD_KEYS);
+    info.keptPtr = NULL;
+    info.lastPtrPtr = &info.keptPtr;
+    DeleteFirstLines(treePtr->rootPtr, count, &info);
+    for (nodePtr = treePtr->rootPtr; nodePtr->level > 0; ) {
+	nodePtr = nodePtr->children.nodePtr;
+    }
+    linePtr = nodePtr->children.linePtr;
+
+    /*
+     * Tags that were on at the end of the deleted range must now
+     * start at the beginning of the new first line, unless they
+     * are turned off right there.
+     */
+
+    for (hPtr = Tcl_FirstHashEntry(&info.toggles, &search); hPtr != NULL;
+	    hPtr = Tcl_NextHashEntry(&search)) {
+	segPtr = (CkTextSegment *) Tcl_GetHashValue(hPtr);
+	if (segPtr == NULL) {
+	    continue;
+	}
+	for (prev2Ptr = NULL, prevPtr = linePtr->segPtr;
+		(prevPtr != NULL) && (prevPtr->size == 0);
+		prev2Ptr = prevPtr, prevPtr = prevPtr->nextPtr) {
+	    if ((prevPtr->typePtr == &ckTextToggleOffType)
+		    && (prevPtr->body.toggle.tagPtr
+		    == segPtr->body.toggle.tagPtr)) {
+		break;
+	    }
+	}
+	if ((prevPtr != NULL) && (prevPtr->size == 0)) {
+	    if (prev2Ptr == NULL) {
+		linePtr->segPtr = prevPtr->nextPtr;
+	    } else {
+		prev2Ptr->nextPtr = prevPtr->nextPtr;
+	    }
+	    ckfree((char *) prevPtr);
+	    ckfree((char *) segPtr);
+	    continue;
+	}
+	segPtr->body.toggle.inNodeCounts = 1;
+	segPtr->nextPtr = linePtr->segPtr;
+	linePtr->segPtr = segPtr;
+    }
+    Tcl_DeleteHashTable(&info.toggles);
+
+    /*
+     * Segments that refused to die (marks) go in front of the
+     * new first line.
+     */
+
+    if (info.keptPtr != NULL) {
+	*info.lastPtrPtr = linePtr->segPtr;
+	linePtr->segPtr = info.keptPtr;
+    }
+
+    for ( ; nodePtr != NULL; nodePtr = nodePtr->parentPtr) {
+	RecomputeNodeCounts(nodePtr);
+    }
+    CleanupLine(linePtr);
+    Rebalance(treePtr, linePtr->parentPtr);
+    if (ckBTreeDebug) {
+	CkBTreeCheck(tree);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * DeleteFirstLines --
+ *
+ *	Recursive utility procedure for CkBTreeDeleteLines:  deletes
+ *	the first lines of the subtree rooted at a node.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Lines and child nodes that become empty are freed.  The counts
+ *	of nodePtr and the node of the first remaining line are left
+ *	for the caller to recompute.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+DeleteFirstLines(nodePtr, count, infoPtr)
+    Node *nodePtr;			/* Node to delete lines from. */
+    int count;				/* Number of lines to delete. */
+    DeleteLinesInfo *infoPtr;		/* Toggles and segments found in
+					 * the deleted lines. */
+{
+    Node *childPtr;
+    CkTextLine *linePtr;
+    CkTextSegment *segPtr, *nextPtr, *onPtr;
+    Tcl_HashEntry *hPtr;
+    int new, numLines;
+
+    if (nodePtr->level == 0) {
+	for ( ; count > 0; count--) {
+	    linePtr = nodePtr->children.linePtr;
+	    nodePtr->children.linePtr = linePtr->nextPtr;
+	    for (segPtr = linePtr->segPtr; segPtr != NULL; segPtr = nextPtr) {
+		nextPtr = segPtr->nextPtr;
+		if ((segPtr->typePtr == &ckTextToggleOnType)
+			|| (segPtr->typePtr == &ckTextToggleOffType)) {
+		    /*
+		     * Keep the toggle-on segment of a tag until the
+		     * matching toggle-off segment shows up.
+		     */
+
+		    hPtr = Tcl_CreateHashEntry(&infoPtr->toggles,
+			    (char *) segPtr->body.toggle.tagPtr, &new);
+		    onPtr = (CkTextSegment *) Tcl_GetHashValue(hPtr);
+		    if ((onPtr == NULL)
+			    && (segPtr->typePtr == &ckTextToggleOnType)) {
+			Tcl_SetHashValue(hPtr, (ClientData) segPtr);
+			continue;
+		    }
+		    if (onPtr != NULL) {
+			ckfree((char *) onPtr);
+			Tcl_SetHashValue(hPtr, (ClientData) NULL);
+		    }
+		    ckfree((char *) segPtr);
+		    continue;
+		}
+		if ((*segPtr->typePtr->deleteProc)(segPtr, linePtr, 0) != 0) {
+		    segPtr->nextPtr = NULL;
+		    *infoPtr->lastPtrPtr = segPtr;
+		    infoPtr->lastPtrPtr = &segPtr->nextPtr;
+		}
+	    }
+	    CkTextFreeCharOffsets(linePtr);
+	    ckfree((char *) linePtr);
+	}
+	return;
+    }
+    while (count > 0) {
+	childPtr = nodePtr->children.nodePtr;
+	numLines = childPtr->numLines;
+	if (numLines > count) {
+	    DeleteFirstLines(childPtr, count, infoPtr);
+	    return;
+	}
+	DeleteFirstLines(childPtr, numLines, infoPtr);
+	nodePtr->children.nodePtr = childPtr->nextPtr;
+	DeleteSummaries(childPtr->summaryPtr);
+	ckfree((char *) childPtr);
+	count -= numLines;
+    }
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -1182,6 +1598,193 @@ CkBTreeTag(index1Ptr, index2Ptr, tagPtr, add)
     }
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * CkBTreeRetagLine --
+ *
+ *	Replace the ranges of a group of tags in one line by a new set
+ *	of ranges, as done by the syntax highlighter.  The tags must
+ *	never span line boundaries, i.e. each toggle-on of these tags
+ *	in the line has its toggle-off in the same line.
+ *
+ * Results:
+ *	Returns 1 if the line was modified, 0 if the tags already
+ *	covered exactly the given ranges.
+ *
+ * Side effects:
+ *	All toggles of the tags in tagPtrs are removed from the line,
+ *	then a toggle pair is added for each span.  Unlike CkBTreeTag
+ *	the toggle counts of the nodes above the line are updated once
+ *	per tag rather than once per toggle.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+CkBTreeRetagLine(tree, linePtr, numTags, tagPtrs, numSpans, spanPtr)
+    CkTextBTree tree;			/* Tree containing the line. */
+    CkTextLine *linePtr;		/* Line to retag. */
+    int numTags;			/* Number of tags in tagPtrs. */
+    CkTextTag **tagPtrs;		/* Tags whose ranges are replaced. */
+    int numSpans;			/* Number of spans in spanPtr. */
+    CkTextTagSpan *spanPtr;		/* New ranges, sorted by position and
+					 * not overlapping;  start and end are
+					 * offsets within the line and must
+					 * not include the final newline.
+					 * Each tag must be one of tagPtrs. */
+{
+    CkTextSegment *segPtr, *prevPtr, *nextPtr;
+    int staticDeltas[NUM_TAG_INFOS], *deltas;
+    int i, toggle, offset, pos;
+
+    /*
+     * See whether the line already has the right toggles.
+     */
+
+    toggle = 0;
+    for (offset = 0, segPtr = linePtr->segPtr; segPtr != NULL;
+	    offset += segPtr->size, segPtr = segPtr->nextPtr) {
+	if ((segPtr->typePtr != &ckTextToggleOnType)
+		&& (segPtr->typePtr != &ckTextToggleOffType)) {
+	    continue;
+	}
+	for (i = 0; i < numTags; i++) {
+	    if (tagPtrs[i] == segPtr->body.toggle.tagPtr) {
+		break;
+	    }
+	}
+	if (i >= numTags) {
+	    continue;
+	}
+	if ((toggle >= 2 * numSpans)
+		|| (segPtr->body.toggle.tagPtr != spanPtr[toggle/2].tagPtr)
+		|| (segPtr->typePtr != ((toggle & 1) ? &ckTextToggleOffType
+			: &ckTextToggleOnType))
+		|| (offset != ((toggle & 1) ? spanPtr[toggle/2].end
+			: spanPtr[toggle/2].start))) {
+	    break;
+	}
+	toggle++;
+    }
+    if ((segPtr == NULL) && (toggle == 2 * numSpans)) {
+	return 0;
+    }
+
+    deltas = staticDeltas;
+    if (numTags > NUM_TAG_INFOS) {
+	deltas = (int *) ckalloc((unsigned) (numTags * sizeof(int)));
+    }
+    memset((VOID *) deltas, 0, numTags * sizeof(int));
+
+    /*
+     * Remove the old toggles.
+     */
+
+    for (prevPtr = NULL, segPtr = linePtr->segPtr; segPtr != NULL;
+	    segPtr = nextPtr) {
+	nextPtr = segPtr->nextPtr;
+	if ((segPtr->typePtr == &ckTextToggleOnType)
+		|| (segPtr->typePtr == &ckTextToggleOffType)) {
+	    for (i = 0; i < numTags; i++) {
+		if (tagPtrs[i] == segPtr->body.toggle.tagPtr) {
+		    break;
+		}
+	    }
+	    if (i < numTags) {
+		if (segPtr->body.toggle.inNodeCounts) {
+		    deltas[i]--;
+		}
+		if (prevPtr == NULL) {
+		    linePtr->segPtr = nextPtr;
+		} else {
+		    prevPtr->nextPtr = nextPtr;
+		}
+		ckfree((char *) segPtr);
+		continue;
+	    }
+	}
+	prevPtr = segPtr;
+    }
+
+    /*
+     * Add the new toggles in a single pass over the line, splitting
+     * segments the same way SplitSeg does.
+     */
+
+    prevPtr = NULL;
+    segPtr = linePtr->segPtr;
+    offset = 0;
+    for (toggle = 0; toggle < 2 * numSpans; toggle++) {
+	pos = (toggle & 1) ? spanPtr[toggle/2].end : spanPtr[toggle/2].start;
+	while (segPtr != NULL) {
+	    if (segPtr->size > pos - offset) {
+		if (pos > offset) {
+		    segPtr = (*segPtr->typePtr->splitProc)(segPtr,
+			    pos - offset);
+		    if (prevPtr == NULL) {
+			linePtr->segPtr = segPtr;
+		    } else {
+			prevPtr->nextPtr = segPtr;
+		    }
+		    offset += segPtr->size;
+		    prevPtr = segPtr;
+		    segPtr = segPtr->nextPtr;
+		}
+		break;
+	    } else if ((segPtr->size == 0) && (pos == offset)
+		    && !segPtr->typePtr->leftGravity) {
+		break;
+	    }
+	    offset += segPtr->size;
+	    prevPtr = segPtr;
+	    segPtr = segPtr->nextPtr;
+	}
+	if (segPtr == NULL) {
+	    panic("CkBTreeRetagLine reached end of line!");
+	}
+	nextPtr = (CkTextSegment *) ckalloc(TSEG_SIZE);
+	nextPtr->typePtr = (toggle & 1) ? &ckTextToggleOffType
+		: &ckTextToggleOnType;
+	nextPtr->size = 0;
+	nextPtr->body.toggle.tagPtr = spanPtr[toggle/2].tagPtr;
+	nextPtr->body.toggle.inNodeCounts = 1;
+	nextPtr->nextPtr = segPtr;
+	if (prevPtr == NULL) {
+	    linePtr->segPtr = nextPtr;
+	} else {
+	    prevPtr->nextPtr = nextPtr;
+	}
+	prevPtr = nextPtr;
+	for (i = 0; i < numTags; i++) {
+	    if (tagPtrs[i] == spanPtr[toggle/2].tagPtr) {
+		deltas[i]++;
+		break;
+	    }
+	}
+    }
+
+    /*
+     * Bring the node toggle counts up to date before CleanupLine, which
+     * may cancel toggles and subtract them from the counts.
+     */
+
+    for (i = 0; i < numTags; i++) {
+	if (deltas[i] != 0) {
+	    ChangeNodeToggleCount(linePtr->parentPtr, tagPtrs[i], deltas[i]);
+	}
+    }
+    if (deltas != staticDeltas) {
+	ckfree((char *) deltas);
+    }
+    CleanupLine(linePtr);
+
+    if (ckBTreeDebug) {
+	CkBTreeCheck(tree);
+    }
+    return 1;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -1612,20 +2215,114 @@ CkBTreeGetTags(indexPtr, numTagsPtr)
 				 * the B-tree. */
     int *numTagsPtr;		/* Store number of tags found at this
 				 * location. */
+{
+    CkTextTag *tagSpace[NUM_TAG_INFOS], **tagPtrs;
+    int countSpace[NUM_TAG_INFOS];
+    TagInfo tagInfo;
+
+    tagInfo.tagPtrs = tagSpace;
+    tagInfo.counts = countSpace;
+    CollectTags(indexPtr, &tagInfo);
+    *numTagsPtr = tagInfo.numTags;
+    if (tagInfo.numTags == 0) {
+	tagPtrs = NULL;
+    } else if (tagInfo.arraySize > NUM_TAG_INFOS) {
+	tagPtrs = tagInfo.tagPtrs;
+    } else {
+	tagPtrs = (CkTextTag **) ckalloc((unsigned)
+		tagInfo.numTags*sizeof(CkTextTag *));
+	memcpy((VOID *) tagPtrs, (VOID *) tagInfo.tagPtrs,
+		tagInfo.numTags*sizeof(CkTextTag *));
+    }
+    if (tagInfo.arraySize > NUM_TAG_INFOS) {
+	ckfree((char *) tagInfo.counts);
+	if (tagPtrs == NULL) {
+	    ckfree((char *) tagInfo.tagPtrs);
+	}
+    }
+    return tagPtrs;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CkBTreeFillTags --
+ *
+ *	Like CkBTreeGetTags, but stores the tags of a character in an
+ *	array supplied by the caller, so that no storage needs to be
+ *	allocated in the common case of a character with few tags.
+ *
+ * Results:
+ *	The return value is the number of tags associated with the
+ *	character at indexPtr.  Pointers to the first maxTags of them
+ *	are stored at tagPtrs.  If the return value is larger than
+ *	maxTags, the caller should use CkBTreeGetTags instead.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+CkBTreeFillTags(indexPtr, tagPtrs, maxTags)
+    CkTextIndex *indexPtr;	/* Indicates a particular position in
+				 * the B-tree. */
+    CkTextTag **tagPtrs;	/* Store pointers to tags here. */
+    int maxTags;		/* Number of entries in tagPtrs. */
+{
+    CkTextTag *tagSpace[NUM_TAG_INFOS];
+    int countSpace[NUM_TAG_INFOS];
+    TagInfo tagInfo;
+
+    tagInfo.tagPtrs = tagSpace;
+    tagInfo.counts = countSpace;
+    CollectTags(indexPtr, &tagInfo);
+    memcpy((VOID *) tagPtrs, (VOID *) tagInfo.tagPtrs,
+	    ((tagInfo.numTags < maxTags) ? tagInfo.numTags : maxTags)
+	    * sizeof(CkTextTag *));
+    if (tagInfo.arraySize > NUM_TAG_INFOS) {
+	ckfree((char *) tagInfo.tagPtrs);
+	ckfree((char *) tagInfo.counts);
+    }
+    return tagInfo.numTags;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CollectTags --
+ *
+ *	This is a utility procedure used by CkBTreeGetTags and
+ *	CkBTreeFillTags.  It finds the tags associated with a
+ *	particular character by counting toggles in the B-tree.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	On return the first numTags entries of the arrays at
+ *	*tagInfoPtr hold the tags present at the character.  The
+ *	arrays initially given by the caller must hold NUM_TAG_INFOS
+ *	entries;  if larger arrays were needed, they are malloc-ed
+ *	and arraySize tells so.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+CollectTags(indexPtr, tagInfoPtr)
+    CkTextIndex *indexPtr;	/* Indicates a particular position in
+				 * the B-tree. */
+    TagInfo *tagInfoPtr;	/* Arrays for tags and counts. */
 {
     register Node *nodePtr;
     register CkTextLine *siblingLinePtr;
     register CkTextSegment *segPtr;
     int src, dst, index;
-    TagInfo tagInfo;
-#define NUM_TAG_INFOS 10
 
-    tagInfo.numTags = 0;
-    tagInfo.arraySize = NUM_TAG_INFOS;
-    tagInfo.tagPtrs = (CkTextTag **) ckalloc((unsigned)
-	    NUM_TAG_INFOS*sizeof(CkTextTag *));
-    tagInfo.counts = (int *) ckalloc((unsigned)
-	    NUM_TAG_INFOS*sizeof(int));
+    tagInfoPtr->numTags = 0;
+    tagInfoPtr->arraySize = NUM_TAG_INFOS;
 
     /*
      * Record tag toggles within the line of indexPtr but preceding
@@ -1637,7 +2334,7 @@ CkBTreeGetTags(indexPtr, numTagsPtr)
 	    index += segPtr->size, segPtr = segPtr->nextPtr) {
 	if ((segPtr->typePtr == &ckTextToggleOnType)
 		|| (segPtr->typePtr == &ckTextToggleOffType)) {
-	    IncCount(segPtr->body.toggle.tagPtr, 1, &tagInfo);
+	    IncCount(segPtr->body.toggle.tagPtr, 1, tagInfoPtr);
 	}
     }
 
@@ -1653,7 +2350,7 @@ CkBTreeGetTags(indexPtr, numTagsPtr)
 		segPtr = segPtr->nextPtr) {
 	    if ((segPtr->typePtr == &ckTextToggleOnType)
 		    || (segPtr->typePtr == &ckTextToggleOffType)) {
-		IncCount(segPtr->body.toggle.tagPtr, 1, &tagInfo);
+		IncCount(segPtr->body.toggle.tagPtr, 1, tagInfoPtr);
 	    }
 	}
     }
@@ -1674,7 +2371,7 @@ CkBTreeGetTags(indexPtr, numTagsPtr)
 		    summaryPtr = summaryPtr->nextPtr) {
 		if (summaryPtr->toggleCount & 1) {
 		    IncCount(summaryPtr->tagPtr, summaryPtr->toggleCount,
-			    &tagInfo);
+			    tagInfoPtr);
 		}
 	    }
 	}
@@ -1686,27 +2383,21 @@ CkBTreeGetTags(indexPtr, numTagsPtr)
      * of interest, but not at the desired character itself).
      */
 
-    for (src = 0, dst = 0; src < tagInfo.numTags; src++) {
-	if (tagInfo.counts[src] & 1) {
-	    tagInfo.tagPtrs[dst] = tagInfo.tagPtrs[src];
+    for (src = 0, dst = 0; src < tagInfoPtr->numTags; src++) {
+	if (tagInfoPtr->counts[src] & 1) {
+	    tagInfoPtr->tagPtrs[dst] = tagInfoPtr->tagPtrs[src];
 	    dst++;
 	}
     }
-    *numTagsPtr = dst;
-    ckfree((char *) tagInfo.counts);
-    if (dst == 0) {
-	ckfree((char *) tagInfo.tagPtrs);
-	return NULL;
-    }
-    return tagInfo.tagPtrs;
+    tagInfoPtr->numTags = dst;
 }
-
+
 /*
  *----------------------------------------------------------------------
  *
  * IncCount --
  *
- *	This is a utility procedure used by CkBTreeGetTags.  It
+ *	This is a utility procedure used by CollectTags.  It
  *	increments the count for a particular tag, adding a new
  *	entry for that tag if there wasn't one previously.
  *
@@ -1753,12 +2444,14 @@ IncCount(tagPtr, inc, tagInfoPtr)
 		(newSize*sizeof(CkTextTag *)));
 	memcpy((VOID *) newTags, (VOID *) tagInfoPtr->tagPtrs,
 		tagInfoPtr->arraySize * sizeof(CkTextTag *));
-	ckfree((char *) tagInfoPtr->tagPtrs);
-	tagInfoPtr->tagPtrs = newTags;
 	newCounts = (int *) ckalloc((unsigned) (newSize*sizeof(int)));
 	memcpy((VOID *) newCounts, (VOID *) tagInfoPtr->counts,
 		tagInfoPtr->arraySize * sizeof(int));
-	ckfree((char *) tagInfoPtr->counts);
+	if (tagInfoPtr->arraySize > NUM_TAG_INFOS) {
+	    ckfree((char *) tagInfoPtr->tagPtrs);
+	    ckfree((char *) tagInfoPtr->counts);
+	}
+	tagInfoPtr->tagPtrs = newTags;
 	tagInfoPtr->counts = newCounts;
 	tagInfoPtr->arraySize = newSize;
     }
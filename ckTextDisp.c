@@ -62,6 +62,23 @@ typedef struct Style {
  * between them.
  */
 
+/*
+ * Resolving the tags of a character into a Style is cached per set of
+ * tags.  The sets below, with up to STYLE_CACHE_TAGS tags sorted by
+ * address and padded with NULL pointers, form the hash keys for
+ * dInfoPtr->styleCache, whose values are Styles holding one reference
+ * each.  Characters with more tags bypass the cache.  The cache is
+ * emptied whenever tag options or priorities change and when it holds
+ * more than STYLE_CACHE_SIZE sets.
+ */
+
+#define STYLE_CACHE_TAGS 8
+#define STYLE_CACHE_SIZE 256
+
+typedef struct StyleKey {
+    CkTextTag *tagPtrs[STYLE_CACHE_TAGS];
+} StyleKey;
+
 #define SAME_BACKGROUND(s1, s2) \
     (((s1)->sValuePtr->border == (s2)->sValuePtr->border) \
         && ((s1)->sValuePtr->borderWidth == (s2)->sValuePtr->borderWidth) \
@@ -133,6 +150,8 @@ typedef struct DLine {
 typedef struct DInfo {
     Tcl_HashTable styleTable;	/* Hash table that maps from StyleValues
 				 * to Styles for this widget. */
+    Tcl_HashTable styleCache;	/* Hash table that maps from StyleKeys
+				 * to Styles for this widget. */
     DLine *dLinePtr;		/* First in list of all display lines for
 				 * this widget, in order from top to bottom. */
     int x;			/* First x-coordinate that may be used for
@@ -223,12 +242,22 @@ typedef struct CharInfo {
  *				under the mouse cursor now).  Need to
  *				recompute the current character before
  *				the next redisplay.
+ * VIEW_AT_END:			Non-zero means that the end of the text
+ *				was visible at the bottom of the window
+ *				when the DLines were last computed, and
+ *				the view hasn't been changed since.
+ * SEE_END_PENDING:		Non-zero means that CkTextSeeEnd has been
+ *				called:  the top index must be recomputed
+ *				so that the end of the text is at the
+ *				bottom of the window.
  */
 
 #define DINFO_OUT_OF_DATE	1
 #define REDRAW_PENDING		2
 #define REDRAW_BORDERS		4
 #define REPICK_NEEDED		8
+#define VIEW_AT_END		16
+#define SEE_END_PENDING		32
 
 /*
  * The following counters keep statistics about redisplay that can be
@@ -309,6 +338,7 @@ CkTextCreateDInfo(textPtr)
 
     dInfoPtr = (DInfo *) ckalloc(sizeof(DInfo));
     Tcl_InitHashTable(&dInfoPtr->styleTable, sizeof(StyleValues)/sizeof(int));
+    Tcl_InitHashTable(&dInfoPtr->styleCache, sizeof(StyleKey)/sizeof(int));
     dInfoPtr->dLinePtr = NULL;
     dInfoPtr->topOfEof = 0;
     dInfoPtr->newCharOffset = 0;
@@ -319,7 +349,7 @@ CkTextCreateDInfo(textPtr)
     dInfoPtr->yScrollFirst = -1;
     dInfoPtr->yScrollLast = -1;
     dInfoPtr->dLinesInvalidated = 0;
-    dInfoPtr->flags = DINFO_OUT_OF_DATE;
+    dInfoPtr->flags = DINFO_OUT_OF_DATE|VIEW_AT_END;
     textPtr->dInfoPtr = dInfoPtr;
 }
 
@@ -354,6 +384,8 @@ CkTextFreeDInfo(textPtr)
      */
 
     FreeDLines(textPtr, dInfoPtr->dLinePtr, (DLine *) NULL, 1);
+    CkTextTagsChanged(textPtr);
+    Tcl_DeleteHashTable(&dInfoPtr->styleCache);
     Tcl_DeleteHashTable(&dInfoPtr->styleTable);
     if (dInfoPtr->flags & REDRAW_PENDING) {
 	Tk_CancelIdleCall(DisplayText, (ClientData) textPtr);
@@ -385,12 +417,13 @@ GetStyle(textPtr, indexPtr)
     CkTextIndex *indexPtr;	/* The character in the text for which
 				 * display information is wanted. */
 {
-    CkTextTag **tagPtrs;
+    CkTextTag *tagSpace[STYLE_CACHE_TAGS], **tagPtrs;
     register CkTextTag *tagPtr;
     StyleValues styleValues;
+    StyleKey styleKey;
     Style *stylePtr;
-    Tcl_HashEntry *hPtr;
-    int numTags, new, i;
+    Tcl_HashEntry *hPtr, *cachePtr;
+    int numTags, new, i, j;
 
     /*
      * The variables below keep track of the highest-priority specification
@@ -402,13 +435,43 @@ GetStyle(textPtr, indexPtr)
     int tabPrio, wrapPrio;
 
     /*
-     * Find out what tags are present for the character, then compute
-     * a StyleValues structure corresponding to those tags (scan
+     * Find out what tags are present for the character.  If there
+     * are only a few, look for the style of the same set of tags in
+     * the cache first.
+     */
+
+    cachePtr = NULL;
+    tagPtrs = tagSpace;
+    numTags = CkBTreeFillTags(indexPtr, tagSpace, STYLE_CACHE_TAGS);
+    if (numTags > STYLE_CACHE_TAGS) {
+	tagPtrs = CkBTreeGetTags(indexPtr, &numTags);
+    } else {
+	memset((VOID *) &styleKey, 0, sizeof(StyleKey));
+	for (i = 0; i < numTags; i++) {
+	    for (j = i; (j > 0) && ((unsigned long) styleKey.tagPtrs[j-1]
+		    > (unsigned long) tagSpace[i]); j--) {
+		styleKey.tagPtrs[j] = styleKey.tagPtrs[j-1];
+	    }
+	    styleKey.tagPtrs[j] = tagSpace[i];
+	}
+	if (textPtr->dInfoPtr->styleCache.numEntries >= STYLE_CACHE_SIZE) {
+	    CkTextTagsChanged(textPtr);
+	}
+	cachePtr = Tcl_CreateHashEntry(&textPtr->dInfoPtr->styleCache,
+		(char *) &styleKey, &new);
+	if (!new) {
+	    stylePtr = (Style *) Tcl_GetHashValue(cachePtr);
+	    stylePtr->refCount++;
+	    return stylePtr;
+	}
+    }
+
+    /*
+     * Compute a StyleValues structure corresponding to the tags (scan
      * through all of the tags, saving information for the highest-
      * priority tag).
      */
 
-    tagPtrs = CkBTreeGetTags(indexPtr, &numTags);
     bgPrio = fgPrio = attrPrio = justifyPrio = -1;
     lMargin1Prio = lMargin2Prio = rMarginPrio = -1;
     tabPrio = wrapPrio = -1;
@@ -464,12 +527,13 @@ GetStyle(textPtr, indexPtr)
 	    wrapPrio = tagPtr->priority;
 	}
     }
-    if (tagPtrs != NULL) {
+    if ((tagPtrs != tagSpace) && (tagPtrs != NULL)) {
 	ckfree((char *) tagPtrs);
     }
 
     /*
      * Use an existing style if there's one around that matches.
+     * Otherwise make a new one.
      */
 
     hPtr = Tcl_CreateHashEntry(&textPtr->dInfoPtr->styleTable,
@@ -477,21 +541,58 @@ GetStyle(textPtr, indexPtr)
     if (!new) {
 	stylePtr = (Style *) Tcl_GetHashValue(hPtr);
 	stylePtr->refCount++;
-	return stylePtr;
+    } else {
+	stylePtr = (Style *) ckalloc(sizeof(Style));
+	stylePtr->refCount = 1;
+	stylePtr->sValuePtr = (StyleValues *)
+		Tcl_GetHashKey(&textPtr->dInfoPtr->styleTable, hPtr);
+	stylePtr->hPtr = hPtr;
+	Tcl_SetHashValue(hPtr, stylePtr);
     }
 
     /*
-     * No existing style matched.  Make a new one.
+     * Remember the style for this set of tags.  The cache holds a
+     * reference of its own.
      */
 
-    stylePtr = (Style *) ckalloc(sizeof(Style));
-    stylePtr->refCount = 1;
-    stylePtr->sValuePtr = (StyleValues *)
-	    Tcl_GetHashKey(&textPtr->dInfoPtr->styleTable, hPtr);
-    stylePtr->hPtr = hPtr;
-    Tcl_SetHashValue(hPtr, stylePtr);
+    if (cachePtr != NULL) {
+	Tcl_SetHashValue(cachePtr, stylePtr);
+	stylePtr->refCount++;
+    }
     return stylePtr;
 }
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CkTextTagsChanged --
+ *
+ *	This procedure is called when the options or priorities of
+ *	tags change, or a tag is deleted, so that sets of tags may no
+ *	longer resolve to the styles remembered for them.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The cache of styles for sets of tags is emptied.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+CkTextTagsChanged(textPtr)
+    CkText *textPtr;		/* Information about overall widget. */
+{
+    Tcl_HashEntry *hPtr;
+    Tcl_HashSearch search;
+
+    for (hPtr = Tcl_FirstHashEntry(&textPtr->dInfoPtr->styleCache,
+	    &search); hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
+	FreeStyle(textPtr, (Style *) Tcl_GetHashValue(hPtr));
+	Tcl_DeleteHashEntry(hPtr);
+    }
+}
 
 /*
  *----------------------------------------------------------------------
@@ -892,6 +993,34 @@ UpdateDisplayInfo(textPtr)
     if (!(dInfoPtr->flags & DINFO_OUT_OF_DATE)) {
 	return;
     }
+
+    /*
+     * Compute the top index for CkTextSeeEnd, now that all the
+     * changes to the text since it was called are done.
+     */
+
+    if (dInfoPtr->flags & SEE_END_PENDING) {
+	dInfoPtr->flags &= ~SEE_END_PENDING;
+#if CK_USE_UTF
+	CkTextMakeByteIndex(textPtr->tree, CkBTreeNumLines(textPtr->tree), 0,
+		&index);
+#else
+	CkTextMakeIndex(textPtr->tree, CkBTreeNumLines(textPtr->tree), 0,
+		&index);
+#endif
+	CkTextIndexBackChars(&index, 1, &index);
+	MeasureUp(textPtr, &index, dInfoPtr->maxY - dInfoPtr->y,
+		&textPtr->topIndex);
+    }
+
+    /*
+     * Bring the syntax highlighting of the lines in view up to date.
+     * This may discard more DLines, so do it before clearing the flag.
+     */
+
+    if (textPtr->hlPtr != NULL) {
+	CkTextHighlightView(textPtr, dInfoPtr->maxY - dInfoPtr->y);
+    }
     dInfoPtr->flags &= ~DINFO_OUT_OF_DATE;
 
     /*
@@ -1047,6 +1176,11 @@ UpdateDisplayInfo(textPtr)
 	    break;
 	}
     }
+    if (index.linePtr == lastLinePtr) {
+	dInfoPtr->flags |= VIEW_AT_END;
+    } else {
+	dInfoPtr->flags &= ~VIEW_AT_END;
+    }
 
     /*
      * Delete any DLine structures that don't fit on the screen.
@@ -1381,9 +1515,11 @@ DisplayText(clientData)
     CkWindow *winPtr;
     register DLine *dlPtr;
     DLine *prevPtr;
-    int maxHeight;
+    CkTextDispChunk *chunkPtr;
+    int maxHeight, scroll;
     int bottomY = 0;		/* Initialization needed only to stop
 				 * compiler warnings. */
+    double t0;
 
     if (textPtr->winPtr == NULL) {
 	/*
@@ -1392,6 +1528,7 @@ DisplayText(clientData)
 
 	return;
     }
+    t0 = CkProfileStart(textPtr->winPtr->mainPtr);
 
     if (ckTextDebug) {
 	Tcl_SetVar2(textPtr->interp, "ck_textRelayout", (char *) NULL,
@@ -1437,6 +1574,50 @@ DisplayText(clientData)
     dInfoPtr->dLinesInvalidated = 0;
     dInfoPtr->flags &= ~REDRAW_PENDING;
 
+    /*
+     * If the view was only scrolled vertically, all lines which are
+     * still on the screen have moved by the same distance.  In that
+     * case move them within the window and redraw just the lines
+     * which came into view.
+     */
+
+    scroll = 0;
+    for (dlPtr = dInfoPtr->dLinePtr; dlPtr != NULL; dlPtr = dlPtr->nextPtr) {
+	if (dlPtr->oldY == -1) {
+	    continue;
+	}
+	if ((scroll != 0) && (dlPtr->oldY - dlPtr->y != scroll)) {
+	    scroll = 0;
+	    break;
+	}
+	scroll = dlPtr->oldY - dlPtr->y;
+	if (scroll == 0) {
+	    break;
+	}
+    }
+    if ((scroll != 0) && Ck_ScrollWindow(textPtr->winPtr, dInfoPtr->y,
+	    dInfoPtr->maxY, scroll)) {
+	for (dlPtr = dInfoPtr->dLinePtr; dlPtr != NULL;
+		dlPtr = dlPtr->nextPtr) {
+	    if ((dlPtr->oldY == -1) ||
+		    (dlPtr->oldY + dlPtr->height > dInfoPtr->maxY) ||
+		    (dlPtr->y + dlPtr->height > dInfoPtr->maxY)) {
+		continue;
+	    }
+	    dlPtr->oldY = dlPtr->y;
+	    for (chunkPtr = dlPtr->chunkPtr; chunkPtr != NULL;
+		    chunkPtr = chunkPtr->nextPtr) {
+		if (chunkPtr->displayProc == CkTextInsertDisplayProc) {
+		    (*chunkPtr->displayProc)(chunkPtr,
+			    chunkPtr->x + dInfoPtr->x - dInfoPtr->curOffset,
+			    0, dlPtr->height, 0, textPtr->winPtr->window,
+			    dlPtr->y);
+		}
+	    }
+	}
+	dInfoPtr->topOfEof = dInfoPtr->maxY;
+    }
+
     maxHeight = -1;
     for (dlPtr = dInfoPtr->dLinePtr; dlPtr != NULL; dlPtr = dlPtr->nextPtr) {
         if ((dlPtr->height > maxHeight) && (dlPtr->oldY != dlPtr->y)) {
@@ -1543,6 +1724,7 @@ done:
 	Ck_SetHWCursor(textPtr->winPtr, 0);
     }
     Ck_EventuallyRefresh(textPtr->winPtr);
+    CkProfileWindow(textPtr->winPtr, t0);
 }
 
 /*
@@ -2073,6 +2255,71 @@ CkTextSetYView(textPtr, indexPtr, pickPlace)
 	Tk_DoWhenIdle(DisplayText, (ClientData) textPtr);
     }
     dInfoPtr->flags |= REDRAW_PENDING|DINFO_OUT_OF_DATE|REPICK_NEEDED;
+    dInfoPtr->flags &= ~SEE_END_PENDING;
+    if (lineIndex >= CkBTreeNumLines(textPtr->tree) - 1) {
+	dInfoPtr->flags |= VIEW_AT_END;
+    } else {
+	dInfoPtr->flags &= ~VIEW_AT_END;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CkTextAtEnd --
+ *
+ *	Tells whether the end of the text is visible at the bottom of
+ *	the window, as of the last time the display was laid out.
+ *	Used to decide whether a text with -maxlines should follow
+ *	new lines appended to it.
+ *
+ * Results:
+ *	1 if the view is at the end of the text, 0 otherwise.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+CkTextAtEnd(textPtr)
+    CkText *textPtr;		/* Widget record for text widget. */
+{
+    return (textPtr->dInfoPtr->flags & VIEW_AT_END) ? 1 : 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CkTextSeeEnd --
+ *
+ *	Arrange for the last line of the text to be displayed at the
+ *	bottom of the window.  Unlike "see end", this doesn't bring
+ *	the display information for the old view up to date first,
+ *	and the new view is only computed once for any number of
+ *	calls before the next redisplay.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The view changes when the display is next updated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+CkTextSeeEnd(textPtr)
+    CkText *textPtr;		/* Widget record for text widget. */
+{
+    DInfo *dInfoPtr = textPtr->dInfoPtr;
+
+    if (!(dInfoPtr->flags & REDRAW_PENDING)) {
+	Tk_DoWhenIdle(DisplayText, (ClientData) textPtr);
+    }
+    dInfoPtr->flags |= REDRAW_PENDING|DINFO_OUT_OF_DATE|REPICK_NEEDED
+	    |VIEW_AT_END|SEE_END_PENDING;
 }
 
 /*
@@ -2406,6 +2653,7 @@ ScrollByLines(textPtr, offset)
     DInfo *dInfoPtr = textPtr->dInfoPtr;
     DLine *dlPtr, *lowestPtr;
 
+    dInfoPtr->flags &= ~(VIEW_AT_END|SEE_END_PENDING);
     if (offset < 0) {
 	/*
 	 * Must scroll up (to show earlier information in the text).
@@ -2592,6 +2840,9 @@ CkTextYviewCmd(textPtr, interp, argc, argv)
      */
 
     type = Ck_GetScrollInfo(interp, argc, argv, &fraction, &count);
+    if (type != CK_SCROLL_ERROR) {
+	dInfoPtr->flags &= ~VIEW_AT_END;
+    }
     switch (type) {
 	case CK_SCROLL_ERROR:
 	    return TCL_ERROR;
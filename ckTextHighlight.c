@@ -0,0 +1,1073 @@
+/*
+ * ckTextHighlight.c --
+ *
+ *	This file implements syntax highlighting for text widgets:
+ *	a list of rules, each mapping keywords, a regular expression
+ *	or a region between two regular expressions to a tag.  The
+ *	rules are applied to lines as they come into view and again
+ *	to lines which are modified.
+ *
+ * Copyright (c) 1995 Christian Werner
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ */
+
+#include "ckPort.h"
+#include "ck.h"
+#include "ckText.h"
+
+#if CK_USE_UTF
+
+/*
+ * One of the following structures exists for each highlighting rule.
+ */
+
+typedef struct HighlightRule {
+    CkTextTag *tagPtr;		/* Tag to put on matching characters. */
+    int type;			/* RULE_KEYWORDS, RULE_REGEXP or
+				 * RULE_REGION, see below. */
+    Tcl_Obj *patObj;		/* Pattern for RULE_REGEXP, start pattern
+				 * for RULE_REGION, else NULL.  The object
+				 * holds the compiled regular expression. */
+    Tcl_Obj *endObj;		/* End pattern for RULE_REGION, else NULL. */
+    Tcl_HashTable keywords;	/* Words for RULE_KEYWORDS. */
+    int maxKeyword;		/* Length of longest word in keywords. */
+    char *spec;			/* Rule as given to "highlight add", for
+				 * "highlight rules" (malloc-ed). */
+    int matchStart, matchEnd;	/* Next match of rule in the line being
+				 * highlighted, or MATCH_UNKNOWN or
+				 * MATCH_NONE in matchStart. */
+    struct HighlightRule *nextPtr;
+				/* Next rule in order of precedence. */
+} HighlightRule;
+
+#define RULE_KEYWORDS	1
+#define RULE_REGEXP	2
+#define RULE_REGION	3
+
+#define MATCH_UNKNOWN	-2
+#define MATCH_NONE	-1
+
+/*
+ * The following structure is hung off the text widget when it has
+ * highlighting rules.  The state of each line is kept in an array:
+ * a value >= 0 means the line is highlighted and tells whether the
+ * end of the line is inside a region (the number of the region's rule,
+ * counting from 1) or not (0).  STATE_UNKNOWN means the line must be
+ * highlighted, and DIRTY(s) that it must be highlighted again because
+ * the state at its start has changed, s being its old state.
+ */
+
+typedef struct Highlighter {
+    HighlightRule *firstRulePtr;	/* List of rules, first has highest
+					 * precedence. */
+    int numRegions;			/* Number of RULE_REGION rules. */
+    CkTextTag **tagPtrs;		/* Tags used by rules (malloc-ed). */
+    int numTags;			/* Number of entries in tagPtrs. */
+    int *states;			/* State of each line (malloc-ed). */
+    int numLines;			/* Number of lines described by states,
+					 * i.e. number of lines in the text
+					 * after the last change was applied. */
+    int statesSize;			/* Number of entries in states. */
+    int changePending;			/* Non-zero means the text has been
+					 * modified since changeFirst and
+					 * changeLast were recorded. */
+    int changeFirst, changeLast;	/* Range of lines being modified,
+					 * numbered as before the change. */
+    CkTextTagSpan *spans;		/* Spans of the line being
+					 * highlighted (malloc-ed). */
+    int spansSize;			/* Number of entries in spans. */
+} Highlighter;
+
+#define STATE_UNKNOWN	-1
+#define DIRTY(s)	(-(s) - 2)
+
+/*
+ * The following structure describes the line being highlighted.
+ * Regular expressions are matched at character offsets, which are
+ * found by counting characters forward from the last offset used,
+ * since matching proceeds from the start to the end of the line.
+ */
+
+typedef struct LineText {
+    char *string;		/* The line, without its newline. */
+    int length;			/* Number of bytes in string. */
+    Tcl_Obj *textObj;		/* String object for string, or NULL. */
+    int bytePos, charPos;	/* Byte offset in string and the number
+				 * of characters before it. */
+} LineText;
+
+/*
+ * Forward declarations for procedures defined later in this file:
+ */
+
+static void		ApplyChange _ANSI_ARGS_((CkText *textPtr));
+static void		CollectTags _ANSI_ARGS_((Highlighter *hlPtr));
+static void		FreeRule _ANSI_ARGS_((HighlightRule *rulePtr));
+static int		HighlightLine _ANSI_ARGS_((CkText *textPtr,
+			    int lineIndex, CkTextLine *linePtr, int state));
+static void		HighlightRange _ANSI_ARGS_((CkText *textPtr,
+			    int firstLine, int lastLine));
+static int		NextMatch _ANSI_ARGS_((CkText *textPtr,
+			    HighlightRule *rulePtr, Tcl_Obj *patObj,
+			    LineText *ltPtr, int pos, int *startPtr,
+			    int *endPtr));
+static void		ResetStates _ANSI_ARGS_((CkText *textPtr));
+static void		UntagAll _ANSI_ARGS_((CkText *textPtr,
+			    CkTextTag *tagPtr));
+
+/*
+ * Characters which make up the words looked up for RULE_KEYWORDS.
+ * Bytes of multi-byte characters count as word characters, so that
+ * words are never split in the middle of a character.
+ */
+
+#define IS_WORD(c) (isalnum((unsigned char) (c)) || ((c) == '_') \
+	|| ((unsigned char) (c) >= 0x80))
+
+/*
+ *--------------------------------------------------------------
+ *
+ * CkTextHighlightCmd --
+ *
+ *	This procedure is invoked to process the "highlight" options of
+ *	the widget command for text widgets.  See the user documentation
+ *	for details on what it does.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	See the user documentation.
+ *
+ *--------------------------------------------------------------
+ */
+
+int
+CkTextHighlightCmd(textPtr, interp, argc, argv)
+    register CkText *textPtr;	/* Information about text widget. */
+    Tcl_Interp *interp;		/* Current interpreter. */
+    int argc;			/* Number of arguments. */
+    char **argv;		/* Argument strings.  Someone else has already
+				 * parsed this command enough to know that
+				 * argv[1] is "highlight". */
+{
+    Highlighter *hlPtr = textPtr->hlPtr;
+    HighlightRule *rulePtr, **rulePtrPtr;
+    CkTextIndex index;
+    int c, i, new;
+    size_t length;
+
+    if (argc < 3) {
+	Tcl_AppendResult(interp, "wrong # args: should be \"",
+		argv[0], " highlight option ?arg arg ...?\"", (char *) NULL);
+	return TCL_ERROR;
+    }
+    c = argv[2][0];
+    length = strlen(argv[2]);
+    if ((c == 'a') && (strncmp(argv[2], "add", length) == 0)) {
+	char *keywords = NULL, *pattern = NULL;
+	char *startPattern = NULL, *endPattern = NULL;
+	CkTextTag *tagPtr;
+
+	if ((argc != 6) && (argc != 8)) {
+	    goto addUsage;
+	}
+	for (i = 4; i < argc; i += 2) {
+	    length = strlen(argv[i]);
+	    if (length < 2) {
+		goto addUsage;
+	    } else if (strncmp(argv[i], "-keywords", length) == 0) {
+		keywords = argv[i+1];
+	    } else if (strncmp(argv[i], "-regexp", length) == 0) {
+		pattern = argv[i+1];
+	    } else if (strncmp(argv[i], "-start", length) == 0) {
+		startPattern = argv[i+1];
+	    } else if (strncmp(argv[i], "-end", length) == 0) {
+		endPattern = argv[i+1];
+	    } else {
+		goto addUsage;
+	    }
+	}
+	if ((argc == 6) ? ((keywords == NULL) == (pattern == NULL))
+		: ((startPattern == NULL) || (endPattern == NULL))) {
+	    addUsage:
+	    Tcl_AppendResult(interp, "wrong # args: should be \"",
+		    argv[0], " highlight add tagName -keywords list\", \"",
+		    argv[0], " highlight add tagName -regexp pattern\", or \"",
+		    argv[0], " highlight add tagName -start pattern ",
+		    "-end pattern\"", (char *) NULL);
+	    return TCL_ERROR;
+	}
+	if (startPattern != NULL) {
+	    pattern = startPattern;
+	}
+	if (strcmp(argv[3], "sel") == 0) {
+	    Tcl_AppendResult(interp, "can't highlight with the \"sel\" tag",
+		    (char *) NULL);
+	    return TCL_ERROR;
+	}
+
+	rulePtr = (HighlightRule *) ckalloc(sizeof(HighlightRule));
+	rulePtr->tagPtr = NULL;
+	rulePtr->patObj = rulePtr->endObj = NULL;
+	rulePtr->maxKeyword = 0;
+	rulePtr->spec = NULL;
+	rulePtr->nextPtr = NULL;
+	if (keywords != NULL) {
+	    char **words;
+	    int numWords;
+
+	    rulePtr->type = RULE_KEYWORDS;
+	    Tcl_InitHashTable(&rulePtr->keywords, TCL_STRING_KEYS);
+	    if (Tcl_SplitList(interp, keywords, &numWords, &words) != TCL_OK) {
+		FreeRule(rulePtr);
+		return TCL_ERROR;
+	    }
+	    for (i = 0; i < numWords; i++) {
+		Tcl_CreateHashEntry(&rulePtr->keywords, words[i], &new);
+		if ((int) strlen(words[i]) > rulePtr->maxKeyword) {
+		    rulePtr->maxKeyword = strlen(words[i]);
+		}
+	    }
+	    ckfree((char *) words);
+	} else {
+	    rulePtr->type = (endPattern == NULL) ? RULE_REGEXP : RULE_REGION;
+	    rulePtr->patObj = Tcl_NewStringObj(pattern, -1);
+	    Tcl_IncrRefCount(rulePtr->patObj);
+	    if (Tcl_GetRegExpFromObj(interp, rulePtr->patObj,
+		    TCL_REG_ADVANCED) == NULL) {
+		FreeRule(rulePtr);
+		return TCL_ERROR;
+	    }
+	    if (endPattern != NULL) {
+		rulePtr->endObj = Tcl_NewStringObj(endPattern, -1);
+		Tcl_IncrRefCount(rulePtr->endObj);
+		if (Tcl_GetRegExpFromObj(interp, rulePtr->endObj,
+			TCL_REG_ADVANCED) == NULL) {
+		    FreeRule(rulePtr);
+		    return TCL_ERROR;
+		}
+	    }
+	}
+	rulePtr->spec = Tcl_Merge(argc-3, argv+3);
+
+	/*
+	 * Take the tag away from whatever characters it was put on
+	 * before, from now on only the highlighter sets it.
+	 */
+
+	tagPtr = CkTextCreateTag(textPtr, argv[3]);
+	if (tagPtr->highlightRules == 0) {
+	    UntagAll(textPtr, tagPtr);
+	}
+	tagPtr->highlightRules++;
+	rulePtr->tagPtr = tagPtr;
+
+	if (hlPtr == NULL) {
+	    hlPtr = (Highlighter *) ckalloc(sizeof(Highlighter));
+	    hlPtr->firstRulePtr = NULL;
+	    hlPtr->numRegions = 0;
+	    hlPtr->tagPtrs = NULL;
+	    hlPtr->numTags = 0;
+	    hlPtr->states = NULL;
+	    hlPtr->numLines = hlPtr->statesSize = 0;
+	    hlPtr->changePending = 0;
+	    hlPtr->spans = NULL;
+	    hlPtr->spansSize = 0;
+	    textPtr->hlPtr = hlPtr;
+	}
+	for (rulePtrPtr = &hlPtr->firstRulePtr; *rulePtrPtr != NULL;
+		rulePtrPtr = &(*rulePtrPtr)->nextPtr) {
+	    /* Empty loop body. */
+	}
+	*rulePtrPtr = rulePtr;
+	if (rulePtr->type == RULE_REGION) {
+	    hlPtr->numRegions++;
+	}
+	CollectTags(hlPtr);
+	ResetStates(textPtr);
+    } else if ((c == 'd') && (strncmp(argv[2], "delete", length) == 0)) {
+	if (hlPtr == NULL) {
+	    return TCL_OK;
+	}
+	ApplyChange(textPtr);
+	rulePtrPtr = &hlPtr->firstRulePtr;
+	while (*rulePtrPtr != NULL) {
+	    rulePtr = *rulePtrPtr;
+	    for (i = 3; i < argc; i++) {
+		if (strcmp(argv[i], rulePtr->tagPtr->name) == 0) {
+		    break;
+		}
+	    }
+	    if ((argc > 3) && (i >= argc)) {
+		rulePtrPtr = &rulePtr->nextPtr;
+		continue;
+	    }
+	    *rulePtrPtr = rulePtr->nextPtr;
+	    if (rulePtr->type == RULE_REGION) {
+		hlPtr->numRegions--;
+	    }
+	    rulePtr->tagPtr->highlightRules--;
+	    if (rulePtr->tagPtr->highlightRules == 0) {
+		UntagAll(textPtr, rulePtr->tagPtr);
+	    }
+	    FreeRule(rulePtr);
+	}
+	if (hlPtr->firstRulePtr == NULL) {
+	    CkTextFreeHighlighter(textPtr);
+	} else {
+	    CollectTags(hlPtr);
+	    ResetStates(textPtr);
+	}
+    } else if ((c == 'r') && (strncmp(argv[2], "rules", length) == 0)) {
+	if (argc != 3) {
+	    Tcl_AppendResult(interp, "wrong # args: should be \"",
+		    argv[0], " highlight rules\"", (char *) NULL);
+	    return TCL_ERROR;
+	}
+	if (hlPtr != NULL) {
+	    for (rulePtr = hlPtr->firstRulePtr; rulePtr != NULL;
+		    rulePtr = rulePtr->nextPtr) {
+		Tcl_AppendElement(interp, rulePtr->spec);
+	    }
+	}
+    } else if ((c == 'u') && (strncmp(argv[2], "update", length) == 0)) {
+	if (argc > 4) {
+	    Tcl_AppendResult(interp, "wrong # args: should be \"",
+		    argv[0], " highlight update ?index?\"", (char *) NULL);
+	    return TCL_ERROR;
+	}
+	if (CkTextGetIndex(interp, textPtr, (argc > 3) ? argv[3] : "end",
+		&index) != TCL_OK) {
+	    return TCL_ERROR;
+	}
+	if (hlPtr != NULL) {
+	    HighlightRange(textPtr, 0, CkBTreeLineIndex(index.linePtr));
+	}
+    } else {
+	Tcl_AppendResult(interp, "bad highlight option \"", argv[2],
+		"\":  must be add, delete, rules, or update", (char *) NULL);
+	return TCL_ERROR;
+    }
+    return TCL_OK;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * CkTextFreeHighlighter --
+ *
+ *	This procedure is called to release the highlighting rules
+ *	of a text widget, when the last rule is deleted or when the
+ *	widget is destroyed.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory is freed and textPtr->hlPtr is reset to NULL.  Tags
+ *	already put on the text stay there.
+ *
+ *--------------------------------------------------------------
+ */
+
+void
+CkTextFreeHighlighter(textPtr)
+    CkText *textPtr;		/* Text widget. */
+{
+    Highlighter *hlPtr = textPtr->hlPtr;
+    HighlightRule *rulePtr;
+
+    if (hlPtr == NULL) {
+	return;
+    }
+    while (hlPtr->firstRulePtr != NULL) {
+	rulePtr = hlPtr->firstRulePtr;
+	hlPtr->firstRulePtr = rulePtr->nextPtr;
+	rulePtr->tagPtr->highlightRules--;
+	FreeRule(rulePtr);
+    }
+    if (hlPtr->tagPtrs != NULL) {
+	ckfree((char *) hlPtr->tagPtrs);
+    }
+    if (hlPtr->states != NULL) {
+	ckfree((char *) hlPtr->states);
+    }
+    if (hlPtr->spans != NULL) {
+	ckfree((char *) hlPtr->spans);
+    }
+    ckfree((char *) hlPtr);
+    textPtr->hlPtr = NULL;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * CkTextHighlightChanged --
+ *
+ *	This procedure is called by the text widget before characters
+ *	are inserted or deleted.  Like CkTextChanged it must be called
+ *	*before* the change is made.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Highlighting is removed from the first and last line of the
+ *	range, so that no highlighted characters get merged into
+ *	other lines.  The lines of the range are highlighted again
+ *	when they are next displayed.
+ *
+ *--------------------------------------------------------------
+ */
+
+void
+CkTextHighlightChanged(textPtr, index1Ptr, index2Ptr)
+    CkText *textPtr;		/* Text widget. */
+    CkTextIndex *index1Ptr;	/* First character to be changed. */
+    CkTextIndex *index2Ptr;	/* Character just after the last one to
+				 * be changed. */
+{
+    Highlighter *hlPtr = textPtr->hlPtr;
+    int first, last;
+
+    if (hlPtr == NULL) {
+	return;
+    }
+    ApplyChange(textPtr);
+    first = CkBTreeLineIndex(index1Ptr->linePtr);
+    last = CkBTreeLineIndex(index2Ptr->linePtr);
+    CkBTreeRetagLine(textPtr->tree, index1Ptr->linePtr, hlPtr->numTags,
+	    hlPtr->tagPtrs, 0, (CkTextTagSpan *) NULL);
+    if (last != first) {
+	CkBTreeRetagLine(textPtr->tree, index2Ptr->linePtr, hlPtr->numTags,
+		hlPtr->tagPtrs, 0, (CkTextTagSpan *) NULL);
+    }
+    if (last >= hlPtr->numLines) {
+	last = hlPtr->numLines - 1;
+    }
+    if (first > last) {
+	first = last;
+    }
+    hlPtr->changePending = 1;
+    hlPtr->changeFirst = first;
+    hlPtr->changeLast = last;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * CkTextHighlightView --
+ *
+ *	This procedure is called by the display code before it lays
+ *	out the lines in view.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Lines starting at the top of the view which aren't highlighted
+ *	yet or were changed get their highlighting tags.
+ *
+ *--------------------------------------------------------------
+ */
+
+void
+CkTextHighlightView(textPtr, numLines)
+    CkText *textPtr;		/* Text widget. */
+    int numLines;		/* Number of lines in view. */
+{
+    int top;
+
+    top = CkBTreeLineIndex(textPtr->topIndex.linePtr);
+    HighlightRange(textPtr, top, top + numLines - 1);
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * HighlightRange --
+ *
+ *	Highlight the lines in a range which need it.  With region
+ *	rules, lines before the range are highlighted as well if the
+ *	state at the start of the range isn't known.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Tags are put on characters and the display is updated.  If the
+ *	state at the end of a line changes, the next line is marked
+ *	for highlighting.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+HighlightRange(textPtr, firstLine, lastLine)
+    CkText *textPtr;		/* Text widget. */
+    int firstLine, lastLine;	/* Range of lines. */
+{
+    Highlighter *hlPtr = textPtr->hlPtr;
+    CkTextLine *linePtr;
+    int i, old, state;
+
+    ApplyChange(textPtr);
+    if (lastLine >= hlPtr->numLines) {
+	lastLine = hlPtr->numLines - 1;
+    }
+    if (firstLine < 0) {
+	firstLine = 0;
+    }
+    if (firstLine > lastLine) {
+	return;
+    }
+    if (hlPtr->numRegions > 0) {
+	while ((firstLine > 0) && (hlPtr->states[firstLine-1] < 0)) {
+	    firstLine--;
+	}
+    }
+    linePtr = CkBTreeFindLine(textPtr->tree, firstLine);
+    for (i = firstLine; i <= lastLine;
+	    i++, linePtr = CkBTreeNextLine(linePtr)) {
+	old = hlPtr->states[i];
+	if (old >= 0) {
+	    continue;
+	}
+	state = ((i > 0) && (hlPtr->numRegions > 0)) ?
+		hlPtr->states[i-1] : 0;
+	state = HighlightLine(textPtr, i, linePtr, state);
+	hlPtr->states[i] = state;
+	if ((hlPtr->numRegions > 0) && (DIRTY(old) != state)
+		&& (i + 1 < hlPtr->numLines) && (hlPtr->states[i+1] >= 0)) {
+	    hlPtr->states[i+1] = DIRTY(hlPtr->states[i+1]);
+	}
+    }
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * HighlightLine --
+ *
+ *	Apply the rules to a single line.  Where matches of several
+ *	rules overlap, the one starting first wins, and of those
+ *	starting at the same character the first rule.
+ *
+ * Results:
+ *	The state at the end of the line.
+ *
+ * Side effects:
+ *	The tags of the rules are set on the line and its display
+ *	is updated if they changed.
+ *
+ *--------------------------------------------------------------
+ */
+
+static int
+HighlightLine(textPtr, lineIndex, linePtr, state)
+    CkText *textPtr;		/* Text widget. */
+    int lineIndex;		/* Index of line. */
+    CkTextLine *linePtr;	/* Line to highlight. */
+    int state;			/* State at the start of the line. */
+{
+    Highlighter *hlPtr = textPtr->hlPtr;
+    HighlightRule *rulePtr, *bestPtr;
+    CkTextSegment *segPtr;
+    CkTextTagSpan *spanPtr;
+    CkTextIndex index1, index2;
+    Tcl_DString line;
+    LineText lt;
+    char *string;
+    int length, pos, start, end, numSpans = 0, i;
+
+    Tcl_DStringInit(&line);
+    for (segPtr = linePtr->segPtr; segPtr != NULL; segPtr = segPtr->nextPtr) {
+	if (segPtr->typePtr == &ckTextCharType) {
+	    Tcl_DStringAppend(&line, segPtr->body.chars, segPtr->size);
+	}
+    }
+    length = Tcl_DStringLength(&line);
+    if ((length > 0) && (Tcl_DStringValue(&line)[length-1] == '\n')) {
+	length--;
+    }
+    string = Tcl_DStringValue(&line);
+    lt.string = string;
+    lt.length = length;
+    lt.textObj = NULL;
+    lt.bytePos = lt.charPos = 0;
+
+    for (rulePtr = hlPtr->firstRulePtr; rulePtr != NULL;
+	    rulePtr = rulePtr->nextPtr) {
+	rulePtr->matchStart = MATCH_UNKNOWN;
+    }
+    pos = 0;
+    if (state > 0) {
+	/*
+	 * The line starts inside a region:  look for its end.
+	 */
+
+	for (bestPtr = hlPtr->firstRulePtr, i = 1; i < state;
+		bestPtr = bestPtr->nextPtr, i++) {
+	    /* Empty loop body. */
+	}
+	start = 0;
+	goto regionEnd;
+    }
+    while (pos < length) {
+	bestPtr = NULL;
+	for (rulePtr = hlPtr->firstRulePtr; rulePtr != NULL;
+		rulePtr = rulePtr->nextPtr) {
+	    if ((rulePtr->matchStart == MATCH_UNKNOWN)
+		    || ((rulePtr->matchStart >= 0)
+		    && (rulePtr->matchStart < pos))) {
+		if (!NextMatch(textPtr, rulePtr, rulePtr->patObj, &lt,
+			pos, &rulePtr->matchStart, &rulePtr->matchEnd)) {
+		    rulePtr->matchStart = MATCH_NONE;
+		}
+	    }
+	    if ((rulePtr->matchStart >= 0) && ((bestPtr == NULL)
+		    || (rulePtr->matchStart < bestPtr->matchStart))) {
+		bestPtr = rulePtr;
+	    }
+	}
+	if (bestPtr == NULL) {
+	    break;
+	}
+	start = bestPtr->matchStart;
+	end = bestPtr->matchEnd;
+	bestPtr->matchStart = MATCH_UNKNOWN;
+	if (end <= start) {
+	    /*
+	     * Empty matches tag nothing;  go on after the character.
+	     */
+
+	    pos = start + (Tcl_UtfNext(string + start) - (string + start));
+	    continue;
+	}
+	pos = end;
+	if (bestPtr->type == RULE_REGION) {
+	    regionEnd:
+	    if (NextMatch(textPtr, bestPtr, bestPtr->endObj, &lt, pos,
+		    &i, &end)) {
+		state = 0;
+	    } else {
+		end = length;
+		for (rulePtr = hlPtr->firstRulePtr, state = 1;
+			rulePtr != bestPtr; rulePtr = rulePtr->nextPtr) {
+		    state++;
+		}
+	    }
+	    pos = end;
+	    if (end <= start) {
+		continue;
+	    }
+	}
+
+	/*
+	 * Add the span, merging it with the previous one if that ends
+	 * right here and has the same tag.
+	 */
+
+	if ((numSpans > 0) && (hlPtr->spans[numSpans-1].end == start)
+		&& (hlPtr->spans[numSpans-1].tagPtr == bestPtr->tagPtr)) {
+	    hlPtr->spans[numSpans-1].end = end;
+	    continue;
+	}
+	if (numSpans >= hlPtr->spansSize) {
+	    hlPtr->spansSize = (hlPtr->spansSize == 0) ? 16
+		    : 2 * hlPtr->spansSize;
+	    spanPtr = (CkTextTagSpan *) ckalloc((unsigned)
+		    (hlPtr->spansSize * sizeof(CkTextTagSpan)));
+	    if (hlPtr->spans != NULL) {
+		memcpy((VOID *) spanPtr, (VOID *) hlPtr->spans,
+			numSpans * sizeof(CkTextTagSpan));
+		ckfree((char *) hlPtr->spans);
+	    }
+	    hlPtr->spans = spanPtr;
+	}
+	spanPtr = &hlPtr->spans[numSpans++];
+	spanPtr->start = start;
+	spanPtr->end = end;
+	spanPtr->tagPtr = bestPtr->tagPtr;
+    }
+    if (lt.textObj != NULL) {
+	Tcl_DecrRefCount(lt.textObj);
+    }
+    Tcl_DStringFree(&line);
+
+    if (CkBTreeRetagLine(textPtr->tree, linePtr, hlPtr->numTags,
+	    hlPtr->tagPtrs, numSpans, hlPtr->spans)) {
+	CkTextMakeByteIndex(textPtr->tree, lineIndex, 0, &index1);
+	CkTextMakeByteIndex(textPtr->tree, lineIndex + 1, 0, &index2);
+	CkTextChanged(textPtr, &index1, &index2);
+    }
+    return state;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * NextMatch --
+ *
+ *	Find the first match of a rule in a line at or after a
+ *	given position.
+ *
+ * Results:
+ *	Returns 1 and stores the offsets of the match at *startPtr
+ *	and *endPtr if there is a match, else returns 0.
+ *
+ * Side effects:
+ *	For regular expressions, a string object for the line is
+ *	created at ltPtr->textObj if there is none yet;  the caller
+ *	must release it.  The character position in *ltPtr is moved
+ *	to pos.
+ *
+ *--------------------------------------------------------------
+ */
+
+static int
+NextMatch(textPtr, rulePtr, patObj, ltPtr, pos, startPtr, endPtr)
+    CkText *textPtr;		/* Text widget. */
+    HighlightRule *rulePtr;	/* Rule to match. */
+    Tcl_Obj *patObj;		/* Pattern to match, or NULL for the
+				 * keywords of the rule. */
+    LineText *ltPtr;		/* Line to search. */
+    int pos;			/* Where to start looking. */
+    int *startPtr, *endPtr;	/* Return the match here. */
+{
+    Tcl_RegExp regexp;
+    Tcl_RegExpInfo info;
+    char word[64], *string = ltPtr->string;
+    int length = ltPtr->length, start, end;
+
+    if (patObj == NULL) {
+	/*
+	 * Look for the next word which is a keyword.  Don't start in
+	 * the middle of a word.
+	 */
+
+	start = pos;
+	if ((start > 0) && IS_WORD(string[start-1])) {
+	    while ((start < length) && IS_WORD(string[start])) {
+		start++;
+	    }
+	}
+	while (start < length) {
+	    while ((start < length) && !IS_WORD(string[start])) {
+		start++;
+	    }
+	    for (end = start; (end < length) && IS_WORD(string[end]); end++) {
+		/* Empty loop body. */
+	    }
+	    if ((end > start) && (end - start <= rulePtr->maxKeyword)
+		    && (end - start < (int) sizeof(word))) {
+		memcpy(word, string + start, (size_t) (end - start));
+		word[end - start] = '\0';
+		if (Tcl_FindHashEntry(&rulePtr->keywords, word) != NULL) {
+		    *startPtr = start;
+		    *endPtr = end;
+		    return 1;
+		}
+	    }
+	    start = end;
+	}
+	return 0;
+    }
+
+    if (pos > length) {
+	return 0;
+    }
+    regexp = Tcl_GetRegExpFromObj(textPtr->interp, patObj, TCL_REG_ADVANCED);
+    if (regexp == NULL) {
+	return 0;
+    }
+    if (ltPtr->textObj == NULL) {
+	ltPtr->textObj = Tcl_NewStringObj(string, length);
+	Tcl_IncrRefCount(ltPtr->textObj);
+    }
+    if (pos < ltPtr->bytePos) {
+	ltPtr->bytePos = ltPtr->charPos = 0;
+    }
+    ltPtr->charPos += Tcl_NumUtfChars(string + ltPtr->bytePos,
+	    pos - ltPtr->bytePos);
+    ltPtr->bytePos = pos;
+    if (Tcl_RegExpExecObj(textPtr->interp, regexp, ltPtr->textObj,
+	    ltPtr->charPos, 1, (pos > 0) ? TCL_REG_NOTBOL : 0) <= 0) {
+	return 0;
+    }
+    Tcl_RegExpGetInfo(regexp, &info);
+    start = Tcl_UtfAtIndex(string + pos, info.matches[0].start) - string;
+    end = Tcl_UtfAtIndex(string + start,
+	    info.matches[0].end - info.matches[0].start) - string;
+    *startPtr = start;
+    *endPtr = end;
+    return 1;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * ApplyChange --
+ *
+ *	Update the line states after the text was modified, once the
+ *	number of lines after the modification is known.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The states of lines after the modified range are moved to
+ *	their new line numbers, the modified lines are marked for
+ *	highlighting.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+ApplyChange(textPtr)
+    CkText *textPtr;		/* Text widget. */
+{
+    Highlighter *hlPtr = textPtr->hlPtr;
+    int numLines, delta, first, last, lastNew, i, *states;
+
+    if (!hlPtr->changePending) {
+	return;
+    }
+    hlPtr->changePending = 0;
+    numLines = CkBTreeNumLines(textPtr->tree);
+    delta = numLines - hlPtr->numLines;
+    first = hlPtr->changeFirst;
+    last = hlPtr->changeLast;
+    lastNew = last + delta;
+    if ((first < 0) || (lastNew < first)) {
+	ResetStates(textPtr);
+	return;
+    }
+    if (numLines > hlPtr->statesSize) {
+	hlPtr->statesSize = numLines + numLines / 4 + 16;
+	states = (int *) ckalloc((unsigned)
+		(hlPtr->statesSize * sizeof(int)));
+	memcpy((VOID *) states, (VOID *) hlPtr->states,
+		hlPtr->numLines * sizeof(int));
+	ckfree((char *) hlPtr->states);
+	hlPtr->states = states;
+    }
+    if ((delta != 0) && (last + 1 < hlPtr->numLines)) {
+	memmove((VOID *) (hlPtr->states + lastNew + 1),
+		(VOID *) (hlPtr->states + last + 1),
+		(hlPtr->numLines - last - 1) * sizeof(int));
+    }
+    for (i = first; (i <= lastNew) && (i < numLines); i++) {
+	hlPtr->states[i] = STATE_UNKNOWN;
+    }
+    hlPtr->numLines = numLines;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * ResetStates --
+ *
+ *	Mark all lines for highlighting, e.g. after the rules changed.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The state array is resized to the number of lines and filled,
+ *	and the whole text is scheduled for redisplay.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+ResetStates(textPtr)
+    CkText *textPtr;		/* Text widget. */
+{
+    Highlighter *hlPtr = textPtr->hlPtr;
+    int i;
+
+    hlPtr->changePending = 0;
+    hlPtr->numLines = CkBTreeNumLines(textPtr->tree);
+    if (hlPtr->numLines > hlPtr->statesSize) {
+	if (hlPtr->states != NULL) {
+	    ckfree((char *) hlPtr->states);
+	}
+	hlPtr->statesSize = hlPtr->numLines + hlPtr->numLines / 4 + 16;
+	hlPtr->states = (int *) ckalloc((unsigned)
+		(hlPtr->statesSize * sizeof(int)));
+    }
+    for (i = 0; i < hlPtr->numLines; i++) {
+	hlPtr->states[i] = STATE_UNKNOWN;
+    }
+    CkTextRelayoutWindow(textPtr);
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * CollectTags --
+ *
+ *	Rebuild the array of distinct tags used by the rules.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	hlPtr->tagPtrs and hlPtr->numTags are updated.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+CollectTags(hlPtr)
+    Highlighter *hlPtr;		/* Highlighter. */
+{
+    HighlightRule *rulePtr;
+    int i, numRules = 0;
+
+    for (rulePtr = hlPtr->firstRulePtr; rulePtr != NULL;
+	    rulePtr = rulePtr->nextPtr) {
+	numRules++;
+    }
+    if (hlPtr->tagPtrs != NULL) {
+	ckfree((char *) hlPtr->tagPtrs);
+    }
+    hlPtr->tagPtrs = (CkTextTag **) ckalloc((unsigned)
+	    (numRules * sizeof(CkTextTag *)));
+    hlPtr->numTags = 0;
+    for (rulePtr = hlPtr->firstRulePtr; rulePtr != NULL;
+	    rulePtr = rulePtr->nextPtr) {
+	for (i = 0; i < hlPtr->numTags; i++) {
+	    if (hlPtr->tagPtrs[i] == rulePtr->tagPtr) {
+		break;
+	    }
+	}
+	if (i >= hlPtr->numTags) {
+	    hlPtr->tagPtrs[hlPtr->numTags++] = rulePtr->tagPtr;
+	}
+    }
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * UntagAll --
+ *
+ *	Remove a tag from the whole text.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The tag is removed and the characters which had it are
+ *	redisplayed.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+UntagAll(textPtr, tagPtr)
+    CkText *textPtr;		/* Text widget. */
+    CkTextTag *tagPtr;		/* Tag to remove. */
+{
+    CkTextIndex first, last;
+
+    if (tagPtr->affectsDisplay) {
+	CkTextRedrawTag(textPtr, (CkTextIndex *) NULL,
+		(CkTextIndex *) NULL, tagPtr, 1);
+    }
+    CkBTreeTag(CkTextMakeByteIndex(textPtr->tree, 0, 0, &first),
+	    CkTextMakeByteIndex(textPtr->tree,
+		    CkBTreeNumLines(textPtr->tree), 0, &last),
+	    tagPtr, 0);
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * FreeRule --
+ *
+ *	Release the storage of a rule.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory is freed.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+FreeRule(rulePtr)
+    HighlightRule *rulePtr;	/* Rule to free. */
+{
+    if (rulePtr->type == RULE_KEYWORDS) {
+	Tcl_DeleteHashTable(&rulePtr->keywords);
+    }
+    if (rulePtr->patObj != NULL) {
+	Tcl_DecrRefCount(rulePtr->patObj);
+    }
+    if (rulePtr->endObj != NULL) {
+	Tcl_DecrRefCount(rulePtr->endObj);
+    }
+    if (rulePtr->spec != NULL) {
+	ckfree(rulePtr->spec);
+    }
+    ckfree((char *) rulePtr);
+}
+
+#else /* !CK_USE_UTF */
+
+/*
+ *--------------------------------------------------------------
+ *
+ * CkTextHighlightCmd et al. --
+ *
+ *	Syntax highlighting relies on the regular expression and
+ *	UTF-8 procedures of Tcl 8.1 or later.  With older versions
+ *	the "highlight" widget command reports an error, and text
+ *	widgets never have rules for the other procedures to apply.
+ *
+ *--------------------------------------------------------------
+ */
+
+int
+CkTextHighlightCmd(textPtr, interp, argc, argv)
+    register CkText *textPtr;	/* Information about text widget. */
+    Tcl_Interp *interp;		/* Current interpreter. */
+    int argc;			/* Number of arguments. */
+    char **argv;		/* Argument strings. */
+{
+    Tcl_AppendResult(interp, "highlight requires Tcl 8.1 or later",
+	    (char *) NULL);
+    return TCL_ERROR;
+}
+
+void
+CkTextFreeHighlighter(textPtr)
+    CkText *textPtr;		/* Text widget. */
+{
+}
+
+void
+CkTextHighlightChanged(textPtr, index1Ptr, index2Ptr)
+    CkText *textPtr;		/* Text widget. */
+    CkTextIndex *index1Ptr;	/* First character to be changed. */
+    CkTextIndex *index2Ptr;	/* Character just after the last one to
+				 * be changed. */
+{
+}
+
+void
+CkTextHighlightView(textPtr, numLines)
+    CkText *textPtr;		/* Text widget. */
+    int numLines;		/* Number of lines in view. */
+{
+}
+
+#endif /* CK_USE_UTF */
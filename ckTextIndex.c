@@ -22,12 +22,40 @@
 
 #define LAST_CHAR 1000000
 
+#if CK_USE_UTF
+/*
+ * Converting between character and byte offsets in a line means
+ * decoding the line from its start.  For long lines a table with the
+ * byte offset of every OFFSET_STEP'th character is kept in the
+ * charOffsets field of the line.  Element 0 of the table holds the
+ * number of characters in the line, element 1 the number of bytes,
+ * and element 2+k the byte offset of character k*OFFSET_STEP.  The
+ * table is built on demand for lines of at least OFFSET_MIN bytes and
+ * is freed whenever characters are inserted into or deleted from the
+ * line (see CkTextFreeCharOffsets).  Conversions shorter than
+ * OFFSET_MIN characters don't bother with the table.
+ */
+
+#define OFFSET_STEP 64
+#define OFFSET_MIN 128
+#endif
+
 /*
  * Forward declarations for procedures defined later in this file:
  */
 
+#if CK_USE_UTF
+static int		ByteToChar _ANSI_ARGS_((CkTextLine *linePtr,
+			    int *offsets, int byteIndex));
+static int		CharToByte _ANSI_ARGS_((CkTextLine *linePtr,
+			    int *offsets, int charIndex));
+#endif
 static char *		ForwBack _ANSI_ARGS_((char *string,
 			    CkTextIndex *indexPtr));
+#if CK_USE_UTF
+static int *		GetCharOffsets _ANSI_ARGS_((CkTextLine *linePtr,
+			    int *numCharsPtr, int *numBytesPtr));
+#endif
 static char *		StartEnd _ANSI_ARGS_(( char *string,
 			    CkTextIndex *indexPtr));
 
@@ -157,7 +185,7 @@ CkTextMakeIndex(tree, lineIndex, charIndex, indexPtr)
     int index;
 #if CK_USE_UTF
     char *p, *start, *end;
-    int offset;
+    int offset, *offsets, numChars, numBytes;
     Tcl_UniChar ch;
 #endif
 
@@ -174,6 +202,18 @@ CkTextMakeIndex(tree, lineIndex, charIndex, indexPtr)
 	indexPtr->linePtr = CkBTreeFindLine(tree, CkBTreeNumLines(tree));
 	charIndex = 0;
     }
+#if CK_USE_UTF
+    if (charIndex >= OFFSET_MIN) {
+	offsets = GetCharOffsets(indexPtr->linePtr, &numChars, &numBytes);
+	if (charIndex >= numChars) {
+	    indexPtr->charIndex = numBytes - 1;
+	} else {
+	    indexPtr->charIndex = CharToByte(indexPtr->linePtr, offsets,
+		    charIndex);
+	}
+	return indexPtr;
+    }
+#endif
 
     /*
      * Verify that the index is within the range of the line.
@@ -572,6 +612,15 @@ CkTextPrintIndex(indexPtr, string)
     int numBytes, charIndex;
 
     numBytes = indexPtr->charIndex;
+    if (numBytes >= OFFSET_MIN) {
+	int *offsets, numChars, lineBytes;
+
+	offsets = GetCharOffsets(indexPtr->linePtr, &numChars, &lineBytes);
+	charIndex = ByteToChar(indexPtr->linePtr, offsets, numBytes);
+	sprintf(string, "%d.%d", CkBTreeLineIndex(indexPtr->linePtr) + 1,
+		charIndex);
+	return;
+    }
     charIndex = 0;
     for (segPtr = indexPtr->linePtr->segPtr; ; segPtr = segPtr->nextPtr) {
 	if (numBytes <= segPtr->size) {
@@ -840,7 +889,7 @@ CkTextIndexForwChars(srcPtr, count, dstPtr)
     CkTextLine *linePtr;
     CkTextSegment *segPtr;
 #if CK_USE_UTF
-    int byteOffset;
+    int byteOffset, *offsets, numChars, numBytes, charIndex;
     char *p, *start, *end;
     Tcl_UniChar ch;
 #else
@@ -855,6 +904,30 @@ CkTextIndexForwChars(srcPtr, count, dstPtr)
     *dstPtr = *srcPtr;
 
 #if CK_USE_UTF
+    if (count >= OFFSET_MIN) {
+	/*
+	 * Long distance: skip whole lines by their character counts
+	 * and use the offset tables at both ends.
+	 */
+
+	linePtr = dstPtr->linePtr;
+	offsets = GetCharOffsets(linePtr, &numChars, &numBytes);
+	charIndex = ByteToChar(linePtr, offsets, dstPtr->charIndex);
+	while (count >= numChars - charIndex) {
+	    count -= numChars - charIndex;
+	    charIndex = 0;
+	    linePtr = CkBTreeNextLine(dstPtr->linePtr);
+	    if (linePtr == NULL) {
+		dstPtr->charIndex = numBytes - 1;
+		return;
+	    }
+	    dstPtr->linePtr = linePtr;
+	    offsets = GetCharOffsets(linePtr, &numChars, &numBytes);
+	}
+	dstPtr->charIndex = CharToByte(linePtr, offsets, charIndex + count);
+	return;
+    }
+
     segPtr = CkTextIndexToSeg(dstPtr, &byteOffset);
     while (1) {
 
@@ -1029,7 +1102,7 @@ CkTextIndexBackChars(srcPtr, count, dstPtr)
     int lineIndex;
 #if CK_USE_UTF
     CkTextSegment *oldPtr;
-    int segSize;
+    int segSize, *offsets, numChars, numBytes, charIndex;
     char *p, *start, *end;
 #endif
 
@@ -1040,6 +1113,32 @@ CkTextIndexBackChars(srcPtr, count, dstPtr)
 
     *dstPtr = *srcPtr;
 #if CK_USE_UTF
+    if (count >= OFFSET_MIN) {
+	/*
+	 * Long distance: see CkTextIndexForwChars.
+	 */
+
+	lineIndex = -1;
+	offsets = GetCharOffsets(dstPtr->linePtr, &numChars, &numBytes);
+	charIndex = ByteToChar(dstPtr->linePtr, offsets, dstPtr->charIndex);
+	while (count > charIndex) {
+	    count -= charIndex;
+	    if (lineIndex < 0) {
+		lineIndex = CkBTreeLineIndex(dstPtr->linePtr);
+	    }
+	    if (lineIndex == 0) {
+		dstPtr->charIndex = 0;
+		return;
+	    }
+	    lineIndex--;
+	    dstPtr->linePtr = CkBTreeFindLine(dstPtr->tree, lineIndex);
+	    offsets = GetCharOffsets(dstPtr->linePtr, &numChars, &numBytes);
+	    charIndex = numChars;
+	}
+	dstPtr->charIndex = CharToByte(dstPtr->linePtr, offsets,
+		charIndex - count);
+	return;
+    }
 
     /*
      * Find offset within seg that contains byteIndex.
@@ -1268,3 +1367,244 @@ StartEnd(string, indexPtr)
     done:
     return p;
 }
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CkTextFreeCharOffsets --
+ *
+ *	Discard the character offset table of a line.  Must be called
+ *	whenever characters are added to or removed from the line, and
+ *	before the line itself is freed.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory is freed; the table is rebuilt when next needed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+CkTextFreeCharOffsets(linePtr)
+    CkTextLine *linePtr;	/* Line whose characters change. */
+{
+    if (linePtr->charOffsets != NULL) {
+	ckfree((char *) linePtr->charOffsets);
+	linePtr->charOffsets = NULL;
+    }
+}
+
+#if CK_USE_UTF
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetCharOffsets --
+ *
+ *	Return the character offset table of a line, building it if
+ *	the line is long enough to deserve one.
+ *
+ * Results:
+ *	The number of characters and bytes in the line are stored at
+ *	*numCharsPtr and *numBytesPtr.  The return value is the table
+ *	(owned by the line), or NULL for lines shorter than OFFSET_MIN
+ *	bytes.
+ *
+ * Side effects:
+ *	The table may be allocated and stored in the line.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int *
+GetCharOffsets(linePtr, numCharsPtr, numBytesPtr)
+    CkTextLine *linePtr;	/* Line to look at. */
+    int *numCharsPtr;		/* Store number of characters here. */
+    int *numBytesPtr;		/* Store number of bytes here. */
+{
+    CkTextSegment *segPtr;
+    int *offsets, numChars, numBytes, i;
+    char *p, *end;
+    Tcl_UniChar ch;
+
+    offsets = linePtr->charOffsets;
+    if (offsets != NULL) {
+	*numCharsPtr = offsets[0];
+	*numBytesPtr = offsets[1];
+	return offsets;
+    }
+    numBytes = 0;
+    for (segPtr = linePtr->segPtr; segPtr != NULL; segPtr = segPtr->nextPtr) {
+	numBytes += segPtr->size;
+    }
+    *numBytesPtr = numBytes;
+    if (numBytes < OFFSET_MIN) {
+	numChars = 0;
+	for (segPtr = linePtr->segPtr; segPtr != NULL;
+		segPtr = segPtr->nextPtr) {
+	    if (segPtr->typePtr == &ckTextCharType) {
+		numChars += Tcl_NumUtfChars(segPtr->body.chars, segPtr->size);
+	    } else {
+		numChars += segPtr->size;
+	    }
+	}
+	*numCharsPtr = numChars;
+	return NULL;
+    }
+
+    /*
+     * There can't be more characters than bytes, which bounds the
+     * size of the table.
+     */
+
+    offsets = (int *) ckalloc((unsigned)
+	    (numBytes / OFFSET_STEP + 3) * sizeof(int));
+    numChars = 0;
+    numBytes = 0;
+    for (segPtr = linePtr->segPtr; segPtr != NULL; segPtr = segPtr->nextPtr) {
+	if (segPtr->typePtr == &ckTextCharType) {
+	    p = segPtr->body.chars;
+	    end = p + segPtr->size;
+	    while (p < end) {
+		if (numChars % OFFSET_STEP == 0) {
+		    offsets[2 + numChars / OFFSET_STEP] =
+			numBytes + (p - segPtr->body.chars);
+		}
+		numChars++;
+		if ((unsigned char) *p < 0x80) {
+		    p++;
+		} else {
+		    p += Tcl_UtfToUniChar(p, &ch);
+		}
+	    }
+	} else {
+	    for (i = 0; i < segPtr->size; i++) {
+		if (numChars % OFFSET_STEP == 0) {
+		    offsets[2 + numChars / OFFSET_STEP] = numBytes + i;
+		}
+		numChars++;
+	    }
+	}
+	numBytes += segPtr->size;
+    }
+    offsets[0] = numChars;
+    offsets[1] = numBytes;
+    linePtr->charOffsets = offsets;
+    *numCharsPtr = numChars;
+    return offsets;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CharToByte, ByteToChar --
+ *
+ *	Convert between character and byte offsets in a line, starting
+ *	from the nearest entry of the line's offset table, or from the
+ *	start of the line if offsets is NULL.
+ *
+ * Results:
+ *	CharToByte returns the byte offset of character charIndex,
+ *	which must exist in the line.  ByteToChar returns the number of
+ *	characters before byte offset byteIndex.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+CharToByte(linePtr, offsets, charIndex)
+    CkTextLine *linePtr;	/* Line to look at. */
+    int *offsets;		/* Offset table of line, or NULL. */
+    int charIndex;		/* Character offset to convert. */
+{
+    CkTextSegment *segPtr;
+    int byteIndex, index, segEnd, n;
+    char *p, *end;
+    Tcl_UniChar ch;
+
+    byteIndex = 0;
+    if (offsets != NULL) {
+	byteIndex = offsets[2 + charIndex / OFFSET_STEP];
+	charIndex %= OFFSET_STEP;
+    }
+    index = 0;
+    for (segPtr = linePtr->segPtr; (charIndex > 0) && (segPtr != NULL);
+	    segPtr = segPtr->nextPtr) {
+	segEnd = index + segPtr->size;
+	if (segEnd > byteIndex) {
+	    if (segPtr->typePtr == &ckTextCharType) {
+		p = segPtr->body.chars + (byteIndex - index);
+		end = segPtr->body.chars + segPtr->size;
+		while ((charIndex > 0) && (p < end)) {
+		    p += Tcl_UtfToUniChar(p, &ch);
+		    charIndex--;
+		}
+		byteIndex = index + (p - segPtr->body.chars);
+	    } else {
+		n = segEnd - byteIndex;
+		if (n > charIndex) {
+		    n = charIndex;
+		}
+		byteIndex += n;
+		charIndex -= n;
+	    }
+	}
+	index = segEnd;
+    }
+    return byteIndex;
+}
+
+static int
+ByteToChar(linePtr, offsets, byteIndex)
+    CkTextLine *linePtr;	/* Line to look at. */
+    int *offsets;		/* Offset table of line, or NULL. */
+    int byteIndex;		/* Byte offset to convert. */
+{
+    CkTextSegment *segPtr;
+    int charIndex, start, index, segEnd, from, low, high, mid;
+
+    charIndex = 0;
+    start = 0;
+    if (offsets != NULL) {
+	/*
+	 * Binary search for the last table entry at or before byteIndex.
+	 */
+
+	low = 0;
+	high = (offsets[0] - 1) / OFFSET_STEP;
+	while (low < high) {
+	    mid = (low + high + 1) / 2;
+	    if (offsets[2 + mid] <= byteIndex) {
+		low = mid;
+	    } else {
+		high = mid - 1;
+	    }
+	}
+	charIndex = low * OFFSET_STEP;
+	start = offsets[2 + low];
+    }
+    index = 0;
+    for (segPtr = linePtr->segPtr; (segPtr != NULL) && (index < byteIndex);
+	    segPtr = segPtr->nextPtr) {
+	segEnd = index + segPtr->size;
+	if (segEnd > start) {
+	    from = (start > index) ? start : index;
+	    if (segEnd > byteIndex) {
+		segEnd = byteIndex;
+	    }
+	    if (segPtr->typePtr == &ckTextCharType) {
+		charIndex += Tcl_NumUtfChars(segPtr->body.chars +
+			(from - index), segEnd - from);
+	    } else {
+		charIndex += segEnd - from;
+	    }
+	}
+	index += segPtr->size;
+    }
+    return charIndex;
+}
+#endif
@@ -112,6 +112,11 @@ CkTextTagCmd(textPtr, interp, argc, argv)
 	    return TCL_ERROR;
 	}
 	tagPtr = CkTextCreateTag(textPtr, argv[3]);
+	if (tagPtr->highlightRules > 0) {
+	    Tcl_AppendResult(interp, "tag \"", argv[3],
+		    "\" is used by highlighting rules", (char *) NULL);
+	    return TCL_ERROR;
+	}
 	for (i = 4; i < argc; i += 2) {
 	    if (CkTextGetIndex(interp, textPtr, argv[i], &index1) != TCL_OK) {
 		return TCL_ERROR;
@@ -231,6 +236,7 @@ CkTextTagCmd(textPtr, interp, argc, argv)
 	} else {
 	    int result;
 
+	    CkTextTagsChanged(textPtr);
 	    result = Ck_ConfigureWidget(interp, textPtr->winPtr,
                     tagConfigSpecs, argc-4, argv+4, (char *) tagPtr, 0);
 	    /*
@@ -321,6 +327,11 @@ CkTextTagCmd(textPtr, interp, argc, argv)
 	    if (tagPtr == textPtr->selTagPtr) {
 		continue;
 	    }
+	    if (tagPtr->highlightRules > 0) {
+		Tcl_AppendResult(interp, "tag \"", argv[i],
+			"\" is used by highlighting rules", (char *) NULL);
+		return TCL_ERROR;
+	    }
 	    if (tagPtr->affectsDisplay) {
 		CkTextRedrawTag(textPtr, (CkTextIndex *) NULL,
 			(CkTextIndex *) NULL, tagPtr, 1);
@@ -633,6 +644,7 @@ CkTextCreateTag(textPtr, tagName)
     tagPtr->tabArrayPtr = NULL;
     tagPtr->wrapMode = NULL;
     tagPtr->affectsDisplay = 0;
+    tagPtr->highlightRules = 0;
     textPtr->numTags++;
     Tcl_SetHashValue(hPtr, tagPtr);
     return tagPtr;
@@ -835,6 +847,12 @@ ChangeTagPriority(textPtr, tagPtr, prio)
     Tcl_HashEntry *hPtr;
     Tcl_HashSearch search;
 
+    /*
+     * Styles remembered for sets of tags depend on the priorities,
+     * and on the tag still existing if it is being deleted.
+     */
+
+    CkTextTagsChanged(textPtr);
     if (prio < 0) {
 	prio = 0;
     }
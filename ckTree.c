@@ -1125,11 +1125,13 @@ DisplayTree(clientData)
     long rarrow;
     long ulcorner, urcorner, llcorner, lrcorner, lvline, lhline, ltee, ttee;
     WINDOW *window;
+    double t0;
 
     treePtr->flags &= ~REDRAW_PENDING;
     if ((treePtr->winPtr == NULL) || !(winPtr->flags & CK_MAPPED)) {
 	return;
     }
+    t0 = CkProfileStart(winPtr->mainPtr);
     if (treePtr->flags & UPDATE_V_SCROLLBAR) {
         TreeUpdateVScrollbar(treePtr);
     }
@@ -1138,6 +1140,7 @@ DisplayTree(clientData)
     if (treePtr->firstChild == NULL) {
 	Ck_ClearToBot(winPtr, 0, 0);
 	Ck_EventuallyRefresh(winPtr);
+	CkProfileWindow(winPtr, t0);
 	return;
     }
 
@@ -1265,6 +1268,7 @@ DisplayTree(clientData)
     if (y < winPtr->height)
 	Ck_ClearToBot(winPtr, 0, y);
     Ck_EventuallyRefresh(winPtr);
+    CkProfileWindow(winPtr, t0);
 }
 
 /*
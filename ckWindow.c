@@ -17,11 +17,30 @@
 #endif
 
 /*
- * Main information.
+ * Main information. This is the head of the list of all main windows,
+ * one per terminal; see "curses newterm".
  */
 
 CkMainInfo *ckMainInfo = NULL;
 
+/*
+ * Main information whose curses screen is the current one.
+ */
+
+static CkMainInfo *curTermPtr = NULL;
+
+/*
+ * For incremental screen updates DoRefresh keeps one of the following
+ * structures per screen line. It records the leftmost and rightmost
+ * (exclusive) column which has been damaged on that line by windows
+ * refreshed so far. Windows further up in the stacking order overlapping
+ * a damaged span must be touched in order to stay on top.
+ */
+
+typedef struct CkDamage {
+    int x1, x2;			/* Damaged columns, empty if x1 >= x2. */
+} CkDamage;
+
 #ifdef __WIN32__
 
 /*
@@ -137,17 +156,25 @@ CkCmd commands[] = {
  * Static procedures of this module.
  */
 
+static CkWindow *CreateMainWindow _ANSI_ARGS_((Tcl_Interp *interp,
+			char *className, char *termType, FILE *inFile,
+			FILE *outFile, ClientData headlessData));
+static void	TerminalDeleted _ANSI_ARGS_((ClientData clientData,
+			Tcl_Interp *interp));
 static void	UnlinkWindow _ANSI_ARGS_((CkWindow *winPtr));
 static void	UnlinkToplevel _ANSI_ARGS_((CkWindow *winPtr));
 static void     ChangeToplevelFocus _ANSI_ARGS_((CkWindow *winPtr));
 static void	DoRefresh _ANSI_ARGS_((ClientData clientData));
 static void	RefreshToplevels _ANSI_ARGS_((CkWindow *winPtr));
 static void	RefreshThem _ANSI_ARGS_((CkWindow *winPtr));
+static void	RefreshWindow _ANSI_ARGS_((CkWindow *winPtr));
+static void	EventuallyRefreshAll _ANSI_ARGS_((CkWindow *winPtr));
 static void     UpdateHWCursor _ANSI_ARGS_((CkMainInfo *mainPtr));
 static CkWindow *GetWindowXY _ANSI_ARGS_((CkWindow *winPtr, int *xPtr,
 			int *yPtr));
 static int	DeadAppCmd _ANSI_ARGS_((ClientData clientData,
 			Tcl_Interp *interp, int argc, char **argv));
+static void	FreeRedirInfo _ANSI_ARGS_((ClientData clientData));
 static int      ExecCmd _ANSI_ARGS_((ClientData clientData,
 			Tcl_Interp *interp, int argc, char **argv));
 static int      PutsCmd _ANSI_ARGS_((ClientData clientData,
@@ -235,6 +262,8 @@ NewWindow(parentPtr)
     winPtr->bg = COLOR_BLACK;
     winPtr->attr = A_NORMAL;
     winPtr->flags = 0;
+    winPtr->damageX1 = winPtr->damageY1 = 0;
+    winPtr->damageX2 = winPtr->damageY2 = 0;
 
     return winPtr;
 }
@@ -363,13 +392,77 @@ Ck_MainWindow(interp)
     Tcl_Interp *interp;		/* Interpreter that embodies application,
     				 * also used for error reporting. */
 {
-    if (ckMainInfo == NULL || ckMainInfo->interp != interp) {
-      if (interp != NULL) {
-        Tcl_SetResult(interp, "no main window for application.", TCL_STATIC);
-      }
-      return NULL;
+    CkMainInfo *mainPtr;
+
+    for (mainPtr = ckMainInfo; mainPtr != NULL; mainPtr = mainPtr->nextPtr) {
+	if (mainPtr->interp == interp) {
+	    return mainPtr->winPtr;
+	}
+    }
+    if (interp != NULL) {
+	Tcl_SetResult(interp, "no main window for application.", TCL_STATIC);
+    }
+    return NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CkLookupMainInfo --
+ *
+ *	Check that a main information structure is still alive.
+ *
+ * Results:
+ *	Returns mainPtr if it is in the list of main windows,
+ *	otherwise NULL.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+CkMainInfo *
+CkLookupMainInfo(mainPtr)
+    CkMainInfo *mainPtr;
+{
+    CkMainInfo *infoPtr;
+
+    for (infoPtr = ckMainInfo; infoPtr != NULL; infoPtr = infoPtr->nextPtr) {
+	if (infoPtr == mainPtr) {
+	    return infoPtr;
+	}
+    }
+    return NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CkSetTerm --
+ *
+ *	Make the curses screen of the given main window the current
+ *	one. Must be called before curses procedures which implicitly
+ *	refer to the current terminal (newwin, doupdate, getch, etc.)
+ *	when more than one terminal is served by the process.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Curses' current screen may be switched.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+CkSetTerm(mainPtr)
+    CkMainInfo *mainPtr;
+{
+    if (mainPtr != curTermPtr && mainPtr->screen != NULL) {
+	set_term(mainPtr->screen);
+	curTermPtr = mainPtr;
     }
-    return ckMainInfo->winPtr;
 }
 
 /*
@@ -377,7 +470,8 @@ Ck_MainWindow(interp)
  *
  * Ck_CreateMainWindow --
  *
- *	Make the main window.
+ *	Make the main window on the terminal connected to standard
+ *	input and output.
  *
  * Results:
  *	The return value is a token for the new window, or NULL if
@@ -395,6 +489,42 @@ CkWindow *
 Ck_CreateMainWindow(interp, className)
     Tcl_Interp *interp;		/* Interpreter to use for error reporting. */
     char *className;		/* Class name of the new main window. */
+{
+    return CreateMainWindow(interp, className, NULL, NULL, NULL, NULL);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CreateMainWindow --
+ *
+ *	Make a main window, either on standard input and output
+ *	(inFile is NULL) or on the terminal given by inFile/outFile.
+ *	If headlessData isn't NULL, inFile/outFile are the streams
+ *	of a headless terminal opened by CkHeadlessOpen, which
+ *	takes the place of standard input and output.
+ *
+ * Results:
+ *	The return value is a token for the new window, or NULL if
+ *	an error prevented the new window from being created.  If
+ *	NULL is returned, an error message will be left in
+ *	interp->result.
+ *
+ * Side effects:
+ *	A new window structure is allocated locally. A new curses
+ *	screen is created and becomes the current one.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static CkWindow *
+CreateMainWindow(interp, className, termType, inFile, outFile, headlessData)
+    Tcl_Interp *interp;		/* Interpreter to use for error reporting. */
+    char *className;		/* Class name of the new main window. */
+    char *termType;		/* Terminal type or NULL for $TERM. */
+    FILE *inFile, *outFile;	/* Terminal streams, NULL for standard
+				 * input and output. */
+    ClientData headlessData;	/* Token from CkHeadlessOpen or NULL. */
 {
     int dummy;
     Tcl_HashEntry *hPtr;
@@ -408,6 +538,9 @@ Ck_CreateMainWindow(interp, className)
     Ck_SignalProc sigproc;
 #endif
 #endif
+#ifdef SIGWINCH
+    Ck_SignalProc winchproc = NULL;
+#endif
 #ifdef NCURSES_MOUSE_VERSION
     MEVENT mEvent;
 #endif
@@ -415,10 +548,15 @@ Ck_CreateMainWindow(interp, className)
     int isxterm = 0;
 
     /*
-     * For now, only one main window may exists for the application.
+     * Only one main window may exist on standard input and output.
      */
-    if (ckMainInfo != NULL)
-        return NULL;
+    if (inFile == NULL || headlessData != NULL) {
+	for (mainPtr = ckMainInfo; mainPtr != NULL;
+	     mainPtr = mainPtr->nextPtr) {
+	    if (!(mainPtr->flags & CK_NEWTERM))
+		return NULL;
+	}
+    }
 
     /*
      * Create the basic CkWindow structure.
@@ -434,6 +572,10 @@ Ck_CreateMainWindow(interp, className)
     mainPtr = (CkMainInfo *) ckalloc(sizeof(CkMainInfo));
     mainPtr->winPtr = winPtr;
     mainPtr->interp = interp;
+    mainPtr->screen = NULL;
+    mainPtr->termIn = (inFile != NULL) ? inFile : stdin;
+    mainPtr->termOut = (outFile != NULL) ? outFile : stdout;
+    mainPtr->termFd = fileno(mainPtr->termIn);
     Tcl_InitHashTable(&mainPtr->nameTable, TCL_STRING_KEYS);
     Tcl_InitHashTable(&mainPtr->winTable, TCL_ONE_WORD_KEYS);
     mainPtr->topLevPtr = NULL;
@@ -444,7 +586,20 @@ Ck_CreateMainWindow(interp, className)
     mainPtr->refreshDelay = 0;
     mainPtr->lastRefresh = 0;
     mainPtr->refreshTimer = NULL;
-    mainPtr->flags = 0;
+    mainPtr->damagePtr = NULL;
+    memset((char *) &mainPtr->stats, 0, sizeof (Ck_Stats));
+    mainPtr->mouseData = NULL;
+    mainPtr->barcodeData = NULL;
+    mainPtr->pasteData = NULL;
+    mainPtr->inputQueue = NULL;
+    mainPtr->profileData = NULL;
+    mainPtr->headlessData = headlessData;
+    mainPtr->pairData = NULL;
+    mainPtr->inputErrors = 0;
+    mainPtr->buttonPressed = 0;
+    mainPtr->flags = CK_REFRESH_ALL | ((headlessData != NULL) ? CK_HEADLESS :
+	(inFile != NULL) ? CK_NEWTERM : 0);
+    mainPtr->nextPtr = ckMainInfo;
     ckMainInfo = mainPtr;
     winPtr->mainPtr = mainPtr;
     winPtr->nameUid = Ck_GetUid(".");
@@ -510,19 +665,60 @@ Ck_CreateMainWindow(interp, className)
     sigproc = (Ck_SignalProc) signal(SIGTSTP, SIG_IGN);
 #endif
 #endif
+#ifdef SIGWINCH
+    /*
+     * Curses mustn't catch SIGWINCH for a headless terminal, since
+     * it would take the size of the real terminal, if any.
+     */
+    if (headlessData != NULL)
+	winchproc = (Ck_SignalProc) signal(SIGWINCH, SIG_IGN);
+#endif
 
 #ifndef __WIN32__
     /*
      * Fix for problem when X server left linux console
      * in non-blocking mode
      */
-    fcntl(0, F_SETFL, fcntl(0, F_GETFL) & (~O_NDELAY));
-#endif
+    fcntl(mainPtr->termFd, F_SETFL,
+	  fcntl(mainPtr->termFd, F_GETFL) & (~O_NDELAY));
 
+    mainPtr->screen = newterm(termType, mainPtr->termOut, mainPtr->termIn);
+#ifdef SIGWINCH
+    if (headlessData != NULL)
+	signal(SIGWINCH, winchproc);
+#endif
+    if (mainPtr->screen == NULL) {
+#else
     if (initscr() == (WINDOW *) ERR) {
+#endif
+	Tcl_AppendResult(interp, "can't initialize terminal of type \"",
+	    (termType != NULL) ? termType : "", "\"", (char *) NULL);
+	ckMainInfo = mainPtr->nextPtr;
+	Tcl_DeleteHashTable(&mainPtr->nameTable);
+	Tcl_DeleteHashTable(&mainPtr->winTable);
+	Ck_DeleteBindingTable(mainPtr->bindingTable);
+#if CK_USE_UTF
+	if (mainPtr->isoEncoding != NULL) {
+	    Tcl_FreeEncoding(mainPtr->isoEncoding);
+	}
+#endif
+	ckfree((char *) mainPtr);
     	ckfree((char *) winPtr);
+#ifdef SIGTSTP
+#ifdef HAVE_SIGACTION
+	sigaction(SIGTSTP, &oldsig, NULL);
+#else
+	signal(SIGTSTP, sigproc);
+#endif
+#endif
     	return NULL;
     }
+#ifndef __WIN32__
+    curTermPtr = mainPtr;
+    def_prog_mode();
+#endif
+    if (headlessData != NULL)
+	CkHeadlessSetup(mainPtr);
 #ifdef SIGTSTP
     /* This is essential for ncurses-1.9.4 */
 #ifdef HAVE_SIGACTION
@@ -541,6 +737,8 @@ Ck_CreateMainWindow(interp, className)
     nonl();
     mainPtr->maxWidth = COLS;
     mainPtr->maxHeight = LINES;
+    mainPtr->damagePtr = (CkDamage *)
+	ckalloc(sizeof (CkDamage) * mainPtr->maxHeight);
     winPtr->width = mainPtr->maxWidth;
     winPtr->height = mainPtr->maxHeight;
     winPtr->window = newwin(winPtr->height, winPtr->width, 0, 0);
@@ -563,7 +761,9 @@ Ck_CreateMainWindow(interp, className)
     mainPtr->flags |= CK_HAS_MOUSE;
     term = "win32";
 #else
-    term = getenv("TERM");
+    term = (termType != NULL) ? termType : getenv("TERM");
+    if (term == NULL)
+	term = "";
     isxterm = strncmp(term, "xterm", 5) == 0 ||
 	strncmp(term, "rxvt", 4) == 0 ||
 	strncmp(term, "kterm", 5) == 0 ||
@@ -571,9 +771,9 @@ Ck_CreateMainWindow(interp, className)
 	(term[0] != '\0' && strncmp(term + 1, "xterm", 5) == 0);
     if (!(mainPtr->flags & CK_HAS_MOUSE) && isxterm) {
 	mainPtr->flags |= CK_HAS_MOUSE | CK_MOUSE_XTERM;
-	fflush(stdout);
-	fputs("\033[?1000h", stdout);
-	fflush(stdout);
+	fflush(mainPtr->termOut);
+	fputs("\033[?1000h", mainPtr->termOut);
+	fflush(mainPtr->termOut);
     }
 #endif	/* __WIN32__ */
 
@@ -583,14 +783,15 @@ Ck_CreateMainWindow(interp, className)
      * therefore by setting the following environment variable
      * usage of GPM can be turned on.
      */
-    if (!isxterm && (mainPtr->flags & CK_HAS_MOUSE)) {
+    if (!isxterm && (mainPtr->flags & (CK_HAS_MOUSE | CK_NEWTERM)) ==
+	CK_HAS_MOUSE) {
 	char *forcegpm = getenv("CK_USE_GPM");
 
 	if (forcegpm && strchr("YyTt123456789", forcegpm[0])) {
 	    mainPtr->flags &= ~CK_HAS_MOUSE;
 	}
     }
-    if (!isxterm && !(mainPtr->flags & CK_HAS_MOUSE)) {
+    if (!isxterm && !(mainPtr->flags & (CK_HAS_MOUSE | CK_NEWTERM))) {
 	int fd;
 	Gpm_Connect conn;
 #if (TCL_MAJOR_VERSION == 7) && (TCL_MINOR_VERSION <= 4)
@@ -637,13 +838,15 @@ Ck_CreateMainWindow(interp, className)
     InputSetup(&inputInfo);
 #else
 #if (TCL_MAJOR_VERSION >= 8)
-    Tcl_CreateFileHandler(0,
+    Tcl_CreateFileHandler(mainPtr->termFd,
 	TCL_READABLE, CkHandleInput, (ClientData) mainPtr);
 #else
 #if (TCL_MAJOR_VERSION == 7) && (TCL_MINOR_VERSION <= 4)
-    Tk_CreateFileHandler2(0, CkHandleInput, (ClientData) mainPtr);
+    Tk_CreateFileHandler2(mainPtr->termFd, CkHandleInput,
+	(ClientData) mainPtr);
 #else
-    Tcl_CreateFileHandler(Tcl_GetFile((ClientData) 0, TCL_UNIX_FD),
+    Tcl_CreateFileHandler(Tcl_GetFile((ClientData) mainPtr->termFd,
+			  TCL_UNIX_FD),
 			  TCL_READABLE, CkHandleInput, (ClientData) mainPtr);
 #endif
 #endif
@@ -698,7 +901,7 @@ Ck_CreateMainWindow(interp, className)
 	Tcl_DStringFree(&cmdName);
 #endif
         Tcl_CreateCommand(interp, cmdPtr->name, cmdPtr->cmdProc,
-            (ClientData) redirInfo, (Tcl_CmdDeleteProc *) free);
+            (ClientData) redirInfo, FreeRedirInfo);
     }
 
     /*
@@ -755,10 +958,46 @@ Ck_CreateMainWindow(interp, className)
 int
 Ck_Init(interp)
     Tcl_Interp *interp;         /* Interpreter to initialize. */
+{
+    return Ck_InitTerminal(interp, NULL, NULL);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Ck_InitTerminal --
+ *
+ *      Like Ck_Init, but the main window of the new Ck application
+ *      is created on the terminal device given by name instead of
+ *      standard input and output. Each interpreter initialized this
+ *      way drives its own terminal; when the interpreter is deleted
+ *      the terminal is closed.  If device is NULL and the environment
+ *      variable CK_HEADLESS is set, a headless terminal of the size
+ *      given by the variable replaces standard input and output.
+ *
+ * Results:
+ *      Returns a standard Tcl completion code and sets interp->result
+ *      if there is an error.
+ *
+ * Side effects:
+ *      The terminal device is opened. Depends on what's in the
+ *      ck.tcl script.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+Ck_InitTerminal(interp, device, termType)
+    Tcl_Interp *interp;         /* Interpreter to initialize. */
+    char *device;		/* Terminal device or NULL for standard
+				 * input and output. */
+    char *termType;		/* Terminal type or NULL for $TERM. */
 {
     CkWindow *mainWindow;
     char *p, *name, *class;
     int code;
+    FILE *inFile = NULL, *outFile = NULL;
+    ClientData headlessData = NULL;
     static char initCmd[] =
 #if (TCL_MAJOR_VERSION >= 8)
 "proc init {} {\n\
@@ -808,8 +1047,52 @@ init";
     class = (char *) ckalloc((unsigned) (strlen(name) + 1));
     strcpy(class, name);
     class[0] = toupper((unsigned char) class[0]);
-    mainWindow = Ck_CreateMainWindow(interp, class);
+    if (device != NULL) {
+#ifdef __WIN32__
+	ckfree(class);
+	Tcl_AppendResult(interp, "can't open terminal \"", device,
+	    "\": not supported on this platform", (char *) NULL);
+	return TCL_ERROR;
+#else
+	int fd = open(device, O_RDWR | O_NOCTTY, 0);
+
+	if (fd >= 0) {
+	    inFile = fdopen(fd, "r");
+	    outFile = fdopen(dup(fd), "w");
+	}
+	if (inFile == NULL || outFile == NULL) {
+	    Tcl_AppendResult(interp, "couldn't open terminal \"", device,
+		"\": ", Tcl_PosixError(interp), (char *) NULL);
+	    if (inFile != NULL) {
+		fclose(inFile);
+	    } else if (fd >= 0) {
+		close(fd);
+	    }
+	    ckfree(class);
+	    return TCL_ERROR;
+	}
+#endif
+    } else if ((p = getenv("CK_HEADLESS")) != NULL) {
+	headlessData = CkHeadlessOpen(interp, p, &inFile, &outFile);
+	if (headlessData == NULL) {
+	    ckfree(class);
+	    return TCL_ERROR;
+	}
+	if (termType == NULL)
+	    termType = "xterm";
+    }
+    mainWindow = CreateMainWindow(interp, class, termType, inFile, outFile,
+	headlessData);
     ckfree(class);
+    if (inFile != NULL && mainWindow == NULL) {
+	fclose(inFile);
+	fclose(outFile);
+	CkFreeHeadless(headlessData);
+	return TCL_ERROR;
+    }
+    if (device != NULL) {
+	Tcl_CallWhenDeleted(interp, TerminalDeleted, (ClientData) NULL);
+    }
 
 #if !((TCL_MAJOR_VERSION == 7) && (TCL_MINOR_VERSION <= 4))
     if (Tcl_PkgRequire(interp, "Tcl", TCL_VERSION, 0) == NULL)
@@ -820,6 +1103,39 @@ init";
 #endif
     return Tcl_Eval(interp, initCmd);
 }
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TerminalDeleted --
+ *
+ *      Called when an interpreter created by Ck_InitTerminal is
+ *      deleted in order to release its terminal.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      The main window of the interpreter, if still alive, is
+ *      destroyed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+TerminalDeleted(clientData, interp)
+    ClientData clientData;	/* Not used. */
+    Tcl_Interp *interp;		/* Interpreter being deleted. */
+{
+    CkMainInfo *mainPtr;
+
+    for (mainPtr = ckMainInfo; mainPtr != NULL; mainPtr = mainPtr->nextPtr) {
+	if (mainPtr->interp == interp) {
+	    Ck_DestroyWindow(mainPtr->winPtr);
+	    break;
+	}
+    }
+}
 
 /*
  *--------------------------------------------------------------
@@ -1041,6 +1357,7 @@ Ck_DestroyWindow(winPtr)
 	Ck_HandleEvent(winPtr->mainPtr, (CkEvent *) &event);
     }
     if (winPtr->window != NULL) {
+	CkSetTerm(winPtr->mainPtr);
 	delwin(winPtr->window);
 	winPtr->window = NULL;
     }
@@ -1065,7 +1382,9 @@ Ck_DestroyWindow(winPtr)
 		winPtr->pathName));
 	if (mainPtr->winPtr == winPtr) {
 	    CkCmd *cmdPtr;
+	    CkMainInfo **infoPtrPtr;
 
+	    CkSetTerm(mainPtr);
 	    for (cmdPtr = commands; cmdPtr->name != NULL; cmdPtr++)
 		if (cmdPtr->cmdProc != Ck_ExitCmd)
 		    Tcl_CreateCommand(mainPtr->interp, cmdPtr->name,
@@ -1079,14 +1398,16 @@ Ck_DestroyWindow(winPtr)
 	    mainPtr->flags &= (getmouse(&mEvent) != ERR) ? ~CK_HAS_MOUSE : ~0;
 #endif	/* NCURSES_MOUSE_VERSION */
 
+	    CkFreePaste(mainPtr);
+
 	    if (mainPtr->flags & CK_HAS_MOUSE) {
 #ifdef __WIN32__
 		mouse_set(0);
 #endif
 		if (mainPtr->flags & CK_MOUSE_XTERM) {
-		    fflush(stdout);
-		    fputs("\033[?1000l", stdout);
-		    fflush(stdout);
+		    fflush(mainPtr->termOut);
+		    fputs("\033[?1000l", mainPtr->termOut);
+		    fflush(mainPtr->termOut);
 		} else {
 #ifdef HAVE_GPM
 #if (TCL_MAJOR_VERSION >= 8)
@@ -1111,13 +1432,51 @@ Ck_DestroyWindow(winPtr)
 		wrefresh(stdscr);
 	    }
 	    endwin();
+	    Tk_CancelIdleCall(DoRefresh, (ClientData) mainPtr);
+	    if (mainPtr->flags & CK_REFRESH_TIMER) {
+		Tk_DeleteTimerHandler(mainPtr->refreshTimer);
+	    }
+	    if (mainPtr->flags & (CK_NEWTERM | CK_HEADLESS)) {
+#if (TCL_MAJOR_VERSION >= 8)
+		Tcl_DeleteFileHandler(mainPtr->termFd);
+		Tcl_DeleteExitHandler(CkEvtExit, (ClientData) mainPtr);
+		CkEvtExit((ClientData) mainPtr);
+#else
+#if (TCL_MAJOR_VERSION == 7) && (TCL_MINOR_VERSION <= 4)
+		Tk_DeleteFileHandler(mainPtr->termFd);
+#else
+		Tcl_DeleteFileHandler(Tcl_GetFile((ClientData)
+		    mainPtr->termFd, TCL_UNIX_FD));
+#endif
+#endif
+		delscreen(mainPtr->screen);
+		fclose(mainPtr->termIn);
+		fclose(mainPtr->termOut);
+		CkFreeHeadless(mainPtr->headlessData);
+	    }
+	    if (curTermPtr == mainPtr) {
+		curTermPtr = NULL;
+	    }
 #if CK_USE_UTF
 	    if (mainPtr->isoEncoding != NULL) {
 		Tcl_FreeEncoding(mainPtr->isoEncoding);
 	    }
 #endif
+	    if (mainPtr->damagePtr != NULL) {
+		ckfree((char *) mainPtr->damagePtr);
+	    }
+	    CkFreePairs(mainPtr);
+	    CkFreeBarcode(mainPtr);
+	    CkFreeInputQueue(mainPtr);
+	    CkFreeProfile(mainPtr);
+	    for (infoPtrPtr = &ckMainInfo; *infoPtrPtr != NULL;
+		 infoPtrPtr = &(*infoPtrPtr)->nextPtr) {
+		if (*infoPtrPtr == mainPtr) {
+		    *infoPtrPtr = mainPtr->nextPtr;
+		    break;
+		}
+	    }
 	    ckfree((char *) mainPtr);
-	    ckMainInfo = NULL;
 	    goto done;
 	}
     }
@@ -1142,7 +1501,7 @@ Ck_DestroyWindow(winPtr)
 	if (topPtr->focusPtr == winPtr)
 	    topPtr->focusPtr = winPtr->parentPtr;
     }
-    Ck_EventuallyRefresh(winPtr);
+    EventuallyRefreshAll(winPtr);
 done:
     ckfree((char *) winPtr);
 }
@@ -1250,6 +1609,7 @@ Ck_MakeWindowExist(winPtr)
     if (winPtr->height <= 0)
 	winPtr->height = 1;
 
+    CkSetTerm(winPtr->mainPtr);
     winPtr->window = newwin(winPtr->height, winPtr->width, y, x);
     idlok(winPtr->window, TRUE);
     scrollok(winPtr->window, FALSE);
@@ -1335,13 +1695,14 @@ Ck_MoveWindow(winPtr, x, y)
 	newy = 0;
     }
 
+    CkSetTerm(winPtr->mainPtr);
     mvwin(winPtr->window, newy, newx);
 
     for (childPtr = winPtr->childList;
          childPtr != NULL; childPtr = childPtr->nextPtr)
 	if (!(childPtr->flags & CK_TOPLEVEL))
 	    Ck_MoveWindow(childPtr, childPtr->x, childPtr->y);
-    Ck_EventuallyRefresh(winPtr);
+    EventuallyRefreshAll(winPtr);
 }
 
 /*
@@ -1426,6 +1787,7 @@ Ck_ResizeWindow(winPtr, width, height)
     if (y + winPtr->height > winPtr->mainPtr->maxHeight)
 	winPtr->height = winPtr->mainPtr->maxHeight - y;
 
+    CkSetTerm(winPtr->mainPtr);
     new = newwin(winPtr->height, winPtr->width, y, x);
     if (winPtr->window == NULL) {
 	winPtr->flags |= CK_MAPPED;
@@ -1448,7 +1810,7 @@ Ck_ResizeWindow(winPtr, width, height)
 	    continue;
 	Ck_ResizeWindow(childPtr, -12345, -12345);
     }
-    Ck_EventuallyRefresh(winPtr);
+    EventuallyRefreshAll(winPtr);
 
     event.type = CK_EV_MAP;
     event.winPtr = winPtr;
@@ -1496,9 +1858,10 @@ Ck_UnmapWindow(winPtr)
     if (!(winPtr->flags & CK_MAPPED))
 	return;
     winPtr->flags &= ~CK_MAPPED;
+    CkSetTerm(winPtr->mainPtr);
     delwin(winPtr->window);
     winPtr->window = NULL;
-    Ck_EventuallyRefresh(winPtr);
+    EventuallyRefreshAll(winPtr);
 
     if (mainPtr->focusPtr == winPtr) {
 	CkWindow *parentPtr;
@@ -1830,7 +2193,7 @@ Ck_RestackWindow(winPtr, aboveBelow, otherPtr)
     }
 
 done:
-    Ck_EventuallyRefresh(winPtr);
+    EventuallyRefreshAll(winPtr);
     return TCL_OK;
 }
 
@@ -1940,7 +2303,8 @@ ChangeToplevelFocus(winPtr)
  *
  * Ck_EventuallyRefresh --
  *
- *	Dispatch refresh of entire screen.
+ *	Dispatch refresh of entire screen. The given window is
+ *	considered damaged as a whole.
  *
  * Results:
  *	None.
@@ -1952,10 +2316,90 @@ void
 Ck_EventuallyRefresh(winPtr)
     CkWindow *winPtr;
 {
+    if (winPtr->window != NULL)
+	CkDamageWindow(winPtr, 0, 0, winPtr->width, winPtr->height);
+    winPtr->mainPtr->stats.refreshRequests++;
     if (++winPtr->mainPtr->refreshCount == 1)
 	Tk_DoWhenIdle(DoRefresh, (ClientData) winPtr->mainPtr);
 }
-
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * EventuallyRefreshAll --
+ *
+ *	Dispatch refresh of entire screen where all windows must be
+ *	touched, since the window hierarchy or stacking order changed
+ *	and formerly obscured parts of windows may have become visible.
+ *
+ * Results:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+EventuallyRefreshAll(winPtr)
+    CkWindow *winPtr;
+{
+    winPtr->mainPtr->flags |= CK_REFRESH_ALL;
+    Ck_EventuallyRefresh(winPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CkDamageWindow --
+ *
+ *	Record that a rectangular region of a window has been drawn
+ *	into and must be brought to the screen on the next refresh.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The damaged region of the window is extended to include the
+ *	given rectangle.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+CkDamageWindow(winPtr, x, y, width, height)
+    CkWindow *winPtr;
+    int x, y;			/* Top-left corner in window coordinates. */
+    int width, height;		/* Dimensions of damaged region. */
+{
+    int x2 = x + width, y2 = y + height;
+
+    if (x < 0)
+	x = 0;
+    if (y < 0)
+	y = 0;
+    if (x2 > winPtr->width)
+	x2 = winPtr->width;
+    if (y2 > winPtr->height)
+	y2 = winPtr->height;
+    if (x >= x2 || y >= y2)
+	return;
+    if (!(winPtr->flags & CK_DAMAGED)) {
+	winPtr->damageX1 = x;
+	winPtr->damageY1 = y;
+	winPtr->damageX2 = x2;
+	winPtr->damageY2 = y2;
+	winPtr->flags |= CK_DAMAGED;
+	return;
+    }
+    if (x < winPtr->damageX1)
+	winPtr->damageX1 = x;
+    if (y < winPtr->damageY1)
+	winPtr->damageY1 = y;
+    if (x2 > winPtr->damageX2)
+	winPtr->damageX2 = x2;
+    if (y2 > winPtr->damageY2)
+	winPtr->damageY2 = y2;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -1967,6 +2411,8 @@ Ck_EventuallyRefresh(winPtr)
  *	TCP buffering.
  *	Therefore the refreshDelay may be used in order to limit updates
  *	to happen not more often than 1000/refreshDelay times per second.
+ *	Unless CK_REFRESH_ALL is set, only damaged windows and windows
+ *	overlapping them further up in the stacking order are touched.
  *
  * Results:
  *	None.
@@ -1979,6 +2425,8 @@ DoRefresh(clientData)
     ClientData clientData;
 {
     CkMainInfo *mainPtr = (CkMainInfo *) clientData;
+    int i;
+    double t0 = 0.0;
 
     if (mainPtr->flags & CK_REFRESH_TIMER) {
 	Tk_DeleteTimerHandler(mainPtr->refreshTimer);
@@ -2013,12 +2461,31 @@ DoRefresh(clientData)
 	}
 	mainPtr->lastRefresh = t0;
     }
+    if (ckStatsTiming)
+	t0 = CkStatsClock();
+    for (i = 0; i < mainPtr->maxHeight; i++) {
+	mainPtr->damagePtr[i].x1 = mainPtr->maxWidth;
+	mainPtr->damagePtr[i].x2 = 0;
+    }
+    if (mainPtr->flags & CK_REFRESH_ALL)
+	mainPtr->stats.refreshFullCount++;
+    CkSetTerm(mainPtr);
     curs_set(0);
     RefreshToplevels(mainPtr->topLevPtr);
-    UpdateHWCursor(ckMainInfo);
+    mainPtr->flags &= ~CK_REFRESH_ALL;
+    UpdateHWCursor(mainPtr);
+    mainPtr->stats.refreshes++;
+#ifndef __WIN32__
+    for (i = 0; i < mainPtr->maxHeight; i++) {
+	if (is_linetouched(newscr, i) == TRUE)
+	    mainPtr->stats.refreshLines++;
+    }
+#endif
     doupdate();
+    if (ckStatsTiming)
+	mainPtr->stats.phaseTime[CK_STATS_REFRESH] += CkStatsClock() - t0;
 }
-
+
 /*
  *----------------------------------------------------------------------
  *
@@ -2039,13 +2506,12 @@ RefreshToplevels(winPtr)
     if (winPtr->topLevPtr != NULL)
 	RefreshToplevels(winPtr->topLevPtr);
     if (winPtr->window != NULL) {
-	touchwin(winPtr->window);
-	wnoutrefresh(winPtr->window);
+	RefreshWindow(winPtr);
 	if (winPtr->childList != NULL)
 	    RefreshThem(winPtr->childList);
     }
 }
-
+
 /*
  *----------------------------------------------------------------------
  *
@@ -2067,14 +2533,105 @@ RefreshThem(winPtr)
         RefreshThem(winPtr->nextPtr);
     if (winPtr->flags & CK_TOPLEVEL)
 	return;
-    if (winPtr->window != NULL) {
-	touchwin(winPtr->window);
-	wnoutrefresh(winPtr->window);
-    }
+    if (winPtr->window != NULL)
+	RefreshWindow(winPtr);
     if (winPtr->childList != NULL)
         RefreshThem(winPtr->childList);
 }
-
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RefreshWindow --
+ *
+ *	Refresh a single curses window. Windows are processed bottom
+ *	up in stacking order. Lines of the window which overlap regions
+ *	damaged by windows further down are touched in order to keep
+ *	the window on top, then the window's own damaged region is
+ *	added to the per line damage spans.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The window is copied to the curses virtual screen, its damaged
+ *	state is cleared and refresh statistics are updated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+RefreshWindow(winPtr)
+    CkWindow *winPtr;
+{
+    CkMainInfo *mainPtr = winPtr->mainPtr;
+    CkDamage *dmgPtr;
+    WINDOW *window = winPtr->window;
+    int x0, y0, width, height, x1, x2, y, touched;
+
+    if (mainPtr->flags & CK_REFRESH_ALL) {
+	winPtr->flags &= ~CK_DAMAGED;
+	touchwin(window);
+	wnoutrefresh(window);
+	mainPtr->stats.refreshWinsTouched++;
+	return;
+    }
+
+    /*
+     * Catch drawing which happened without reporting the damage.
+     */
+
+    if (!(winPtr->flags & CK_DAMAGED) && is_wintouched(window))
+	CkDamageWindow(winPtr, 0, 0, winPtr->width, winPtr->height);
+
+    /*
+     * A touched line is copied in full to the virtual screen, thus the
+     * damage recorded for it must cover the window's entire width in
+     * order to get the windows stacked above refreshed, too.
+     */
+
+    getbegyx(window, y0, x0);
+    getmaxyx(window, height, width);
+    x1 = x0 < 0 ? 0 : x0;
+    x2 = x0 + width > mainPtr->maxWidth ? mainPtr->maxWidth : x0 + width;
+    touched = 0;
+    for (y = 0; y < height && y0 + y < mainPtr->maxHeight; y++) {
+	if (y0 + y < 0)
+	    continue;
+	dmgPtr = &mainPtr->damagePtr[y0 + y];
+	if (dmgPtr->x1 < x0 + width && dmgPtr->x2 > x0) {
+	    touchline(window, y, 1);
+	    if (x1 < dmgPtr->x1)
+		dmgPtr->x1 = x1;
+	    if (x2 > dmgPtr->x2)
+		dmgPtr->x2 = x2;
+	    touched++;
+	}
+    }
+    if (winPtr->flags & CK_DAMAGED) {
+	winPtr->flags &= ~CK_DAMAGED;
+	for (y = winPtr->damageY1; y < winPtr->damageY2 &&
+	     y0 + y < mainPtr->maxHeight; y++) {
+	    if (y0 + y < 0)
+		continue;
+	    dmgPtr = &mainPtr->damagePtr[y0 + y];
+	    if (x1 < dmgPtr->x1)
+		dmgPtr->x1 = x1;
+	    if (x2 > dmgPtr->x2)
+		dmgPtr->x2 = x2;
+	}
+	touchline(window, winPtr->damageY1,
+		  winPtr->damageY2 - winPtr->damageY1);
+	touched++;
+    }
+    if (touched) {
+	wnoutrefresh(window);
+	mainPtr->stats.refreshWinsTouched++;
+    } else {
+	mainPtr->stats.refreshWinsSkipped++;
+    }
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -2095,6 +2652,7 @@ UpdateHWCursor(mainPtr)
     int x, y;
     CkWindow *wPtr, *stopAtWin, *winPtr = mainPtr->focusPtr;
 
+    CkSetTerm(mainPtr);
     if (winPtr == NULL || winPtr->window == NULL ||
         (winPtr->flags & (CK_SHOW_CURSOR | CK_ALREADY_DEAD)) == 0) {
 invisible:
@@ -2284,6 +2842,7 @@ Ck_ClearToEol(winPtr, x, y)
 	getyx(window, y, x);
     else
 	wmove(window, y, x);
+    CkDamageWindow(winPtr, x, y, winPtr->width - x, 1);
     for (; x < winPtr->width; x++)
 	waddch(window, ' ');
 }
@@ -2312,6 +2871,8 @@ Ck_ClearToBot(winPtr, x, y)
 	return;
 
     wmove(window, y, x);
+    CkDamageWindow(winPtr, (y + 1 < winPtr->height) ? 0 : x, y,
+		   winPtr->width, winPtr->height - y);
     for (; x < winPtr->width; x++)
 	waddch(window, ' ');
     for (++y; y < winPtr->height; y++) {
@@ -2320,6 +2881,50 @@ Ck_ClearToBot(winPtr, x, y)
 	    waddch(window, ' ');
     }
 }
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Ck_ScrollWindow --
+ *
+ *	Move the contents of the lines top through bottom - 1 of a
+ *	window up by count lines (down if count is negative), using
+ *	the curses scrolling region.  This lets widgets which scroll
+ *	their view redraw only the lines uncovered, which are left
+ *	blank for the caller to fill in.
+ *
+ * Results:
+ *	Returns 1 if the lines were moved, 0 if the caller must
+ *	redraw the entire range itself.
+ *
+ * Side effects:
+ *	The range is marked as damaged.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+Ck_ScrollWindow(winPtr, top, bottom, count)
+    CkWindow *winPtr;
+    int top, bottom;		/* Range of lines to move. */
+    int count;			/* Number of lines to move up. */
+{
+    WINDOW *window = winPtr->window;
+    int kept = bottom - top - (count < 0 ? -count : count);
+
+    if (window == NULL || top < 0 || bottom > winPtr->height ||
+	count == 0 || kept <= 0)
+	return 0;
+    if (wsetscrreg(window, top, bottom - 1) == ERR)
+	return 0;
+    scrollok(window, TRUE);
+    wscrl(window, count);
+    scrollok(window, FALSE);
+    wsetscrreg(window, 0, winPtr->height - 1);
+    CkDamageWindow(winPtr, 0, top, winPtr->width, bottom - top);
+    winPtr->mainPtr->stats.refreshLinesScrolled += kept;
+    return 1;
+}
 
 /*
  *----------------------------------------------------------------------
@@ -2345,6 +2950,24 @@ DeadAppCmd(clientData, interp, argc, argv)
     return TCL_ERROR;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * FreeRedirInfo --
+ *
+ *	Release the client data of a redirected Tcl command when the
+ *	command (or its interpreter) is deleted.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+FreeRedirInfo(clientData)
+    ClientData clientData;
+{
+    ckfree((char *) clientData);
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -2387,6 +3010,7 @@ ExecCmd(clientData, interp, argc, argv)
 	}
         savedargv1 = argv[1];
         argv[1] = argv[0];
+	CkSetTerm(redirInfo->mainPtr);
     	curs_set(1);
 	nodelay(stdscr, FALSE);
         endwin();
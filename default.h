@@ -89,6 +89,8 @@
 #define DEF_LISTBOX_FG                   "white"
 #define DEF_LISTBOX_ATTR                 "normal"
 #define DEF_LISTBOX_HEIGHT               "10"
+#define DEF_LISTBOX_ITEM_COMMAND         NULL
+#define DEF_LISTBOX_ITEM_COUNT           "0"
 #define DEF_LISTBOX_SELECT_ATTR_COLOR    "bold"
 #define DEF_LISTBOX_SELECT_ATTR_MONO     "bold"
 #define DEF_LISTBOX_SELECT_BG_COLOR      "black"
@@ -137,6 +139,7 @@
 #define DEF_TEXT_BG_MONO                 "black"
 #define DEF_TEXT_FG                      "white"
 #define DEF_TEXT_HEIGHT                  "10"
+#define DEF_TEXT_MAX_LINES               "0"
 #define DEF_TEXT_SELECT_ATTR_COLOR       "normal"
 #define DEF_TEXT_SELECT_ATTR_MONO        "reverse"
 #define DEF_TEXT_SELECT_BG_COLOR         "white"
@@ -49,6 +49,9 @@ bind Entry <Select> {
 bind Entry <KeyPress> {
     ckEntryInsert %W %A
 }
+bind Entry <Paste> {
+    ckEntryPaste %W %A
+}
 bind Entry <Control> {# nothing}
 bind Entry <Escape> {# nothing}
 bind Entry <Return> {# nothing}
@@ -129,6 +132,21 @@ proc ckEntryInsert {w s} {
     ckEntrySeeInsert $w
 }
 
+# ckEntryPaste --
+# Insert pasted text into an entry.  Control characters are dropped,
+# since the entry ignores them when they are typed.
+#
+# Arguments:
+# w -		The entry window in which to insert the text
+# s -		The text to insert
+
+proc ckEntryPaste {w s} {
+    # The class is built with format, since regular expressions of
+    # Tcl before 8.1 don't know \x escapes.
+    regsub -all "\[[format %c 1]-[format %c 31][format %c 127]\]" $s {} s
+    ckEntryInsert $w $s
+}
+
 # ckEntryBackspace --
 # Backspace over the character just before the insertion cursor.
 # If backspacing would move the cursor off the left edge of the
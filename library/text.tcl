@@ -76,6 +76,9 @@ bind Text <BackSpace> {
 bind Text <KeyPress> {
     ckTextInsert %W %A
 }
+bind Text <Paste> {
+    ckTextInsert %W %A
+}
 bind Text <Button-1> {
     if [ckFocusOK %W] {
         ckTextSetCursor %W @%x,%y
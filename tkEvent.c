@@ -19,10 +19,16 @@
 
 #if (TCL_MAJOR_VERSION == 7) && (TCL_MINOR_VERSION <= 4)
 
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 /*
  * For each timer callback that's pending, there is one record
- * of the following type, chained together in a list sorted by
- * time (earliest event first).
+ * of the following type.  The records are kept in a binary heap
+ * ordered by time (earliest event first, ties broken by creation
+ * order), and in a hash table keyed by token so that they can be
+ * found quickly when deleted.
  */
 
 typedef struct TimerEvent {
@@ -32,13 +38,32 @@ typedef struct TimerEvent {
     ClientData clientData;	/* Argument to pass to proc. */
     Tk_TimerToken token;	/* Identifies event so it can be
 				 * deleted. */
-    struct TimerEvent *nextPtr;	/* Next event in queue, or NULL for
-				 * end of queue. */
+    int id;			/* Creation sequence number. */
+    int index;			/* Position of event in timerHeap. */
 } TimerEvent;
 
-static TimerEvent *firstTimerHandlerPtr;
-				/* First event in queue. */
+static TimerEvent **timerHeap = NULL;
+				/* Heap of pending events;  timerHeap[0]
+				 * is the next one to fire. */
+static int numTimers = 0;	/* Number of events in timerHeap. */
+static int timerHeapSize = 0;	/* Number of slots allocated for
+				 * timerHeap. */
+static Tcl_HashTable timerTable;
+				/* Maps tokens to TimerEvents. */
+static int timerTableInit = 0;	/* Non-zero once timerTable has been
+				 * initialized. */
+
+/*
+ * The macro below is true if timer event a fires before b.
+ */
+
+#define TIMER_BEFORE(a, b) \
+    (((a)->time.tv_sec < (b)->time.tv_sec) || \
+     (((a)->time.tv_sec == (b)->time.tv_sec) && \
+      (((a)->time.tv_usec < (b)->time.tv_usec) || \
+       (((a)->time.tv_usec == (b)->time.tv_usec) && ((a)->id < (b)->id)))))
 
+#ifndef HAVE_EPOLL
 /*
  * The information below is used to provide read, write, and
  * exception masks to select during calls to Tk_DoOneEvent.
@@ -57,6 +82,26 @@ static fd_mask check[3*MASK_SIZE];
 static int numFds = 0;		/* Number of valid bits in mask
 				 * arrays (this value is passed
 				 * to select). */
+#else
+/*
+ * When configured with --enable-epoll, files are registered once
+ * with an epoll instance and only re-registered when the conditions
+ * a handler waits for change, instead of rebuilding select masks in
+ * each call to Tk_DoOneEvent.
+ */
+
+#define MAX_EPOLL_EVENTS 64
+
+static int epollFd = -1;	/* Epoll instance, created on demand. */
+static Tcl_HashTable epollTable;
+				/* Maps file descriptors to FileHandlers
+				 * for dispatching epoll results. */
+static int numAlwaysReady = 0;	/* Number of handlers on files which
+				 * epoll refuses (e.g. regular files) and
+				 * which wait for some condition;  such
+				 * files are always ready, like with
+				 * select. */
+#endif
 
 /*
  * For each file registered in a call to Tk_CreateFileHandler,
@@ -67,6 +112,7 @@ static int numFds = 0;		/* Number of valid bits in mask
 
 typedef struct FileHandler {
     int fd;			/* POSIX file descriptor for file. */
+#ifndef HAVE_EPOLL
     fd_mask *readPtr;		/* Pointer to word in ready array
 				 * for this file's read mask bit. */
     fd_mask *writePtr;		/* Same for write mask bit. */
@@ -77,6 +123,13 @@ typedef struct FileHandler {
     fd_mask *checkExceptPtr;	/* Same for except mask bit. */
     fd_mask bitSelect;		/* Value to AND with *readPtr etc. to
 				 * select just this file's bit. */
+#else
+    int readyMask;		/* Conditions found by the last wait
+				 * and not yet handled. */
+    int waitMask;		/* Conditions currently waited for. */
+    int noEpoll;		/* Non-zero if epoll can't watch the
+				 * file;  it is then always ready. */
+#endif
     int mask;			/* Mask of desired events: TK_READABLE, etc. */
     Tk_FileProc *proc;		/* Procedure to call, in the style of
 				 * Tk_CreateFileHandler.  This is NULL
@@ -203,11 +256,31 @@ static BgError *lastBgPtr = NULL;
 				/* First in list of all background errors
 				 * waiting to be processed (NULL if none). */
 
+/*
+ * Time spent in timer handlers, idle handlers and waiting for files,
+ * in microseconds, if ckStatsTiming is set.  See TkEventStats.
+ */
+
+static double timerTime = 0.0;
+static double idleTime = 0.0;
+static double waitTime = 0.0;
+
 /*
  * Prototypes for procedures referenced only in this file:
  */
 
 static void		AfterProc _ANSI_ARGS_((ClientData clientData));
+#ifdef HAVE_EPOLL
+static void		EpollInit _ANSI_ARGS_((void));
+static void		EpollSetMask _ANSI_ARGS_((FileHandler *filePtr,
+			    int mask));
+#endif
+static int		WaitForFiles _ANSI_ARGS_((struct timeval *timeoutPtr));
+static void		TimerHeapMove _ANSI_ARGS_((TimerEvent *timerPtr,
+			    int index));
+static void		TimerHeapRemove _ANSI_ARGS_((TimerEvent *timerPtr));
+static void		TimerSiftDown _ANSI_ARGS_((int index));
+static void		TimerSiftUp _ANSI_ARGS_((int index));
 static void		DeleteFileEvent _ANSI_ARGS_((FILE *f));
 static int		FileEventProc _ANSI_ARGS_((ClientData clientData,
 			    int mask, int flags));
@@ -259,11 +332,13 @@ Tk_CreateFileHandler(fd, mask, proc, clientData)
     ClientData clientData;	/* Arbitrary data to pass to proc. */
 {
     register FileHandler *filePtr;
+#ifndef HAVE_EPOLL
     int index;
 
     if (fd >= FD_SETSIZE) {
 	panic("Tk_CreatefileHandler can't handle file id %d", fd);
     }
+#endif
 
     /*
      * Make sure the file isn't already registered.  Create a
@@ -277,6 +352,7 @@ Tk_CreateFileHandler(fd, mask, proc, clientData)
 	    break;
 	}
     }
+#ifndef HAVE_EPOLL
     index = fd/(NBBY*sizeof(fd_mask));
     if (filePtr == NULL) {
 	filePtr = (FileHandler *) ckalloc(sizeof(FileHandler));
@@ -291,6 +367,33 @@ Tk_CreateFileHandler(fd, mask, proc, clientData)
 	filePtr->nextPtr = firstFileHandlerPtr;
 	firstFileHandlerPtr = filePtr;
     }
+#else
+    if (filePtr == NULL) {
+	Tcl_HashEntry *hPtr;
+	int new;
+
+	EpollInit();
+	filePtr = (FileHandler *) ckalloc(sizeof(FileHandler));
+	filePtr->fd = fd;
+	filePtr->readyMask = 0;
+	filePtr->waitMask = 0;
+	filePtr->noEpoll = 0;
+	filePtr->nextPtr = firstFileHandlerPtr;
+	firstFileHandlerPtr = filePtr;
+	hPtr = Tcl_CreateHashEntry(&epollTable, (char *) fd, &new);
+	Tcl_SetHashValue(hPtr, filePtr);
+    } else {
+	/*
+	 * The file may have been closed and another one opened with
+	 * the same descriptor, which dropped it from the epoll set
+	 * although the mask didn't change:  register it anew when
+	 * Tk_DoOneEvent waits next time.
+	 */
+
+	EpollSetMask(filePtr, 0);
+	filePtr->noEpoll = 0;
+    }
+#endif
 
     /*
      * The remainder of the initialization below is done
@@ -303,9 +406,11 @@ Tk_CreateFileHandler(fd, mask, proc, clientData)
     filePtr->proc2 = NULL;
     filePtr->clientData = clientData;
 
+#ifndef HAVE_EPOLL
     if (numFds <= fd) {
 	numFds = fd+1;
     }
+#endif
 }
 
 /*
@@ -401,6 +506,11 @@ Tk_DeleteFileHandler(fd)
     } else {
 	prevPtr->nextPtr = filePtr->nextPtr;
     }
+#ifdef HAVE_EPOLL
+    EpollSetMask(filePtr, 0);
+    Tcl_DeleteHashEntry(Tcl_FindHashEntry(&epollTable, (char *) fd));
+    ckfree((char *) filePtr);
+#else
     ckfree((char *) filePtr);
 
     /*
@@ -414,6 +524,7 @@ Tk_DeleteFileHandler(fd)
 	    numFds = filePtr->fd+1;
 	}
     }
+#endif
 }
 
 /*
@@ -442,7 +553,9 @@ Tk_CreateTimerHandler(milliseconds, proc, clientData)
     Tk_TimerProc *proc;		/* Procedure to invoke. */
     ClientData clientData;	/* Arbitrary data to pass to proc. */
 {
-    register TimerEvent *timerPtr, *tPtr2, *prevPtr;
+    register TimerEvent *timerPtr;
+    Tcl_HashEntry *hPtr;
+    int new;
     static int id = 0;
 
     timerPtr = (TimerEvent *) ckalloc(sizeof(TimerEvent));
@@ -466,29 +579,128 @@ Tk_CreateTimerHandler(milliseconds, proc, clientData)
     timerPtr->proc = proc;
     timerPtr->clientData = clientData;
     id++;
+    timerPtr->id = id;
     timerPtr->token = (Tk_TimerToken) id;
 
     /*
-     * Add the event to the queue in the correct position
+     * Remember the event by its token and add it to the heap
      * (ordered by event firing time).
      */
 
-    for (tPtr2 = firstTimerHandlerPtr, prevPtr = NULL; tPtr2 != NULL;
-	    prevPtr = tPtr2, tPtr2 = tPtr2->nextPtr) {
-	if ((tPtr2->time.tv_sec > timerPtr->time.tv_sec)
-		|| ((tPtr2->time.tv_sec == timerPtr->time.tv_sec)
-		&& (tPtr2->time.tv_usec > timerPtr->time.tv_usec))) {
+    if (!timerTableInit) {
+	Tcl_InitHashTable(&timerTable, TCL_ONE_WORD_KEYS);
+	timerTableInit = 1;
+    }
+    hPtr = Tcl_CreateHashEntry(&timerTable, (char *) timerPtr->token, &new);
+    Tcl_SetHashValue(hPtr, timerPtr);
+    if (numTimers >= timerHeapSize) {
+	TimerEvent **newHeap;
+
+	timerHeapSize = (timerHeapSize == 0) ? 64 : 2 * timerHeapSize;
+	newHeap = (TimerEvent **)
+	    ckalloc((unsigned) (timerHeapSize * sizeof (TimerEvent *)));
+	if (timerHeap != NULL) {
+	    memcpy((VOID *) newHeap, (VOID *) timerHeap,
+		    numTimers * sizeof (TimerEvent *));
+	    ckfree((char *) timerHeap);
+	}
+	timerHeap = newHeap;
+    }
+    TimerHeapMove(timerPtr, numTimers);
+    numTimers++;
+    TimerSiftUp(timerPtr->index);
+    return timerPtr->token;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * TimerHeapMove, TimerSiftUp, TimerSiftDown, TimerHeapRemove --
+ *
+ *	Helpers to maintain the heap of pending timer events:
+ *	store an event at a given slot, restore the heap order
+ *	after an event got earlier or later than its parent or
+ *	children, and take an event out of the heap.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Events are moved within timerHeap.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+TimerHeapMove(timerPtr, index)
+    TimerEvent *timerPtr;
+    int index;
+{
+    timerHeap[index] = timerPtr;
+    timerPtr->index = index;
+}
+
+static void
+TimerSiftUp(index)
+    int index;
+{
+    TimerEvent *timerPtr = timerHeap[index];
+    int parent;
+
+    while (index > 0) {
+	parent = (index - 1) / 2;
+	if (!TIMER_BEFORE(timerPtr, timerHeap[parent])) {
 	    break;
 	}
+	TimerHeapMove(timerHeap[parent], index);
+	index = parent;
     }
-    if (prevPtr == NULL) {
-	timerPtr->nextPtr = firstTimerHandlerPtr;
-	firstTimerHandlerPtr = timerPtr;
-    } else {
-	timerPtr->nextPtr = prevPtr->nextPtr;
-	prevPtr->nextPtr = timerPtr;
+    TimerHeapMove(timerPtr, index);
+}
+
+static void
+TimerSiftDown(index)
+    int index;
+{
+    TimerEvent *timerPtr = timerHeap[index];
+    int child;
+
+    while ((child = 2 * index + 1) < numTimers) {
+	if ((child + 1 < numTimers)
+		&& TIMER_BEFORE(timerHeap[child + 1], timerHeap[child])) {
+	    child++;
+	}
+	if (!TIMER_BEFORE(timerHeap[child], timerPtr)) {
+	    break;
+	}
+	TimerHeapMove(timerHeap[child], index);
+	index = child;
     }
-    return timerPtr->token;
+    TimerHeapMove(timerPtr, index);
+}
+
+static void
+TimerHeapRemove(timerPtr)
+    TimerEvent *timerPtr;
+{
+    int index = timerPtr->index;
+    Tcl_HashEntry *hPtr;
+
+    hPtr = Tcl_FindHashEntry(&timerTable, (char *) timerPtr->token);
+    if (hPtr != NULL) {
+	Tcl_DeleteHashEntry(hPtr);
+    }
+    numTimers--;
+    if (index < numTimers) {
+	TimerHeapMove(timerHeap[numTimers], index);
+	if ((index > 0) && TIMER_BEFORE(timerHeap[index],
+		timerHeap[(index - 1) / 2])) {
+	    TimerSiftUp(index);
+	} else {
+	    TimerSiftDown(index);
+	}
+    }
+    timerHeap[numTimers] = NULL;
 }
 
 /*
@@ -515,21 +727,19 @@ Tk_DeleteTimerHandler(token)
     Tk_TimerToken token;	/* Result previously returned by
 				 * Tk_DeleteTimerHandler. */
 {
-    register TimerEvent *timerPtr, *prevPtr;
+    register TimerEvent *timerPtr;
+    Tcl_HashEntry *hPtr;
 
-    for (timerPtr = firstTimerHandlerPtr, prevPtr = NULL; timerPtr != NULL;
-	    prevPtr = timerPtr, timerPtr = timerPtr->nextPtr) {
-	if (timerPtr->token != token) {
-	    continue;
-	}
-	if (prevPtr == NULL) {
-	    firstTimerHandlerPtr = timerPtr->nextPtr;
-	} else {
-	    prevPtr->nextPtr = timerPtr->nextPtr;
-	}
-	ckfree((char *) timerPtr);
+    if (!timerTableInit) {
 	return;
     }
+    hPtr = Tcl_FindHashEntry(&timerTable, (char *) token);
+    if (hPtr == NULL) {
+	return;
+    }
+    timerPtr = (TimerEvent *) Tcl_GetHashValue(hPtr);
+    TimerHeapRemove(timerPtr);
+    ckfree((char *) timerPtr);
 }
 
 /*
@@ -659,6 +869,218 @@ Tk_CancelIdleCall(proc, clientData)
     }
 }
 
+/*
+ *--------------------------------------------------------------
+ *
+ * WaitForFiles --
+ *
+ *	Wait until one of the files selected by the last pass
+ *	through Tk_DoOneEvent becomes ready, or the given timeout
+ *	expires, and record which files are ready.
+ *
+ * Results:
+ *	The number of ready files, 0 on timeout, or -1 on error
+ *	(errno tells why).
+ *
+ * Side effects:
+ *	The ready information is left for the next pass through
+ *	Tk_DoOneEvent.
+ *
+ *--------------------------------------------------------------
+ */
+
+#ifndef HAVE_EPOLL
+static int
+WaitForFiles(timeoutPtr)
+    struct timeval *timeoutPtr;	/* Maximum time to wait, NULL means
+				 * wait forever. */
+{
+    int numFound;
+
+    memcpy((VOID *) ready, (VOID *) check, 3*MASK_SIZE*sizeof(fd_mask));
+    numFound = select(numFds, (SELECT_MASK *) &ready[0],
+	    (SELECT_MASK *) &ready[MASK_SIZE],
+	    (SELECT_MASK *) &ready[2*MASK_SIZE], timeoutPtr);
+    if (numFound <= 0) {
+	/*
+	 * Some systems don't clear the masks after an error, so
+	 * we have to do it here.
+	 */
+
+	memset((VOID *) ready, 0, 3*MASK_SIZE*sizeof(fd_mask));
+    }
+    return numFound;
+}
+#else
+static int
+WaitForFiles(timeoutPtr)
+    struct timeval *timeoutPtr;	/* Maximum time to wait, NULL means
+				 * wait forever. */
+{
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    register FileHandler *filePtr;
+    Tcl_HashEntry *hPtr;
+    int i, mask, numFound, timeout;
+
+    EpollInit();
+    if (numAlwaysReady > 0) {
+	timeout = 0;
+    } else if (timeoutPtr == NULL) {
+	timeout = -1;
+    } else {
+	/*
+	 * Round up, otherwise we'd wake up just before a timer is due
+	 * and spin until it is.
+	 */
+
+	timeout = timeoutPtr->tv_sec * 1000
+	    + (timeoutPtr->tv_usec + 999) / 1000;
+    }
+    numFound = epoll_wait(epollFd, events, MAX_EPOLL_EVENTS, timeout);
+    for (i = 0; i < numFound; i++) {
+	hPtr = Tcl_FindHashEntry(&epollTable, (char *) events[i].data.fd);
+	if (hPtr == NULL) {
+	    continue;
+	}
+	filePtr = (FileHandler *) Tcl_GetHashValue(hPtr);
+	mask = 0;
+	if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+	    mask |= TK_READABLE;
+	}
+	if (events[i].events & (EPOLLOUT | EPOLLERR)) {
+	    mask |= TK_WRITABLE;
+	}
+	if (events[i].events & EPOLLPRI) {
+	    mask |= TK_EXCEPTION;
+	}
+	filePtr->readyMask |= mask & filePtr->waitMask;
+    }
+    if ((numAlwaysReady > 0) && (numFound >= 0)) {
+	for (filePtr = firstFileHandlerPtr; filePtr != NULL;
+		filePtr = filePtr->nextPtr) {
+	    mask = filePtr->waitMask & (TK_READABLE | TK_WRITABLE);
+	    if (filePtr->noEpoll && (mask != 0)) {
+		filePtr->readyMask |= mask;
+		numFound++;
+	    }
+	}
+    }
+    return numFound;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * EpollInit --
+ *
+ *	Create the epoll instance and the table of registered
+ *	files, if not done yet.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	A file descriptor is allocated for the epoll instance.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+EpollInit()
+{
+    if (epollFd >= 0) {
+	return;
+    }
+    epollFd = epoll_create(MAX_EPOLL_EVENTS);
+    if (epollFd < 0) {
+	panic("Tk_DoOneEvent can't create epoll instance");
+    }
+    fcntl(epollFd, F_SETFD, FD_CLOEXEC);
+    Tcl_InitHashTable(&epollTable, TCL_ONE_WORD_KEYS);
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * EpollSetMask --
+ *
+ *	Change the conditions (TK_READABLE etc.) a file is waited
+ *	for in epoll.  Files which epoll can't handle, such as
+ *	regular files, are treated as always ready.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The file is added to, modified in or removed from the
+ *	epoll set, but only if the conditions changed.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+EpollSetMask(filePtr, mask)
+    FileHandler *filePtr;	/* File to watch. */
+    int mask;			/* New conditions, 0 to stop watching. */
+{
+    struct epoll_event event;
+    int op;
+
+    mask &= TK_READABLE | TK_WRITABLE | TK_EXCEPTION;
+    if (filePtr->noEpoll) {
+	filePtr->waitMask = mask;
+	if (mask != 0) {
+	    numAlwaysReady++;
+	}
+	return;
+    }
+    if (mask == filePtr->waitMask) {
+	return;
+    }
+    event.events = 0;
+    if (mask & TK_READABLE) {
+	event.events |= EPOLLIN;
+    }
+    if (mask & TK_WRITABLE) {
+	event.events |= EPOLLOUT;
+    }
+    if (mask & TK_EXCEPTION) {
+	event.events |= EPOLLPRI;
+    }
+    event.data.u64 = 0;
+    event.data.fd = filePtr->fd;
+    if (mask == 0) {
+	op = EPOLL_CTL_DEL;
+    } else if (filePtr->waitMask == 0) {
+	op = EPOLL_CTL_ADD;
+    } else {
+	op = EPOLL_CTL_MOD;
+    }
+    if (epoll_ctl(epollFd, op, filePtr->fd, &event) < 0) {
+	if ((op == EPOLL_CTL_MOD) && (errno == ENOENT)) {
+	    /*
+	     * The file was closed and another one opened with the same
+	     * descriptor, which dropped the old registration.
+	     */
+
+	    (void) epoll_ctl(epollFd, EPOLL_CTL_ADD, filePtr->fd, &event);
+	} else if ((op == EPOLL_CTL_ADD) && (errno == EEXIST)) {
+	    /*
+	     * Still registered from before, just update the conditions.
+	     */
+
+	    (void) epoll_ctl(epollFd, EPOLL_CTL_MOD, filePtr->fd, &event);
+	} else if ((op == EPOLL_CTL_ADD) && (errno == EPERM)) {
+	    filePtr->noEpoll = 1;
+	    filePtr->waitMask = mask;
+	    numAlwaysReady++;
+	    return;
+	}
+    }
+    filePtr->waitMask = mask;
+}
+#endif
+
 /*
  *--------------------------------------------------------------
  *
@@ -694,6 +1116,7 @@ Tk_DoOneEvent(flags)
     register FileHandler *filePtr;
     struct timeval curTime, timeoutVal, *timeoutPtr;
     int numFound, mask, anyFilesToWaitFor;
+    double t0 = 0.0;
 
     if ((flags & TK_ALL_EVENTS) == 0) {
 	flags |= TK_ALL_EVENTS;
@@ -710,10 +1133,18 @@ Tk_DoOneEvent(flags)
 	(void) Tcl_AsyncInvoke((Tcl_Interp *) NULL, 0);
 	return 1;
     }
+#ifndef HAVE_EPOLL
     memset((VOID *) check, 0, 3*MASK_SIZE*sizeof(fd_mask));
+#else
+    numAlwaysReady = 0;
+#endif
     anyFilesToWaitFor = 0;
     for (filePtr = firstFileHandlerPtr; filePtr != NULL;
 	    filePtr = filePtr->nextPtr) {
+#ifdef HAVE_EPOLL
+	mask = filePtr->readyMask;
+	filePtr->readyMask = 0;
+#else
 	mask = 0;
 	if (*filePtr->readPtr & filePtr->bitSelect) {
 	    mask |= TK_READABLE;
@@ -727,6 +1158,7 @@ Tk_DoOneEvent(flags)
 	    mask |= TK_EXCEPTION;
 	    *filePtr->exceptPtr &= ~filePtr->bitSelect;
 	}
+#endif
 	if (filePtr->proc2 != NULL) {
 	    /*
 	     * Handler created by Tk_CreateFileHandler2.
@@ -742,6 +1174,9 @@ Tk_DoOneEvent(flags)
 	     */
 
 	    if (!(flags & TK_FILE_EVENTS)) {
+#ifdef HAVE_EPOLL
+		EpollSetMask(filePtr, 0);
+#endif
 		continue;
 	    }
 	    if (mask != 0) {
@@ -750,6 +1185,12 @@ Tk_DoOneEvent(flags)
 	    }
 	    mask = filePtr->mask;
 	}
+#ifdef HAVE_EPOLL
+	EpollSetMask(filePtr, mask);
+	if (filePtr->waitMask != 0) {
+	    anyFilesToWaitFor = 1;
+	}
+#else
 	if (mask != 0) {
 	    anyFilesToWaitFor = 1;
 	    if (mask & TK_READABLE) {
@@ -762,6 +1203,7 @@ Tk_DoOneEvent(flags)
 		*filePtr->checkExceptPtr |= filePtr->bitSelect;
 	    }
 	}
+#endif
     }
 
     /*
@@ -770,16 +1212,22 @@ Tk_DoOneEvent(flags)
      */
 
     checkTime:
-    if ((firstTimerHandlerPtr != NULL) && (flags & TK_TIMER_EVENTS)) {
-	register TimerEvent *timerPtr = firstTimerHandlerPtr;
+    if ((numTimers > 0) && (flags & TK_TIMER_EVENTS)) {
+	register TimerEvent *timerPtr = timerHeap[0];
 
 	(void) gettimeofday(&curTime, (struct timezone *) NULL);
 	if ((timerPtr->time.tv_sec < curTime.tv_sec)
 		|| ((timerPtr->time.tv_sec == curTime.tv_sec)
 		&&  (timerPtr->time.tv_usec < curTime.tv_usec))) {
-	    firstTimerHandlerPtr = timerPtr->nextPtr;
+	    TimerHeapRemove(timerPtr);
+	    if (ckStatsTiming) {
+		t0 = CkStatsClock();
+	    }
 	    (*timerPtr->proc)(timerPtr->clientData);
 	    ckfree((char *) timerPtr);
+	    if (t0 != 0.0) {
+		timerTime += CkStatsClock() - t0;
+	    }
 	    return 1;
 	}
     }
@@ -794,20 +1242,8 @@ Tk_DoOneEvent(flags)
     if (((idleList != NULL) && (flags & TK_IDLE_EVENTS))
 	    || (flags & TK_DONT_WAIT)) {
 	if (flags & (TK_X_EVENTS|TK_FILE_EVENTS)) {
-	    memcpy((VOID *) ready, (VOID *) check,
-		    3*MASK_SIZE*sizeof(fd_mask));
 	    timeoutVal.tv_sec = timeoutVal.tv_usec = 0;
-	    numFound = select(numFds, (SELECT_MASK *) &ready[0],
-		    (SELECT_MASK *) &ready[MASK_SIZE],
-		    (SELECT_MASK *) &ready[2*MASK_SIZE], &timeoutVal);
-	    if (numFound <= 0) {
-		/*
-		 * Some systems don't clear the masks after an error, so
-		 * we have to do it here.
-		 */
-
-		memset((VOID *) ready, 0, 3*MASK_SIZE*sizeof(fd_mask));
-	    }
+	    numFound = WaitForFiles(&timeoutVal);
 	    if ((numFound > 0) || ((numFound == -1) && (errno == EINTR))) {
 		goto checkFiles;
 	    }
@@ -840,6 +1276,9 @@ Tk_DoOneEvent(flags)
 
 	oldGeneration = myGeneration = idleList->generation;
 	idleGeneration++;
+	if (ckStatsTiming) {
+	    t0 = CkStatsClock();
+	}
 
 	/*
 	 * The code below is trickier than it may look, for the following
@@ -870,6 +1309,9 @@ Tk_DoOneEvent(flags)
 	    (*idlePtr->proc)(idlePtr->clientData);
 	    ckfree((char *) idlePtr);
 	}
+	if (t0 != 0.0) {
+	    idleTime += CkStatsClock() - t0;
+	}
 	return 1;
     }
 
@@ -883,13 +1325,13 @@ Tk_DoOneEvent(flags)
 	    || !(flags & (TK_TIMER_EVENTS|TK_FILE_EVENTS|TK_X_EVENTS))) {
 	return 0;
     }
-    if ((firstTimerHandlerPtr == NULL) || !(flags & TK_TIMER_EVENTS)) {
+    if ((numTimers == 0) || !(flags & TK_TIMER_EVENTS)) {
 	timeoutPtr = NULL;
     } else {
 	timeoutPtr = &timeoutVal;
-	timeoutVal.tv_sec = firstTimerHandlerPtr->time.tv_sec
+	timeoutVal.tv_sec = timerHeap[0]->time.tv_sec
 	    - curTime.tv_sec;
-	timeoutVal.tv_usec = firstTimerHandlerPtr->time.tv_usec
+	timeoutVal.tv_usec = timerHeap[0]->time.tv_usec
 	    - curTime.tv_usec;
 	if (timeoutVal.tv_usec < 0) {
 	    timeoutVal.tv_sec -= 1;
@@ -899,17 +1341,13 @@ Tk_DoOneEvent(flags)
     if ((timeoutPtr == NULL) && !anyFilesToWaitFor) {
 	return 0;
     }
-    memcpy((VOID *) ready, (VOID *) check, 3*MASK_SIZE*sizeof(fd_mask));
-    numFound = select(numFds, (SELECT_MASK *) &ready[0],
-	    (SELECT_MASK *) &ready[MASK_SIZE],
-	    (SELECT_MASK *) &ready[2*MASK_SIZE], timeoutPtr);
-    if (numFound == -1) {
-	/*
-	 * Some systems don't clear the masks after an error, so
-	 * we have to do it here.
-	 */
-
-	memset((VOID *) ready, 0, 3*MASK_SIZE*sizeof(fd_mask));
+    if (ckStatsTiming) {
+	t0 = CkStatsClock();
+    }
+    numFound = WaitForFiles(timeoutPtr);
+    if (t0 != 0.0) {
+	waitTime += CkStatsClock() - t0;
+	t0 = 0.0;
     }
     if (numFound == 0) {
 	goto checkTime;
@@ -917,6 +1355,47 @@ Tk_DoOneEvent(flags)
     goto checkFiles;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * TkEventStats --
+ *
+ *	Fill in the parts of a statistics record kept by the event
+ *	loop:  the number of pending idle and timer handlers and the
+ *	time spent in them and in waiting for files.  These are
+ *	shared by all main windows.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	If reset is non-zero, the times are set to zero.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TkEventStats(statsPtr, reset)
+    Ck_Stats *statsPtr;		/* Record to fill in, or NULL. */
+    int reset;			/* Non-zero means reset times. */
+{
+    IdleHandler *idlePtr;
+
+    if (statsPtr != NULL) {
+	statsPtr->idleHandlers = 0;
+	for (idlePtr = idleList; idlePtr != NULL; idlePtr = idlePtr->nextPtr) {
+	    statsPtr->idleHandlers++;
+	}
+	statsPtr->timerHandlers = numTimers;
+	statsPtr->phaseTime[CK_STATS_TIMERS] = timerTime;
+	statsPtr->phaseTime[CK_STATS_IDLE] = idleTime;
+	statsPtr->phaseTime[CK_STATS_WAIT] = waitTime;
+    }
+    if (reset) {
+	timerTime = idleTime = waitTime = 0.0;
+    }
+}
+
 /*
  *----------------------------------------------------------------------
  *
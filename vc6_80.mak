@@ -47,14 +47,14 @@ DLLLFLAGS = /NODEFAULTLIB /RELEASE /NOLOGO /MACHINE:IX86 /SUBSYSTEM:WINDOWS \
 WIDGOBJS = ckButton.obj ckEntry.obj ckFrame.obj ckListbox.obj \
 	ckMenu.obj ckMenubutton.obj ckMessage.obj ckScrollbar.obj ckTree.obj
 
-TEXTOBJS = ckText.obj ckTextBTree.obj ckTextDisp.obj ckTextIndex.obj \
-	ckTextMark.obj ckTextTag.obj
+TEXTOBJS = ckText.obj ckTextBTree.obj ckTextDisp.obj ckTextHighlight.obj \
+	ckTextIndex.obj ckTextMark.obj ckTextTag.obj
 
 OBJS =  ckBind.obj ckBorder.obj ckCmds.obj ckConfig.obj ckEvent.obj \
 	ckFocus.obj \
-	ckGeometry.obj ckGet.obj ckGrid.obj ckMain.obj ckOption.obj \
+	ckGeometry.obj ckGet.obj ckGrid.obj ckHeadless.obj ckMain.obj ckOption.obj \
 	ckPack.obj ckPlace.obj \
-	ckPreserve.obj ckRecorder.obj ckUtil.obj ckWindow.obj tkEvent.obj \
+	ckPreserve.obj ckProfile.obj ckRecorder.obj ckUtil.obj ckWindow.obj tkEvent.obj \
 	ckAppInit.obj $(WIDGOBJS) $(TEXTOBJS)
 
 HDRS = default.h ks_names.h ck.h ckPort.h ckText.h